@@ -0,0 +1,555 @@
+/** micro benchmarks, run headless
+ * usage: bench [--json] [--filter SUBSTRING] [--min-ms DURATION]
+ * --json: one JSON object per benchmark instead of a table
+ * --filter: only run benchmarks whose name contains SUBSTRING
+ * --min-ms: minimal measured duration of each benchmark (default 200)
+ */
+
+#include "rico.hpp"
+#include "bitgrid.hpp"
+#include "camera.hpp"
+#include "draw.hpp"
+#include "nbody.hpp"
+#include "random.hpp"
+#include "sparselife.hpp"
+#include "spatial.hpp"
+#include "sprite.hpp"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+	bool json = false;
+	char const *filter = "";
+	double min_ms = 200.0;
+
+	// keep the compiler from optimizing value away
+	template<typename T>
+	void keep(T const& value) {
+		asm volatile("" : : "r"(&value) : "memory");
+	}
+
+	/**
+	 * run fn until it took at least min_ms, then print the time per call
+	 * @param name name of the benchmark
+	 * @param unit what items_per_op counts (pixels, cells, ...)
+	 * @param items_per_op number of items processed by a call to fn
+	 * @param fn function to measure
+	 */
+	template<typename F>
+	void run(std::string const& name, char const *unit, double items_per_op, F&& fn) {
+		if (std::strstr(name.c_str(), filter) == NULL) return;
+		fn(); // warm up
+		uint64_t iterations = 1;
+		double elapsed_ms;
+		while (true) {
+			rico::TimePoint start = rico::Clock::now();
+			for (uint64_t i = 0; i < iterations; ++i) fn();
+			elapsed_ms = rico::Duration(rico::Clock::now() - start).count();
+			if (elapsed_ms >= min_ms || iterations >= (uint64_t(1) << 40)) break;
+			// aim a bit above min_ms to not run a third time
+			double factor = (elapsed_ms > 0.0) ? 1.2 * min_ms / elapsed_ms : 100.0;
+			iterations = std::max(iterations * 2, static_cast<uint64_t>(iterations * std::min(factor, 100.0)));
+		}
+		double ns_per_op = elapsed_ms * 1e6 / iterations;
+		double items_per_sec = items_per_op * 1e9 / ns_per_op;
+		if (json) {
+			std::printf("{\"name\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.3f,\"unit\":\"%s\",\"items_per_op\":%.0f,\"items_per_sec\":%.1f}\n",
+				name.c_str(), static_cast<unsigned long long>(iterations), ns_per_op, unit, items_per_op, items_per_sec);
+		} else {
+			std::printf("%-40s %14.1f ns/op %12.2f M%s/s\n", name.c_str(), ns_per_op, items_per_sec * 1e-6, unit);
+		}
+		std::fflush(stdout);
+	}
+
+	std::string sized(char const *name, uint32_t w, uint32_t h) {
+		return std::string(name) + " " + std::to_string(w) + "x" + std::to_string(h);
+	}
+
+	// expose the protected helpers of Game
+	struct Bench : public rico::Game {
+		bool OnUserCreate(int, char const **) override { return true; }
+		bool OnUserUpdate(double) override { return false; }
+		void OnUserDestroy(void) override {}
+		using rico::Game::Clear;
+	};
+
+	struct Size {
+		uint32_t w, h;
+	};
+
+	constexpr Size sizes[] = { { 320, 240 }, { 640, 480 }, { 1920, 1080 } };
+
+	void bench_framebuffer(void) {
+		for (Size size : sizes) {
+			if (rico::GameEngine::ConstructHeadless(size.w, size.h, 1) != 0) std::exit(EXIT_FAILURE);
+			double pixels = double(size.w) * size.h;
+			rico::Color color(1, 2, 3);
+
+			run(sized("SetPixel", size.w, size.h), "pixels", pixels, [&]() {
+				for (uint32_t y = 0; y < size.h; ++y) {
+					for (uint32_t x = 0; x < size.w; ++x) rico::GameEngine::SetPixel(rico::Position(x, y), color);
+				}
+			});
+			run(sized("SetPixelUnchecked", size.w, size.h), "pixels", pixels, [&]() {
+				for (uint32_t y = 0; y < size.h; ++y) {
+					for (uint32_t x = 0; x < size.w; ++x) rico::GameEngine::SetPixelUnchecked(rico::Position(x, y), color);
+				}
+			});
+			run(sized("GetPixel", size.w, size.h), "pixels", pixels, [&]() {
+				rico::Color output;
+				for (uint32_t y = 0; y < size.h; ++y) {
+					for (uint32_t x = 0; x < size.w; ++x) rico::GameEngine::GetPixel(rico::Position(x, y), &output);
+				}
+				keep(output);
+			});
+			Bench game;
+			run(sized("Game::Clear", size.w, size.h), "pixels", pixels, [&]() {
+				game.Clear(color);
+			});
+			// indexed mode, palette lookup of the whole frame
+			std::vector<uint8_t> indices(size.w * size.h);
+			for (size_t i = 0; i < indices.size(); ++i) indices[i] = static_cast<uint8_t>(i * 7);
+			std::vector<uint32_t> palette(256), expanded(size.w * size.h);
+			for (uint32_t i = 0; i < 256; ++i) palette[i] = rico::Color(uint8_t(i), uint8_t(i), uint8_t(i));
+			run(sized("expand scalar", size.w, size.h), "pixels", pixels, [&]() {
+				rico::raster::detail::expand_scalar(expanded.data(), indices.data(), indices.size(), palette.data());
+				keep(expanded[0]);
+			});
+			run(sized("expand", size.w, size.h) + " (" + rico::raster::backend() + ")", "pixels", pixels, [&]() {
+				rico::raster::expand(expanded.data(), size.w, indices.data(), size.w, size.w, size.h, palette.data());
+				keep(expanded[0]);
+			});
+			// zoom out: box filter a world twice as large into the frame
+			std::vector<uint32_t> world(4 * size.w * size.h), reduced(size.w * size.h);
+			for (size_t i = 0; i < world.size(); ++i) world[i] = static_cast<uint32_t>(i * 0x9e3779b9u);
+			run(sized("downsample scalar", size.w, size.h), "pixels", pixels, [&]() {
+				for (uint32_t y = 0; y < size.h; ++y) {
+					uint32_t const *top = world.data() + 2 * y * 2 * size.w;
+					rico::raster::detail::downsample_scalar(reduced.data() + y * size.w, top, top + 2 * size.w, size.w);
+				}
+				keep(reduced[0]);
+			});
+			run(sized("downsample", size.w, size.h) + " (" + rico::raster::backend() + ")", "pixels", pixels, [&]() {
+				rico::raster::downsample(reduced.data(), size.w, world.data(), 2 * size.w, size.w, size.h);
+				keep(reduced[0]);
+			});
+		}
+		{
+			// the world only changes where a few bodies move
+			Size size = { 640, 480 };
+			if (rico::GameEngine::ConstructHeadless(size.w, size.h, 1) != 0) std::exit(EXIT_FAILURE);
+			rico::WorldBuffer world(4 * size.w, 4 * size.h, 3);
+			rico::Camera camera(world);
+			camera.SetZoom(-2);
+			rico::FrameBuffer target = world.Frame();
+			uint32_t frame = 0;
+			run(sized("Camera::Render zoom -2", size.w, size.h), "pixels", double(size.w) * size.h, [&]() {
+				target.Fill(rico::Position((frame * 8) % (4 * size.w), (frame * 8) % (4 * size.h)), 8, 8, rico::WHITE);
+				camera.Render(world, rico::GameEngine::GetFrameBuffer());
+				++frame;
+			});
+		}
+	}
+
+	void bench_shapes(void) {
+		Size size = { 640, 480 };
+		if (rico::GameEngine::ConstructHeadless(size.w, size.h, 1) != 0) std::exit(EXIT_FAILURE);
+
+		// random lines, never of length 0
+		std::vector<rico::Line> lines(1024);
+		double line_pixels = 0.0;
+		Random::Seed(1);
+		for (rico::Line& line : lines) {
+			do {
+				line = rico::Line(
+					rico::Position(Random::rangeUint(0, size.w - 1), Random::rangeUint(0, size.h - 1)),
+					rico::Position(Random::rangeUint(0, size.w - 1), Random::rangeUint(0, size.h - 1)),
+					rico::RED);
+			} while (line.start == line.stop);
+			uint32_t dx = std::max(line.start.x, line.stop.x) - std::min(line.start.x, line.stop.x);
+			uint32_t dy = std::max(line.start.y, line.stop.y) - std::min(line.start.y, line.stop.y);
+			line_pixels += std::max(dx, dy) + 1;
+		}
+		run("Line::Draw 1024 random", "pixels", line_pixels, [&]() {
+			for (rico::Line const& line : lines) line.Draw();
+		});
+
+		for (uint32_t side : { 8u, 64u, 256u }) {
+			rico::Rectangle rectangle(rico::Position(10, 10), rico::Position(10 + side + 1, 10 + side + 1), rico::RED, rico::BLUE);
+			run("Rectangle::Fill " + std::to_string(side) + "x" + std::to_string(side), "pixels", double(side) * side, [&]() {
+				rectangle.Fill();
+			});
+		}
+	}
+
+	void bench_draw_list(void) {
+		Size size = { 640, 480 };
+		if (rico::GameEngine::ConstructHeadless(size.w, size.h, 1) != 0) std::exit(EXIT_FAILURE);
+		rico::FrameBuffer frame = rico::GameEngine::GetFrameBuffer();
+		rico::DrawList list;
+
+		// small squares, as drawn by examples/gravity.cpp
+		std::vector<rico::Rectangle> squares(1024);
+		Random::Seed(4);
+		for (rico::Rectangle& square : squares) {
+			rico::Position center(Random::rangeUint(4, size.w - 5), Random::rangeUint(4, size.h - 5));
+			rico::Position offset(2, 2);
+			square = rico::Rectangle(center - offset, center + offset, rico::GREEN, rico::GREEN);
+		}
+		run("Rectangle::Draw+Fill 1024 5x5", "shapes", 1024, [&]() {
+			for (rico::Rectangle const& square : squares) {
+				square.Draw();
+				square.Fill();
+			}
+		});
+		run("DrawList 1024 5x5 rects", "shapes", 1024, [&]() {
+			for (rico::Rectangle const& square : squares) list.Add(square);
+			list.Render(frame);
+		});
+		run("DrawList 1024 5x5 rects (pool)", "shapes", 1024, [&]() {
+			for (rico::Rectangle const& square : squares) list.Add(square);
+			list.Render(frame, &rico::GameEngine::GetThreadPool());
+		});
+
+		std::vector<rico::Line> lines(1024);
+		for (rico::Line& line : lines) {
+			line = rico::Line(
+				rico::Position(Random::rangeUint(0, size.w - 1), Random::rangeUint(0, size.h - 1)),
+				rico::Position(Random::rangeUint(0, size.w - 1), Random::rangeUint(0, size.h - 1)),
+				rico::RED);
+		}
+		run("DrawList 1024 random lines", "shapes", 1024, [&]() {
+			for (rico::Line const& line : lines) list.Add(line);
+			list.Render(frame);
+		});
+		run("DrawList 1024 filled circles r=8", "shapes", 1024, [&]() {
+			for (rico::Rectangle const& square : squares) list.AddFillCircle(square.top_left.x, square.top_left.y, 8, rico::BLUE);
+			list.Render(frame);
+		});
+	}
+
+	// balls with translucent edges, as drawn by examples/sprites.cpp, and a tile map covering the frame
+	void bench_sprites(void) {
+		Size size = { 640, 480 };
+		if (rico::GameEngine::ConstructHeadless(size.w, size.h, 1) != 0) std::exit(EXIT_FAILURE);
+		rico::FrameBuffer frame = rico::GameEngine::GetFrameBuffer();
+		constexpr uint32_t side = 12;
+		rico::Tmat2D<uint32_t> pixels(side, side);
+		for (uint32_t y = 0; y < side; ++y) {
+			for (uint32_t x = 0; x < side; ++x) {
+				int32_t dx = 2 * int32_t(x) + 1 - int32_t(side), dy = 2 * int32_t(y) + 1 - int32_t(side);
+				int32_t d2 = dx * dx + dy * dy, r2 = int32_t(side * side);
+				uint8_t alpha = (d2 < r2 - 4 * int32_t(side)) ? 255 : (d2 < r2) ? 128 : 0;
+				pixels[y][x] = rico::PixelFormat::pack(255, 0, 0, alpha);
+			}
+		}
+		rico::Sprite ball(pixels);
+		std::vector<rico::Position> positions(1024);
+		Random::Seed(5);
+		for (rico::Position& position : positions) {
+			position = rico::Position(Random::rangeUint(0, size.w - side), Random::rangeUint(0, size.h - side));
+		}
+		run("SetPixel 1024 sprites 12x12", "sprites", 1024, [&]() {
+			for (rico::Position const& position : positions) {
+				for (uint32_t y = 0; y < side; ++y) {
+					for (uint32_t x = 0; x < side; ++x) {
+						if (rico::PixelFormat::alpha(pixels[y][x]) != 0) {
+							rico::GameEngine::SetPixelUnchecked(rico::Position(position.x + x, position.y + y), rico::Color(pixels[y][x]));
+						}
+					}
+				}
+			}
+		});
+		run("Sprite::Draw 1024 12x12", "sprites", 1024, [&]() {
+			for (rico::Position const& position : positions) ball.Draw(frame, int32_t(position.x), int32_t(position.y));
+		});
+		rico::DrawList list;
+		run("DrawList 1024 sprites 12x12 (pool)", "sprites", 1024, [&]() {
+			for (rico::Position const& position : positions) list.AddSprite(ball, int32_t(position.x), int32_t(position.y));
+			list.Render(frame, &rico::GameEngine::GetThreadPool());
+		});
+		rico::TileMap map(16, 16, size.w / 16 + 1, size.h / 16 + 1);
+		rico::Tmat2D<uint32_t> tile(16, 16);
+		for (uint32_t y = 0; y < 16; ++y) {
+			for (uint32_t x = 0; x < 16; ++x) tile[y][x] = rico::Color(uint8_t(x * 16), uint8_t(y * 16), 0);
+		}
+		map.fill(map.add_tile(rico::Sprite(tile)));
+		double pixels_count = double(size.w) * size.h;
+		run(sized("TileMap::Draw 16x16 tiles", size.w, size.h), "pixels", pixels_count, [&]() {
+			map.Draw(frame, -8, -8);
+		});
+		run(sized("TileMap::Draw 16x16 tiles (pool)", size.w, size.h), "pixels", pixels_count, [&]() {
+			map.Draw(frame, -8, -8, &rico::GameEngine::GetThreadPool());
+		});
+	}
+
+	void bench_tmat(void) {
+		for (Size size : sizes) {
+			double elements = double(size.w) * size.h;
+			rico::Tmat2D<uint32_t> a(size.h, size.w), b(size.h, size.w);
+			run(sized("Tmat2D copy", size.w, size.h), "elements", elements, [&]() {
+				b = a;
+				keep(b);
+			});
+			run(sized("Tmat2D move", size.w, size.h), "moves", 2.0, [&]() {
+				b = std::move(a);
+				a = std::move(b);
+				keep(a);
+			});
+		}
+	}
+
+	void bench_arena(void) {
+		// per-frame scratch vectors, from the heap or from an arena
+		for (uint32_t count : { 64u, 4096u }) {
+			run("std::vector scratch x" + std::to_string(count), "vectors", 16.0, [&]() {
+				for (uint32_t i = 0; i < 16; ++i) {
+					std::vector<uint32_t> scratch;
+					scratch.reserve(count);
+					scratch.push_back(i);
+					keep(scratch[0]);
+				}
+			});
+			rico::Arena arena;
+			run("ArenaVector scratch x" + std::to_string(count), "vectors", 16.0, [&]() {
+				arena.Reset();
+				for (uint32_t i = 0; i < 16; ++i) {
+					rico::ArenaVector<uint32_t> scratch { rico::ArenaAllocator<uint32_t>(arena) };
+					scratch.reserve(count);
+					scratch.push_back(i);
+					keep(scratch[0]);
+				}
+			});
+		}
+	}
+
+	void bench_random(void) {
+		constexpr uint32_t count = 4096;
+		run("Random::Uint", "numbers", count, [&]() {
+			uint32_t sum = 0;
+			for (uint32_t i = 0; i < count; ++i) sum += Random::Uint();
+			keep(sum);
+		});
+		run("Random::rangeUint [0, 255]", "numbers", count, [&]() {
+			uint32_t sum = 0;
+			for (uint32_t i = 0; i < count; ++i) sum += Random::rangeUint(0, 255);
+			keep(sum);
+		});
+		run("Random::rangeUint [0, 2^31]", "numbers", count, [&]() {
+			uint32_t sum = 0;
+			for (uint32_t i = 0; i < count; ++i) sum += Random::rangeUint(0, 1u << 31);
+			keep(sum);
+		});
+		run("Random::Double", "numbers", count, [&]() {
+			double sum = 0.0;
+			for (uint32_t i = 0; i < count; ++i) sum += Random::Double();
+			keep(sum);
+		});
+		RandomStream stream(1);
+		run("RandomStream::Uint", "numbers", count, [&]() {
+			uint32_t sum = 0;
+			for (uint32_t i = 0; i < count; ++i) sum += stream.Uint();
+			keep(sum);
+		});
+		run("RandomStream::rangeUint [0, 255]", "numbers", count, [&]() {
+			uint32_t sum = 0;
+			for (uint32_t i = 0; i < count; ++i) sum += stream.rangeUint(0, 255);
+			keep(sum);
+		});
+		for (Size size : sizes) {
+			std::vector<uint32_t> pixels(size_t(size.w) * size.h);
+			run(sized("RandomStream::Fill", size.w, size.h) + " (" + RandomStream::backend() + ")", "pixels", double(pixels.size()), [&]() {
+				stream.Fill(pixels.data(), pixels.size(), rico::PixelFormat::alpha_mask);
+				keep(pixels[0]);
+			});
+		}
+	}
+
+	void bench_life(void) {
+		for (uint32_t side : { 64u, 512u, 2048u }) {
+			rico::BitGrid current(side, side), next(side, side);
+			Random::Seed(2);
+			for (uint32_t y = 0; y < side; ++y) {
+				for (uint32_t x = 0; x < side; ++x) current.set(rico::Position(x, y), Random::rangeUint(0, 1) == 1);
+			}
+			uint64_t changed = 0;
+			run(sized("life_step", side, side), "cells", double(side) * side, [&]() {
+				rico::life_step(current, next, rico::CONWAY, [&](uint32_t, uint32_t, uint64_t, uint64_t) { ++changed; });
+				current.swap(next);
+			});
+			keep(changed);
+		}
+		// a soup in the middle of a board 16 times larger: only the tiles
+		// around it are computed, which gets cheaper as it settles down
+		for (uint32_t side : { 512u, 2048u }) {
+			rico::SparseLife board;
+			Random::Seed(2);
+			int32_t const half = static_cast<int32_t>(side / 2);
+			for (int32_t y = -half; y < half; ++y) {
+				for (int32_t x = -half; x < half; ++x) board.set(x, y, Random::rangeUint(0, 1) == 1);
+			}
+			run(sized("SparseLife::Step", side, side), "cells", double(side) * side, [&]() {
+				board.Step();
+			});
+			run(sized("SparseLife::Step (pool)", side, side), "cells", double(side) * side, [&]() {
+				board.Step(&rico::GameEngine::GetThreadPool());
+			});
+			keep(board.get_generation());
+		}
+		{
+			// a glider gun, whose future is mostly memoized
+			rico::SparseLife board;
+			char const *gun[9] = {
+				"........................O...........",
+				"......................O.O...........",
+				"............OO......OO............OO",
+				"...........O...O....OO............OO",
+				"OO........O.....O...OO..............",
+				"OO........O...O.OO....O.O...........",
+				"..........O.....O.......O...........",
+				"...........O...O....................",
+				"............OO......................" };
+			for (int32_t y = 0; y < 9; ++y) {
+				for (int32_t x = 0; gun[y][x] != '\0'; ++x) board.set(x, y, gun[y][x] == 'O');
+			}
+			run("SparseLife::Jump 2^10 (glider gun)", "generations", 1024.0, [&]() {
+				board.Jump(10);
+			});
+			keep(board.population());
+		}
+	}
+
+	// batched operations of a structure of arrays, against a loop over Tvec2D
+	template<typename T>
+	void bench_vec2d(char const *precision) {
+		for (uint32_t n : { 1024u, 100000u }) {
+			rico::Tvec2DArray<T> a, b;
+			std::vector<rico::Tvec2D<T>> scalar(n);
+			Random::Seed(3);
+			for (uint32_t i = 0; i < n; ++i) {
+				a.push_back(rico::Tvec2D<T>(T(Random::rangeDouble(-1.0, 1.0)), T(Random::rangeDouble(-1.0, 1.0))));
+				b.push_back(rico::Tvec2D<T>(T(Random::rangeDouble(-1.0, 1.0)), T(Random::rangeDouble(-1.0, 1.0))));
+				scalar[i] = a.get(i);
+			}
+			std::vector<T> output;
+			std::string suffix = std::string(" (") + rico::vec2d::backend<T>() + ") " + precision + " n=" + std::to_string(n);
+			run("Tvec2DArray::add_scaled" + suffix, "vectors", n, [&]() {
+				a.add_scaled(b, T(1e-3));
+				keep(a.x[0]);
+			});
+			run("Tvec2DArray::dot" + suffix, "vectors", n, [&]() {
+				a.dot(b, output);
+				keep(output[0]);
+			});
+			run("Tvec2DArray::normalize" + suffix, "vectors", n, [&]() {
+				a.normalize();
+				keep(a.x[0]);
+			});
+			run("Tvec2D::normalized " + std::string(precision) + " n=" + std::to_string(n), "vectors", n, [&]() {
+				for (rico::Tvec2D<T>& v : scalar) v = v.normalized();
+				keep(scalar[0]);
+			});
+		}
+	}
+
+	// same force law and integration as examples/gravity.cpp
+	template<typename T>
+	void bench_nbody(char const *precision) {
+		rico::ThreadPool pool;
+		for (uint32_t n : { 64u, 256u, 1024u, 10000u, 100000u }) {
+			rico::Bodies<T> bodies;
+			Random::Seed(3);
+			for (uint32_t i = 0; i < n; ++i) {
+				bodies.add(T(Random::rangeDouble(1.0, 1e3)), T(Random::rangeDouble(-1.0, 1.0)), T(Random::rangeDouble(-1.0, 1.0)), 0, 0);
+			}
+			rico::Gravity<T> gravity;
+			T const delta_time = T(1e-5);
+			std::string suffix = std::string(" ") + precision + " n=" + std::to_string(n);
+			if (n <= 1024) {
+				run("nbody direct" + suffix, "bodies", n, [&]() {
+					gravity.compute_direct(bodies);
+					gravity.integrate(bodies, delta_time);
+				});
+				run("nbody " + std::string(rico::nbody::backend<T>()) + suffix, "bodies", n, [&]() {
+					gravity.compute_vectorized(bodies, &pool);
+					gravity.integrate(bodies, delta_time);
+				});
+			}
+			run("nbody tree" + suffix, "bodies", n, [&]() {
+				gravity.compute_tree(bodies, &pool);
+				gravity.integrate(bodies, delta_time);
+			});
+		}
+	}
+
+	// rebuild each frame, then a short-range query per point
+	void bench_spatial(void) {
+		rico::ThreadPool pool;
+		for (uint32_t n : { 1000u, 100000u }) {
+			std::vector<float> x(n), y(n);
+			Random::Seed(3);
+			for (uint32_t i = 0; i < n; ++i) {
+				x[i] = float(Random::rangeDouble(-1.0, 1.0));
+				y[i] = float(Random::rangeDouble(-1.0, 1.0));
+			}
+			// about 4 points per cell
+			rico::SpatialHash<float> grid(2.0f / std::sqrt(float(n) / 4.0f));
+			std::string suffix = " n=" + std::to_string(n);
+			run("SpatialHash::build" + suffix, "points", n, [&]() {
+				grid.build(x.data(), y.data(), n);
+			});
+			run("SpatialHash::build parallel" + suffix, "points", n, [&]() {
+				grid.build(x.data(), y.data(), n, &pool);
+			});
+			uint64_t found = 0;
+			run("SpatialHash::for_each_in_radius" + suffix, "queries", n, [&]() {
+				for (uint32_t i : grid.sorted()) {
+					grid.for_each_in_radius(x[i], y[i], grid.cell_size, [&found](uint32_t, float) { ++found; });
+				}
+			});
+			keep(found);
+			uint32_t indices[8];
+			float squares[8];
+			run("SpatialHash::nearest k=8" + suffix, "queries", n, [&]() {
+				for (uint32_t i : grid.sorted()) {
+					found += grid.nearest(rico::Tvec2D<float>(x[i], y[i]), 8, indices, squares);
+				}
+			});
+			keep(found);
+		}
+	}
+
+} // namespace
+
+int main(int argc, char const **argv) {
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--json") == 0) {
+			json = true;
+		} else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+			filter = argv[++i];
+		} else if (std::strcmp(argv[i], "--min-ms") == 0 && i + 1 < argc) {
+			min_ms = std::atof(argv[++i]);
+		} else {
+			std::fprintf(stderr, "usage: %s [--json] [--filter SUBSTRING] [--min-ms DURATION]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	bench_framebuffer();
+	bench_shapes();
+	bench_draw_list();
+	bench_sprites();
+	bench_tmat();
+	bench_arena();
+	bench_random();
+	bench_life();
+	bench_vec2d<float>("float");
+	bench_vec2d<double>("double");
+	bench_nbody<float>("float");
+	bench_nbody<double>("double");
+	bench_spatial();
+	return EXIT_SUCCESS;
+}
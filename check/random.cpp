@@ -0,0 +1,72 @@
+/** rico/check/random.cpp
+ *
+ * the states of RandomStream::Fill must stay apart from the streams made
+ * by Jump and LongJump: no number of a lane may come out of another stream
+ * (a shared 64 bits output means a shared state, with overwhelming odds)
+ *
+ * usage: random (exit status 0 if the streams are disjoint)
+ */
+
+#include "random.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+
+	constexpr size_t COUNT = 4096; // numbers taken from each stream, and from each lane
+
+	// the lanes of Fill, in the order of the numbers (lane after lane, each block)
+	std::vector<uint64_t> lanes(RandomStream const& original) {
+		RandomStream stream = original;
+		std::vector<uint64_t> numbers(4 * COUNT);
+		stream.FillBytes(numbers.data(), numbers.size() * sizeof(uint64_t));
+		return numbers;
+	}
+
+	std::vector<uint64_t> sequence(RandomStream const& original) {
+		RandomStream stream = original;
+		std::vector<uint64_t> numbers(COUNT);
+		for (uint64_t& number : numbers) number = stream.Uint64();
+		return numbers;
+	}
+
+	int failures = 0;
+
+	void check(std::string const& name, std::vector<uint64_t> const& numbers, std::set<uint64_t>& seen) {
+		size_t shared = 0;
+		for (uint64_t number : numbers) {
+			if (!seen.insert(number).second) ++shared;
+		}
+		if (shared != 0) {
+			std::printf("%s: %zu numbers already seen\n", name.c_str(), shared);
+			++failures;
+		}
+	}
+
+} // namespace
+
+int main(void) {
+	RandomStream a(12345);
+	RandomStream b = a;
+	b.Jump();
+	RandomStream c = a;
+	c.LongJump();
+	std::set<uint64_t> seen;
+	check("a", sequence(a), seen);
+	check("a.Fill", lanes(a), seen);
+	check("a.Jump", sequence(b), seen);
+	check("a.Jump.Fill", lanes(b), seen);
+	check("a.LongJump", sequence(c), seen);
+	check("a.LongJump.Fill", lanes(c), seen);
+	// past the lanes of b
+	b.Jump();
+	check("a.Jump.Jump", sequence(b), seen);
+	if (failures != 0) return EXIT_FAILURE;
+	std::printf("random: %zu numbers, streams and lanes disjoint\n", seen.size());
+	return EXIT_SUCCESS;
+}
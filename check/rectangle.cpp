@@ -0,0 +1,131 @@
+/** rico/check/rectangle.cpp
+ *
+ * rectangles include both of their corners (see draw.hpp): from (x0, y0)
+ * to (x1, y1), in any order, they cover [min, max] on both axes, clipped to
+ * the frame. Checked pixel per pixel against that rule for
+ * FrameBuffer::DrawRect / FillRect, DrawList::AddRect / AddFillRect and
+ * Rectangle::Draw / Fill (whose fill is the inside of the outline)
+ *
+ * usage: rectangle (exit status 0 if every shape covers the expected pixels)
+ */
+
+#include "rico.hpp"
+#include "draw.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+namespace {
+
+	constexpr uint32_t WIDTH = 97, HEIGHT = 61;
+	constexpr uint32_t BACKGROUND = 0xff000000u, INK = 0xffffffffu;
+
+	int failures = 0;
+
+	// expected(x, y) for each pixel of the frame after draw, on a cleared frame
+	void check(char const *name, int64_t x0, int64_t y0, int64_t x1, int64_t y1,
+		std::function<void(void)> const& draw, std::function<bool(int64_t, int64_t)> const& expected)
+	{
+		rico::FrameBuffer frame = rico::GameEngine::GetFrameBuffer();
+		for (uint32_t y = 0; y < HEIGHT; ++y) std::fill(frame.row(y).begin(), frame.row(y).end(), BACKGROUND);
+		draw();
+		uint32_t wrong = 0;
+		for (uint32_t y = 0; y < HEIGHT; ++y) {
+			for (uint32_t x = 0; x < WIDTH; ++x) {
+				if ((frame.row(y)[x] == INK) != expected(x, y)) ++wrong;
+			}
+		}
+		if (wrong != 0) {
+			std::printf("%s (%lld, %lld) (%lld, %lld): %u wrong pixels\n", name,
+				(long long) x0, (long long) y0, (long long) x1, (long long) y1, wrong);
+			++failures;
+		}
+	}
+
+	void check_signed(int32_t x0, int32_t y0, int32_t x1, int32_t y1) {
+		int64_t const left = std::min(x0, x1), right = std::max(x0, x1);
+		int64_t const top = std::min(y0, y1), bottom = std::max(y0, y1);
+		auto inside = [=](int64_t x, int64_t y) {
+			return left <= x && x <= right && top <= y && y <= bottom;
+		};
+		auto border = [=](int64_t x, int64_t y) {
+			return inside(x, y) && (x == left || x == right || y == top || y == bottom);
+		};
+		rico::Color const ink(INK);
+		check("FrameBuffer::DrawRect", x0, y0, x1, y1, [=]() {
+			rico::GameEngine::GetFrameBuffer().DrawRect(x0, y0, x1, y1, ink);
+		}, border);
+		check("FrameBuffer::FillRect", x0, y0, x1, y1, [=]() {
+			rico::GameEngine::GetFrameBuffer().FillRect(x0, y0, x1, y1, ink);
+		}, inside);
+		check("DrawList::AddRect", x0, y0, x1, y1, [=]() {
+			rico::DrawList list;
+			list.AddRect(x0, y0, x1, y1, ink);
+			list.Render(rico::GameEngine::GetFrameBuffer());
+		}, border);
+		check("DrawList::AddFillRect", x0, y0, x1, y1, [=]() {
+			rico::DrawList list;
+			list.AddFillRect(x0, y0, x1, y1, ink);
+			list.Render(rico::GameEngine::GetFrameBuffer());
+		}, inside);
+	}
+
+	void check_shape(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) {
+		rico::Rectangle const rectangle(rico::Position(x0, y0), rico::Position(x1, y1), rico::Color(INK), rico::Color(INK));
+		int64_t const left = std::min(x0, x1), right = std::max(x0, x1);
+		int64_t const top = std::min(y0, y1), bottom = std::max(y0, y1);
+		check("Rectangle::Draw", x0, y0, x1, y1, [&rectangle]() { rectangle.Draw(); }, [=](int64_t x, int64_t y) {
+			return left <= x && x <= right && top <= y && y <= bottom
+				&& (x == left || x == right || y == top || y == bottom);
+		});
+		check("Rectangle::Fill", x0, y0, x1, y1, [&rectangle]() { rectangle.Fill(); }, [=](int64_t x, int64_t y) {
+			return left < x && x < right && top < y && y < bottom;
+		});
+	}
+
+	struct Check : public rico::Game {
+
+		bool OnUserCreate(int argc, char const **argv) override {
+			(void) argc;
+			(void) argv;
+			// corners inside, on the edges and outside of the frame, in both orders
+			int32_t const xs[] = { -20, -1, 0, 1, 2, 40, 41, int32_t(WIDTH) - 1, int32_t(WIDTH), 130, INT32_MIN, INT32_MAX };
+			int32_t const ys[] = { -5, 0, 1, 3, int32_t(HEIGHT) - 1, int32_t(HEIGHT) + 7, INT32_MIN, INT32_MAX };
+			for (int32_t x0 : xs) {
+				for (int32_t x1 : xs) {
+					for (int32_t y0 : ys) {
+						for (int32_t y1 : ys) check_signed(x0, y0, x1, y1);
+					}
+				}
+			}
+			uint32_t const us[] = { 0, 1, 2, 3, 30, 60, 96, 200, UINT32_MAX };
+			for (uint32_t x0 : us) {
+				for (uint32_t x1 : us) {
+					check_shape(x0, 5, x1, 9);
+					check_shape(x0, x1, 17, 12);
+				}
+			}
+			return true;
+		}
+
+		bool OnUserUpdate(double elapsed_time) override {
+			(void) elapsed_time;
+			return false;
+		}
+
+		void OnUserDestroy(void) override {
+			if (failures == 0) std::printf("rectangle: corners included, fills inside the outlines\n");
+		}
+
+	}; // struct Check
+
+} // namespace
+
+int main(void) {
+	if (rico::GameEngine::ConstructHeadless(WIDTH, HEIGHT, 1, 1) != 0) return EXIT_FAILURE;
+	int status = rico::GameEngine::Run<Check>(0, NULL);
+	return (status == EXIT_SUCCESS && failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
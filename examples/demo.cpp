@@ -1,48 +1,79 @@
+/** random noise
+ * q = QUIT
+ * z = toggle the size of the macro pixels
+ * the window can be resized
+ */
+
 #include "rico.hpp"
 #include "random.hpp"
 #include <iostream>
 
+constexpr uint32_t WINDOW_WIDTH = 640, WINDOW_HEIGHT = 480;
+constexpr uint32_t PIXEL_SIZE = 10, ZOOMED_PIXEL_SIZE = 5;
+
 class Demo : public rico::Game {
 protected:
 
 	double ms_count;
 	uint32_t frames_count;
+	RandomStreams streams; // one per thread of the pool
+	bool zoomed;
 
 	bool OnUserCreate(int argc, char const **argv) override {
 		(void) argc;
 		(void) argv;
 		ms_count = 0.0;
 		frames_count = 0;
+		zoomed = false;
+		streams.Seed(rico::GameEngine::GetThreadPool().Size(), Random::Uint());
 		Clear(rico::WHITE);
 		return true;
 	}
 
 	bool OnUserUpdate(double elapsed_ms) override {
-		for (uint32_t i = 0; i < Width(); ++i) {
-			for (uint32_t j = 0; j < Height(); ++j) {
-				rico::Position pos(i, j);
-				rico::Color color(Random::rangeUint(0, 255), Random::rangeUint(0, 255), Random::rangeUint(0, 255));
-				SetPixel(pos, color);
-			}
+		{
+			RICO_PROFILE("noise");
+			// random bytes straight into the rows, opaque alpha
+			rico::FrameBuffer frame = Frame();
+			ParallelFor2D(frame.height(), frame.width(), 64,
+				[&](uint32_t row, uint32_t col, uint32_t rows, uint32_t cols) {
+					RandomStream& stream = streams[rico::ThreadPool::ThreadIndex()];
+					for (uint32_t y = row; y < row + rows; ++y) stream.Fill(frame.row(y).data() + col, cols, rico::PixelFormat::alpha_mask);
+				});
+			frame.MarkAll();
 		}
 		++frames_count;
 		ms_count += elapsed_ms;
 		if (ms_count >= 1000.0) {
 			std::cout << "FPS=" << frames_count << std::endl;
+			rico::Profiler::Get().Report(std::cout);
 			frames_count = 0;
 			ms_count -= 1000.0;
 		}
 		if (GetButton('q').pressed) return false;
+		if (GetButton('z').pressed) {
+			// in place: neither the window nor the renderer are recreated
+			zoomed = !zoomed;
+			rico::GameEngine::Resize(WINDOW_WIDTH, WINDOW_HEIGHT, zoomed ? ZOOMED_PIXEL_SIZE : PIXEL_SIZE);
+		}
 		return true;
 	}
 
+	void OnUserResize(uint32_t width, uint32_t height) override {
+		// the whole frame is redrawn by the next update anyway
+		std::cout << "frame resized to " << width << "x" << height << std::endl;
+	}
+
 	void OnUserDestroy(void) override {
 		return;
 	}
 };
 
 int main(int argc, char const **argv) {
-	int retval = rico::GameEngine::Construct(640, 480, 10);
+	int retval = rico::GameEngine::Construct(WINDOW_WIDTH, WINDOW_HEIGHT, PIXEL_SIZE);
 	if (retval != 0) return EXIT_FAILURE;
+	rico::GameEngine::SetResizable(true);
+	// every pixel is redrawn each frame, so draw straight into the texture
+	rico::GameEngine::SetSubmit(rico::Submit::DIRECT);
 	return rico::GameEngine::Run<Demo>(argc, argv);
 }
\ No newline at end of file
@@ -3,18 +3,55 @@
  * p = toggle PAUSE
  * f = reduce precision (faster computation)
  * s = increase precision (slower computation)
+ * c = toggle collisions
+ * r = start/stop recording to gravity.y4m
+ * k = save a snapshot to gravity.snap
+ * = / - = zoom in / out
+ * arrows = move the view over the world
+ * usage: gravity [number of random bodies | snapshot to resume] [snapshot interval]
+ * with an interval, a snapshot is saved every interval steps to gravity<step>.snap
+ * build with -DGRAVITY_FLOAT to simulate in single precision
+ * build with -DGRAVITY_CANVAS to fade the traces on the canvas of the engine
+ * (on the GPU with RICO_BACKEND=opengl) instead of a world larger than the
+ * window: the view is the window, without zoom nor pan
  */
 
 #include "rico.hpp"
+#include "camera.hpp"
+#include "draw.hpp"
+#include "nbody.hpp"
 #include "random.hpp"
+#include "snapshot.hpp"
+#include "spatial.hpp"
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
 #include <vector>
 
 constexpr double G = 1.0; //6.674e-11; // gravitational constant
 constexpr uint8_t fading = 2; // trace fading speed
+constexpr uint32_t WORLD = 2; // world side, in window sides
+constexpr int32_t PAN = 4; // frame pixels per frame
 
 using vec = rico::Tvec2D<double>;
 
+// precision of the simulation
+#ifdef GRAVITY_FLOAT
+using real = float;
+#else
+using real = double;
+#endif
+
+// where the traces are drawn and faded
+#ifdef GRAVITY_CANVAS
+constexpr bool CANVAS = true; // the canvas of the engine, only new disks are drawn
+#else
+constexpr bool CANVAS = false; // a world buffer, under a camera
+#endif
+
 struct Body {
 	double mass;
 	vec position;
@@ -46,57 +83,23 @@ struct Body {
 		if (mass > 100.0) radius = 2;
 	}
 
-	// return the distance between *this and other
-	double distance(Body const& other) const {
-		double delta_x = this->position.x - other.position.x;
-		double delta_y = this->position.y - other.position.y;
-		return std::hypot(delta_x, delta_y);
-	}
-
-	// gravitational force that other apply to *this
-	vec force(Body const& other) const {
-		// direction of the force
-		vec AB = other.position - this->position;
-		// distance (has a minimal value, lead to energy loss in the system)
-		double d = std::max(distance(other), 5e-2);
-		// proportionality constant (gravity formula)
-		double C = (G * this->mass * other.mass) / (d*d);
-		// force is equivalent to Cu (where u is the unit vector of AB)
-		return C * (AB / d);
-	}
-
-	// apply the force for the given duration
-	void apply(vec const& force, double delta_time) {
-		// Newton's law
-		vec acceleration = force / this->mass;
-		// after integration, delta_speed = acceleration*t
-		speed += acceleration * delta_time;
-		// after integration, delta_position = speed*t+(acceleration/2)*t^2
-		position += (speed + ((acceleration * delta_time) / 2.0)) * delta_time;
-	}
-
-	// draw body
-	void draw(void) const {
-		// map [-1.0, +1.0] to [0, +width]
-		int32_t x = static_cast<int32_t>(((1.0 + position.x) / 2.0) * static_cast<double>(rico::GameEngine::GetWidth()));
-		// map [-1.0, +1.0] to [0, +height]
-		int32_t y = static_cast<int32_t>(((1.0 + position.y) / 2.0) * static_cast<double>(rico::GameEngine::GetHeight()));
-		// return if some pixels are out of the screen
-		if (x < radius) return;
-		if (y < radius) return;
-		if (static_cast<uint32_t>(x+radius) >= rico::GameEngine::GetWidth()) return;
-		if (static_cast<uint32_t>(y+radius) >= rico::GameEngine::GetHeight()) return;
-		// create rectangle representing the planet (circle will be done later)
-		rico::Position center(static_cast<uint32_t>(x), static_cast<uint32_t>(y));
-		rico::Position offset(radius, radius);
-		rico::Rectangle rectangle(center-offset, center+offset, color, color);
-		// display the rectangle
-		rectangle.Draw();
-		rectangle.Fill();
-	}
-
 }; // struct Body
 
+// queue a body of the given radius and color at position, in a world of width x height pixels
+void draw(rico::DrawList& list, uint32_t width, uint32_t height, vec position, int8_t radius, rico::Color color) {
+	// map [-1.0, +1.0] to [0, +width]
+	int32_t x = static_cast<int32_t>(((1.0 + position.x) / 2.0) * static_cast<double>(width));
+	// map [-1.0, +1.0] to [0, +height]
+	int32_t y = static_cast<int32_t>(((1.0 + position.y) / 2.0) * static_cast<double>(height));
+	// return if some pixels are out of the world
+	if (x < radius) return;
+	if (y < radius) return;
+	if (static_cast<uint32_t>(x+radius) >= width) return;
+	if (static_cast<uint32_t>(y+radius) >= height) return;
+	// disk representing the planet
+	list.AddFillCircle(x, y, radius, color);
+}
+
 /*
 // 3 bodies, similar to Sun Earth and Moon
 constexpr Body Sun   {1.989e30, {0.0, 0.0                       }, {0.0, 0.0    }, rico::YELLOW,               5};
@@ -106,63 +109,159 @@ constexpr Body Moon  {7.342e22, {0.0, Earth.position.y + 3.847e5}, {0.0, 1.022e3
 
 class NBodies : public rico::Game {
 private:
-	std::vector<Body> bodies;
-	std::vector<vec> forces;
+	rico::Bodies<real> bodies;
+	std::vector<rico::Color> colors;
+	std::vector<int8_t> radii;
+	rico::Gravity<real> gravity;
+	// bodies sorted by bucket of their cell, for the collisions
+	rico::SpatialHash<real> grid;
+	rico::Tvec2DArray<real> bounce; // speeds after the collisions
+	real pixel; // side of a world pixel, in simulation units
+	int8_t max_radius;
+	rico::DrawList list;
+	// bodies are drawn into the world, larger than the window
+	std::unique_ptr<rico::WorldBuffer> world;
+	std::unique_ptr<rico::Camera> camera;
 	bool pause;
+	bool collisions;
+	bool recording;
 	double delta_time;
+	uint64_t steps; // simulated since the start of the run
+	std::unique_ptr<rico::SnapshotSeries> series;
 
-	void DarkenScreen(void) const {
-		rico::Color color;
-		rico::Position pos;
-		for (uint32_t row = 0; row < Height(); ++row) {
-			for (uint32_t col = 0; col < Width(); ++col) {
-				pos = {col, row};
-				if(GetPixel(pos, &color)) {
-					color.r = (color.r > fading) ? color.r - fading : 0;
-					color.g = (color.g > fading) ? color.g - fading : 0;
-					color.b = (color.b > fading) ? color.b - fading : 0;
-					SetPixel(pos, color);
-				}
-			}
-		}
+	// side of the world, in pixels
+	uint32_t Side(void) const {
+		return CANVAS ? Width() : world->get_width();
+	}
+
+	void DarkenWorld(void) const {
+		rico::FrameBuffer frame = world->Frame();
+		ParallelFor2D(frame.height(), frame.width(), 128,
+			[&frame](uint32_t row, uint32_t col, uint32_t rows, uint32_t cols) {
+				frame.SaturatingSub(rico::Position(col, row), cols, rows, rico::Color(fading, fading, fading));
+			});
+	}
+
+	void Add(Body const& body) {
+		bodies.add(real(body.mass), real(body.position.x), real(body.position.y), real(body.speed.x), real(body.speed.y));
+		colors.push_back(body.color);
+		radii.push_back(body.radius);
 	}
 
 	void UpdatePositions(void) {
-		uint32_t i, j, n = bodies.size();
-		// compute force for each body
-		for (i = 0; i < n; ++i) {
-			forces[i] = vec();
-			for (j = 0; j < n; ++j) {
-				if (i != j) {
-					forces[i] += bodies[i].force(bodies[j]);
-				}
+		RICO_PROFILE("forces");
+		// SIMD direct sum for a few bodies, Barnes-Hut quadtree for many
+		gravity.step(bodies, real(delta_time), &rico::GameEngine::GetThreadPool());
+	}
+
+	// elastic collisions of the disks that overlap, each body being bounced
+	// by the speeds before any collision, so that bodies are independent
+	void Collide(void) {
+		RICO_PROFILE("collisions");
+		rico::ThreadPool& pool = rico::GameEngine::GetThreadPool();
+		uint32_t const n = bodies.size();
+		// pairs in contact are at most one cell apart
+		grid.cell_size = real(2 * max_radius + 1) * pixel;
+		grid.build(bodies.position.x.data(), bodies.position.y.data(), n, &pool);
+		bounce.resize(n);
+		real const *x = bodies.position.x.data(), *y = bodies.position.y.data();
+		real const *vx = bodies.speed.x.data(), *vy = bodies.speed.y.data();
+		real const *m = bodies.mass.data();
+		uint32_t const chunk = 256;
+		// in sorted order, consecutive bodies read the same cells
+		uint32_t const *sorted = grid.sorted().data();
+		pool.ParallelFor((n + chunk - 1) / chunk, [&](uint32_t index) {
+			uint32_t end = std::min(n, (index + 1) * chunk);
+			for (uint32_t k = index * chunk; k < end; ++k) {
+				uint32_t i = sorted[k];
+				real bx = vx[i], by = vy[i];
+				grid.for_each_in_radius(x[i], y[i], real(radii[i] + max_radius + 1) * pixel, [&](uint32_t j, real d2) {
+					real contact = real(radii[i] + radii[j] + 1) * pixel;
+					if (j == i || d2 == 0 || d2 >= contact * contact) return;
+					real dx = x[j] - x[i], dy = y[j] - y[i];
+					real along = (vx[j] - vx[i]) * dx + (vy[j] - vy[i]) * dy;
+					if (along >= 0) return; // moving apart already
+					// exchange of momentum along the line of centers
+					real c = 2 * m[j] / (m[i] + m[j]) * along / d2;
+					bx += c * dx;
+					by += c * dy;
+				});
+				bounce.set(i, rico::Tvec2D<real>(bx, by));
 			}
-		}
-		// apply forces to bodies
-		for (i = 0; i < n; ++i) {
-			bodies[i].apply(forces[i], delta_time);
-		}
+		});
+		bodies.speed.swap(bounce);
+	}
+
+	// the state of the simulation (the traces are not saved)
+	void Save(rico::SnapshotWriter& writer) const {
+		writer.Write("bodies", bodies);
+		writer.Write("colors", colors);
+		writer.Write("radii", radii);
+		writer.WriteValue("delta_time", delta_time);
+		writer.WriteValue("collisions", collisions);
+		writer.WriteValue("random", Random::State());
+	}
+
+	void Restore(rico::Snapshot const& snapshot) {
+		snapshot.Read("bodies", bodies);
+		snapshot.Read("colors", colors);
+		snapshot.Read("radii", radii);
+		if (colors.size() != bodies.size() || radii.size() != bodies.size()) throw std::runtime_error("inconsistent snapshot");
+		snapshot.ReadValue("delta_time", delta_time);
+		snapshot.ReadValue("collisions", collisions);
+		uint64_t state;
+		snapshot.ReadValue("random", state);
+		Random::Seed(state);
+		steps = snapshot.get_frame();
 	}
 
 protected:
 
 	bool OnUserCreate(int argc, char const **argv) override {
-		(void) argc; (void) argv;
 		if (Width() != Height()) return false;
-		Clear(rico::BLACK);
-
-		// insert random bodies
-		bodies = std::vector<Body>(3);
-		// insert 2 massive bodies orbiting the center
-		bodies.push_back(Body(5e3, {-0.25, 0.0}, {0.0, -75.0}, rico::WHITE, 4));
-		bodies.push_back(Body(5e3, {+0.25, 0.0}, {0.0, +75.0}, rico::WHITE, 4));
-		// insert 2 light bodies orbiting the center
-		bodies.push_back(Body(1e2, {+0.75, 0.0}, {0.0, -100.0}, rico::GREEN, 2));
-		bodies.push_back(Body(1e2, {-0.75, 0.0}, {0.0, +100.0}, rico::RED, 2));
-
-		forces.insert(forces.begin(), bodies.size(), vec());
+		if (!CANVAS) {
+			Clear(rico::BLACK);
+			// the whole world fits in the window at zoom -1
+			world.reset(new rico::WorldBuffer(WORLD * Width(), WORLD * Height(), 3));
+			camera.reset(new rico::Camera(*world));
+			camera->SetZoom(-1);
+		}
+
+		gravity = rico::Gravity<real>(real(G));
 		pause = false;
+		collisions = true;
+		recording = false;
 		delta_time = 1e-5;
+		steps = 0;
+
+		std::string const first = (argc > 1) ? argv[1] : "";
+		if (first.size() > 5 && first.compare(first.size() - 5, 5, ".snap") == 0) {
+			Restore(rico::Snapshot(first));
+		} else {
+			// insert random bodies
+			uint32_t count = (argc > 1) ? static_cast<uint32_t>(std::strtoul(argv[1], NULL, 10)) : 3;
+			for (uint32_t i = 0; i < count; ++i) Add(Body());
+			// insert 2 massive bodies orbiting the center
+			Add(Body(5e3, {-0.25, 0.0}, {0.0, -75.0}, rico::WHITE, 4));
+			Add(Body(5e3, {+0.25, 0.0}, {0.0, +75.0}, rico::WHITE, 4));
+			// insert 2 light bodies orbiting the center
+			Add(Body(1e2, {+0.75, 0.0}, {0.0, -100.0}, rico::GREEN, 2));
+			Add(Body(1e2, {-0.75, 0.0}, {0.0, +100.0}, rico::RED, 2));
+		}
+		if (bodies.size() == 0) return false;
+		// the world maps [-1.0, +1.0] to its width
+		pixel = real(2.0 / Side());
+		max_radius = *std::max_element(radii.begin(), radii.end());
+
+		uint32_t interval = (argc > 2) ? static_cast<uint32_t>(std::strtoul(argv[2], NULL, 10)) : 0;
+		if (interval != 0) {
+			// deltas between keyframes, to reproduce a run from any snapshot
+			series.reset(new rico::SnapshotSeries("gravity", interval));
+			if (series->Due(steps)) {
+				Save(series->Begin(steps));
+				series->End();
+			}
+		}
 		return true;
 	}
 
@@ -173,17 +272,60 @@ protected:
 		if (GetButton('p').pressed) pause = !pause;
 		if (GetButton('f').pressed) delta_time *= 2.0;
 		if (GetButton('s').pressed) delta_time /= 2.0;
+		if (GetButton('c').pressed) collisions = !collisions;
+		if (GetButton('k').pressed) {
+			rico::SnapshotWriter writer("gravity.snap", steps);
+			Save(writer);
+			writer.Close();
+		}
 		if (!pause) {
-			// fade traces
-			DarkenScreen();
 			// apply gravity
 			UpdatePositions();
+			if (collisions) Collide();
+			++steps;
+			if (series && series->Due(steps)) {
+				Save(series->Begin(steps));
+				series->End();
+			}
+		}
+		return true;
+	}
+
+	void OnUserRender(void) override {
+		// on the main thread, always
+		if (GetButton('r').pressed) {
+			if (recording) {
+				std::cout << "dropped frames: " << rico::GameEngine::StopRecording() << std::endl;
+				recording = false;
+			} else {
+				recording = (rico::GameEngine::StartRecording("gravity.y4m", rico::CaptureFormat::Y4M) == 0);
+			}
+		}
+		if (CANVAS) {
+			// the engine fades the canvas and blends the new disks over it
+			if (!pause) rico::GameEngine::FadeCanvas(rico::Color(fading, fading, fading));
+			for (uint32_t i = 0; i < bodies.size(); ++i) {
+				draw(list, Width(), Height(), vec(bodies.position.get(i)), radii[i], colors[i]);
+			}
+			list.Render(Frame(), &rico::GameEngine::GetThreadPool());
+			return;
+		}
+		if (GetButton('=').pressed) camera->Zoom(+1);
+		if (GetButton('-').pressed) camera->Zoom(-1);
+		camera->Pan(
+			(GetButton(SDL_SCANCODE_RIGHT).down ? PAN : 0) - (GetButton(SDL_SCANCODE_LEFT).down ? PAN : 0),
+			(GetButton(SDL_SCANCODE_DOWN).down ? PAN : 0) - (GetButton(SDL_SCANCODE_UP).down ? PAN : 0));
+		if (!pause) {
+			// fade traces
+			DarkenWorld();
 		}
 		// draw elements
-		for (Body const& body : bodies) {
-			body.draw();
+		for (uint32_t i = 0; i < bodies.size(); ++i) {
+			draw(list, world->get_width(), world->get_height(), vec(bodies.position.get(i)), radii[i], colors[i]);
 		}
-		return true;
+		list.Render(world->Frame(), &rico::GameEngine::GetThreadPool());
+		// only the visible part of the world is copied to the frame
+		camera->Render(*world, Frame());
 	}
 
 	void OnUserDestroy(void) override {
@@ -195,5 +337,8 @@ protected:
 int main(int argc, char const **argv) {
 	int retval = rico::GameEngine::Construct(1000, 1000, 5);
 	if (retval != 0) return EXIT_FAILURE;
+	// the simulation of the next frame runs while the current one is presented
+	rico::GameEngine::SetPipelined(true);
+	rico::GameEngine::SetCanvas(CANVAS);
 	return rico::GameEngine::Run<NBodies>(argc, argv);
 }
\ No newline at end of file
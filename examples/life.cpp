@@ -2,131 +2,174 @@
  * q = QUIT
  * p = toggle PAUSE
  * s = compute one step (while pausing)
+ * j = jump 2^JUMP generations at once (HashLife)
+ * arrows = move the view over the board
  * left click = toggle cell
  * right click = spawn glider
+ * k = save a snapshot to life.snap
+ * usage: life [ratio of alive cells | snapshot to resume] [snapshot interval]
+ * with an interval, a snapshot is saved every interval updates to life<update>.snap
  */
 
 #include "rico.hpp"
+#include "sparselife.hpp"
 #include "random.hpp"
+#include "snapshot.hpp"
+#include "sprite.hpp"
+#include <memory>
+#include <string>
 
-#define ALIVE rico::BLACK
-#define DEAD rico::WHITE
+// cells are drawn as palette indices (see GameEngine::SetIndexed)
+constexpr uint8_t ALIVE = 1;
+constexpr uint8_t DEAD = 0;
+
+constexpr uint32_t FPS = 30; // generations per second
+constexpr int32_t SOUP = 512; // side of the random region, in cells
+constexpr int32_t PAN = 4; // cells per frame
+constexpr uint32_t JUMP = 10;
 
 class GameOfLife : public rico::Game {
 private:
 
 	using vec = rico::Tvec2D<int32_t>;
-	using mat = rico::Tmat2D<bool>;
 	bool pause, step;
-	mat current, next;
-	static constexpr uint32_t FPS = 30;
+	rico::SparseLife board; // unbounded
+	vec view; // board cell at the top-left of the window
+	bool moved; // the whole view must be redrawn
+	uint64_t updates; // that computed the board, since the start of the run
+	std::unique_ptr<rico::SnapshotSeries> series;
+	rico::Sprite glider_pattern;
 
-	// return the position in the matrix with wrap around
-	rico::Position wrap(vec v) {
-		uint32_t x = static_cast<uint32_t>(v.x + Width()) % Width();
-		uint32_t y = static_cast<uint32_t>(v.y + Height()) % Height();
-		return rico::Position(x, y);
+	void Save(rico::SnapshotWriter& writer) const {
+		writer.Write("board", board);
+		writer.WriteValue("view", view);
+		writer.WriteValue("random", Random::State());
 	}
 
-	// create glider centered around position p
-	void glider(rico::Position p) {
-		vec v(p.x, p.y);
-		vec const offsets[5] = {
-			{+0, -1}, {+1, +0}, {-1, +1}, {+0, +1}, {+1, +1}
-		};
-		for (uint32_t i = 0; i < 5; ++i) {
-			current[wrap(v + offsets[i])] = true;
-			SetPixel(wrap(v + offsets[i]), ALIVE);
-		}
+	void Restore(rico::Snapshot const& snapshot) {
+		snapshot.Read("board", board);
+		snapshot.ReadValue("view", view);
+		uint64_t state;
+		snapshot.ReadValue("random", state);
+		Random::Seed(state);
+		updates = snapshot.get_frame();
 	}
 
-	// compute next state
-	void update(void) {
-		vec const offsets[8] = {
-			{-1, -1}, {+0, -1}, {+1, -1},
-			{-1, +0},           {+1, +0},
-			{-1, +1}, {+0, +1}, {+1, +1},
-		};
-		for (uint32_t x = 0; x < Width(); ++x) {
-			for (uint32_t y = 0; y < Height(); ++y) {
-				vec pos(x , y);
-				int32_t sum = 0;
-				for (int32_t i = 0; i < 8; ++i) {
-					if (current[wrap(pos + offsets[i])]) ++sum;
-				}
-				bool& src = current[wrap(pos)];
-				bool& dst = next[wrap(pos)];
-				if (sum <= 1) { dst = false; SetPixel(wrap(pos), DEAD); }
-				if (sum == 2) { dst = src; /* pixel keep color */ }
-				if (sum == 3) { dst = true; SetPixel(wrap(pos), ALIVE); }
-				if (sum >= 4) { dst = false; SetPixel(wrap(pos), DEAD); }
-			}
-		}
+	// board cell under the mouse, if any
+	bool mouse(vec *output) {
+		rico::Position pos;
+		if (!GetMousePos(&pos)) return false;
+		*output = view + vec(static_cast<int32_t>(pos.x), static_cast<int32_t>(pos.y));
+		return true;
+	}
+
+	// create glider centered around cell v, its cells are the runs of the pattern
+	void glider(vec v) {
+		vec const corner = v - vec(1, 1);
+		glider_pattern.for_each_run([&](uint32_t row, uint32_t col, uint32_t length) {
+			for (uint32_t i = 0; i < length; ++i) board.set(corner.x + int32_t(col + i), corner.y + int32_t(row), true);
+		});
 	}
 
 protected:
 
 	bool OnUserCreate(int argc, char const **argv) override {
 		pause = step = false;
-		current = mat(Height(), Width());
-		next = mat(Height(), Width());
-		double ratio = 0.5;
-		if (argc >= 2) {
-			ratio = std::strtod(argv[1], NULL);
-			if (ratio < 0.0 || ratio > 1.0) return false;
-		}
-		for (uint32_t y = 0; y < Height(); ++y) {
-			for (uint32_t x = 0; x < Width(); ++x) {
-				rico::Position pos(x, y);
-				bool& cell = current[pos];
-				cell = Random::Double() < ratio;
-				if (cell) {
-					SetPixel(pos, ALIVE);
-				} else {
-					SetPixel(pos, DEAD);
+		glider_pattern = rico::Sprite::FromText({
+			".O.",
+			"..O",
+			"OOO" }, { { 'O', rico::BLACK } });
+		SetPaletteColor(ALIVE, rico::BLACK);
+		SetPaletteColor(DEAD, rico::WHITE);
+		updates = 0;
+		std::string const first = (argc >= 2) ? argv[1] : "";
+		if (first.size() > 5 && first.compare(first.size() - 5, 5, ".snap") == 0) {
+			Restore(rico::Snapshot(first));
+		} else {
+			double ratio = 0.5;
+			if (argc >= 2) {
+				ratio = std::strtod(argv[1], NULL);
+				if (ratio < 0.0 || ratio > 1.0) return false;
+			}
+			// the soup is centered on the origin, and so is the view
+			for (int32_t y = -SOUP / 2; y < SOUP / 2; ++y) {
+				for (int32_t x = -SOUP / 2; x < SOUP / 2; ++x) {
+					if (Random::Double() < ratio) board.set(x, y, true);
 				}
 			}
+			view = vec(-static_cast<int32_t>(Width() / 2), -static_cast<int32_t>(Height() / 2));
+		}
+		moved = true;
+		uint32_t interval = (argc >= 3) ? static_cast<uint32_t>(std::strtoul(argv[2], NULL, 10)) : 0;
+		if (interval != 0) {
+			// deltas between keyframes only hold the blocks of the tiles that changed
+			series.reset(new rico::SnapshotSeries("life", interval));
+			if (series->Due(updates)) {
+				Save(series->Begin(updates));
+				series->End();
+			}
 		}
 		return true;
 	}
 
+	void OnUserResize(uint32_t width, uint32_t height) override {
+		(void) width;
+		(void) height;
+		// the frame was cleared
+		moved = true;
+	}
+
 	void OnUserDestroy(void) override {
 		return;
 	}
 
 	bool OnUserUpdate(double elapsed_ms) override {
 		(void) elapsed_ms;
+		bool computed = false;
 		if (!pause || step) {
-			// update next state based on current state
-			update();
-			// swap buffers for the next update
-			mat tmp(std::move(current));
-			current = std::move(next);
-			next = std::move(tmp);
+			// only the active tiles of the board are computed
+			board.Step(&rico::GameEngine::GetThreadPool());
 			// if step was true, set it false to pause at the next frame
 			step = false;
+			computed = true;
 		}
 		// handle user inputs
-		rico::Position pos;
+		vec cell;
 		if (GetButton('q').pressed) return false;
 		if (GetButton('p').pressed) pause = !pause;
 		if (GetButton('s').pressed && pause) step = true;
-		if (GetButton(rico::Button::LEFT).pressed) {
-			if (GetMousePos(&pos)) {
-				bool& cell = current[pos];
-				cell = !cell;
-				if (cell) {
-					SetPixel(pos, ALIVE);
-				} else {
-					SetPixel(pos, DEAD);
-				}
+		if (GetButton('j').pressed) {
+			board.Jump(JUMP);
+			computed = true;
+		}
+		if (GetButton('k').pressed) {
+			rico::SnapshotWriter writer("life.snap", updates);
+			Save(writer);
+			writer.Close();
+		}
+		if (computed) {
+			++updates;
+			if (series && series->Due(updates)) {
+				Save(series->Begin(updates));
+				series->End();
 			}
 		}
+		vec const pan = vec(
+			(GetButton(SDL_SCANCODE_RIGHT).down ? PAN : 0) - (GetButton(SDL_SCANCODE_LEFT).down ? PAN : 0),
+			(GetButton(SDL_SCANCODE_DOWN).down ? PAN : 0) - (GetButton(SDL_SCANCODE_UP).down ? PAN : 0));
+		if (pan != vec(0, 0)) {
+			view += pan;
+			moved = true;
+		}
+		if (GetButton(rico::Button::LEFT).pressed) {
+			if (mouse(&cell)) board.toggle(cell.x, cell.y);
+		}
 		if (GetButton(rico::Button::RIGHT).pressed) {
-			if (GetMousePos(&pos)) glider(pos);
+			if (mouse(&cell)) glider(cell);
 		}
-		// limit the number of updates per second
-		WaitMs(1000.0 / FPS);
+		// redraw the tiles that changed (all of them if the view moved)
+		board.Draw(Indexed(), view.x, view.y, ALIVE, DEAD, moved);
+		moved = false;
 		return true;
 	}
 };
@@ -134,5 +177,10 @@ protected:
 int main(int argc, char const **argv) {
 	int retval = rico::GameEngine::Construct(640, 480, 10);
 	if (retval != 0) return EXIT_FAILURE;
+	// 1 byte per cell instead of 4
+	retval = rico::GameEngine::SetIndexed(true);
+	if (retval != 0) return EXIT_FAILURE;
+	// limit the number of updates per second
+	rico::GameEngine::SetTargetFps(FPS);
 	return rico::GameEngine::Run<GameOfLife>(argc, argv);
-}
\ No newline at end of file
+}
@@ -0,0 +1,159 @@
+/** sprites bouncing over a scrolling tile map
+ * q = QUIT
+ * p = toggle PAUSE
+ * usage: sprites [number of sprites]
+ */
+
+#include "rico.hpp"
+#include "draw.hpp"
+#include "random.hpp"
+#include "sprite.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+constexpr uint32_t WINDOW_WIDTH = 960, WINDOW_HEIGHT = 720, PIXEL_SIZE = 2;
+constexpr uint32_t TILE = 16; // side of the tiles, in pixels
+constexpr uint32_t BALL = 12; // diameter of the sprites, in pixels
+constexpr uint32_t SPRITES = 2000; // default number of sprites
+constexpr uint32_t SCROLL = 1; // pixels per frame
+
+class Sprites : public rico::Game {
+private:
+
+	using vec = rico::Tvec2D<float>;
+	std::vector<rico::Sprite> balls; // one per color
+	std::unique_ptr<rico::TileMap> map;
+	rico::Tvec2DArray<float> position, speed; // of the sprites, in pixels and pixels per second
+	std::vector<uint8_t> colors; // of the sprites, index in balls
+	rico::DrawList list;
+	uint32_t scroll;
+	bool pause;
+	double ms_count;
+	uint32_t frames_count;
+
+	// disk of diameter BALL, shaded toward the bottom-right, antialiased edge (translucent)
+	static rico::Sprite Ball(rico::Color color) {
+		rico::Tmat2D<uint32_t> pixels(BALL, BALL);
+		float const radius = BALL / 2.0f;
+		for (uint32_t y = 0; y < BALL; ++y) {
+			for (uint32_t x = 0; x < BALL; ++x) {
+				vec d = vec(x + 0.5f - radius, y + 0.5f - radius);
+				float coverage = std::min(std::max(radius - d.length() + 0.5f, 0.0f), 1.0f);
+				float shade = 1.0f - 0.5f * std::max(d.dot(vec(1.0f, 1.0f).normalized()) / radius, 0.0f);
+				pixels[y][x] = rico::PixelFormat::pack(
+					uint8_t(color.r * shade), uint8_t(color.g * shade), uint8_t(color.b * shade),
+					uint8_t(255.0f * coverage));
+			}
+		}
+		return rico::Sprite(std::move(pixels));
+	}
+
+	// opaque square of one color, with a darker border
+	static rico::Sprite Tile(rico::Color color) {
+		rico::Tmat2D<uint32_t> pixels(TILE, TILE);
+		rico::Color border(color.r / 2, color.g / 2, color.b / 2);
+		for (uint32_t y = 0; y < TILE; ++y) {
+			for (uint32_t x = 0; x < TILE; ++x) {
+				pixels[y][x] = (x == 0 || y == 0) ? border : color;
+			}
+		}
+		return rico::Sprite(std::move(pixels));
+	}
+
+	// a checkerboard covering the frame with 2 tiles to spare on each axis, to scroll
+	void BuildMap(void) {
+		map.reset(new rico::TileMap(TILE, TILE, Width() / TILE + 3, Height() / TILE + 3));
+		uint16_t light = map->add_tile(Tile(rico::Color(96, 128, 96)));
+		uint16_t dark = map->add_tile(Tile(rico::Color(64, 96, 64)));
+		for (uint32_t row = 0; row < map->get_rows(); ++row) {
+			for (uint32_t col = 0; col < map->get_cols(); ++col) map->set(col, row, ((row + col) % 2 == 0) ? light : dark);
+		}
+	}
+
+	void Move(double elapsed_ms) {
+		RICO_PROFILE("move");
+		// batched over all the sprites, then bounced on the edges of the frame
+		position.add_scaled(speed, float(elapsed_ms / 1000.0));
+		float const width = float(Width() - BALL), height = float(Height() - BALL);
+		for (uint32_t i = 0; i < position.size(); ++i) {
+			vec p = position.get(i), s = speed.get(i);
+			if (p.x < 0.0f) { p.x = -p.x; s.x = -s.x; }
+			if (p.x > width) { p.x = 2.0f * width - p.x; s.x = -s.x; }
+			if (p.y < 0.0f) { p.y = -p.y; s.y = -s.y; }
+			if (p.y > height) { p.y = 2.0f * height - p.y; s.y = -s.y; }
+			position.set(i, vec(std::min(std::max(p.x, 0.0f), width), std::min(std::max(p.y, 0.0f), height)));
+			speed.set(i, s);
+		}
+	}
+
+protected:
+
+	bool OnUserCreate(int argc, char const **argv) override {
+		uint32_t count = SPRITES;
+		if (argc >= 2) count = static_cast<uint32_t>(std::strtoul(argv[1], NULL, 10));
+		if (Width() < BALL || Height() < BALL) return false;
+		for (rico::Color color : { rico::RED, rico::GREEN, rico::BLUE, rico::YELLOW }) balls.push_back(Ball(color));
+		BuildMap();
+		for (uint32_t i = 0; i < count; ++i) {
+			position.push_back(vec(float(Random::rangeDouble(0.0, Width() - BALL)), float(Random::rangeDouble(0.0, Height() - BALL))));
+			speed.push_back(vec(float(Random::rangeDouble(-100.0, 100.0)), float(Random::rangeDouble(-100.0, 100.0))));
+			colors.push_back(static_cast<uint8_t>(i % balls.size()));
+		}
+		scroll = 0;
+		pause = false;
+		ms_count = 0.0;
+		frames_count = 0;
+		return true;
+	}
+
+	void OnUserResize(uint32_t width, uint32_t height) override {
+		(void) width;
+		(void) height;
+		BuildMap();
+	}
+
+	void OnUserDestroy(void) override {
+		return;
+	}
+
+	bool OnUserUpdate(double elapsed_ms) override {
+		if (GetButton('q').pressed) return false;
+		if (GetButton('p').pressed) pause = !pause;
+		if (!pause) {
+			Move(elapsed_ms);
+			scroll = (scroll + SCROLL) % (2 * TILE);
+		}
+		rico::FrameBuffer frame = Frame();
+		{
+			RICO_PROFILE("tile map");
+			// the checkerboard repeats every 2 tiles
+			int32_t offset = -static_cast<int32_t>(scroll);
+			map->Draw(frame, offset, offset, &rico::GameEngine::GetThreadPool());
+		}
+		for (uint32_t i = 0; i < position.size(); ++i) {
+			list.AddSprite(balls[colors[i]], int32_t(position.x[i]), int32_t(position.y[i]));
+		}
+		list.Render(frame, &rico::GameEngine::GetThreadPool());
+		++frames_count;
+		ms_count += elapsed_ms;
+		if (ms_count >= 1000.0) {
+			std::cout << "FPS=" << frames_count << std::endl;
+			rico::Profiler::Get().Report(std::cout);
+			frames_count = 0;
+			ms_count -= 1000.0;
+		}
+		return true;
+	}
+};
+
+int main(int argc, char const **argv) {
+	int retval = rico::GameEngine::Construct(WINDOW_WIDTH, WINDOW_HEIGHT, PIXEL_SIZE);
+	if (retval != 0) return EXIT_FAILURE;
+	rico::GameEngine::SetResizable(true);
+	// the tile map covers every pixel each frame, so draw straight into the texture
+	rico::GameEngine::SetSubmit(rico::Submit::DIRECT);
+	return rico::GameEngine::Run<Sprites>(argc, argv);
+}
@@ -0,0 +1,275 @@
+/** rico/arena.hpp
+ *
+ * Arena is a bump allocator for scratch data that lives for a frame:
+ * allocating moves a pointer forward in a block of memory, nothing is
+ * freed individually, and Reset makes the whole arena available again.
+ * When a frame needed more than one block, Reset replaces them by a single
+ * block large enough for all of them: once the largest frame was seen,
+ * frames do not allocate from the heap anymore.
+ *
+ * ArenaAllocator adapts an arena for the containers of the standard library
+ * (ArenaVector is a std::vector in an arena). deallocate does nothing, so
+ * a growing container leaves its previous storage in the arena until the
+ * next Reset: reserve when the size is known.
+ *
+ * GameEngine owns a frame arena, reset at each frame (see
+ * GameEngine::GetFrameArena) and one arena per thread of its pool (see
+ * GameEngine::GetThreadArena).
+ *
+ * Heap allocations are counted (see HeapAllocations): the storage of
+ * Tmat2D always, and every operator new in a program where a single
+ * translation unit defines RICO_COUNT_ALLOCATIONS before including this
+ * file, which replaces the global operator new and delete. GameEngine
+ * reports the allocations of each frame with the profiler counter "heap
+ * allocations" and GetFrameAllocations.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace rico {
+
+	namespace detail {
+
+		inline std::atomic<uint64_t> heap_allocations(0);
+
+	} // namespace detail
+
+	/**
+	 * record an allocation from the heap (by operator new or by Tmat2D)
+	 */
+	inline void CountHeapAllocation(void) {
+		detail::heap_allocations.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @return number of heap allocations since the start of the program
+	 */
+	inline uint64_t HeapAllocations(void) {
+		return detail::heap_allocations.load(std::memory_order_relaxed);
+	}
+
+	class Arena {
+	public:
+
+		static constexpr size_t BLOCK = 64 * 1024; // size of the first block, in bytes
+		static constexpr size_t ALIGNMENT = 64; // of the blocks
+
+	private:
+
+		struct Block {
+			unsigned char *data;
+			size_t size;
+		}; // struct Arena::Block
+
+		std::vector<Block> blocks;
+		size_t current; // index of the block being filled
+		size_t offset; // bytes used in the current block
+		size_t used; // bytes used in the previous blocks (padding included)
+		size_t peak; // largest used + offset since the creation
+
+		static Block NewBlock(size_t size) {
+			size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+			void *data = std::aligned_alloc(ALIGNMENT, size);
+			if (data == NULL) throw std::bad_alloc();
+			CountHeapAllocation();
+			return Block { static_cast<unsigned char*>(data), size };
+		}
+
+		void Release(void) noexcept {
+			for (Block& block : blocks) std::free(block.data);
+			blocks.clear();
+		}
+
+	public:
+
+		Arena(void) noexcept
+			: current(0), offset(0), used(0), peak(0)
+		{}
+
+		~Arena(void) noexcept {
+			Release();
+		}
+
+		Arena(Arena const&) = delete;
+		Arena& operator=(Arena const&) = delete;
+
+		/**
+		 * @param bytes size of the allocation
+		 * @param alignment power of 2, at most ALIGNMENT
+		 * @return uninitialized storage, valid until the next Reset
+		 */
+		void* Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+			if (alignment > ALIGNMENT || (alignment & (alignment - 1)) != 0) throw std::invalid_argument("invalid alignment");
+			while (current < blocks.size()) {
+				size_t start = (offset + alignment - 1) & ~(alignment - 1);
+				if (start + bytes <= blocks[current].size) {
+					offset = start + bytes;
+					peak = std::max(peak, used + offset);
+					return blocks[current].data + start;
+				}
+				// the rest of this block is lost until Reset
+				used += blocks[current].size;
+				++current;
+				offset = 0;
+			}
+			size_t last = blocks.empty() ? BLOCK / 2 : blocks.back().size;
+			blocks.push_back(NewBlock(std::max(2 * last, bytes)));
+			offset = bytes;
+			peak = std::max(peak, used + offset);
+			return blocks.back().data;
+		}
+
+		/**
+		 * @return uninitialized storage for count elements of type T, valid
+		 *   until the next Reset (T is never destroyed)
+		 */
+		template<typename T>
+		T* Allocate(size_t count) {
+			static_assert(std::is_trivially_destructible<T>::value, "arena elements are never destroyed");
+			return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+		}
+
+		/**
+		 * make the whole arena available again, everything allocated is lost
+		 * if several blocks were used, they are merged into a single one
+		 */
+		void Reset(void) {
+			if (blocks.size() > 1) {
+				size_t total = 0;
+				for (Block const& block : blocks) total += block.size;
+				Release();
+				blocks.push_back(NewBlock(total));
+			}
+			current = 0;
+			offset = 0;
+			used = 0;
+		}
+
+		/**
+		 * @return bytes allocated since the last Reset (alignment padding included)
+		 */
+		size_t Used(void) const {
+			return used + offset;
+		}
+
+		/**
+		 * @return largest Used since the creation of the arena
+		 */
+		size_t Peak(void) const {
+			return peak;
+		}
+
+		/**
+		 * @return bytes reserved from the heap
+		 */
+		size_t Capacity(void) const {
+			size_t total = 0;
+			for (Block const& block : blocks) total += block.size;
+			return total;
+		}
+
+	}; // class Arena
+
+	/**
+	 * allocator of the standard library, in an arena
+	 */
+	template<typename T>
+	class ArenaAllocator {
+	public:
+
+		using value_type = T;
+
+		Arena *arena;
+
+		explicit ArenaAllocator(Arena& _arena) noexcept
+			: arena(&_arena)
+		{}
+
+		template<typename U>
+		ArenaAllocator(ArenaAllocator<U> const& other) noexcept
+			: arena(other.arena)
+		{}
+
+		T* allocate(size_t count) {
+			return static_cast<T*>(arena->Allocate(count * sizeof(T), alignof(T)));
+		}
+
+		void deallocate(T*, size_t) noexcept {}
+
+		template<typename U>
+		bool operator==(ArenaAllocator<U> const& other) const noexcept { return arena == other.arena; }
+		template<typename U>
+		bool operator!=(ArenaAllocator<U> const& other) const noexcept { return arena != other.arena; }
+
+	}; // class ArenaAllocator
+
+	template<typename T>
+	using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+} // namespace rico
+
+#ifdef RICO_COUNT_ALLOCATIONS
+
+// replacement of the global allocation functions (a single translation unit
+// of the program must define RICO_COUNT_ALLOCATIONS), memory comes from
+// malloc and goes back to free
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(size_t size) {
+	rico::CountHeapAllocation();
+	void *retval = std::malloc(size == 0 ? 1 : size);
+	if (retval == NULL) throw std::bad_alloc();
+	return retval;
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void* operator new(size_t size, std::nothrow_t const&) noexcept {
+	rico::CountHeapAllocation();
+	return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, std::nothrow_t const&) noexcept {
+	return operator new(size, std::nothrow);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+	rico::CountHeapAllocation();
+	size_t align = static_cast<size_t>(alignment);
+	void *retval = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align);
+	if (retval == NULL) throw std::bad_alloc();
+	return retval;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+	return operator new(size, alignment);
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // RICO_COUNT_ALLOCATIONS
@@ -0,0 +1,245 @@
+/** rico/bitgrid.hpp
+ *
+ * BitGrid is a 2D grid of cells holding one bit each, packed 64 cells per
+ * 64 bits word. Each row starts on a new word, and the unused bits of the
+ * last word of a row are always 0. The grid is a torus: the neighbors of a
+ * cell on an edge are taken on the opposite edge.
+ *
+ * life_step compute the next generation of a Life-like cellular automaton
+ * (rule given as birth/survival neighbor counts, Conway's B3/S23 by
+ * default) 64 cells at a time: the 8 neighbors of every cell of a word are
+ * themselves words (shifted copies of the 3 rows around it), summed with
+ * bit-parallel full adders. Wrapping around only happens at word
+ * boundaries, by injecting a single bit in the shifted words.
+ *
+ * Each word that changed is reported to a callback, along with the mask
+ * of the cells that changed, so that the caller can update the display
+ * in the same pass.
+ */
+
+#pragma once
+
+#include "rico.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace rico {
+
+	class BitGrid {
+	private:
+
+		uint32_t rows, cols; // dimensions, in cells
+		uint32_t words; // number of words per row
+		std::vector<uint64_t> bits; // rows * words words
+
+	public:
+
+		BitGrid(void)
+			: rows(0), cols(0), words(0)
+		{}
+
+		/**
+		 * create a grid with every cell set to 0
+		 */
+		BitGrid(uint32_t _rows, uint32_t _cols)
+			: rows(_rows), cols(_cols), words((_cols + 63) / 64),
+			bits(static_cast<size_t>(_rows) * words, 0)
+		{}
+
+		uint32_t get_rows(void) const { return rows; }
+		uint32_t get_cols(void) const { return cols; }
+		uint32_t get_words(void) const { return words; }
+
+		/**
+		 * @return mask of the bits used in the last word of a row
+		 */
+		uint64_t last_mask(void) const {
+			uint32_t used = cols - 64 * (words - 1);
+			return (used == 64) ? ~uint64_t(0) : (uint64_t(1) << used) - 1;
+		}
+
+		// words of a row, unused bits of the last word must be kept to 0
+		uint64_t* row(uint32_t index) { return bits.data() + static_cast<size_t>(index) * words; }
+		uint64_t const* row(uint32_t index) const { return bits.data() + static_cast<size_t>(index) * words; }
+
+		bool get(Position pos) const {
+			if (pos.x >= cols || pos.y >= rows) throw std::out_of_range("index out of range");
+			return (row(pos.y)[pos.x / 64] >> (pos.x % 64)) & 1;
+		}
+
+		void set(Position pos, bool value) {
+			if (pos.x >= cols || pos.y >= rows) throw std::out_of_range("index out of range");
+			uint64_t& word = row(pos.y)[pos.x / 64];
+			uint64_t mask = uint64_t(1) << (pos.x % 64);
+			word = value ? (word | mask) : (word & ~mask);
+		}
+
+		// @return the new value of the cell
+		bool toggle(Position pos) {
+			bool value = !get(pos);
+			set(pos, value);
+			return value;
+		}
+
+		void clear(void) {
+			std::fill(bits.begin(), bits.end(), 0);
+		}
+
+		void swap(BitGrid& other) noexcept {
+			std::swap(rows, other.rows);
+			std::swap(cols, other.cols);
+			std::swap(words, other.words);
+			bits.swap(other.bits);
+		}
+
+	}; // class BitGrid
+
+	/**
+	 * rule of a Life-like automaton
+	 * bit k of birth (survive) is set if a dead (alive) cell with k alive
+	 * neighbors is alive at the next generation
+	 */
+	struct LifeRule {
+
+		uint16_t birth, survive;
+
+		constexpr LifeRule(uint16_t _birth, uint16_t _survive)
+			: birth(_birth), survive(_survive)
+		{}
+
+		constexpr bool operator==(LifeRule const& rhs) const {
+			return birth == rhs.birth && survive == rhs.survive;
+		}
+
+	}; // struct LifeRule
+
+	static constexpr LifeRule CONWAY(1 << 3, (1 << 2) | (1 << 3));
+
+	namespace detail {
+
+		// neighbors on the left of each cell of word w, wrapping around the row
+		inline uint64_t west(uint64_t const *line, uint32_t w, uint32_t words, uint32_t cols) {
+			uint64_t carry;
+			if (w == 0) {
+				carry = (line[words - 1] >> ((cols - 1) % 64)) & 1;
+			} else {
+				carry = line[w - 1] >> 63;
+			}
+			return (line[w] << 1) | carry;
+		}
+
+		// neighbors on the right of each cell of word w, wrapping around the row
+		inline uint64_t east(uint64_t const *line, uint32_t w, uint32_t words, uint32_t cols) {
+			if (w + 1 == words) {
+				// the unused bits are 0, so the last used bit receive the first cell
+				return (line[w] >> 1) | ((line[0] & 1) << ((cols - 1) % 64));
+			}
+			return (line[w] >> 1) | (line[w + 1] << 63);
+		}
+
+		inline void full_adder(uint64_t a, uint64_t b, uint64_t c, uint64_t& sum, uint64_t& carry) {
+			uint64_t t = a ^ b;
+			sum = t ^ c;
+			carry = (a & b) | (t & c);
+		}
+
+		// cells whose neighbor count (bits s0..s3) is in mask
+		inline uint64_t count_in(uint16_t mask, uint64_t s0, uint64_t s1, uint64_t s2, uint64_t s3) {
+			uint64_t retval = 0;
+			for (uint32_t k = 0; k <= 8; ++k) {
+				if ((mask >> k) & 1) {
+					retval |= ((k & 1) ? s0 : ~s0)
+						& ((k & 2) ? s1 : ~s1)
+						& ((k & 4) ? s2 : ~s2)
+						& ((k & 8) ? s3 : ~s3);
+				}
+			}
+			return retval;
+		}
+
+		/**
+		 * next generation of the 64 cells of mid, given the 3 rows around
+		 * them and their neighbors on the left (w) and right (e), the kernel
+		 * of both life_step and SparseLife
+		 */
+		inline uint64_t life_word(
+			uint64_t uw, uint64_t u, uint64_t ue,
+			uint64_t mw, uint64_t mid, uint64_t me,
+			uint64_t dw, uint64_t d, uint64_t de,
+			LifeRule rule, bool conway)
+		{
+			// sum the 8 neighbors, count = s0 + 2*s1 + 4*s2 + 8*s3
+			uint64_t sa, ca, sb, cb, sc, cc, s0, cd, t, ce, s1, cf;
+			full_adder(uw, u, ue, sa, ca);
+			full_adder(mw, me, dw, sb, cb);
+			sc = d ^ de;
+			cc = d & de;
+			full_adder(sa, sb, sc, s0, cd);
+			full_adder(ca, cb, cc, t, ce);
+			s1 = t ^ cd;
+			cf = t & cd;
+			uint64_t s2 = ce ^ cf, s3 = ce & cf;
+			if (conway) {
+				// 3 neighbors, or 2 neighbors and alive
+				return s1 & ~s2 & ~s3 & (s0 | mid);
+			}
+			return (mid & count_in(rule.survive, s0, s1, s2, s3))
+				| (~mid & count_in(rule.birth, s0, s1, s2, s3));
+		}
+
+	} // namespace detail
+
+	/**
+	 * compute rows [row_begin, row_end) of the next generation of src into dst
+	 * on_change(row, word, changed, value) is called on each word of dst that
+	 * differs from src: changed is the mask of the modified cells and value
+	 * the new word (cell x of the row is bit x % 64 of word x / 64)
+	 * @param src current generation
+	 * @param[out] dst next generation, same dimensions as src
+	 * @param rule rule of the automaton
+	 * @param on_change callback for modified words
+	 * @param row_begin first row to compute
+	 * @param row_end one past the last row to compute (clamped to the grid)
+	 */
+	template<typename F>
+	void life_step(
+		BitGrid const& src,
+		BitGrid& dst,
+		LifeRule rule,
+		F&& on_change,
+		uint32_t row_begin = 0,
+		uint32_t row_end = UINT32_MAX)
+	{
+		uint32_t const rows = src.get_rows(), cols = src.get_cols(), words = src.get_words();
+		if (dst.get_rows() != rows || dst.get_cols() != cols) {
+			throw std::invalid_argument("grids of different dimensions");
+		}
+		if (rows == 0 || cols == 0) return;
+		row_end = std::min(row_end, rows);
+		bool const conway = (rule == CONWAY);
+		uint64_t const last_mask = src.last_mask();
+
+		for (uint32_t r = row_begin; r < row_end; ++r) {
+			uint64_t const *up = src.row((r + rows - 1) % rows);
+			uint64_t const *mid = src.row(r);
+			uint64_t const *down = src.row((r + 1) % rows);
+			uint64_t *out = dst.row(r);
+			for (uint32_t w = 0; w < words; ++w) {
+				using namespace detail;
+				uint64_t const alive = mid[w];
+				uint64_t next = life_word(
+					west(up, w, words, cols), up[w], east(up, w, words, cols),
+					west(mid, w, words, cols), alive, east(mid, w, words, cols),
+					west(down, w, words, cols), down[w], east(down, w, words, cols),
+					rule, conway);
+				if (w + 1 == words) next &= last_mask;
+
+				out[w] = next;
+				uint64_t changed = next ^ alive;
+				if (changed != 0) on_change(r, w, changed, next);
+			}
+		}
+	}
+
+} // namespace rico
@@ -0,0 +1,283 @@
+/** rico/camera.hpp
+ *
+ * WorldBuffer is a picture larger than the window (the world), drawn to
+ * with a FrameBuffer like the frame of the engine, and Camera presents a
+ * part of it in the frame, panned and zoomed.
+ *
+ * The world keeps a pyramid of levels (mipmaps): level 0 is the world
+ * itself, each next level halves the previous one on both axes, each of
+ * its pixels being the average of 2 x 2 pixels (box filter, with the SIMD
+ * kernels of raster.hpp). The world keeps track of the tiles written to
+ * (see DirtyTiles), and levels are only brought up to date when a camera
+ * needs them, from the tiles of the previous level that changed: a still
+ * world costs nothing, whatever its size.
+ *
+ * Zoom is a power of 2: at zoom 0, one world pixel is one frame pixel, at
+ * zoom k > 0 each world pixel is replicated on 2^k x 2^k frame pixels, at
+ * zoom -k the level k is shown. Only the visible part of the world is
+ * copied to the frame (areas outside of the world are filled), the world is
+ * never rasterized again.
+ */
+
+#pragma once
+
+#include "rico.hpp"
+#include "raster.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace rico {
+
+	class WorldBuffer {
+	public:
+
+		static constexpr uint32_t MAX_LEVELS = 16;
+
+	private:
+
+		uint32_t cols, rows; // dimensions of level 0
+		std::vector<Tmat2D<uint32_t>> levels;
+		// tiles of each level changed since the next level was computed
+		std::unique_ptr<DirtyTiles[]> dirty;
+
+		// bring level + 1 up to date with level
+		void Reduce(uint32_t level) {
+			DirtyTiles& changed = dirty[level];
+			if (changed.Empty()) return;
+			Tmat2D<uint32_t> const& src = levels[level];
+			Tmat2D<uint32_t>& dst = levels[level + 1];
+			changed.ForEachRun([&](SDL_Rect const& rect) {
+				// runs are aligned on tiles, and levels but the last have even dimensions
+				uint32_t x0 = static_cast<uint32_t>(rect.x) / 2, y0 = static_cast<uint32_t>(rect.y) / 2;
+				uint32_t x1 = (static_cast<uint32_t>(rect.x + rect.w) + 1) / 2;
+				uint32_t y1 = (static_cast<uint32_t>(rect.y + rect.h) + 1) / 2;
+				raster::downsample(
+					dst.get_pointer() + y0 * dst.get_pitch() + x0, dst.get_pitch(),
+					src.get_pointer() + 2 * y0 * src.get_pitch() + 2 * x0, src.get_pitch(),
+					x1 - x0, y1 - y0);
+				dirty[level + 1].MarkRect(x0, y0, x1 - x0, y1 - y0);
+			});
+			changed.Clear();
+		}
+
+	public:
+
+		/**
+		 * @param width, height dimensions of the world, in pixels, rounded up
+		 * to a multiple of 2^(count - 1)
+		 * @param count number of levels, 1 for the world alone
+		 */
+		WorldBuffer(uint32_t width, uint32_t height, uint32_t count = 1) {
+			if (count == 0 || count > MAX_LEVELS) throw std::invalid_argument("invalid number of levels");
+			if (width == 0 || height == 0) throw std::invalid_argument("empty world");
+			uint32_t const mask = (1u << (count - 1)) - 1;
+			cols = (width + mask) & ~mask;
+			rows = (height + mask) & ~mask;
+			dirty.reset(new DirtyTiles[count]);
+			for (uint32_t level = 0; level < count; ++level) {
+				levels.emplace_back(rows >> level, cols >> level, true);
+				Tmat2D<uint32_t>& pixels = levels.back();
+				raster::fill(pixels.get_pointer(), pixels.get_pitch(), pixels.get_cols(), pixels.get_rows(), uint32_t(BLACK));
+				dirty[level].Reset(pixels.get_cols(), pixels.get_rows());
+				dirty[level].Clear();
+			}
+		}
+
+		uint32_t get_width(void) const { return cols; }
+		uint32_t get_height(void) const { return rows; }
+		uint32_t get_levels(void) const { return static_cast<uint32_t>(levels.size()); }
+
+		/**
+		 * view of level 0, to draw into the world (as into the frame)
+		 */
+		FrameBuffer Frame(void) {
+			Tmat2D<uint32_t>& pixels = levels.front();
+			return FrameBuffer(pixels.get_pointer(), pixels.get_pitch(), cols, rows, &dirty[0]);
+		}
+
+		/**
+		 * bring the levels 1 to level up to date with level 0
+		 * @return level, valid until the next write to the world
+		 */
+		Tmat2D<uint32_t> const& Level(uint32_t level) {
+			RICO_ASSERT_BOUNDS(level < levels.size());
+			if (level != 0) {
+				RICO_PROFILE("downsample");
+				for (uint32_t k = 0; k < level; ++k) Reduce(k);
+			}
+			return levels[level];
+		}
+
+	}; // class WorldBuffer
+
+	/**
+	 * point of view over a WorldBuffer, see the top of this file
+	 */
+	class Camera {
+	public:
+
+		static constexpr int32_t MAX_ZOOM = 4;
+
+	private:
+
+		int32_t x, y; // world pixel at the center of the frame
+		// and the position in it, in 2^-MAX_ZOOM world pixels: pans smaller
+		// than a world pixel add up, and show at the zooms that magnify
+		int32_t sub_x, sub_y;
+		int32_t zoom;
+		uint32_t cols, rows; // dimensions of the world
+		int32_t min_zoom;
+
+		// floor(value / 2^shift), for negative values too
+		static int64_t floor_shift(int64_t value, int32_t shift) {
+			return (value >= 0) ? (value >> shift) : -((-value + (int64_t(1) << shift) - 1) >> shift);
+		}
+
+		// move the center by delta 2^-MAX_ZOOM world pixels, along one axis
+		static void Move(int32_t& pixel, int32_t& sub, int64_t delta, uint32_t limit) {
+			int64_t position = (int64_t(pixel) << MAX_ZOOM) + sub + delta;
+			int64_t const last = (int64_t(limit) << MAX_ZOOM) - 1;
+			position = std::max<int64_t>(0, std::min(position, last));
+			pixel = static_cast<int32_t>(position >> MAX_ZOOM);
+			sub = static_cast<int32_t>(position & ((1 << MAX_ZOOM) - 1));
+		}
+
+		void Clamp(void) {
+			x = std::max(0, std::min(x, static_cast<int32_t>(cols) - 1));
+			y = std::max(0, std::min(y, static_cast<int32_t>(rows) - 1));
+			zoom = std::max(min_zoom, std::min(zoom, MAX_ZOOM));
+		}
+
+		// frame coordinate of the center at this level, with 2^magnify
+		// frame pixels per pixel of the level
+		int64_t Origin(int32_t pixel, int32_t sub, int32_t level, int32_t magnify) const {
+			if (level > 0) return pixel >> level;
+			return (int64_t(pixel) << magnify) + (sub >> (MAX_ZOOM - magnify));
+		}
+
+	public:
+
+		/**
+		 * centered on world, at zoom 0
+		 */
+		explicit Camera(WorldBuffer const& world) :
+			x(static_cast<int32_t>(world.get_width() / 2)), y(static_cast<int32_t>(world.get_height() / 2)),
+			sub_x(0), sub_y(0),
+			zoom(0),
+			cols(world.get_width()), rows(world.get_height()),
+			min_zoom(1 - static_cast<int32_t>(world.get_levels()))
+		{}
+
+		int32_t get_x(void) const { return x; }
+		int32_t get_y(void) const { return y; }
+		int32_t get_zoom(void) const { return zoom; }
+
+		/**
+		 * center the view on the world pixel (x, y), clamped to the world
+		 */
+		void CenterOn(int32_t _x, int32_t _y) {
+			x = _x;
+			y = _y;
+			sub_x = sub_y = 0;
+			Clamp();
+		}
+
+		/**
+		 * move the view by (dx, dy) frame pixels
+		 */
+		void Pan(int32_t dx, int32_t dy) {
+			// frame pixels to world pixels: times 2^-zoom, kept exact
+			int32_t const shift = MAX_ZOOM - zoom;
+			Move(x, sub_x, int64_t(dx) * (int64_t(1) << shift), cols);
+			Move(y, sub_y, int64_t(dy) * (int64_t(1) << shift), rows);
+		}
+
+		/**
+		 * set the zoom, clamped to [1 - world levels, MAX_ZOOM]
+		 */
+		void SetZoom(int32_t _zoom) {
+			zoom = _zoom;
+			Clamp();
+		}
+
+		void Zoom(int32_t delta) {
+			SetZoom(zoom + delta);
+		}
+
+		/**
+		 * world pixel shown at pos of a frame of width x height pixels
+		 * @return false if pos shows no world pixel
+		 */
+		bool ScreenToWorld(Position pos, uint32_t width, uint32_t height, Position *world) const {
+			int32_t const level = std::max(0, -zoom), magnify = std::max(0, zoom);
+			int64_t const ox = Origin(x, sub_x, level, magnify), oy = Origin(y, sub_y, level, magnify);
+			int64_t wx = floor_shift(ox + int64_t(pos.x) - width / 2, magnify) * (int64_t(1) << level);
+			int64_t wy = floor_shift(oy + int64_t(pos.y) - height / 2, magnify) * (int64_t(1) << level);
+			if (wx < 0 || wy < 0 || wx >= cols || wy >= rows) return false;
+			*world = Position(static_cast<uint32_t>(wx), static_cast<uint32_t>(wy));
+			return true;
+		}
+
+		/**
+		 * copy the visible part of world to frame, fill the rest with background
+		 * the whole frame is marked dirty
+		 */
+		void Render(WorldBuffer& world, FrameBuffer const& frame, Color background = BLACK) {
+			RICO_PROFILE("camera");
+			int32_t const level = std::max(0, -zoom), magnify = std::max(0, zoom);
+			Tmat2D<uint32_t> const& src = world.Level(static_cast<uint32_t>(level));
+			int64_t const src_cols = src.get_cols(), src_rows = src.get_rows();
+			int64_t const half_w = frame.width() / 2, half_h = frame.height() / 2;
+			// center of the frame, in frame pixels from the origin of the level
+			int64_t const ox = Origin(x, sub_x, level, magnify), oy = Origin(y, sub_y, level, magnify);
+			// frame pixel (sx, sy) shows the pixel (floor((ox + sx - half_w) / 2^magnify), ...)
+			// visible frame rectangle [x0, x1) x [y0, y1)
+			auto clamp = [](int64_t value, uint32_t limit) {
+				return static_cast<uint32_t>(std::max<int64_t>(0, std::min<int64_t>(value, limit)));
+			};
+			uint32_t const x0 = clamp(half_w - ox, frame.width());
+			uint32_t const x1 = clamp(half_w - ox + (src_cols << magnify), frame.width());
+			uint32_t const y0 = clamp(half_h - oy, frame.height());
+			uint32_t const y1 = clamp(half_h - oy + (src_rows << magnify), frame.height());
+			if (x0 >= x1 || y0 >= y1) {
+				frame.Fill(background);
+				return;
+			}
+			// outside of the world
+			frame.Fill(Position(0, 0), frame.width(), y0, background);
+			frame.Fill(Position(0, y1), frame.width(), frame.height() - y1, background);
+			frame.Fill(Position(0, y0), x0, y1 - y0, background);
+			frame.Fill(Position(x1, y0), frame.width() - x1, y1 - y0, background);
+			// first world pixel shown, at this level
+			uint32_t const wx = static_cast<uint32_t>(floor_shift(ox + int64_t(x0) - half_w, magnify));
+			uint32_t const wy = static_cast<uint32_t>(floor_shift(oy + int64_t(y0) - half_h, magnify));
+			uint32_t const *origin = src.get_pointer() + wy * src.get_pitch() + wx;
+			if (magnify == 0) {
+				frame.Blit(Position(x0, y0), x1 - x0, y1 - y0, origin, src.get_pitch());
+				return;
+			}
+			// nearest pixel: the phase of x0 in its block of 2^magnify pixels
+			uint32_t const phase_x = static_cast<uint32_t>((ox + int64_t(x0) - half_w) & ((1 << magnify) - 1));
+			uint32_t const phase_y = static_cast<uint32_t>((oy + int64_t(y0) - half_h) & ((1 << magnify) - 1));
+			uint32_t *dst = frame.data() + y0 * frame.pitch();
+			uint32_t const *previous = NULL;
+			for (uint32_t sy = y0; sy < y1; ++sy, dst += frame.pitch()) {
+				uint32_t const *line = origin + ((sy - y0 + phase_y) >> magnify) * src.get_pitch();
+				if (line == previous) {
+					// same world row as the frame row above
+					std::memcpy(dst + x0, dst - frame.pitch() + x0, (x1 - x0) * sizeof(uint32_t));
+					continue;
+				}
+				for (uint32_t sx = x0; sx < x1; ++sx) dst[sx] = line[(sx - x0 + phase_x) >> magnify];
+				previous = line;
+			}
+			frame.MarkDirty(Position(x0, y0), x1 - x0, y1 - y0);
+		}
+
+	}; // class Camera
+
+} // namespace rico
@@ -0,0 +1,397 @@
+/** rico/capture.hpp
+ *
+ * Recorder writes frames to disk without blocking the game loop.
+ *
+ * Submit copies a frame (every Nth one is kept) into one of a fixed pool of
+ * buffers and hands its index to a writer thread through a lock-free
+ * single producer / single consumer queue (SpscQueue); the writer encodes
+ * it and gives the buffer back through a second queue. When every buffer
+ * is in use, the frame is dropped instead of waiting: dropped frames are
+ * counted, and reported by the profiler (counter "capture dropped").
+ *
+ * Formats (pixels are read in PixelFormat, alpha is ignored):
+ * - RAW: a single file of rgb24 frames, back to back
+ *   (ffmpeg -f rawvideo -pix_fmt rgb24 -s WIDTHxHEIGHT -i FILE)
+ * - Y4M: a single YUV4MPEG2 file, 4:4:4, full range BT.601
+ * - PNG: one file per frame, named PATH<6 digits sequence number>.png
+ *   (stored deflate blocks: fast to write, not compressed)
+ */
+
+#pragma once
+
+#include "profiler.hpp"
+#include "pixel.hpp"
+#include "raster.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace rico {
+
+	/**
+	 * bounded lock-free queue, for exactly one producer thread and one
+	 * consumer thread
+	 */
+	template<typename T>
+	class SpscQueue {
+	private:
+
+		std::unique_ptr<T[]> slots;
+		size_t mask; // capacity - 1, capacity being a power of 2
+		alignas(64) std::atomic<size_t> head; // next slot to pop, written by the consumer
+		alignas(64) std::atomic<size_t> tail; // next slot to push, written by the producer
+
+	public:
+
+		/**
+		 * @param capacity maximal number of elements (rounded up to a power of 2)
+		 */
+		explicit SpscQueue(size_t capacity) :
+			mask(0),
+			head(0),
+			tail(0)
+		{
+			size_t size = 1;
+			while (size < capacity) size *= 2;
+			slots.reset(new T[size]);
+			mask = size - 1;
+		}
+
+		/**
+		 * @return false if the queue is full
+		 */
+		bool Push(T const& value) {
+			size_t position = tail.load(std::memory_order_relaxed);
+			if (position - head.load(std::memory_order_acquire) > mask) return false;
+			slots[position & mask] = value;
+			tail.store(position + 1, std::memory_order_release);
+			return true;
+		}
+
+		/**
+		 * @return false if the queue is empty
+		 */
+		bool Pop(T& value) {
+			size_t position = head.load(std::memory_order_relaxed);
+			if (position == tail.load(std::memory_order_acquire)) return false;
+			value = slots[position & mask];
+			head.store(position + 1, std::memory_order_release);
+			return true;
+		}
+
+	}; // class SpscQueue
+
+	enum class CaptureFormat {
+		RAW,
+		Y4M,
+		PNG
+	}; // enum class CaptureFormat
+
+	namespace detail {
+
+		inline uint32_t crc32(uint32_t crc, uint8_t const *data, size_t size) {
+			static uint32_t const *table = []() {
+				static uint32_t values[256];
+				for (uint32_t n = 0; n < 256; ++n) {
+					uint32_t c = n;
+					for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+					values[n] = c;
+				}
+				return values;
+			}();
+			crc = ~crc;
+			for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+			return ~crc;
+		}
+
+		inline uint32_t adler32(uint8_t const *data, size_t size) {
+			uint32_t a = 1, b = 0;
+			while (size > 0) {
+				// largest block before b can overflow
+				size_t block = std::min<size_t>(size, 5552);
+				for (size_t i = 0; i < block; ++i) {
+					a += data[i];
+					b += a;
+				}
+				a %= 65521;
+				b %= 65521;
+				data += block;
+				size -= block;
+			}
+			return (b << 16) | a;
+		}
+
+		inline void put_be32(std::vector<uint8_t>& out, uint32_t value) {
+			out.push_back(static_cast<uint8_t>(value >> 24));
+			out.push_back(static_cast<uint8_t>(value >> 16));
+			out.push_back(static_cast<uint8_t>(value >> 8));
+			out.push_back(static_cast<uint8_t>(value));
+		}
+
+		inline void png_chunk(std::ostream& os, char const *type, uint8_t const *data, size_t size) {
+			std::vector<uint8_t> header;
+			put_be32(header, static_cast<uint32_t>(size));
+			header.insert(header.end(), type, type + 4);
+			uint32_t crc = crc32(0, header.data() + 4, 4);
+			crc = crc32(crc, data, size);
+			std::vector<uint8_t> footer;
+			put_be32(footer, crc);
+			os.write(reinterpret_cast<char const*>(header.data()), header.size());
+			os.write(reinterpret_cast<char const*>(data), size);
+			os.write(reinterpret_cast<char const*>(footer.data()), footer.size());
+		}
+
+	} // namespace detail
+
+	class Recorder {
+	private:
+
+		CaptureFormat format;
+		std::string path;
+		uint32_t width, height;
+		uint32_t every; // keep one frame out of every
+		uint64_t submitted; // frames given to Submit
+
+		// buffers and their indices, free and waiting to be written
+		std::vector<std::vector<uint32_t>> buffers;
+		SpscQueue<uint32_t> available, filled;
+
+		std::atomic<uint64_t> written, dropped;
+		std::atomic<bool> failed;
+		uint32_t dropped_counter; // profiler counter
+
+		// writer thread, sleeping while there is nothing to write
+		std::ofstream stream; // RAW and Y4M
+		std::vector<uint8_t> bytes; // encoding scratch
+		std::vector<uint8_t> zlib;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::atomic<bool> stop;
+		std::thread writer; // last, started once everything else is ready
+
+		void Drop(void) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			Profiler::Get().Add(dropped_counter, 1);
+		}
+
+		void EncodeRgb(std::vector<uint32_t> const& frame) {
+			bytes.resize(static_cast<size_t>(width) * height * 3);
+			uint8_t *out = bytes.data();
+			for (uint32_t pixel : frame) {
+				*out++ = PixelFormat::red(pixel);
+				*out++ = PixelFormat::green(pixel);
+				*out++ = PixelFormat::blue(pixel);
+			}
+			stream.write(reinterpret_cast<char const*>(bytes.data()), bytes.size());
+		}
+
+		void EncodeY4m(std::vector<uint32_t> const& frame) {
+			size_t plane = static_cast<size_t>(width) * height;
+			bytes.resize(plane * 3);
+			for (size_t i = 0; i < plane; ++i) {
+				int32_t r = PixelFormat::red(frame[i]), g = PixelFormat::green(frame[i]), b = PixelFormat::blue(frame[i]);
+				// offsets keep the sums positive, (x + 32896) >> 8 == round(x / 256) + 128
+				bytes[i] = static_cast<uint8_t>((77 * r + 150 * g + 29 * b + 128) >> 8);
+				bytes[plane + i] = static_cast<uint8_t>(std::min((-43 * r - 85 * g + 128 * b + 32896) >> 8, 255));
+				bytes[2 * plane + i] = static_cast<uint8_t>(std::min((128 * r - 107 * g - 21 * b + 32896) >> 8, 255));
+			}
+			stream << "FRAME\n";
+			stream.write(reinterpret_cast<char const*>(bytes.data()), bytes.size());
+		}
+
+		void EncodePng(std::vector<uint32_t> const& frame, uint64_t sequence) {
+			// scanlines: filter type 0 then rgb24 pixels
+			size_t line = static_cast<size_t>(width) * 3 + 1;
+			bytes.resize(line * height);
+			for (uint32_t y = 0; y < height; ++y) {
+				uint8_t *out = bytes.data() + y * line;
+				*out++ = 0;
+				for (uint32_t x = 0; x < width; ++x) {
+					uint32_t pixel = frame[static_cast<size_t>(y) * width + x];
+					*out++ = PixelFormat::red(pixel);
+					*out++ = PixelFormat::green(pixel);
+					*out++ = PixelFormat::blue(pixel);
+				}
+			}
+			// zlib stream made of stored deflate blocks
+			zlib.clear();
+			zlib.push_back(0x78);
+			zlib.push_back(0x01);
+			size_t offset = 0;
+			do {
+				size_t size = std::min<size_t>(bytes.size() - offset, 65535);
+				bool last = (offset + size == bytes.size());
+				zlib.push_back(last ? 1 : 0);
+				zlib.push_back(static_cast<uint8_t>(size));
+				zlib.push_back(static_cast<uint8_t>(size >> 8));
+				zlib.push_back(static_cast<uint8_t>(~size));
+				zlib.push_back(static_cast<uint8_t>(~size >> 8));
+				zlib.insert(zlib.end(), bytes.begin() + offset, bytes.begin() + offset + size);
+				offset += size;
+			} while (offset < bytes.size());
+			detail::put_be32(zlib, detail::adler32(bytes.data(), bytes.size()));
+
+			char number[24];
+			std::snprintf(number, sizeof(number), "%06llu.png", static_cast<unsigned long long>(sequence));
+			std::ofstream file(path + number, std::ios::binary);
+			static uint8_t const signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+			file.write(reinterpret_cast<char const*>(signature), sizeof(signature));
+			std::vector<uint8_t> header;
+			detail::put_be32(header, width);
+			detail::put_be32(header, height);
+			header.push_back(8); // bits per channel
+			header.push_back(2); // truecolor
+			header.push_back(0); // deflate
+			header.push_back(0); // adaptive filtering
+			header.push_back(0); // no interlace
+			detail::png_chunk(file, "IHDR", header.data(), header.size());
+			detail::png_chunk(file, "IDAT", zlib.data(), zlib.size());
+			detail::png_chunk(file, "IEND", NULL, 0);
+			if (!file) throw std::runtime_error("cannot write " + path + number);
+		}
+
+		void Write(uint32_t index) {
+			RICO_PROFILE("capture encode");
+			if (failed.load(std::memory_order_relaxed)) {
+				Drop();
+				return;
+			}
+			try {
+				uint64_t sequence = written.load(std::memory_order_relaxed);
+				switch (format) {
+					case CaptureFormat::RAW: EncodeRgb(buffers[index]); break;
+					case CaptureFormat::Y4M: EncodeY4m(buffers[index]); break;
+					case CaptureFormat::PNG: EncodePng(buffers[index], sequence); break;
+				}
+				if (format != CaptureFormat::PNG && !stream) throw std::runtime_error("cannot write " + path);
+				written.store(sequence + 1, std::memory_order_relaxed);
+			} catch (std::exception const&) {
+				failed.store(true, std::memory_order_relaxed);
+				Drop();
+			}
+		}
+
+		void WriterLoop(void) {
+			while (true) {
+				bool stopping = stop.load(std::memory_order_acquire);
+				uint32_t index;
+				while (filled.Pop(index)) {
+					Write(index);
+					available.Push(index);
+				}
+				if (stopping) return;
+				std::unique_lock<std::mutex> lock(mutex);
+				// Submit does not lock the mutex, a wake up can be missed
+				wake.wait_for(lock, std::chrono::milliseconds(2));
+			}
+		}
+
+	public:
+
+		/**
+		 * open the output and start the writer thread
+		 * @param _path output file (RAW, Y4M) or prefix of the files (PNG)
+		 * @param _format output format
+		 * @param _width width of the frames, in pixels
+		 * @param _height height of the frames, in pixels
+		 * @param _every keep one frame out of _every
+		 * @param fps frame rate of the kept frames, written in Y4M header
+		 * @param buffer_count number of frames that can wait to be written
+		 */
+		Recorder(
+			std::string _path,
+			CaptureFormat _format,
+			uint32_t _width,
+			uint32_t _height,
+			uint32_t _every = 1,
+			double fps = 60.0,
+			uint32_t buffer_count = 8)
+			: format(_format), path(std::move(_path)),
+			width(_width), height(_height),
+			every(std::max(_every, 1u)),
+			submitted(0),
+			buffers(std::max(buffer_count, 1u)),
+			available(buffers.size()), filled(buffers.size()),
+			written(0), dropped(0), failed(false),
+			dropped_counter(Profiler::Get().RegisterCounter("capture dropped")),
+			stop(false)
+		{
+			if (width == 0 || height == 0) throw std::invalid_argument("empty frames");
+			for (uint32_t i = 0; i < buffers.size(); ++i) {
+				buffers[i].resize(static_cast<size_t>(width) * height);
+				available.Push(i);
+			}
+			if (format != CaptureFormat::PNG) {
+				stream.open(path, std::ios::binary);
+				if (!stream) throw std::runtime_error("cannot open " + path);
+			}
+			if (format == CaptureFormat::Y4M) {
+				// frame rate as a fraction, to the thousandth
+				uint64_t numerator = static_cast<uint64_t>(std::max(fps, 0.001) * 1000.0 + 0.5);
+				stream << "YUV4MPEG2 W" << width << " H" << height
+					<< " F" << numerator << ":1000 Ip A1:1 C444 XCOLORRANGE=FULL\n";
+			}
+			writer = std::thread(&Recorder::WriterLoop, this);
+		}
+
+		~Recorder(void) noexcept {
+			Close();
+		}
+
+		/**
+		 * write the frames still waiting, then stop the writer thread
+		 * later frames are dropped
+		 */
+		void Close(void) {
+			if (!writer.joinable()) return;
+			stop.store(true, std::memory_order_release);
+			wake.notify_one();
+			writer.join();
+			failed.store(true, std::memory_order_relaxed);
+			stream.close();
+		}
+
+		Recorder(Recorder const&) = delete;
+		Recorder& operator=(Recorder const&) = delete;
+
+		/**
+		 * queue a frame to be written (if it is one of the frames kept), never
+		 * waits: the frame is dropped if every buffer is in use
+		 * must always be called from the same thread
+		 * @param pixels frame of width x height pixels
+		 * @param pitch pixels per row of pixels
+		 */
+		void Submit(uint32_t const *pixels, size_t pitch) {
+			if (submitted++ % every != 0) return;
+			RICO_PROFILE("capture");
+			uint32_t index;
+			if (failed.load(std::memory_order_relaxed) || !available.Pop(index)) {
+				Drop();
+				return;
+			}
+			raster::copy(buffers[index].data(), width, pixels, pitch, width, height);
+			filled.Push(index); // never full, there are as many slots as buffers
+			wake.notify_one();
+		}
+
+		uint64_t Written(void) const { return written.load(std::memory_order_relaxed); }
+		uint64_t Dropped(void) const { return dropped.load(std::memory_order_relaxed); }
+
+		/**
+		 * @return true if writing failed (later frames are dropped)
+		 */
+		bool Failed(void) const { return failed.load(std::memory_order_relaxed); }
+
+	}; // class Recorder
+
+} // namespace rico
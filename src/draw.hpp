@@ -0,0 +1,251 @@
+/** rico/draw.hpp
+ *
+ * DrawList collects drawing commands (lines, rectangles and circles, as
+ * outlines or filled, and sprites) as plain data during a frame, and
+ * rasterizes all of them at once with Render.
+ *
+ * Coordinates are signed: commands may be partly (or fully) outside of the
+ * frame, they are clipped. Corners and end points are included: a rectangle
+ * from (0, 0) to (2, 2) covers 3 x 3 pixels, a circle of radius r centered
+ * on (x, y) spans [x - r, x + r] on both axes. A sprite is given by its
+ * top-left pixel, and only referenced: it must outlive the Render.
+ *
+ * Render splits the frame in tiles of TILE x TILE pixels and buckets the
+ * commands by the tiles their bounding box overlaps (counting sort, the
+ * arrays are reused from one frame to the next). Tiles are then rasterized
+ * in parallel on the thread pool, each one running its commands in the
+ * order they were added and clipped to the tile, so the result is the same
+ * as drawing them one after the other. Pixels are written straight into the
+ * FrameBuffer by the shape rasterizers of raster.hpp, which give the same
+ * pixels whatever the clip (a tile can start in the middle of a line).
+ *
+ * Bounding boxes are marked dirty before rasterizing.
+ */
+
+#pragma once
+
+#include "rico.hpp"
+#include "sprite.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace rico {
+
+	class DrawList {
+	public:
+
+		static constexpr uint32_t TILE = 128; // side of a tile, in pixels
+
+		enum class Kind : uint8_t {
+			LINE, // from (x0, y0) to (x1, y1)
+			RECT, // outline of the rectangle of corners (x0, y0) and (x1, y1)
+			FILL_RECT, // the same, filled
+			CIRCLE, // outline of the circle centered on (x0, y0), of radius x1
+			FILL_CIRCLE, // the same, filled (only inside of the outline if y1 != 0)
+			SPRITE // sprite with its top-left pixel at (x0, y0), bottom-right at (x1, y1)
+		}; // enum class DrawList::Kind
+
+		struct Command {
+			Kind kind;
+			int32_t x0, y0, x1, y1;
+			uint32_t color;
+			Sprite const *sprite; // SPRITE only
+		}; // struct DrawList::Command
+
+	private:
+
+		// inclusive bounds
+		struct Box {
+			int32_t x0, y0, x1, y1;
+		}; // struct DrawList::Box
+
+		std::vector<Command> commands;
+		std::vector<Box> boxes; // bounding box of each command
+		// buckets of the last Render, reused
+		std::vector<uint32_t> offsets; // first entry of each tile, count + 1 elements
+		std::vector<uint32_t> entries; // command indices, by tile
+		std::vector<uint32_t> busy; // tiles with at least one command
+
+		// saturated to int32, the box is clipped to the frame anyway
+		static int32_t Narrow(int64_t value) {
+			return static_cast<int32_t>(std::max<int64_t>(INT32_MIN, std::min<int64_t>(value, INT32_MAX)));
+		}
+
+		static Box Bounds(Command const& command) {
+			int64_t const x = command.x0, y = command.y0, radius = command.x1;
+			switch (command.kind) {
+				case Kind::CIRCLE:
+				case Kind::FILL_CIRCLE:
+					return Box { Narrow(x - radius), Narrow(y - radius), Narrow(x + radius), Narrow(y + radius) };
+				default:
+					return Box {
+						std::min(command.x0, command.x1), std::min(command.y0, command.y1),
+						std::max(command.x0, command.x1), std::max(command.y0, command.y1) };
+			}
+		}
+
+		static void Rasterize(uint32_t *pixels, size_t pitch, raster::Clip const& clip, Command const& c) {
+			switch (c.kind) {
+				case Kind::LINE: raster::draw_line(pixels, pitch, clip, c.x0, c.y0, c.x1, c.y1, c.color); break;
+				case Kind::RECT: raster::draw_rect(pixels, pitch, clip, c.x0, c.y0, c.x1, c.y1, c.color); break;
+				case Kind::FILL_RECT: raster::fill_rect(pixels, pitch, clip, c.x0, c.y0, c.x1, c.y1, c.color); break;
+				case Kind::CIRCLE: raster::draw_circle(pixels, pitch, clip, c.x0, c.y0, c.x1, c.color); break;
+				case Kind::FILL_CIRCLE: raster::fill_circle(pixels, pitch, clip, c.x0, c.y0, c.x1, c.color, c.y1 != 0); break;
+				case Kind::SPRITE: c.sprite->Draw(pixels, pitch, clip, c.x0, c.y0); break;
+			}
+		}
+
+		void Add(Kind kind, int32_t x0, int32_t y0, int32_t x1, int32_t y1, Color color) {
+			Command command = { kind, x0, y0, x1, y1, uint32_t(color), NULL };
+			commands.push_back(command);
+			boxes.push_back(Bounds(command));
+		}
+
+	public:
+
+		void AddLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, Color color) {
+			Add(Kind::LINE, x0, y0, x1, y1, color);
+		}
+
+		void AddRect(int32_t x0, int32_t y0, int32_t x1, int32_t y1, Color color) {
+			Add(Kind::RECT, x0, y0, x1, y1, color);
+		}
+
+		void AddFillRect(int32_t x0, int32_t y0, int32_t x1, int32_t y1, Color color) {
+			Add(Kind::FILL_RECT, x0, y0, x1, y1, color);
+		}
+
+		// a negative radius draws nothing
+		void AddCircle(int32_t x, int32_t y, int32_t radius, Color color) {
+			if (radius >= 0) Add(Kind::CIRCLE, x, y, radius, 0, color);
+		}
+
+		void AddFillCircle(int32_t x, int32_t y, int32_t radius, Color color) {
+			if (radius >= 0) Add(Kind::FILL_CIRCLE, x, y, radius, 0, color);
+		}
+
+		// an empty sprite draws nothing, the bottom-right corner saturates (only the box uses it)
+		void AddSprite(Sprite const& sprite, int32_t x, int32_t y) {
+			if (sprite.get_width() == 0 || sprite.get_height() == 0) return;
+			Command command = { Kind::SPRITE, x, y,
+				Narrow(int64_t(x) + sprite.get_width() - 1), Narrow(int64_t(y) + sprite.get_height() - 1), 0, &sprite };
+			commands.push_back(command);
+			boxes.push_back(Bounds(command));
+		}
+
+		/**
+		 * the line from line.start to line.stop
+		 */
+		void Add(rico::Line const& line) {
+			AddLine(
+				signed_coordinate(line.start.x), signed_coordinate(line.start.y),
+				signed_coordinate(line.stop.x), signed_coordinate(line.stop.y),
+				line.outline);
+		}
+
+		/**
+		 * the outline of rectangle, and its interior
+		 */
+		void Add(rico::Rectangle const& rectangle) {
+			int32_t x0 = signed_coordinate(rectangle.top_left.x), y0 = signed_coordinate(rectangle.top_left.y);
+			int32_t x1 = signed_coordinate(rectangle.bottom_right.x), y1 = signed_coordinate(rectangle.bottom_right.y);
+			if (uint32_t(rectangle.outline) == uint32_t(rectangle.fill)) {
+				AddFillRect(x0, y0, x1, y1, rectangle.fill);
+				return;
+			}
+			AddRect(x0, y0, x1, y1, rectangle.outline);
+			if (x1 - x0 >= 2 && y1 - y0 >= 2) AddFillRect(x0 + 1, y0 + 1, x1 - 1, y1 - 1, rectangle.fill);
+		}
+
+		/**
+		 * the outline of circle, and its interior
+		 */
+		void Add(rico::Circle const& circle) {
+			int32_t x = signed_coordinate(circle.center.x), y = signed_coordinate(circle.center.y);
+			int32_t radius = signed_coordinate(circle.radius);
+			if (uint32_t(circle.outline) == uint32_t(circle.fill)) {
+				AddFillCircle(x, y, radius, circle.fill);
+				return;
+			}
+			AddCircle(x, y, radius, circle.outline);
+			Add(Kind::FILL_CIRCLE, x, y, radius, 1, circle.fill);
+		}
+
+		uint32_t Size(void) const {
+			return static_cast<uint32_t>(commands.size());
+		}
+
+		Command const& operator[](uint32_t index) const {
+			return commands[index];
+		}
+
+		void Clear(void) {
+			commands.clear();
+			boxes.clear();
+		}
+
+		/**
+		 * rasterize the commands into frame, then clear them
+		 * @param pool thread pool rasterizing the tiles, NULL to stay on this thread
+		 */
+		void Render(FrameBuffer const& frame, ThreadPool *pool = NULL) {
+			RICO_PROFILE("draw list");
+			int32_t const width = static_cast<int32_t>(frame.width()), height = static_cast<int32_t>(frame.height());
+			uint32_t const cols = (frame.width() + TILE - 1) / TILE, rows = (frame.height() + TILE - 1) / TILE;
+			uint32_t const n = Size();
+			// clip the bounding boxes to the frame (dropping the commands fully off it), mark them dirty and count the commands of each tile
+			offsets.assign(cols * rows + 1, 0);
+			for (uint32_t i = 0; i < n; ++i) {
+				Box& box = boxes[i];
+				box.x0 = std::max(box.x0, 0);
+				box.y0 = std::max(box.y0, 0);
+				box.x1 = std::min(box.x1, width - 1);
+				box.y1 = std::min(box.y1, height - 1);
+				if (box.x0 > box.x1 || box.y0 > box.y1) continue;
+				frame.MarkDirty(Position(box.x0, box.y0), box.x1 - box.x0 + 1, box.y1 - box.y0 + 1);
+				for (uint32_t ty = box.y0 / TILE; ty <= box.y1 / TILE; ++ty) {
+					for (uint32_t tx = box.x0 / TILE; tx <= box.x1 / TILE; ++tx) ++offsets[ty * cols + tx + 1];
+				}
+			}
+			// prefix sum, then fill the buckets in order
+			busy.clear();
+			for (uint32_t tile = 0; tile < cols * rows; ++tile) {
+				if (offsets[tile + 1] != 0) busy.push_back(tile);
+				offsets[tile + 1] += offsets[tile];
+			}
+			entries.resize(offsets[cols * rows]);
+			for (uint32_t i = 0; i < n; ++i) {
+				Box const& box = boxes[i];
+				if (box.x0 > box.x1 || box.y0 > box.y1) continue;
+				for (uint32_t ty = box.y0 / TILE; ty <= box.y1 / TILE; ++ty) {
+					for (uint32_t tx = box.x0 / TILE; tx <= box.x1 / TILE; ++tx) entries[offsets[ty * cols + tx]++] = i;
+				}
+			}
+			// offsets[tile] is now the end of tile, and the beginning of tile + 1
+			auto pass = [&](uint32_t index) {
+				uint32_t tile = busy[index];
+				int32_t x = static_cast<int32_t>((tile % cols) * TILE), y = static_cast<int32_t>((tile / cols) * TILE);
+				raster::Clip clip = { x, y, std::min(x + int32_t(TILE), width), std::min(y + int32_t(TILE), height) };
+				uint32_t begin = (tile == 0) ? 0 : offsets[tile - 1];
+				for (uint32_t k = begin; k < offsets[tile]; ++k) Rasterize(frame.data(), frame.pitch(), clip, commands[entries[k]]);
+			};
+			uint32_t const count = static_cast<uint32_t>(busy.size());
+			if (pool != NULL) {
+				pool->ParallelFor(count, pass);
+			} else {
+				for (uint32_t index = 0; index < count; ++index) pass(index);
+			}
+			Clear();
+		}
+
+		/**
+		 * rasterize the commands into the frame of the engine, on its thread pool
+		 */
+		void Render(void) {
+			Render(GameEngine::GetFrameBuffer(), &GameEngine::GetThreadPool());
+		}
+
+	}; // class DrawList
+
+} // namespace rico
@@ -0,0 +1,592 @@
+/** rico/gpu.hpp
+ *
+ * GpuPresenter is the OpenGL backend of GameEngine (see
+ * GameEngine::SetBackend): it replaces the SDL renderer and its streaming
+ * texture by an OpenGL 3.3 core context, and keeps the frame in textures
+ * that stay on the GPU between frames.
+ *
+ * The functions of OpenGL are loaded at runtime through SDL (nothing else
+ * to link than -lSDL2), only the few used here are declared.
+ *
+ * Passes, each one a triangle covering its target and a fragment shader
+ * reading its sources with texelFetch (no filtering, exact results):
+ * present = stretch the frame to the window, by an integer factor (the
+ *   macro pixels), the rows of the frame going down
+ * lookup = present, the frame being 8 bits indices (indexed mode, a
+ *   quarter of the upload) looked up in a 256 x 1 palette texture
+ * compose = canvas mode: fade the canvas (saturating subtraction) and blend
+ *   the frame over it, with the rounding of raster::blend, into the second
+ *   canvas (ping-pong), then the frame texture is cleared (transparent)
+ *   the CPU only uploads the tiles drawn to, and never touches the canvas
+ *
+ * Textures hold the rows of the frame from the bottom up (row 0 of the frame
+ * is row 0 of the texture), so that uploads and read backs are plain pitched
+ * copies, and only present flips the picture.
+ */
+
+#pragma once
+
+#include <SDL2/SDL.h> // link with -lSDL2
+#include "pixel.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace rico {
+
+	namespace gl {
+
+		using GLenum = unsigned int;
+		using GLuint = unsigned int;
+		using GLint = int;
+		using GLsizei = int;
+		using GLbitfield = unsigned int;
+		using GLfloat = float;
+		using GLchar = char;
+
+		constexpr GLenum TEXTURE_2D = 0x0DE1;
+		constexpr GLenum TEXTURE0 = 0x84C0;
+		constexpr GLenum TEXTURE_MIN_FILTER = 0x2801;
+		constexpr GLenum TEXTURE_MAG_FILTER = 0x2800;
+		constexpr GLenum TEXTURE_WRAP_S = 0x2802;
+		constexpr GLenum TEXTURE_WRAP_T = 0x2803;
+		constexpr GLint NEAREST = 0x2600;
+		constexpr GLint CLAMP_TO_EDGE = 0x812F;
+		constexpr GLint RGBA8 = 0x8058;
+		constexpr GLint R8 = 0x8229;
+		constexpr GLenum RED = 0x1903;
+		constexpr GLenum RGBA = 0x1908;
+		constexpr GLenum BGRA = 0x80E1;
+		constexpr GLenum UNSIGNED_BYTE = 0x1401;
+		constexpr GLenum UNSIGNED_INT_8_8_8_8 = 0x8035;
+		constexpr GLenum UNSIGNED_INT_8_8_8_8_REV = 0x8367;
+		constexpr GLenum UNPACK_ROW_LENGTH = 0x0CF2;
+		constexpr GLenum UNPACK_ALIGNMENT = 0x0CF5;
+		constexpr GLenum PACK_ROW_LENGTH = 0x0D02;
+		constexpr GLenum PACK_ALIGNMENT = 0x0D05;
+		constexpr GLenum FRAMEBUFFER = 0x8D40;
+		constexpr GLenum COLOR_ATTACHMENT0 = 0x8CE0;
+		constexpr GLenum FRAMEBUFFER_COMPLETE = 0x8CD5;
+		constexpr GLbitfield COLOR_BUFFER_BIT = 0x4000;
+		constexpr GLenum TRIANGLES = 0x0004;
+		constexpr GLenum VERTEX_SHADER = 0x8B31;
+		constexpr GLenum FRAGMENT_SHADER = 0x8B30;
+		constexpr GLenum COMPILE_STATUS = 0x8B81;
+		constexpr GLenum LINK_STATUS = 0x8B82;
+		constexpr GLenum INFO_LOG_LENGTH = 0x8B84;
+
+		/**
+		 * entry points of OpenGL, loaded from the current context
+		 */
+		struct Functions {
+
+			void (*ActiveTexture)(GLenum);
+			void (*AttachShader)(GLuint, GLuint);
+			void (*BindFramebuffer)(GLenum, GLuint);
+			void (*BindTexture)(GLenum, GLuint);
+			void (*BindVertexArray)(GLuint);
+			GLenum (*CheckFramebufferStatus)(GLenum);
+			void (*Clear)(GLbitfield);
+			void (*ClearColor)(GLfloat, GLfloat, GLfloat, GLfloat);
+			void (*CompileShader)(GLuint);
+			GLuint (*CreateProgram)(void);
+			GLuint (*CreateShader)(GLenum);
+			void (*DeleteFramebuffers)(GLsizei, GLuint const*);
+			void (*DeleteProgram)(GLuint);
+			void (*DeleteShader)(GLuint);
+			void (*DeleteTextures)(GLsizei, GLuint const*);
+			void (*DeleteVertexArrays)(GLsizei, GLuint const*);
+			void (*DrawArrays)(GLenum, GLint, GLsizei);
+			void (*FramebufferTexture2D)(GLenum, GLenum, GLenum, GLuint, GLint);
+			void (*GenFramebuffers)(GLsizei, GLuint*);
+			void (*GenTextures)(GLsizei, GLuint*);
+			void (*GenVertexArrays)(GLsizei, GLuint*);
+			void (*GetProgramInfoLog)(GLuint, GLsizei, GLsizei*, GLchar*);
+			void (*GetProgramiv)(GLuint, GLenum, GLint*);
+			void (*GetShaderInfoLog)(GLuint, GLsizei, GLsizei*, GLchar*);
+			void (*GetShaderiv)(GLuint, GLenum, GLint*);
+			GLint (*GetUniformLocation)(GLuint, GLchar const*);
+			void (*LinkProgram)(GLuint);
+			void (*PixelStorei)(GLenum, GLint);
+			void (*ReadPixels)(GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, void*);
+			void (*ShaderSource)(GLuint, GLsizei, GLchar const* const*, GLint const*);
+			void (*TexImage2D)(GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, void const*);
+			void (*TexParameteri)(GLenum, GLenum, GLint);
+			void (*TexSubImage2D)(GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, void const*);
+			void (*Uniform1i)(GLint, GLint);
+			void (*Uniform2i)(GLint, GLint, GLint);
+			void (*Uniform3f)(GLint, GLfloat, GLfloat, GLfloat);
+			void (*UseProgram)(GLuint);
+			void (*Viewport)(GLint, GLint, GLsizei, GLsizei);
+
+			template<typename F>
+			static void Load(F*& function, char const *name) {
+				function = reinterpret_cast<F*>(SDL_GL_GetProcAddress(name));
+				if (function == NULL) throw std::runtime_error(std::string("missing OpenGL function ") + name);
+			}
+
+			/**
+			 * @throw if an entry point is missing
+			 */
+			void LoadAll(void) {
+				Load(ActiveTexture, "glActiveTexture");
+				Load(AttachShader, "glAttachShader");
+				Load(BindFramebuffer, "glBindFramebuffer");
+				Load(BindTexture, "glBindTexture");
+				Load(BindVertexArray, "glBindVertexArray");
+				Load(CheckFramebufferStatus, "glCheckFramebufferStatus");
+				Load(Clear, "glClear");
+				Load(ClearColor, "glClearColor");
+				Load(CompileShader, "glCompileShader");
+				Load(CreateProgram, "glCreateProgram");
+				Load(CreateShader, "glCreateShader");
+				Load(DeleteFramebuffers, "glDeleteFramebuffers");
+				Load(DeleteProgram, "glDeleteProgram");
+				Load(DeleteShader, "glDeleteShader");
+				Load(DeleteTextures, "glDeleteTextures");
+				Load(DeleteVertexArrays, "glDeleteVertexArrays");
+				Load(DrawArrays, "glDrawArrays");
+				Load(FramebufferTexture2D, "glFramebufferTexture2D");
+				Load(GenFramebuffers, "glGenFramebuffers");
+				Load(GenTextures, "glGenTextures");
+				Load(GenVertexArrays, "glGenVertexArrays");
+				Load(GetProgramInfoLog, "glGetProgramInfoLog");
+				Load(GetProgramiv, "glGetProgramiv");
+				Load(GetShaderInfoLog, "glGetShaderInfoLog");
+				Load(GetShaderiv, "glGetShaderiv");
+				Load(GetUniformLocation, "glGetUniformLocation");
+				Load(LinkProgram, "glLinkProgram");
+				Load(PixelStorei, "glPixelStorei");
+				Load(ReadPixels, "glReadPixels");
+				Load(ShaderSource, "glShaderSource");
+				Load(TexImage2D, "glTexImage2D");
+				Load(TexParameteri, "glTexParameteri");
+				Load(TexSubImage2D, "glTexSubImage2D");
+				Load(Uniform1i, "glUniform1i");
+				Load(Uniform2i, "glUniform2i");
+				Load(Uniform3f, "glUniform3f");
+				Load(UseProgram, "glUseProgram");
+				Load(Viewport, "glViewport");
+			}
+
+		}; // struct Functions
+
+		// a triangle covering the viewport, without any vertex buffer
+		constexpr char const *FULLSCREEN_VERTEX = R"(#version 330 core
+void main() {
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+		// stretch image (or look indices up in palette) to the viewport,
+		// placed at origin, each texel covering scale x scale fragments
+		constexpr char const *PRESENT_FRAGMENT = R"(#version 330 core
+uniform sampler2D image;
+uniform sampler2D indices;
+uniform sampler2D palette;
+uniform bool lookup;
+uniform ivec2 origin;
+uniform int scale;
+uniform int rows;
+out vec4 color;
+void main() {
+	ivec2 texel = (ivec2(gl_FragCoord.xy) - origin) / scale;
+	texel.y = rows - 1 - texel.y;
+	if (lookup) {
+		int index = int(texelFetch(indices, texel, 0).r * 255.0 + 0.5);
+		color = texelFetch(palette, ivec2(index, 0), 0);
+	} else {
+		color = texelFetch(image, texel, 0);
+	}
+}
+)";
+
+		// out = (src * a + max(dst - fade, 0) * (255 - a)) / 255, rounded,
+		// the alpha of src being used as 255 (see raster::blend)
+		constexpr char const *COMPOSE_FRAGMENT = R"(#version 330 core
+uniform sampler2D canvas;
+uniform sampler2D layer;
+uniform vec3 fade;
+out vec4 color;
+void main() {
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	vec4 dst = floor(texelFetch(canvas, texel, 0) * 255.0 + 0.5);
+	vec4 src = floor(texelFetch(layer, texel, 0) * 255.0 + 0.5);
+	dst.rgb = max(dst.rgb - fade, 0.0);
+	float a = src.a;
+	src.a = 255.0;
+	color = floor((src * a + dst * (255.0 - a)) / 255.0 + 0.5) / 255.0;
+}
+)";
+
+	} // namespace gl
+
+	/**
+	 * OpenGL presentation of the frame, see the top of this file
+	 * must be created, used and destroyed by the thread of the window
+	 */
+	class GpuPresenter {
+	private:
+
+		// upload format of the 32 bits pixels, in native byte order
+		static constexpr bool RGBA_ORDER = std::is_same<PixelFormat, pixel::RGBA8888>::value;
+		static constexpr gl::GLenum FORMAT = RGBA_ORDER ? gl::RGBA : gl::BGRA;
+		static constexpr gl::GLenum TYPE = RGBA_ORDER ? gl::UNSIGNED_INT_8_8_8_8 : gl::UNSIGNED_INT_8_8_8_8_REV;
+
+		SDL_Window *window;
+		SDL_GLContext context;
+		gl::Functions gl;
+		bool loaded; // every entry point of gl was found
+		uint32_t width, height; // of the frame
+		gl::GLuint vao;
+		gl::GLuint present_program, compose_program;
+		gl::GLint present_lookup, present_origin, present_scale, present_rows, compose_fade;
+		// the frame (pixels, or indices and their palette)
+		gl::GLuint frame, indices, palette;
+		// canvas mode: the frame is cleared through its framebuffer, and the
+		// canvas alternates between two textures
+		bool canvas;
+		gl::GLuint frame_fbo;
+		gl::GLuint canvases[2], canvas_fbos[2];
+		uint32_t current; // canvas holding the picture
+
+		gl::GLuint Compile(gl::GLenum type, char const *source) {
+			gl::GLuint shader = gl.CreateShader(type);
+			gl.ShaderSource(shader, 1, &source, NULL);
+			gl.CompileShader(shader);
+			gl::GLint status = 0;
+			gl.GetShaderiv(shader, gl::COMPILE_STATUS, &status);
+			if (status == 0) {
+				gl::GLint length = 0;
+				gl.GetShaderiv(shader, gl::INFO_LOG_LENGTH, &length);
+				std::string log(static_cast<size_t>(std::max(length, 1)), '\0');
+				gl.GetShaderInfoLog(shader, length, NULL, &log[0]);
+				gl.DeleteShader(shader);
+				throw std::runtime_error("shader compilation failed: " + log);
+			}
+			return shader;
+		}
+
+		gl::GLuint Link(char const *fragment_source) {
+			gl::GLuint vertex = Compile(gl::VERTEX_SHADER, gl::FULLSCREEN_VERTEX);
+			gl::GLuint fragment;
+			try {
+				fragment = Compile(gl::FRAGMENT_SHADER, fragment_source);
+			} catch (...) {
+				gl.DeleteShader(vertex);
+				throw;
+			}
+			gl::GLuint program = gl.CreateProgram();
+			gl.AttachShader(program, vertex);
+			gl.AttachShader(program, fragment);
+			gl.LinkProgram(program);
+			// flagged for deletion, deleted with the program
+			gl.DeleteShader(vertex);
+			gl.DeleteShader(fragment);
+			gl::GLint status = 0;
+			gl.GetProgramiv(program, gl::LINK_STATUS, &status);
+			if (status == 0) {
+				gl::GLint length = 0;
+				gl.GetProgramiv(program, gl::INFO_LOG_LENGTH, &length);
+				std::string log(static_cast<size_t>(std::max(length, 1)), '\0');
+				gl.GetProgramInfoLog(program, length, NULL, &log[0]);
+				gl.DeleteProgram(program);
+				throw std::runtime_error("shader link failed: " + log);
+			}
+			return program;
+		}
+
+		// bind the samplers of program to the texture units 0, 1, 2...
+		void Samplers(gl::GLuint program, char const *first, char const *second = NULL, char const *third = NULL) {
+			gl.UseProgram(program);
+			char const *names[3] = { first, second, third };
+			for (gl::GLint unit = 0; unit < 3; ++unit) {
+				if (names[unit] != NULL) gl.Uniform1i(gl.GetUniformLocation(program, names[unit]), unit);
+			}
+		}
+
+		gl::GLuint CreateTexture(gl::GLint internal, uint32_t w, uint32_t h, gl::GLenum format, gl::GLenum type) {
+			gl::GLuint texture = 0;
+			gl.GenTextures(1, &texture);
+			gl.BindTexture(gl::TEXTURE_2D, texture);
+			// no mipmaps: the texture is complete with nearest filtering
+			gl.TexParameteri(gl::TEXTURE_2D, gl::TEXTURE_MIN_FILTER, gl::NEAREST);
+			gl.TexParameteri(gl::TEXTURE_2D, gl::TEXTURE_MAG_FILTER, gl::NEAREST);
+			gl.TexParameteri(gl::TEXTURE_2D, gl::TEXTURE_WRAP_S, gl::CLAMP_TO_EDGE);
+			gl.TexParameteri(gl::TEXTURE_2D, gl::TEXTURE_WRAP_T, gl::CLAMP_TO_EDGE);
+			gl.TexImage2D(gl::TEXTURE_2D, 0, internal, static_cast<gl::GLsizei>(w), static_cast<gl::GLsizei>(h), 0, format, type, NULL);
+			return texture;
+		}
+
+		gl::GLuint CreateFramebuffer(gl::GLuint texture) {
+			gl::GLuint fbo = 0;
+			gl.GenFramebuffers(1, &fbo);
+			gl.BindFramebuffer(gl::FRAMEBUFFER, fbo);
+			gl.FramebufferTexture2D(gl::FRAMEBUFFER, gl::COLOR_ATTACHMENT0, gl::TEXTURE_2D, texture, 0);
+			gl::GLenum status = gl.CheckFramebufferStatus(gl::FRAMEBUFFER);
+			gl.BindFramebuffer(gl::FRAMEBUFFER, 0);
+			if (status != gl::FRAMEBUFFER_COMPLETE) {
+				gl.DeleteFramebuffers(1, &fbo);
+				throw std::runtime_error("incomplete OpenGL framebuffer");
+			}
+			return fbo;
+		}
+
+		void ClearFramebuffer(gl::GLuint fbo, gl::GLfloat alpha) {
+			gl.BindFramebuffer(gl::FRAMEBUFFER, fbo);
+			gl.Viewport(0, 0, static_cast<gl::GLsizei>(width), static_cast<gl::GLsizei>(height));
+			gl.ClearColor(0.0f, 0.0f, 0.0f, alpha);
+			gl.Clear(gl::COLOR_BUFFER_BIT);
+		}
+
+		void CreateCanvas(void) {
+			frame_fbo = CreateFramebuffer(frame);
+			for (uint32_t i = 0; i < 2; ++i) {
+				canvases[i] = CreateTexture(gl::RGBA8, width, height, FORMAT, TYPE);
+				canvas_fbos[i] = CreateFramebuffer(canvases[i]);
+			}
+			// black canvas, transparent frame
+			ClearFramebuffer(canvas_fbos[0], 1.0f);
+			ClearFramebuffer(frame_fbo, 0.0f);
+			gl.BindFramebuffer(gl::FRAMEBUFFER, 0);
+			current = 0;
+		}
+
+		void DestroyCanvas(void) noexcept {
+			gl.DeleteFramebuffers(1, &frame_fbo);
+			gl.DeleteFramebuffers(2, canvas_fbos);
+			gl.DeleteTextures(2, canvases);
+			frame_fbo = canvases[0] = canvases[1] = canvas_fbos[0] = canvas_fbos[1] = 0;
+		}
+
+		void CreateTextures(void) {
+			frame = CreateTexture(gl::RGBA8, width, height, FORMAT, TYPE);
+			indices = CreateTexture(gl::R8, width, height, gl::RED, gl::UNSIGNED_BYTE);
+			if (canvas) CreateCanvas();
+		}
+
+		void DestroyTextures(void) noexcept {
+			if (canvas) DestroyCanvas();
+			gl.DeleteTextures(1, &frame);
+			gl.DeleteTextures(1, &indices);
+			frame = indices = 0;
+		}
+
+		void Release(void) noexcept {
+			if (context == NULL) return;
+			if (loaded) {
+				DestroyTextures();
+				gl.DeleteTextures(1, &palette);
+				gl.DeleteProgram(present_program);
+				gl.DeleteProgram(compose_program);
+				gl.DeleteVertexArrays(1, &vao);
+			}
+			SDL_GL_DeleteContext(context);
+			context = NULL;
+		}
+
+	public:
+
+		/**
+		 * set the attributes of the OpenGL context, before the creation of
+		 * the window (SDL_WINDOW_OPENGL)
+		 */
+		static void SetAttributes(void) {
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+			SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+		}
+
+		/**
+		 * create the context of window, and the textures of a frame of
+		 * _width x _height pixels
+		 * @throw if OpenGL 3.3 is not available
+		 */
+		GpuPresenter(SDL_Window *_window, uint32_t _width, uint32_t _height) :
+			window(_window),
+			context(NULL),
+			gl(),
+			loaded(false),
+			width(_width), height(_height),
+			vao(0),
+			present_program(0), compose_program(0),
+			present_lookup(-1), present_origin(-1), present_scale(-1), present_rows(-1), compose_fade(-1),
+			frame(0), indices(0), palette(0),
+			canvas(false),
+			frame_fbo(0),
+			canvases{0, 0}, canvas_fbos{0, 0},
+			current(0)
+		{
+			context = SDL_GL_CreateContext(window);
+			if (context == NULL) throw std::runtime_error("SDL_GL_CreateContext");
+			try {
+				gl.LoadAll();
+				loaded = true;
+				// the pacer of the engine holds the frame rate, as with the renderer
+				SDL_GL_SetSwapInterval(0);
+				present_program = Link(gl::PRESENT_FRAGMENT);
+				Samplers(present_program, "image", "indices", "palette");
+				present_lookup = gl.GetUniformLocation(present_program, "lookup");
+				present_origin = gl.GetUniformLocation(present_program, "origin");
+				present_scale = gl.GetUniformLocation(present_program, "scale");
+				present_rows = gl.GetUniformLocation(present_program, "rows");
+				compose_program = Link(gl::COMPOSE_FRAGMENT);
+				Samplers(compose_program, "canvas", "layer");
+				compose_fade = gl.GetUniformLocation(compose_program, "fade");
+				gl.UseProgram(0);
+				// core profiles draw with a vertex array bound, even an empty one
+				gl.GenVertexArrays(1, &vao);
+				gl.BindVertexArray(vao);
+				palette = CreateTexture(gl::RGBA8, 256, 1, FORMAT, TYPE);
+				CreateTextures();
+			} catch (...) {
+				Release();
+				throw;
+			}
+		}
+
+		~GpuPresenter(void) noexcept {
+			Release();
+		}
+
+		GpuPresenter(GpuPresenter const&) = delete;
+		GpuPresenter& operator=(GpuPresenter const&) = delete;
+
+		/**
+		 * recreate the textures for a frame of _width x _height pixels, the
+		 * canvas is cleared to black
+		 */
+		void Resize(uint32_t _width, uint32_t _height) {
+			DestroyTextures();
+			width = _width;
+			height = _height;
+			CreateTextures();
+		}
+
+		/**
+		 * enable or disable canvas mode, the canvas starts black and the
+		 * frame texture transparent
+		 */
+		void SetCanvas(bool enable) {
+			if (canvas) DestroyCanvas();
+			canvas = enable;
+			if (canvas) CreateCanvas();
+		}
+
+		/**
+		 * copy a rectangle of pixels of the frame to its texture
+		 * @param rect area to upload
+		 * @param source pixels of the frame, in PixelFormat
+		 * @param source_pitch pixels per row of source
+		 */
+		void UploadPixels(SDL_Rect const& rect, uint32_t const *source, size_t source_pitch) {
+			gl.BindTexture(gl::TEXTURE_2D, frame);
+			gl.PixelStorei(gl::UNPACK_ROW_LENGTH, static_cast<gl::GLint>(source_pitch));
+			gl.PixelStorei(gl::UNPACK_ALIGNMENT, 4);
+			gl.TexSubImage2D(gl::TEXTURE_2D, 0, rect.x, rect.y, rect.w, rect.h, FORMAT, TYPE,
+				source + rect.y * source_pitch + rect.x);
+		}
+
+		/**
+		 * copy a rectangle of indices of the frame to their texture
+		 */
+		void UploadIndices(SDL_Rect const& rect, uint8_t const *source, size_t source_pitch) {
+			gl.BindTexture(gl::TEXTURE_2D, indices);
+			gl.PixelStorei(gl::UNPACK_ROW_LENGTH, static_cast<gl::GLint>(source_pitch));
+			gl.PixelStorei(gl::UNPACK_ALIGNMENT, 1);
+			gl.TexSubImage2D(gl::TEXTURE_2D, 0, rect.x, rect.y, rect.w, rect.h, gl::RED, gl::UNSIGNED_BYTE,
+				source + rect.y * source_pitch + rect.x);
+		}
+
+		/**
+		 * @param colors the 256 colors of the palette, in PixelFormat
+		 */
+		void UploadPalette(uint32_t const *colors) {
+			gl.BindTexture(gl::TEXTURE_2D, palette);
+			gl.PixelStorei(gl::UNPACK_ROW_LENGTH, 0);
+			gl.PixelStorei(gl::UNPACK_ALIGNMENT, 4);
+			gl.TexSubImage2D(gl::TEXTURE_2D, 0, 0, 0, 256, 1, FORMAT, TYPE, colors);
+		}
+
+		/**
+		 * canvas mode: fade the canvas by amount (per channel, clamped at 0)
+		 * then blend the frame texture over it, and clear the frame texture
+		 */
+		void Compose(uint8_t fade_r, uint8_t fade_g, uint8_t fade_b) {
+			uint32_t const next = 1 - current;
+			gl.BindFramebuffer(gl::FRAMEBUFFER, canvas_fbos[next]);
+			gl.Viewport(0, 0, static_cast<gl::GLsizei>(width), static_cast<gl::GLsizei>(height));
+			gl.UseProgram(compose_program);
+			gl.Uniform3f(compose_fade, fade_r, fade_g, fade_b);
+			gl.ActiveTexture(gl::TEXTURE0 + 0);
+			gl.BindTexture(gl::TEXTURE_2D, canvases[current]);
+			gl.ActiveTexture(gl::TEXTURE0 + 1);
+			gl.BindTexture(gl::TEXTURE_2D, frame);
+			gl.DrawArrays(gl::TRIANGLES, 0, 3);
+			gl.ActiveTexture(gl::TEXTURE0 + 0);
+			current = next;
+			ClearFramebuffer(frame_fbo, 0.0f);
+			gl.BindFramebuffer(gl::FRAMEBUFFER, 0);
+		}
+
+		/**
+		 * copy the canvas back to memory (canvas mode), this waits for the GPU
+		 * @param destination width x height pixels, in PixelFormat
+		 * @param destination_pitch pixels per row of destination
+		 */
+		void ReadCanvas(uint32_t *destination, size_t destination_pitch) {
+			gl.BindFramebuffer(gl::FRAMEBUFFER, canvas_fbos[current]);
+			gl.PixelStorei(gl::PACK_ROW_LENGTH, static_cast<gl::GLint>(destination_pitch));
+			gl.PixelStorei(gl::PACK_ALIGNMENT, 4);
+			gl.ReadPixels(0, 0, static_cast<gl::GLsizei>(width), static_cast<gl::GLsizei>(height), FORMAT, TYPE, destination);
+			gl.PixelStorei(gl::PACK_ROW_LENGTH, 0);
+			gl.BindFramebuffer(gl::FRAMEBUFFER, 0);
+		}
+
+		/**
+		 * draw the frame (the canvas in canvas mode) to the window, in macro
+		 * pixels of pixel_size x pixel_size window pixels from its top-left
+		 * corner, the rest in black, and swap the buffers of the window
+		 * @param window_width width of the window
+		 * @param lookup true to look the indices up in the palette (indexed mode)
+		 */
+		void Present(uint32_t window_width, uint32_t pixel_size, bool lookup) {
+			// the drawable is larger than the window on high density displays
+			int drawable_width = 0, drawable_height = 0;
+			SDL_GL_GetDrawableSize(window, &drawable_width, &drawable_height);
+			uint32_t const scale = std::max(1u, pixel_size * static_cast<uint32_t>(std::max(drawable_width, 0)) / std::max(window_width, 1u));
+			gl::GLsizei const target_width = static_cast<gl::GLsizei>(width * scale);
+			gl::GLsizei const target_height = static_cast<gl::GLsizei>(height * scale);
+			gl.BindFramebuffer(gl::FRAMEBUFFER, 0);
+			if (target_width != drawable_width || target_height != drawable_height) {
+				gl.Viewport(0, 0, drawable_width, drawable_height);
+				gl.ClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+				gl.Clear(gl::COLOR_BUFFER_BIT);
+			}
+			// the rows of the window go up: the macro pixels start at its top
+			gl::GLint const bottom = drawable_height - target_height;
+			gl.Viewport(0, bottom, target_width, target_height);
+			gl.UseProgram(present_program);
+			gl.Uniform1i(present_lookup, lookup ? 1 : 0);
+			gl.Uniform2i(present_origin, 0, bottom);
+			gl.Uniform1i(present_scale, static_cast<gl::GLint>(scale));
+			gl.Uniform1i(present_rows, static_cast<gl::GLint>(height));
+			gl.ActiveTexture(gl::TEXTURE0 + 0);
+			gl.BindTexture(gl::TEXTURE_2D, canvas ? canvases[current] : frame);
+			gl.ActiveTexture(gl::TEXTURE0 + 1);
+			gl.BindTexture(gl::TEXTURE_2D, indices);
+			gl.ActiveTexture(gl::TEXTURE0 + 2);
+			gl.BindTexture(gl::TEXTURE_2D, palette);
+			gl.DrawArrays(gl::TRIANGLES, 0, 3);
+			gl.ActiveTexture(gl::TEXTURE0 + 0);
+			SDL_GL_SwapWindow(window);
+		}
+
+	}; // class GpuPresenter
+
+} // namespace rico
@@ -0,0 +1,591 @@
+/** rico/nbody.hpp
+ *
+ * Bodies stores point masses as a structure of arrays (positions, speeds
+ * and forces are Tvec2DArray, masses an array of their own), Gravity
+ * computes the forces they apply to each other and moves them.
+ *
+ * The force of body j on body i is G * m_i * m_j / d^2 along the unit
+ * vector from i to j, where d is the distance between them, clamped to a
+ * minimal distance (to avoid infinite forces on close encounters).
+ *
+ * Below direct_threshold bodies, each pair is computed once and applied to
+ * both bodies (Newton's third law): n(n-1)/2 interactions.
+ *
+ * Above, a Barnes-Hut quadtree is built: the space is split recursively
+ * in 4 quadrants until a cell holds at most LEAF bodies. Far enough from a
+ * cell (size / distance < theta, the opening angle), its bodies are seen as
+ * a single mass at their center of mass, which makes a step O(n log n).
+ * The tree is built by partitioning an array of indices in place, bodies
+ * of a cell end up contiguous, and the forces are computed in parallel on
+ * the thread pool given (if any). theta = 0 gives the exact forces.
+ *
+ * The direct sum also has SIMD kernels (AVX2 + FMA on x86, NEON on ARM),
+ * selected at runtime like the raster kernels. They give up the symmetry
+ * and compute every pair from both sides, 8 (float) or 4 (double) pairs at
+ * a time and without branches: 1 / d^3 comes from the reciprocal square
+ * root estimate of the CPU, refined with Newton-Raphson steps. The double
+ * estimate of AVX2 goes through float, so pairs further than about 1e19
+ * apart pull with a null force. compute_forces uses them below
+ * direct_threshold when available, with the rows split on the thread pool.
+ *
+ * integrate moves the bodies for a duration, with the same integration
+ * scheme as examples/gravity.cpp always used, as batched operations of
+ * Tvec2DArray (see vec2d.hpp).
+ */
+
+#pragma once
+
+#include "scheduler.hpp"
+#include "vec2d.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RICO_NBODY_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define RICO_NBODY_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace rico {
+
+	namespace nbody {
+
+		/**
+		 * direct kernel of a given precision: for each body i in [begin, end),
+		 * ax[i] = sum over j in [0, n) of m[j] * (x[j] - x[i]) / max(d^2, min_square)^(3/2)
+		 * and the same for ay (a body pulls itself with a null force, as long
+		 * as min_square > 0)
+		 */
+		template<typename T>
+		struct Kernels {
+			char const *name;
+			void (*direct)(T const *x, T const *y, T const *m, uint32_t n,
+				uint32_t begin, uint32_t end, T min_square, T *ax, T *ay);
+		}; // struct Kernels
+
+		namespace detail {
+
+			// add the pull of body j on position (xi, yi) to (sx, sy)
+			template<typename T>
+			inline void pull(T xi, T yi, T xj, T yj, T mj, T min_square, T& sx, T& sy) {
+				T dx = xj - xi, dy = yj - yi;
+				T d2 = std::max(dx * dx + dy * dy, min_square);
+				T c = mj / (d2 * std::sqrt(d2));
+				sx += c * dx;
+				sy += c * dy;
+			}
+
+			template<typename T>
+			inline void direct_scalar(T const *x, T const *y, T const *m, uint32_t n,
+				uint32_t begin, uint32_t end, T min_square, T *ax, T *ay)
+			{
+				for (uint32_t i = begin; i < end; ++i) {
+					T sx = 0, sy = 0;
+					for (uint32_t j = 0; j < n; ++j) pull(x[i], y[i], x[j], y[j], m[j], min_square, sx, sy);
+					ax[i] = sx;
+					ay[i] = sy;
+				}
+			}
+
+#ifdef RICO_NBODY_X86
+
+			__attribute__((target("avx2,fma")))
+			inline float hsum_avx2(__m256 v) {
+				__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+				s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+				s = _mm_add_ss(s, _mm_movehdup_ps(s));
+				return _mm_cvtss_f32(s);
+			}
+
+			__attribute__((target("avx2,fma")))
+			inline double hsum_avx2(__m256d v) {
+				__m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+				s = _mm_add_sd(s, _mm_unpackhi_pd(s, s));
+				return _mm_cvtsd_f64(s);
+			}
+
+			// 1/d^3 for 8 squared distances
+			__attribute__((target("avx2,fma")))
+			inline __m256 inverse_cube_avx2(__m256 d2) {
+				// one Newton-Raphson step on 1/d: r = r * (3/2 - d^2/2 * r^2)
+				__m256 r = _mm256_rsqrt_ps(d2);
+				__m256 h = _mm256_mul_ps(_mm256_set1_ps(0.5f), d2);
+				r = _mm256_mul_ps(r, _mm256_fnmadd_ps(h, _mm256_mul_ps(r, r), _mm256_set1_ps(1.5f)));
+				return _mm256_mul_ps(r, _mm256_mul_ps(r, r));
+			}
+
+			// 1/d^3 for 4 squared distances
+			__attribute__((target("avx2,fma")))
+			inline __m256d inverse_cube_avx2(__m256d d2) {
+				// float estimate (12 bits), then two Newton-Raphson steps (about 48 bits)
+				__m256d r = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(d2)));
+				__m256d h = _mm256_mul_pd(_mm256_set1_pd(0.5), d2);
+				__m256d three_halves = _mm256_set1_pd(1.5);
+				r = _mm256_mul_pd(r, _mm256_fnmadd_pd(h, _mm256_mul_pd(r, r), three_halves));
+				r = _mm256_mul_pd(r, _mm256_fnmadd_pd(h, _mm256_mul_pd(r, r), three_halves));
+				return _mm256_mul_pd(r, _mm256_mul_pd(r, r));
+			}
+
+			__attribute__((target("avx2,fma")))
+			inline void direct_avx2(float const *x, float const *y, float const *m, uint32_t n,
+				uint32_t begin, uint32_t end, float min_square, float *ax, float *ay)
+			{
+				__m256 const floor = _mm256_set1_ps(min_square);
+				uint32_t const wide = n - n % 8;
+				for (uint32_t i = begin; i < end; ++i) {
+					__m256 xi = _mm256_set1_ps(x[i]), yi = _mm256_set1_ps(y[i]);
+					__m256 sx = _mm256_setzero_ps(), sy = _mm256_setzero_ps();
+					for (uint32_t j = 0; j < wide; j += 8) {
+						__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + j), xi);
+						__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + j), yi);
+						__m256 d2 = _mm256_max_ps(_mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy)), floor);
+						__m256 c = _mm256_mul_ps(_mm256_loadu_ps(m + j), inverse_cube_avx2(d2));
+						sx = _mm256_fmadd_ps(c, dx, sx);
+						sy = _mm256_fmadd_ps(c, dy, sy);
+					}
+					float tx = 0, ty = 0;
+					for (uint32_t j = wide; j < n; ++j) pull(x[i], y[i], x[j], y[j], m[j], min_square, tx, ty);
+					ax[i] = hsum_avx2(sx) + tx;
+					ay[i] = hsum_avx2(sy) + ty;
+				}
+			}
+
+			__attribute__((target("avx2,fma")))
+			inline void direct_avx2(double const *x, double const *y, double const *m, uint32_t n,
+				uint32_t begin, uint32_t end, double min_square, double *ax, double *ay)
+			{
+				__m256d const floor = _mm256_set1_pd(min_square);
+				uint32_t const wide = n - n % 4;
+				for (uint32_t i = begin; i < end; ++i) {
+					__m256d xi = _mm256_set1_pd(x[i]), yi = _mm256_set1_pd(y[i]);
+					__m256d sx = _mm256_setzero_pd(), sy = _mm256_setzero_pd();
+					for (uint32_t j = 0; j < wide; j += 4) {
+						__m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + j), xi);
+						__m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + j), yi);
+						__m256d d2 = _mm256_max_pd(_mm256_fmadd_pd(dx, dx, _mm256_mul_pd(dy, dy)), floor);
+						__m256d c = _mm256_mul_pd(_mm256_loadu_pd(m + j), inverse_cube_avx2(d2));
+						sx = _mm256_fmadd_pd(c, dx, sx);
+						sy = _mm256_fmadd_pd(c, dy, sy);
+					}
+					double tx = 0, ty = 0;
+					for (uint32_t j = wide; j < n; ++j) pull(x[i], y[i], x[j], y[j], m[j], min_square, tx, ty);
+					ax[i] = hsum_avx2(sx) + tx;
+					ay[i] = hsum_avx2(sy) + ty;
+				}
+			}
+
+#endif // RICO_NBODY_X86
+
+#ifdef RICO_NBODY_NEON
+
+			// 1/d^3 for 4 squared distances
+			inline float32x4_t inverse_cube_neon(float32x4_t d2) {
+				// 8 bits estimate, two Newton-Raphson steps: r = r * (3 - d^2 * r^2) / 2
+				float32x4_t r = vrsqrteq_f32(d2);
+				r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(d2, r), r));
+				r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(d2, r), r));
+				return vmulq_f32(r, vmulq_f32(r, r));
+			}
+
+			// 1/d^3 for 2 squared distances
+			inline float64x2_t inverse_cube_neon(float64x2_t d2) {
+				// 8 bits estimate, three Newton-Raphson steps
+				float64x2_t r = vrsqrteq_f64(d2);
+				r = vmulq_f64(r, vrsqrtsq_f64(vmulq_f64(d2, r), r));
+				r = vmulq_f64(r, vrsqrtsq_f64(vmulq_f64(d2, r), r));
+				r = vmulq_f64(r, vrsqrtsq_f64(vmulq_f64(d2, r), r));
+				return vmulq_f64(r, vmulq_f64(r, r));
+			}
+
+			inline void direct_neon(float const *x, float const *y, float const *m, uint32_t n,
+				uint32_t begin, uint32_t end, float min_square, float *ax, float *ay)
+			{
+				float32x4_t const floor = vdupq_n_f32(min_square);
+				uint32_t const wide = n - n % 4;
+				for (uint32_t i = begin; i < end; ++i) {
+					float32x4_t xi = vdupq_n_f32(x[i]), yi = vdupq_n_f32(y[i]);
+					float32x4_t sx = vdupq_n_f32(0), sy = vdupq_n_f32(0);
+					for (uint32_t j = 0; j < wide; j += 4) {
+						float32x4_t dx = vsubq_f32(vld1q_f32(x + j), xi);
+						float32x4_t dy = vsubq_f32(vld1q_f32(y + j), yi);
+						float32x4_t d2 = vmaxq_f32(vfmaq_f32(vmulq_f32(dy, dy), dx, dx), floor);
+						float32x4_t c = vmulq_f32(vld1q_f32(m + j), inverse_cube_neon(d2));
+						sx = vfmaq_f32(sx, c, dx);
+						sy = vfmaq_f32(sy, c, dy);
+					}
+					float tx = 0, ty = 0;
+					for (uint32_t j = wide; j < n; ++j) pull(x[i], y[i], x[j], y[j], m[j], min_square, tx, ty);
+					ax[i] = vaddvq_f32(sx) + tx;
+					ay[i] = vaddvq_f32(sy) + ty;
+				}
+			}
+
+			inline void direct_neon(double const *x, double const *y, double const *m, uint32_t n,
+				uint32_t begin, uint32_t end, double min_square, double *ax, double *ay)
+			{
+				float64x2_t const floor = vdupq_n_f64(min_square);
+				uint32_t const wide = n - n % 2;
+				for (uint32_t i = begin; i < end; ++i) {
+					float64x2_t xi = vdupq_n_f64(x[i]), yi = vdupq_n_f64(y[i]);
+					float64x2_t sx = vdupq_n_f64(0), sy = vdupq_n_f64(0);
+					for (uint32_t j = 0; j < wide; j += 2) {
+						float64x2_t dx = vsubq_f64(vld1q_f64(x + j), xi);
+						float64x2_t dy = vsubq_f64(vld1q_f64(y + j), yi);
+						float64x2_t d2 = vmaxq_f64(vfmaq_f64(vmulq_f64(dy, dy), dx, dx), floor);
+						float64x2_t c = vmulq_f64(vld1q_f64(m + j), inverse_cube_neon(d2));
+						sx = vfmaq_f64(sx, c, dx);
+						sy = vfmaq_f64(sy, c, dy);
+					}
+					double tx = 0, ty = 0;
+					for (uint32_t j = wide; j < n; ++j) pull(x[i], y[i], x[j], y[j], m[j], min_square, tx, ty);
+					ax[i] = vaddvq_f64(sx) + tx;
+					ay[i] = vaddvq_f64(sy) + ty;
+				}
+			}
+
+#endif // RICO_NBODY_NEON
+
+			template<typename T>
+			inline Kernels<T> select(void) {
+				// SIMD kernels exist for float and double only
+				if constexpr (std::is_same<T, float>::value || std::is_same<T, double>::value) {
+#if defined(RICO_NBODY_X86)
+					__builtin_cpu_init();
+					if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+						return Kernels<T> { "avx2", direct_avx2 };
+					}
+#elif defined(RICO_NBODY_NEON)
+					return Kernels<T> { "neon", direct_neon };
+#endif
+				}
+				return Kernels<T> { "scalar", direct_scalar<T> };
+			}
+
+		} // namespace detail
+
+		/**
+		 * @return the kernels of precision T selected for this CPU
+		 */
+		template<typename T>
+		inline Kernels<T> const& kernels(void) {
+			static Kernels<T> const selected = detail::select<T>();
+			return selected;
+		}
+
+		/**
+		 * @return name of the selected kernels ("avx2", "neon", "scalar")
+		 */
+		template<typename T>
+		inline char const* backend(void) {
+			return kernels<T>().name;
+		}
+
+	} // namespace nbody
+
+
+	template<typename T>
+	struct Bodies {
+
+		Tvec2DArray<T> position;
+		Tvec2DArray<T> speed;
+		std::vector<T> mass;
+		Tvec2DArray<T> force; // output of Gravity::compute_forces
+
+		uint32_t size(void) const {
+			return static_cast<uint32_t>(mass.size());
+		}
+
+		void add(T _mass, T _x, T _y, T _vx, T _vy) {
+			position.push_back(Tvec2D<T>(_x, _y));
+			speed.push_back(Tvec2D<T>(_vx, _vy));
+			mass.push_back(_mass);
+			force.push_back(Tvec2D<T>());
+		}
+
+		void clear(void) {
+			position.clear();
+			speed.clear();
+			mass.clear();
+			force.clear();
+		}
+
+	}; // struct Bodies
+
+	template<typename T>
+	class Gravity {
+	public:
+
+		static constexpr uint32_t LEAF = 8; // maximal number of bodies per leaf
+		static constexpr uint32_t MAX_DEPTH = 48; // deeper cells are leaves anyway
+
+		T G; // gravitational constant
+		T min_distance; // distances are clamped to this value
+		T theta; // opening angle of Barnes-Hut
+		uint32_t direct_threshold; // number of bodies below which pairs are computed directly
+
+		explicit Gravity(
+			T _G = 1,
+			T _min_distance = T(5e-2),
+			T _theta = T(0.5),
+			uint32_t _direct_threshold = 1024)
+			: G(_G), min_distance(_min_distance), theta(_theta),
+			direct_threshold(_direct_threshold)
+		{}
+
+		/**
+		 * compute the force applied on each body into bodies.force, directly or
+		 * with the quadtree depending on the number of bodies
+		 * @param pool thread pool to use, NULL to stay on this thread
+		 */
+		void compute_forces(Bodies<T>& bodies, ThreadPool *pool = NULL) {
+			if (bodies.size() <= direct_threshold) {
+				if (nbody::kernels<T>().direct != nbody::detail::direct_scalar<T>) {
+					compute_vectorized(bodies, pool);
+				} else {
+					// without SIMD, computing each pair once is twice faster
+					compute_direct(bodies);
+				}
+			} else {
+				compute_tree(bodies, pool);
+			}
+		}
+
+		/**
+		 * exact forces, each pair being computed once
+		 */
+		void compute_direct(Bodies<T>& bodies) const {
+			uint32_t const n = bodies.size();
+			T const *x = bodies.position.x.data(), *y = bodies.position.y.data(), *m = bodies.mass.data();
+			T *fx = bodies.force.x.data(), *fy = bodies.force.y.data();
+			std::fill(fx, fx + n, T(0));
+			std::fill(fy, fy + n, T(0));
+			for (uint32_t i = 0; i < n; ++i) {
+				T xi = x[i], yi = y[i], gm = G * m[i];
+				T ax = 0, ay = 0; // forces on i, divided by G * m_i
+				for (uint32_t j = i + 1; j < n; ++j) {
+					T dx = x[j] - xi, dy = y[j] - yi;
+					T d = std::max(std::sqrt(dx * dx + dy * dy), min_distance);
+					T c = m[j] / (d * d * d);
+					ax += c * dx;
+					ay += c * dy;
+					// opposite force on j
+					T cj = gm * c;
+					fx[j] -= cj * dx;
+					fy[j] -= cj * dy;
+				}
+				fx[i] += gm * ax;
+				fy[i] += gm * ay;
+			}
+		}
+
+		/**
+		 * exact forces, every pair being computed from both sides by the
+		 * selected SIMD kernel
+		 * @param pool thread pool to split the bodies on, NULL to stay on this thread
+		 */
+		void compute_vectorized(Bodies<T>& bodies, ThreadPool *pool = NULL) const {
+			uint32_t const n = bodies.size();
+			T const *x = bodies.position.x.data(), *y = bodies.position.y.data(), *m = bodies.mass.data();
+			T *fx = bodies.force.x.data(), *fy = bodies.force.y.data();
+			// a body pulls itself with a null force only if the distance is never 0
+			T const min_square = std::max(min_distance * min_distance, T(std::is_same<T, float>::value ? 1e-20 : 1e-30));
+			auto direct = nbody::kernels<T>().direct;
+			uint32_t const chunk = 64;
+			uint32_t const chunks = (n + chunk - 1) / chunk;
+			auto pass = [&](uint32_t index) {
+				uint32_t begin = index * chunk, end = std::min(n, begin + chunk);
+				direct(x, y, m, n, begin, end, min_square, fx, fy);
+				for (uint32_t i = begin; i < end; ++i) {
+					fx[i] *= G * m[i];
+					fy[i] *= G * m[i];
+				}
+			};
+			if (pool != NULL) {
+				pool->ParallelFor(chunks, pass);
+			} else {
+				for (uint32_t index = 0; index < chunks; ++index) pass(index);
+			}
+		}
+
+		/**
+		 * approximated forces, with the Barnes-Hut quadtree
+		 * @param pool thread pool for the force pass, NULL to stay on this thread
+		 */
+		void compute_tree(Bodies<T>& bodies, ThreadPool *pool = NULL) {
+			uint32_t const n = bodies.size();
+			if (n == 0) return;
+			build(bodies);
+			uint32_t const chunk = 256;
+			uint32_t const chunks = (n + chunk - 1) / chunk;
+			auto pass = [&](uint32_t index) {
+				uint32_t end = std::min(n, (index + 1) * chunk);
+				for (uint32_t k = index * chunk; k < end; ++k) force_on(bodies, k);
+			};
+			if (pool != NULL) {
+				pool->ParallelFor(chunks, pass);
+			} else {
+				for (uint32_t index = 0; index < chunks; ++index) pass(index);
+			}
+		}
+
+		/**
+		 * move the bodies according to their forces for delta_time
+		 */
+		void integrate(Bodies<T>& bodies, T delta_time) {
+			// Newton's law
+			acceleration = bodies.force;
+			acceleration.divide(bodies.mass);
+			// after integration, delta_speed = acceleration*t
+			acceleration *= delta_time;
+			bodies.speed += acceleration;
+			// after integration, delta_position = speed*t+(acceleration/2)*t^2
+			acceleration *= T(0.5);
+			acceleration += bodies.speed;
+			bodies.position.add_scaled(acceleration, delta_time);
+		}
+
+		/**
+		 * compute the forces then move the bodies for delta_time
+		 */
+		void step(Bodies<T>& bodies, T delta_time, ThreadPool *pool = NULL) {
+			compute_forces(bodies, pool);
+			integrate(bodies, delta_time);
+		}
+
+	private:
+
+		struct Node {
+			T cx, cy, mass; // center of mass and total mass
+			T x0, y0, size; // square covered: [x0, x0 + size) x [y0, y0 + size)
+			uint32_t children; // index of the first of 4 children, 0 for leaves
+			uint32_t begin, end; // bodies of the cell, in sorted order
+		}; // struct Gravity::Node
+
+		// reused from one step to the next
+		std::vector<Node> nodes;
+		std::vector<uint32_t> order; // body index, by cell
+		std::vector<T> sx, sy, sm; // positions and masses, by cell
+		Tvec2DArray<T> acceleration; // scratch of integrate
+
+		void build(Bodies<T> const& bodies) {
+			uint32_t const n = bodies.size();
+			order.resize(n);
+			for (uint32_t i = 0; i < n; ++i) order[i] = i;
+			// bounding square, slightly enlarged so that every body is strictly inside
+			auto x_range = std::minmax_element(bodies.position.x.begin(), bodies.position.x.end());
+			auto y_range = std::minmax_element(bodies.position.y.begin(), bodies.position.y.end());
+			T size = std::max(*x_range.second - *x_range.first, *y_range.second - *y_range.first);
+			size = size * T(1.001) + std::max(min_distance, T(1e-6));
+			nodes.clear();
+			nodes.push_back(Node());
+			build_node(bodies, 0, 0, n, *x_range.first - size * T(0.0005), *y_range.first - size * T(0.0005), size, 0);
+			sx.resize(n);
+			sy.resize(n);
+			sm.resize(n);
+			for (uint32_t k = 0; k < n; ++k) {
+				sx[k] = bodies.position.x[order[k]];
+				sy[k] = bodies.position.y[order[k]];
+				sm[k] = bodies.mass[order[k]];
+			}
+		}
+
+		void build_node(Bodies<T> const& bodies, uint32_t slot, uint32_t begin, uint32_t end, T x0, T y0, T size, uint32_t depth) {
+			Node node;
+			node.x0 = x0;
+			node.y0 = y0;
+			node.size = size;
+			node.children = 0;
+			node.begin = begin;
+			node.end = end;
+			node.mass = node.cx = node.cy = 0;
+			if (end - begin <= LEAF || depth == MAX_DEPTH) {
+				for (uint32_t k = begin; k < end; ++k) {
+					T m = bodies.mass[order[k]];
+					node.mass += m;
+					node.cx += m * bodies.position.x[order[k]];
+					node.cy += m * bodies.position.y[order[k]];
+				}
+			} else {
+				// partition in 4 quadrants: south-west, south-east, north-west, north-east
+				T half = size / 2, mx = x0 + half, my = y0 + half;
+				uint32_t *first = order.data();
+				auto south = [&](uint32_t i) { return bodies.position.y[i] < my; };
+				auto west = [&](uint32_t i) { return bodies.position.x[i] < mx; };
+				uint32_t split1 = static_cast<uint32_t>(std::partition(first + begin, first + end, south) - first);
+				uint32_t split0 = static_cast<uint32_t>(std::partition(first + begin, first + split1, west) - first);
+				uint32_t split2 = static_cast<uint32_t>(std::partition(first + split1, first + end, west) - first);
+				node.children = static_cast<uint32_t>(nodes.size());
+				nodes.resize(nodes.size() + 4);
+				build_node(bodies, node.children + 0, begin, split0, x0, y0, half, depth + 1);
+				build_node(bodies, node.children + 1, split0, split1, mx, y0, half, depth + 1);
+				build_node(bodies, node.children + 2, split1, split2, x0, my, half, depth + 1);
+				build_node(bodies, node.children + 3, split2, end, mx, my, half, depth + 1);
+				for (uint32_t c = 0; c < 4; ++c) {
+					Node const& child = nodes[node.children + c];
+					node.mass += child.mass;
+					node.cx += child.mass * child.cx;
+					node.cy += child.mass * child.cy;
+				}
+			}
+			if (node.mass > 0) {
+				node.cx /= node.mass;
+				node.cy /= node.mass;
+			} else {
+				node.cx = x0 + size / 2;
+				node.cy = y0 + size / 2;
+			}
+			nodes[slot] = node;
+		}
+
+		// force on the body at position k of the sorted order
+		void force_on(Bodies<T>& bodies, uint32_t k) const {
+			T const px = sx[k], py = sy[k];
+			T const theta2 = theta * theta;
+			T ax = 0, ay = 0; // force divided by G * m_k
+			uint32_t stack[4 * MAX_DEPTH + 4];
+			uint32_t top = 0;
+			stack[top++] = 0;
+			while (top > 0) {
+				Node const& node = nodes[stack[--top]];
+				if (node.mass == 0) continue;
+				if (node.children == 0) {
+					for (uint32_t q = node.begin; q < node.end; ++q) {
+						if (q == k) continue;
+						T dx = sx[q] - px, dy = sy[q] - py;
+						T d = std::max(std::sqrt(dx * dx + dy * dy), min_distance);
+						T c = sm[q] / (d * d * d);
+						ax += c * dx;
+						ay += c * dy;
+					}
+					continue;
+				}
+				T dx = node.cx - px, dy = node.cy - py;
+				T r2 = dx * dx + dy * dy;
+				bool inside = px >= node.x0 && px < node.x0 + node.size
+					&& py >= node.y0 && py < node.y0 + node.size;
+				if (!inside && node.size * node.size < theta2 * r2) {
+					// far enough, a single mass
+					T d = std::max(std::sqrt(r2), min_distance);
+					T c = node.mass / (d * d * d);
+					ax += c * dx;
+					ay += c * dy;
+				} else {
+					for (uint32_t c = 0; c < 4; ++c) stack[top++] = node.children + c;
+				}
+			}
+			uint32_t i = order[k];
+			T gm = G * sm[k];
+			bodies.force.x[i] = gm * ax;
+			bodies.force.y[i] = gm * ay;
+		}
+
+	}; // class Gravity
+
+} // namespace rico
@@ -0,0 +1,102 @@
+/** rico/pixel.hpp
+ *
+ * Pixel formats, as policies: each one gives the type of a pixel and
+ * constexpr functions to pack three channels (and alpha) into a pixel, and
+ * to unpack them, so that conversions are folded at compile time when the
+ * channels are constants.
+ * RGBA8888 / ARGB8888 = 32 bits, in the packed layout of the same SDL
+ *   formats (the value 0xRRGGBBAA / 0xAARRGGBB, in native byte order)
+ * XRGB8888 = the layout of ARGB8888, the high byte being ignored by the
+ *   texture (SDL_PIXELFORMAT_RGB888)
+ * RGB565 = 16 bits, 5 bits of red, 6 of green and 5 of blue, for
+ *   conversions only (see convert): the frame holds 32 bits pixels
+ *
+ * PixelFormat is the format of the frame, of the kernels of raster.hpp
+ * that depend on it (blend) and of Color, selected at compile time with
+ * -DRICO_PIXEL_FORMAT=<name>. The default is ARGB8888, the native format of
+ * the SDL renderers on the common platforms (Direct3D, Metal, OpenGL and
+ * software), so that uploads are plain copies: the driver has no swizzle to
+ * do (GameEngine warns at creation if its renderer prefers another one).
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace rico {
+namespace pixel {
+
+	/**
+	 * 32 bits pixels, one byte per channel, each at the given shift
+	 */
+	template<uint32_t R, uint32_t G, uint32_t B, uint32_t A>
+	struct Packed8888 {
+
+		using type = uint32_t;
+
+		static constexpr uint32_t red_shift = R;
+		static constexpr uint32_t green_shift = G;
+		static constexpr uint32_t blue_shift = B;
+		static constexpr uint32_t alpha_shift = A;
+		static constexpr uint32_t alpha_mask = 0xffu << A;
+
+		static constexpr type pack(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) {
+			return (uint32_t(r) << R) | (uint32_t(g) << G) | (uint32_t(b) << B) | (uint32_t(a) << A);
+		}
+
+		static constexpr uint8_t red(type value) { return static_cast<uint8_t>(value >> R); }
+		static constexpr uint8_t green(type value) { return static_cast<uint8_t>(value >> G); }
+		static constexpr uint8_t blue(type value) { return static_cast<uint8_t>(value >> B); }
+		static constexpr uint8_t alpha(type value) { return static_cast<uint8_t>(value >> A); }
+
+	}; // struct Packed8888
+
+	struct RGBA8888 : Packed8888<24, 16, 8, 0> {};
+	struct ARGB8888 : Packed8888<16, 8, 0, 24> {};
+	struct XRGB8888 : Packed8888<16, 8, 0, 24> {};
+
+	struct RGB565 {
+
+		using type = uint16_t;
+
+		static constexpr type pack(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) {
+			(void) a;
+			return static_cast<type>(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+		}
+
+		// the high bits are replicated in the low ones, so that 0 and the
+		// maximum map to 0 and 255
+		static constexpr uint8_t red(type value) {
+			return static_cast<uint8_t>(((value >> 11) << 3) | (value >> 13));
+		}
+		static constexpr uint8_t green(type value) {
+			return static_cast<uint8_t>((((value >> 5) & 0x3f) << 2) | ((value >> 9) & 0x3));
+		}
+		static constexpr uint8_t blue(type value) {
+			return static_cast<uint8_t>(((value & 0x1f) << 3) | ((value >> 2) & 0x7));
+		}
+		static constexpr uint8_t alpha(type value) {
+			(void) value;
+			return 255;
+		}
+
+	}; // struct RGB565
+
+	/**
+	 * @return value of format From, in format To
+	 */
+	template<typename To, typename From>
+	constexpr typename To::type convert(typename From::type value) {
+		return To::pack(From::red(value), From::green(value), From::blue(value), From::alpha(value));
+	}
+
+} // namespace pixel
+
+#ifndef RICO_PIXEL_FORMAT
+#define RICO_PIXEL_FORMAT ARGB8888
+#endif
+
+	using PixelFormat = pixel::RICO_PIXEL_FORMAT;
+	static_assert(sizeof(PixelFormat::type) == sizeof(uint32_t), "the frame holds 32 bits pixels");
+
+} // namespace rico
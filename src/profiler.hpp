@@ -0,0 +1,368 @@
+/** rico/profiler.hpp
+ *
+ * Profiler measures the time spent in named zones of code, per frame.
+ *
+ * RICO_PROFILE("name") measures the enclosing scope. Zones with the same
+ * name are merged, and a zone can be entered from several threads at once
+ * (durations are summed). The game loop of GameEngine measures its own
+ * phases: events, update, render, copy forward, upload, render copy,
+ * present and wait, along with the duration of the whole frame.
+ *
+ * At the end of each frame, the time spent in each zone during the frame
+ * is pushed in a rolling window of WINDOW frames, over which min, average
+ * and 99th percentile are computed (frames where a zone was not entered
+ * are not counted). Report prints them as a table.
+ *
+ * Counters are named totals (such as dropped frames) that any thread can
+ * add to, Report prints them below the zones.
+ *
+ * StartTrace / StopTrace record every zone entered in between and write
+ * them as a Chrome trace (JSON, open with chrome://tracing or Perfetto).
+ * GameEngine::Run traces the whole run if the environment variable
+ * RICO_TRACE holds the path of the output file.
+ *
+ * Defining RICO_PROFILER to 0 removes every RICO_PROFILE zone.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <vector>
+
+#ifndef RICO_PROFILER
+#define RICO_PROFILER 1
+#endif
+
+namespace rico {
+
+	class Profiler {
+	public:
+
+		static constexpr uint32_t MAX_ZONES = 64; // the last one is shared once full
+		static constexpr uint32_t MAX_COUNTERS = 32; // same
+		static constexpr uint32_t WINDOW = 128; // frames
+		static constexpr size_t MAX_EVENTS = 1 << 20; // per trace
+
+		// durations in milliseconds, over the rolling window
+		struct Stats {
+			double last, min, avg, p99;
+			uint32_t frames; // number of frames in the window
+		}; // struct Profiler::Stats
+
+	private:
+
+		using Clock = std::chrono::steady_clock;
+
+		struct Zone {
+			char const *name;
+			std::atomic<uint64_t> ns; // time spent during the current frame
+			std::atomic<uint32_t> hits; // number of times entered during the current frame
+			double window[WINDOW]; // time spent per frame, circular
+			uint32_t frames; // number of frames pushed in window
+		}; // struct Profiler::Zone
+
+		struct Counter {
+			char const *name;
+			std::atomic<int64_t> value;
+		}; // struct Profiler::Counter
+
+		struct Event {
+			uint32_t zone, thread;
+			int64_t start, duration; // in ns, start relative to origin
+		}; // struct Profiler::Event
+
+		Zone zones[MAX_ZONES];
+		std::atomic<uint32_t> zone_count;
+		std::mutex mutex; // zone registration and windows
+		Counter counters[MAX_COUNTERS];
+		std::atomic<uint32_t> counter_count;
+		uint32_t frame_zone;
+		Clock::time_point frame_start;
+
+		// trace
+		std::atomic<bool> tracing;
+		std::mutex trace_mutex;
+		std::vector<Event> events;
+		Clock::time_point origin;
+
+		// small and stable identifier of the current thread, for traces
+		static uint32_t ThreadId(void) {
+			static std::atomic<uint32_t> next(0);
+			static thread_local uint32_t const id = next.fetch_add(1, std::memory_order_relaxed);
+			return id;
+		}
+
+		Profiler(void) :
+			zone_count(0),
+			counter_count(0),
+			frame_start(Clock::now()),
+			tracing(false),
+			origin(Clock::now())
+		{
+			for (Zone& zone : zones) {
+				zone.name = "";
+				zone.ns.store(0, std::memory_order_relaxed);
+				zone.hits.store(0, std::memory_order_relaxed);
+				zone.frames = 0;
+			}
+			for (Counter& counter : counters) {
+				counter.name = "";
+				counter.value.store(0, std::memory_order_relaxed);
+			}
+			frame_zone = Register("frame");
+		}
+
+		static Stats Compute(Zone const& zone) {
+			Stats retval = { 0.0, 0.0, 0.0, 0.0, std::min(zone.frames, WINDOW) };
+			if (retval.frames == 0) return retval;
+			double sorted[WINDOW];
+			std::copy(zone.window, zone.window + retval.frames, sorted);
+			std::sort(sorted, sorted + retval.frames);
+			double sum = 0.0;
+			for (uint32_t i = 0; i < retval.frames; ++i) sum += sorted[i];
+			retval.last = zone.window[(zone.frames - 1) % WINDOW];
+			retval.min = sorted[0];
+			retval.avg = sum / retval.frames;
+			retval.p99 = sorted[(retval.frames * 99 + 99) / 100 - 1];
+			return retval;
+		}
+
+		static void WriteEscaped(std::ostream& os, char const *text) {
+			for (; *text != '\0'; ++text) {
+				if (*text == '"' || *text == '\\') os << '\\';
+				if (static_cast<unsigned char>(*text) >= 0x20) os << *text;
+			}
+		}
+
+	public:
+
+		Profiler(Profiler const&) = delete;
+		Profiler& operator=(Profiler const&) = delete;
+
+		/**
+		 * access the single instance
+		 * @return reference to the instance
+		 */
+		static Profiler& Get(void) {
+			static Profiler instance;
+			return instance;
+		}
+
+		/**
+		 * @param name name of the zone, must outlive the profiler (string literal)
+		 * @return identifier of the zone, the same for a name already registered
+		 */
+		uint32_t Register(char const *name) {
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t count = zone_count.load(std::memory_order_relaxed);
+			for (uint32_t i = 0; i < count; ++i) {
+				if (std::strcmp(zones[i].name, name) == 0) return i;
+			}
+			if (count == MAX_ZONES) return MAX_ZONES - 1;
+			zones[count].name = name;
+			zone_count.store(count + 1, std::memory_order_release);
+			return count;
+		}
+
+		/**
+		 * @param name name of the counter, must outlive the profiler (string literal)
+		 * @return identifier of the counter, the same for a name already registered
+		 */
+		uint32_t RegisterCounter(char const *name) {
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t count = counter_count.load(std::memory_order_relaxed);
+			for (uint32_t i = 0; i < count; ++i) {
+				if (std::strcmp(counters[i].name, name) == 0) return i;
+			}
+			if (count == MAX_COUNTERS) return MAX_COUNTERS - 1;
+			counters[count].name = name;
+			counter_count.store(count + 1, std::memory_order_release);
+			return count;
+		}
+
+		/**
+		 * add value to a counter, from any thread
+		 */
+		void Add(uint32_t counter, int64_t value) {
+			counters[counter].value.fetch_add(value, std::memory_order_relaxed);
+		}
+
+		/**
+		 * @return value of the counter registered under name (0 if none)
+		 */
+		int64_t GetCounter(char const *name) {
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t count = counter_count.load(std::memory_order_relaxed);
+			for (uint32_t i = 0; i < count; ++i) {
+				if (std::strcmp(counters[i].name, name) == 0) return counters[i].value.load(std::memory_order_relaxed);
+			}
+			return 0;
+		}
+
+		/**
+		 * add the duration [start, end) to a zone, from any thread
+		 */
+		void Record(uint32_t zone, Clock::time_point start, Clock::time_point end) {
+			int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+			zones[zone].ns.fetch_add(static_cast<uint64_t>(ns), std::memory_order_relaxed);
+			zones[zone].hits.fetch_add(1, std::memory_order_relaxed);
+			if (tracing.load(std::memory_order_relaxed)) {
+				int64_t offset = std::chrono::duration_cast<std::chrono::nanoseconds>(start - origin).count();
+				std::lock_guard<std::mutex> lock(trace_mutex);
+				try {
+					if (events.size() < MAX_EVENTS) events.push_back({ zone, ThreadId(), offset, ns });
+				} catch (std::bad_alloc const&) {
+					// out of memory, keep what was recorded
+					tracing.store(false, std::memory_order_relaxed);
+				}
+			}
+		}
+
+		/**
+		 * end the current frame: push the time spent in each zone in the windows
+		 * called by GameEngine at the end of each frame
+		 */
+		void NextFrame(void) {
+			Clock::time_point now = Clock::now();
+			Record(frame_zone, frame_start, now);
+			frame_start = now;
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t count = zone_count.load(std::memory_order_relaxed);
+			for (uint32_t i = 0; i < count; ++i) {
+				Zone& zone = zones[i];
+				if (zone.hits.exchange(0, std::memory_order_relaxed) == 0) continue;
+				uint64_t ns = zone.ns.exchange(0, std::memory_order_relaxed);
+				zone.window[zone.frames % WINDOW] = static_cast<double>(ns) * 1e-6;
+				++zone.frames;
+			}
+		}
+
+		/**
+		 * @return statistics of the zone registered under name (all 0 if none)
+		 */
+		Stats GetStats(char const *name) {
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t count = zone_count.load(std::memory_order_relaxed);
+			for (uint32_t i = 0; i < count; ++i) {
+				if (std::strcmp(zones[i].name, name) == 0) return Compute(zones[i]);
+			}
+			return Stats{ 0.0, 0.0, 0.0, 0.0, 0 };
+		}
+
+		/**
+		 * print the statistics of every zone, in milliseconds per frame,
+		 * followed by the counters
+		 */
+		void Report(std::ostream& os) {
+			std::lock_guard<std::mutex> lock(mutex);
+			std::ios::fmtflags flags = os.flags();
+			std::streamsize precision = os.precision();
+			os << std::left << std::setw(16) << "zone" << std::right
+				<< std::setw(10) << "last" << std::setw(10) << "min"
+				<< std::setw(10) << "avg" << std::setw(10) << "p99" << " (ms)\n";
+			os << std::fixed << std::setprecision(3);
+			uint32_t count = zone_count.load(std::memory_order_relaxed);
+			for (uint32_t i = 0; i < count; ++i) {
+				if (zones[i].frames == 0) continue;
+				Stats stats = Compute(zones[i]);
+				os << std::left << std::setw(16) << zones[i].name << std::right
+					<< std::setw(10) << stats.last << std::setw(10) << stats.min
+					<< std::setw(10) << stats.avg << std::setw(10) << stats.p99 << '\n';
+			}
+			count = counter_count.load(std::memory_order_relaxed);
+			for (uint32_t i = 0; i < count; ++i) {
+				os << std::left << std::setw(16) << counters[i].name << std::right
+					<< std::setw(10) << counters[i].value.load(std::memory_order_relaxed) << '\n';
+			}
+			os.flags(flags);
+			os.precision(precision);
+		}
+
+		/**
+		 * start recording a trace, discarding any previous one
+		 */
+		void StartTrace(void) {
+			{
+				std::lock_guard<std::mutex> lock(trace_mutex);
+				events.clear();
+				origin = Clock::now();
+			}
+			tracing.store(true, std::memory_order_relaxed);
+		}
+
+		/**
+		 * stop recording and write the trace in Chrome trace event format
+		 * @param path output file
+		 * @return true on success, false otherwise
+		 */
+		bool StopTrace(char const *path) {
+			tracing.store(false, std::memory_order_relaxed);
+			std::lock_guard<std::mutex> lock(trace_mutex);
+			std::ofstream file(path);
+			if (!file) return false;
+			file << "{\"traceEvents\":[";
+			file << std::fixed << std::setprecision(3);
+			for (size_t i = 0; i < events.size(); ++i) {
+				Event const& event = events[i];
+				file << (i == 0 ? "\n" : ",\n") << "{\"name\":\"";
+				WriteEscaped(file, zones[event.zone].name);
+				file << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.thread
+					<< ",\"ts\":" << static_cast<double>(event.start) * 1e-3
+					<< ",\"dur\":" << static_cast<double>(event.duration) * 1e-3 << "}";
+			}
+			file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+			events.clear();
+			return static_cast<bool>(file);
+		}
+
+	}; // class Profiler
+
+	/**
+	 * add the lifetime of the object to a zone (see RICO_PROFILE)
+	 */
+	class ProfileScope {
+	private:
+
+		uint32_t zone;
+		std::chrono::steady_clock::time_point start;
+
+	public:
+
+		explicit ProfileScope(uint32_t _zone) :
+			zone(_zone),
+			start(std::chrono::steady_clock::now())
+		{}
+
+		~ProfileScope(void) noexcept {
+			Profiler::Get().Record(zone, start, std::chrono::steady_clock::now());
+		}
+
+		ProfileScope(ProfileScope const&) = delete;
+		ProfileScope& operator=(ProfileScope const&) = delete;
+
+	}; // class ProfileScope
+
+} // namespace rico
+
+#define RICO_PROFILE_JOIN2(a, b) a##b
+#define RICO_PROFILE_JOIN(a, b) RICO_PROFILE_JOIN2(a, b)
+
+#if RICO_PROFILER
+/**
+ * measure the enclosing scope as zone name (registered on first use)
+ */
+#define RICO_PROFILE(name) \
+	static uint32_t const RICO_PROFILE_JOIN(rico_zone_, __LINE__) = ::rico::Profiler::Get().Register(name); \
+	::rico::ProfileScope RICO_PROFILE_JOIN(rico_scope_, __LINE__)(RICO_PROFILE_JOIN(rico_zone_, __LINE__))
+#else
+#define RICO_PROFILE(name) static_cast<void>(0)
+#endif
@@ -16,17 +16,47 @@
  * Keeping the uniform distribution when calling Random::rangeUint
  * is not easy. 'Random::Uint() % range_size' does not keep it
  * (pigeonhole principle, some outputs have higher probability)
+ * rangeUint maps x to (x * range_size) >> 32 instead (Lemire), and only
+ * rejects the few x that would break the distribution, which is detected
+ * with a single comparison in most cases (no division)
+ *
+ * RandomStream is a generator object (xoshiro256**, period 2^256 - 1)
+ * for code that cannot share the singleton, such as threads: Jump moves
+ * 2^128 numbers ahead, LongJump 2^192, so that streams never overlap.
+ * RandomStreams holds one stream per thread (LongJump apart), each on its
+ * own cache line, to be indexed with ThreadPool::ThreadIndex.
+ * RandomStream::Fill / FillBytes generate many numbers at once from 4
+ * interleaved states, with an AVX2 or NEON version selected at runtime
+ * (same output as the scalar one). Lane k starts (k + 1) * 2^125 numbers
+ * ahead, before the next Jump: no Jump or LongJump of any stream lands in
+ * the lanes of another, and each lane has 2^125 numbers to itself.
  *
  * sources :
  * LCG = wikipedia - linear congruential generator
  * rangeUint distribution = stackexchange - 1242163
+ * bounded range = Lemire, "Fast Random Integer Generation in an Interval"
+ * xoshiro256** = Blackman & Vigna, "Scrambled Linear Pseudorandom Number Generators"
  * class structure = youtube "The Cherno" - singleton
  */
 
 #pragma once
 
+#include <cstddef> // size_t
+#include <cstdint> // uint32_t, uint64_t
+#include <cstring> // std::memcpy
 #include <ctime> // std::time_t, std::time
 #include <stdexcept> // std::domain_error
+#include <vector> // std::vector
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RICO_RANDOM_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define RICO_RANDOM_NEON 1
+#include <arm_neon.h>
+#endif
 
 class Random {
 public:
@@ -35,6 +65,11 @@ public:
 		get().state = s;
 	}
 
+	/* current state, Seed(State()) resumes the sequence from here */
+	static uint64_t State(void) {
+		return get().state;
+	}
+
 	/* range [ 0 , 2^32-1 ] */
 	static uint32_t Uint(void) {
 		uint64_t retval = get().update();
@@ -50,21 +85,29 @@ public:
 	/* range [ min, max ] */
 	static uint32_t rangeUint(uint32_t min, uint32_t max) {
 		if (max < min) throw std::domain_error("empty range");
-		uint64_t range_size = static_cast<uint64_t>(max) - min + 1;
-		if (range_size == 1) return min;
-		// find a range
-		// - as large as possible so that the following process is fast
-		// - divisible by range_size so that the % operation is safe
-		uint64_t max_divisible_range = 1 + static_cast<uint64_t>(MAX);
-		max_divisible_range /= range_size;
-		max_divisible_range *= range_size;
-		// wait for the random process to fall in this range
-		uint32_t x;
-		while (true) {
-			x = Uint();
-			if (x < max_divisible_range) break;
+		return min + bounded(static_cast<uint32_t>(max - min), Uint);
+	}
+
+	/**
+	 * uniform in [ 0, max ] from a source of uniform 32 bits numbers (Lemire)
+	 * x * (max + 1) >> 32 is in range, but 2^32 % (max + 1) values of the
+	 * low half are hit once more than the others: they are rejected
+	 */
+	template<typename F>
+	static uint32_t bounded(uint32_t max, F&& next) {
+		if (max == MAX) return next();
+		uint32_t range_size = max + 1;
+		uint64_t m = static_cast<uint64_t>(next()) * range_size;
+		uint32_t low = static_cast<uint32_t>(m);
+		if (low < range_size) {
+			// slow path, rarely taken for small ranges
+			uint32_t threshold = (0u - range_size) % range_size;
+			while (low < threshold) {
+				m = static_cast<uint64_t>(next()) * range_size;
+				low = static_cast<uint32_t>(m);
+			}
 		}
-		return min + x % range_size;
+		return static_cast<uint32_t>(m >> 32);
 	}
 
 	/* range [ 0, max ] */
@@ -93,10 +136,11 @@ public:
 		return min + Double() * (max - min);
 	}
 
+	static constexpr uint32_t MAX = static_cast<uint32_t>(0xffffffff); // 2^32-1
+
 private:
 
 	uint64_t state;
-	static constexpr uint32_t MAX = static_cast<uint32_t>(0xffffffff); // 2^32-1
 
 	/**
 	 * private constructor of the singleton
@@ -126,4 +170,318 @@ private:
 		return state;
 	}
 
-}; // class Random
\ No newline at end of file
+}; // class Random
+
+/**
+ * xoshiro256** generator, to be used by a single thread at a time
+ */
+class alignas(64) RandomStream {
+public:
+
+	/**
+	 * seeded with the output of splitmix64 on seed (any value is fine)
+	 */
+	explicit RandomStream(uint64_t seed = 0) {
+		Seed(seed);
+	}
+
+	void Seed(uint64_t seed) {
+		for (uint64_t& word : s) {
+			// splitmix64
+			seed += 0x9e3779b97f4a7c15;
+			uint64_t z = seed;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+			word = z ^ (z >> 31);
+		}
+		SplitLanes();
+	}
+
+	/* range [ 0 , 2^64-1 ] */
+	uint64_t Uint64(void) {
+		return next(s);
+	}
+
+	/* range [ 0 , 2^32-1 ] */
+	uint32_t Uint(void) {
+		return static_cast<uint32_t>(Uint64() >> 32);
+	}
+
+	/* range [ 0 , 2^31-1 ] */
+	int32_t Int(void) {
+		return Uint() >> 1;
+	}
+
+	/* range [ min, max ] */
+	uint32_t rangeUint(uint32_t min, uint32_t max) {
+		if (max < min) throw std::domain_error("empty range");
+		return min + Random::bounded(static_cast<uint32_t>(max - min), [this]() { return Uint(); });
+	}
+
+	/* range [ 0, max ] */
+	uint32_t rangeUint(uint32_t max) {
+		return rangeUint(0, max);
+	}
+
+	/* range [ min, max ] */
+	int32_t rangeInt(int32_t min, int32_t max) {
+		if (max < min) throw std::domain_error("empty range");
+		uint32_t umax = static_cast<uint32_t>(max) - static_cast<uint32_t>(min);
+		return static_cast<int32_t>(static_cast<uint32_t>(min) + rangeUint(umax));
+	}
+
+	/* range [ 0.0 , 1.0 ), 53 random bits */
+	double Double(void) {
+		return static_cast<double>(Uint64() >> 11) * 0x1.0p-53;
+	}
+
+	/* range [ min , max ) */
+	double rangeDouble(double min, double max) {
+		if (max <= min) throw std::domain_error("empty range");
+		return min + Double() * (max - min);
+	}
+
+	/**
+	 * advance by 2^128 numbers, 2^128 calls to Uint64 away
+	 */
+	void Jump(void) {
+		static constexpr uint64_t polynomial[4] = { 0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c };
+		jump(s, polynomial);
+		SplitLanes();
+	}
+
+	/**
+	 * advance by 2^192 numbers, 2^64 calls to Jump away
+	 */
+	void LongJump(void) {
+		static constexpr uint64_t polynomial[4] = { 0x76e15d3efefdcbbf, 0xc5004e441c522fb3, 0x77710069854ee241, 0x39109bb02acbe635 };
+		jump(s, polynomial);
+		SplitLanes();
+	}
+
+	/**
+	 * write n uniform 32 bits numbers to dst, with the bits of mask set
+	 * (for instance PixelFormat::alpha_mask for opaque pixels, see pixel.hpp)
+	 * uses the interleaved states, not the one of Uint64 and others
+	 */
+	void Fill(uint32_t *dst, size_t n, uint32_t mask = 0) {
+		FillBytes(dst, n * sizeof(uint32_t), mask);
+	}
+
+	/**
+	 * write size uniform bytes to dst, each 32 bits word being or-ed with
+	 * mask (size need not be a multiple of 4, nor dst aligned)
+	 */
+	void FillBytes(void *dst, size_t size, uint32_t mask = 0) {
+		unsigned char *bytes = static_cast<unsigned char*>(dst);
+		size_t blocks = size / BLOCK;
+		kernel()(lanes, bytes, blocks, mask);
+		size_t rest = size - blocks * BLOCK;
+		if (rest != 0) {
+			unsigned char block[BLOCK];
+			kernel()(lanes, block, 1, mask);
+			std::memcpy(bytes + blocks * BLOCK, block, rest);
+		}
+	}
+
+	/**
+	 * @return name of the Fill kernel selected for this CPU ("avx2", "neon", "scalar")
+	 */
+	static char const* backend(void) {
+		return select().name;
+	}
+
+private:
+
+	static constexpr size_t BLOCK = 32; // bytes written by a step of the 4 lanes
+
+	uint64_t s[4]; // state of Uint64 and others
+	uint64_t lanes[4][4]; // word, lane: states of Fill, 2^125 numbers apart
+
+	static uint64_t rotl(uint64_t x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+
+	static uint64_t next(uint64_t (&state)[4]) {
+		uint64_t retval = rotl(state[1] * 5, 7) * 9;
+		uint64_t t = state[1] << 17;
+		state[2] ^= state[0];
+		state[3] ^= state[1];
+		state[1] ^= state[2];
+		state[0] ^= state[3];
+		state[2] ^= t;
+		state[3] = rotl(state[3], 45);
+		return retval;
+	}
+
+	static void jump(uint64_t (&state)[4], uint64_t const (&polynomial)[4]) {
+		uint64_t result[4] = { 0, 0, 0, 0 };
+		for (uint64_t word : polynomial) {
+			for (int bit = 0; bit < 64; ++bit) {
+				if (word & (uint64_t(1) << bit)) {
+					for (int i = 0; i < 4; ++i) result[i] ^= state[i];
+				}
+				next(state);
+			}
+		}
+		for (int i = 0; i < 4; ++i) state[i] = result[i];
+	}
+
+	// lane k is s moved (k + 1) * 2^125 numbers ahead, a quarter of a Jump
+	// (polynomial x^(2^125) modulo the characteristic one, as those of Jump)
+	void SplitLanes(void) {
+		static constexpr uint64_t polynomial[4] = { 0xaeb33557c76543fe, 0x1b18a0517cea386a, 0x56e93ecb5b361995, 0xaa72e405fb26c80a };
+		uint64_t state[4] = { s[0], s[1], s[2], s[3] };
+		for (int lane = 0; lane < 4; ++lane) {
+			jump(state, polynomial);
+			for (int word = 0; word < 4; ++word) lanes[word][lane] = state[word];
+		}
+	}
+
+	// write blocks steps of the 4 lanes, lane after lane, each block
+	using Kernel = void (*)(uint64_t (&lanes)[4][4], unsigned char *dst, size_t blocks, uint32_t mask);
+
+	static void fill_scalar(uint64_t (&lanes)[4][4], unsigned char *dst, size_t blocks, uint32_t mask) {
+		uint64_t wide_mask = (static_cast<uint64_t>(mask) << 32) | mask;
+		for (size_t block = 0; block < blocks; ++block) {
+			for (int lane = 0; lane < 4; ++lane) {
+				uint64_t state[4] = { lanes[0][lane], lanes[1][lane], lanes[2][lane], lanes[3][lane] };
+				uint64_t value = next(state) | wide_mask;
+				for (int word = 0; word < 4; ++word) lanes[word][lane] = state[word];
+				// little endian layout, as the SIMD stores
+				for (int byte = 0; byte < 8; ++byte) dst[block * BLOCK + lane * 8 + byte] = static_cast<unsigned char>(value >> (8 * byte));
+			}
+		}
+	}
+
+#ifdef RICO_RANDOM_X86
+
+	__attribute__((target("avx2")))
+	static __m256i rotl_avx2(__m256i x, int k) {
+		return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+	}
+
+	__attribute__((target("avx2")))
+	static void fill_avx2(uint64_t (&lanes)[4][4], unsigned char *dst, size_t blocks, uint32_t mask) {
+		__m256i s0 = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(lanes[0]));
+		__m256i s1 = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(lanes[1]));
+		__m256i s2 = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(lanes[2]));
+		__m256i s3 = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(lanes[3]));
+		__m256i wide_mask = _mm256_set1_epi32(static_cast<int>(mask));
+		for (size_t block = 0; block < blocks; ++block) {
+			// rotl(s1 * 5, 7) * 9, multiplications as shifts and adds
+			__m256i x = _mm256_add_epi64(_mm256_slli_epi64(s1, 2), s1);
+			x = rotl_avx2(x, 7);
+			x = _mm256_add_epi64(_mm256_slli_epi64(x, 3), x);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + block * BLOCK), _mm256_or_si256(x, wide_mask));
+			__m256i t = _mm256_slli_epi64(s1, 17);
+			s2 = _mm256_xor_si256(s2, s0);
+			s3 = _mm256_xor_si256(s3, s1);
+			s1 = _mm256_xor_si256(s1, s2);
+			s0 = _mm256_xor_si256(s0, s3);
+			s2 = _mm256_xor_si256(s2, t);
+			s3 = rotl_avx2(s3, 45);
+		}
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes[0]), s0);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes[1]), s1);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes[2]), s2);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes[3]), s3);
+	}
+
+#endif // RICO_RANDOM_X86
+
+#ifdef RICO_RANDOM_NEON
+
+	static uint64x2_t rotl_neon(uint64x2_t x, int k) {
+		return vorrq_u64(vshlq_u64(x, vdupq_n_s64(k)), vshlq_u64(x, vdupq_n_s64(k - 64)));
+	}
+
+	// lanes 2 by 2, low half then high half of each block
+	static void fill_neon(uint64_t (&lanes)[4][4], unsigned char *dst, size_t blocks, uint32_t mask) {
+		uint64x2_t wide_mask = vreinterpretq_u64_u32(vdupq_n_u32(mask));
+		for (int half = 0; half < 2; ++half) {
+			uint64x2_t s0 = vld1q_u64(lanes[0] + 2 * half), s1 = vld1q_u64(lanes[1] + 2 * half);
+			uint64x2_t s2 = vld1q_u64(lanes[2] + 2 * half), s3 = vld1q_u64(lanes[3] + 2 * half);
+			for (size_t block = 0; block < blocks; ++block) {
+				uint64x2_t x = vaddq_u64(vshlq_n_u64(s1, 2), s1);
+				x = rotl_neon(x, 7);
+				x = vaddq_u64(vshlq_n_u64(x, 3), x);
+				vst1q_u8(dst + block * BLOCK + 16 * half, vreinterpretq_u8_u64(vorrq_u64(x, wide_mask)));
+				uint64x2_t t = vshlq_n_u64(s1, 17);
+				s2 = veorq_u64(s2, s0);
+				s3 = veorq_u64(s3, s1);
+				s1 = veorq_u64(s1, s2);
+				s0 = veorq_u64(s0, s3);
+				s2 = veorq_u64(s2, t);
+				s3 = rotl_neon(s3, 45);
+			}
+			vst1q_u64(lanes[0] + 2 * half, s0);
+			vst1q_u64(lanes[1] + 2 * half, s1);
+			vst1q_u64(lanes[2] + 2 * half, s2);
+			vst1q_u64(lanes[3] + 2 * half, s3);
+		}
+	}
+
+#endif // RICO_RANDOM_NEON
+
+	struct Selected {
+		char const *name;
+		Kernel fill;
+	}; // struct RandomStream::Selected
+
+	static Selected const& select(void) {
+		static Selected const selected = []() {
+#if defined(RICO_RANDOM_X86)
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2")) return Selected { "avx2", fill_avx2 };
+#elif defined(RICO_RANDOM_NEON)
+			return Selected { "neon", fill_neon };
+#endif
+			return Selected { "scalar", fill_scalar };
+		}();
+		return selected;
+	}
+
+	static Kernel kernel(void) {
+		return select().fill;
+	}
+
+}; // class RandomStream
+
+/**
+ * one RandomStream per thread, LongJump apart, not sharing cache lines
+ */
+class RandomStreams {
+public:
+
+	/**
+	 * @param count number of streams (ThreadPool::Size for a pool)
+	 * @param seed seed of the first stream
+	 */
+	explicit RandomStreams(uint32_t count = 0, uint64_t seed = 0) {
+		Seed(count, seed);
+	}
+
+	void Seed(uint32_t count, uint64_t seed) {
+		streams.clear();
+		streams.reserve(count);
+		RandomStream stream(seed);
+		for (uint32_t i = 0; i < count; ++i) {
+			streams.push_back(stream);
+			stream.LongJump();
+		}
+	}
+
+	uint32_t size(void) const {
+		return static_cast<uint32_t>(streams.size());
+	}
+
+	RandomStream& operator[](uint32_t index) {
+		return streams[index];
+	}
+
+private:
+
+	std::vector<RandomStream> streams;
+
+}; // class RandomStreams
@@ -0,0 +1,731 @@
+/** rico/raster.hpp
+ *
+ * Bulk operations on rectangles of 32 bits pixels:
+ * fill = set every pixel to the same value
+ * copy = copy pixels from another rectangle (blit)
+ * saturating_sub = subtract a value from each byte, clamping at 0
+ * blend = draw a rectangle over another, using its alpha channel
+ * expand = look 8 bits indices up in a 256 entries palette (LUT)
+ * downsample = halve a rectangle on both axes, each pixel being the
+ *   average of 2 x 2 pixels (box filter), per channel and rounded:
+ *   out = (a + b + c + d + 2) / 4
+ *
+ * A rectangle is given by a pointer to its top-left pixel, its width and
+ * height, and its pitch (the distance between two rows, in pixels).
+ *
+ * Each operation has a scalar version and SIMD versions (SSE2 and AVX2 on
+ * x86, NEON on ARM). The best version supported by the CPU is selected at
+ * runtime, the first time an operation is used. All versions produce
+ * exactly the same result. copy relies on std::memmove, which is already
+ * vectorized by the C library. expand only has an AVX2 version (gather),
+ * SSE2 and NEON have no vector table lookup of 32 bits entries.
+ *
+ * blend reads the alpha channel where PixelFormat puts it (see pixel.hpp)
+ * and compute for each channel: out = (src * a + dst * (255 - a)) / 255
+ * rounded to the nearest integer, the alpha of src being used as 255
+ *
+ * Shapes are rasterized with integer arithmetic only, into an image given
+ * by a pointer to its pixel (0, 0) and its pitch, and clipped to a Clip
+ * rectangle inside of it. Coordinates are signed, corners and end points
+ * are included. Rows are written with fill (short ones inline).
+ * draw_line = incremental Bresenham: the outcodes of the end points
+ *   (Cohen-Sutherland) accept or reject the whole line, otherwise the range
+ *   of steps inside the clip is computed, starting the error term in the
+ *   middle of the line, so a clipped line keeps the pixels of the full one
+ *   (end points very far from the clip are first moved along the line)
+ * draw_rect / fill_rect = outline / area of a rectangle
+ * draw_circle / fill_circle = the row d of a circle of radius r spans
+ *   [-w, +w] with w the largest integer such that w^2 + d^2 <= r^2 + r,
+ *   the outline keeps the pixels not covered by the next row toward the
+ *   center, fill_circle can leave it out (interior only)
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include "pixel.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RICO_RASTER_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+#define RICO_RASTER_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace rico {
+namespace raster {
+
+	/**
+	 * row kernels, process n consecutive pixels
+	 */
+	struct Kernels {
+		char const *name;
+		void (*fill)(uint32_t *dst, size_t n, uint32_t value);
+		void (*saturating_sub)(uint32_t *dst, size_t n, uint32_t amount);
+		void (*blend)(uint32_t *dst, uint32_t const *src, size_t n);
+		void (*expand)(uint32_t *dst, uint8_t const *src, size_t n, uint32_t const *lut);
+		// n pixels of dst from 2 * n pixels of the rows src0 and src1
+		void (*downsample)(uint32_t *dst, uint32_t const *src0, uint32_t const *src1, size_t n);
+	}; // struct Kernels
+
+	namespace detail {
+
+		// byte of the alpha channel in a pixel
+		constexpr uint32_t ALPHA_SHIFT = PixelFormat::alpha_shift;
+		constexpr uint32_t ALPHA_BYTE = ALPHA_SHIFT / 8;
+
+		// exact rounding of t / 255, for t in [0, 255*255]
+		inline uint32_t div255(uint32_t t) {
+			t += 128;
+			return (t + (t >> 8)) >> 8;
+		}
+
+		inline uint32_t blend_pixel(uint32_t dst, uint32_t src) {
+			uint32_t a = (src >> ALPHA_SHIFT) & 0xff, inv = 255 - a;
+			src |= PixelFormat::alpha_mask;
+			uint32_t retval = 0;
+			for (uint32_t shift = 0; shift < 32; shift += 8) {
+				uint32_t s = (src >> shift) & 0xff, d = (dst >> shift) & 0xff;
+				retval |= div255(s * a + d * inv) << shift;
+			}
+			return retval;
+		}
+
+		inline uint32_t saturating_sub_pixel(uint32_t dst, uint32_t amount) {
+			uint32_t retval = 0;
+			for (uint32_t shift = 0; shift < 32; shift += 8) {
+				uint32_t d = (dst >> shift) & 0xff, a = (amount >> shift) & 0xff;
+				retval |= ((d > a) ? d - a : 0) << shift;
+			}
+			return retval;
+		}
+
+		inline void fill_scalar(uint32_t *dst, size_t n, uint32_t value) {
+			for (size_t i = 0; i < n; ++i) dst[i] = value;
+		}
+
+		inline void saturating_sub_scalar(uint32_t *dst, size_t n, uint32_t amount) {
+			for (size_t i = 0; i < n; ++i) dst[i] = saturating_sub_pixel(dst[i], amount);
+		}
+
+		inline void blend_scalar(uint32_t *dst, uint32_t const *src, size_t n) {
+			for (size_t i = 0; i < n; ++i) dst[i] = blend_pixel(dst[i], src[i]);
+		}
+
+		inline void expand_scalar(uint32_t *dst, uint8_t const *src, size_t n, uint32_t const *lut) {
+			for (size_t i = 0; i < n; ++i) dst[i] = lut[src[i]];
+		}
+
+		inline void downsample_scalar(uint32_t *dst, uint32_t const *src0, uint32_t const *src1, size_t n) {
+			for (size_t i = 0; i < n; ++i) {
+				uint32_t a = src0[2 * i], b = src0[2 * i + 1], c = src1[2 * i], d = src1[2 * i + 1];
+				// channels 0 and 2, then 1 and 3, summed in 16 bits lanes of one word
+				uint32_t even = (a & 0x00ff00ff) + (b & 0x00ff00ff) + (c & 0x00ff00ff) + (d & 0x00ff00ff) + 0x00020002;
+				uint32_t odd = ((a >> 8) & 0x00ff00ff) + ((b >> 8) & 0x00ff00ff)
+					+ ((c >> 8) & 0x00ff00ff) + ((d >> 8) & 0x00ff00ff) + 0x00020002;
+				dst[i] = ((even >> 2) & 0x00ff00ff) | (((odd >> 2) & 0x00ff00ff) << 8);
+			}
+		}
+
+#ifdef RICO_RASTER_X86
+
+		__attribute__((target("sse2")))
+		inline void fill_sse2(uint32_t *dst, size_t n, uint32_t value) {
+			__m128i v = _mm_set1_epi32(static_cast<int>(value));
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4) {
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+			}
+			fill_scalar(dst + i, n - i, value);
+		}
+
+		__attribute__((target("sse2")))
+		inline void saturating_sub_sse2(uint32_t *dst, size_t n, uint32_t amount) {
+			__m128i v = _mm_set1_epi32(static_cast<int>(amount));
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4) {
+				__m128i *p = reinterpret_cast<__m128i*>(dst + i);
+				_mm_storeu_si128(p, _mm_subs_epu8(_mm_loadu_si128(p), v));
+			}
+			saturating_sub_scalar(dst + i, n - i, amount);
+		}
+
+		// blend 2 pixels held as 8 lanes of 16 bits
+		__attribute__((target("sse2")))
+		inline __m128i blend_epi16_sse2(__m128i d, __m128i s) {
+			// broadcast the alpha lane of each pixel to its 4 lanes
+			constexpr int broadcast = ALPHA_BYTE * 0x55;
+			__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, broadcast), broadcast);
+			s = _mm_or_si128(s, _mm_set1_epi64x(static_cast<int64_t>(uint64_t(255) << (16 * ALPHA_BYTE))));
+			__m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), a);
+			__m128i t = _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, inv));
+			t = _mm_add_epi16(t, _mm_set1_epi16(128));
+			return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+		}
+
+		__attribute__((target("sse2")))
+		inline void blend_sse2(uint32_t *dst, uint32_t const *src, size_t n) {
+			__m128i zero = _mm_setzero_si128();
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4) {
+				__m128i *p = reinterpret_cast<__m128i*>(dst + i);
+				__m128i d = _mm_loadu_si128(p);
+				__m128i s = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+				__m128i lo = blend_epi16_sse2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero));
+				__m128i hi = blend_epi16_sse2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero));
+				_mm_storeu_si128(p, _mm_packus_epi16(lo, hi));
+			}
+			blend_scalar(dst + i, src + i, n - i);
+		}
+
+		__attribute__((target("avx2")))
+		inline void fill_avx2(uint32_t *dst, size_t n, uint32_t value) {
+			__m256i v = _mm256_set1_epi32(static_cast<int>(value));
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8) {
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+			}
+			fill_scalar(dst + i, n - i, value);
+		}
+
+		__attribute__((target("avx2")))
+		inline void saturating_sub_avx2(uint32_t *dst, size_t n, uint32_t amount) {
+			__m256i v = _mm256_set1_epi32(static_cast<int>(amount));
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8) {
+				__m256i *p = reinterpret_cast<__m256i*>(dst + i);
+				_mm256_storeu_si256(p, _mm256_subs_epu8(_mm256_loadu_si256(p), v));
+			}
+			saturating_sub_scalar(dst + i, n - i, amount);
+		}
+
+		// blend 4 pixels held as 16 lanes of 16 bits
+		__attribute__((target("avx2")))
+		inline __m256i blend_epi16_avx2(__m256i d, __m256i s) {
+			constexpr int broadcast = ALPHA_BYTE * 0x55;
+			__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, broadcast), broadcast);
+			s = _mm256_or_si256(s, _mm256_set1_epi64x(static_cast<int64_t>(uint64_t(255) << (16 * ALPHA_BYTE))));
+			__m256i inv = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+			__m256i t = _mm256_add_epi16(_mm256_mullo_epi16(s, a), _mm256_mullo_epi16(d, inv));
+			t = _mm256_add_epi16(t, _mm256_set1_epi16(128));
+			return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+		}
+
+		__attribute__((target("avx2")))
+		inline void blend_avx2(uint32_t *dst, uint32_t const *src, size_t n) {
+			__m256i zero = _mm256_setzero_si256();
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8) {
+				__m256i *p = reinterpret_cast<__m256i*>(dst + i);
+				__m256i d = _mm256_loadu_si256(p);
+				__m256i s = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i));
+				// unpack and pack both work within 128 bits lanes, so pixels keep their order
+				__m256i lo = blend_epi16_avx2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero));
+				__m256i hi = blend_epi16_avx2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero));
+				_mm256_storeu_si256(p, _mm256_packus_epi16(lo, hi));
+			}
+			blend_scalar(dst + i, src + i, n - i);
+		}
+
+		__attribute__((target("avx2")))
+		inline void expand_avx2(uint32_t *dst, uint8_t const *src, size_t n, uint32_t const *lut) {
+			int const *table = reinterpret_cast<int const*>(lut);
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8) {
+				__m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(src + i)));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_i32gather_epi32(table, indices, 4));
+			}
+			expand_scalar(dst + i, src + i, n - i, lut);
+		}
+
+		// (a + b + c + d + 2) / 4 for 16 bits lanes
+		__attribute__((target("sse2")))
+		inline __m128i average4_epi16_sse2(__m128i a, __m128i b, __m128i c, __m128i d) {
+			__m128i sum = _mm_add_epi16(_mm_add_epi16(a, b), _mm_add_epi16(c, d));
+			return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+		}
+
+		__attribute__((target("sse2")))
+		inline void downsample_sse2(uint32_t *dst, uint32_t const *src0, uint32_t const *src1, size_t n) {
+			__m128i zero = _mm_setzero_si128();
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4) {
+				// split the even and odd pixels of each row
+				__m128 r0 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<__m128i const*>(src0 + 2 * i)));
+				__m128 r1 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<__m128i const*>(src0 + 2 * i + 4)));
+				__m128 r2 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<__m128i const*>(src1 + 2 * i)));
+				__m128 r3 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<__m128i const*>(src1 + 2 * i + 4)));
+				__m128i a = _mm_castps_si128(_mm_shuffle_ps(r0, r1, _MM_SHUFFLE(2, 0, 2, 0)));
+				__m128i b = _mm_castps_si128(_mm_shuffle_ps(r0, r1, _MM_SHUFFLE(3, 1, 3, 1)));
+				__m128i c = _mm_castps_si128(_mm_shuffle_ps(r2, r3, _MM_SHUFFLE(2, 0, 2, 0)));
+				__m128i d = _mm_castps_si128(_mm_shuffle_ps(r2, r3, _MM_SHUFFLE(3, 1, 3, 1)));
+				__m128i lo = average4_epi16_sse2(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero),
+					_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero));
+				__m128i hi = average4_epi16_sse2(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero),
+					_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+			}
+			downsample_scalar(dst + i, src0 + 2 * i, src1 + 2 * i, n - i);
+		}
+
+		__attribute__((target("avx2")))
+		inline __m256i average4_epi16_avx2(__m256i a, __m256i b, __m256i c, __m256i d) {
+			__m256i sum = _mm256_add_epi16(_mm256_add_epi16(a, b), _mm256_add_epi16(c, d));
+			return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+		}
+
+		__attribute__((target("avx2")))
+		inline void downsample_avx2(uint32_t *dst, uint32_t const *src0, uint32_t const *src1, size_t n) {
+			__m256i zero = _mm256_setzero_si256();
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8) {
+				__m256 r0 = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(src0 + 2 * i)));
+				__m256 r1 = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(src0 + 2 * i + 8)));
+				__m256 r2 = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(src1 + 2 * i)));
+				__m256 r3 = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(src1 + 2 * i + 8)));
+				// even and odd pixels, in the order 0 2 8 10 | 4 6 12 14 (shuffles stay in 128 bits lanes)
+				__m256i a = _mm256_castps_si256(_mm256_shuffle_ps(r0, r1, _MM_SHUFFLE(2, 0, 2, 0)));
+				__m256i b = _mm256_castps_si256(_mm256_shuffle_ps(r0, r1, _MM_SHUFFLE(3, 1, 3, 1)));
+				__m256i c = _mm256_castps_si256(_mm256_shuffle_ps(r2, r3, _MM_SHUFFLE(2, 0, 2, 0)));
+				__m256i d = _mm256_castps_si256(_mm256_shuffle_ps(r2, r3, _MM_SHUFFLE(3, 1, 3, 1)));
+				__m256i lo = average4_epi16_avx2(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero),
+					_mm256_unpacklo_epi8(c, zero), _mm256_unpacklo_epi8(d, zero));
+				__m256i hi = average4_epi16_avx2(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero),
+					_mm256_unpackhi_epi8(c, zero), _mm256_unpackhi_epi8(d, zero));
+				// back to the order 0 2 4 6 8 10 12 14
+				__m256i out = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), out);
+			}
+			downsample_scalar(dst + i, src0 + 2 * i, src1 + 2 * i, n - i);
+		}
+
+#endif // RICO_RASTER_X86
+
+#ifdef RICO_RASTER_NEON
+
+		inline void fill_neon(uint32_t *dst, size_t n, uint32_t value) {
+			uint32x4_t v = vdupq_n_u32(value);
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4) {
+				vst1q_u32(dst + i, v);
+			}
+			fill_scalar(dst + i, n - i, value);
+		}
+
+		inline void saturating_sub_neon(uint32_t *dst, size_t n, uint32_t amount) {
+			uint8x16_t v = vreinterpretq_u8_u32(vdupq_n_u32(amount));
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4) {
+				uint8x16_t d = vreinterpretq_u8_u32(vld1q_u32(dst + i));
+				vst1q_u32(dst + i, vreinterpretq_u32_u8(vqsubq_u8(d, v)));
+			}
+			saturating_sub_scalar(dst + i, n - i, amount);
+		}
+
+		// blend 8 channels (2 pixels), a holding the alpha of each channel
+		inline uint8x8_t blend_u8_neon(uint8x8_t d, uint8x8_t s, uint8x8_t a) {
+			uint16x8_t t = vmull_u8(s, a);
+			t = vmlal_u8(t, d, vsub_u8(vdup_n_u8(255), a));
+			t = vaddq_u16(t, vdupq_n_u16(128));
+			return vshrn_n_u16(vsraq_n_u16(t, t, 8), 8);
+		}
+
+		inline void blend_neon(uint32_t *dst, uint32_t const *src, size_t n) {
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4) {
+				uint32x4_t s32 = vld1q_u32(src + i);
+				// broadcast the alpha byte of each pixel to its 4 bytes
+				uint32x4_t alpha = vshlq_u32(s32, vdupq_n_s32(-static_cast<int32_t>(ALPHA_SHIFT)));
+				uint32x4_t a32 = vmulq_n_u32(vandq_u32(alpha, vdupq_n_u32(0xff)), 0x01010101);
+				uint8x16_t s = vreinterpretq_u8_u32(vorrq_u32(s32, vdupq_n_u32(PixelFormat::alpha_mask)));
+				uint8x16_t a = vreinterpretq_u8_u32(a32);
+				uint8x16_t d = vreinterpretq_u8_u32(vld1q_u32(dst + i));
+				uint8x8_t lo = blend_u8_neon(vget_low_u8(d), vget_low_u8(s), vget_low_u8(a));
+				uint8x8_t hi = blend_u8_neon(vget_high_u8(d), vget_high_u8(s), vget_high_u8(a));
+				vst1q_u32(dst + i, vreinterpretq_u32_u8(vcombine_u8(lo, hi)));
+			}
+			blend_scalar(dst + i, src + i, n - i);
+		}
+
+		inline void downsample_neon(uint32_t *dst, uint32_t const *src0, uint32_t const *src1, size_t n) {
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4) {
+				// even pixels in val[0], odd ones in val[1]
+				uint32x4x2_t r0 = vld2q_u32(src0 + 2 * i), r1 = vld2q_u32(src1 + 2 * i);
+				uint8x16_t a = vreinterpretq_u8_u32(r0.val[0]), b = vreinterpretq_u8_u32(r0.val[1]);
+				uint8x16_t c = vreinterpretq_u8_u32(r1.val[0]), d = vreinterpretq_u8_u32(r1.val[1]);
+				uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(a), vget_low_u8(b)), vaddl_u8(vget_low_u8(c), vget_low_u8(d)));
+				uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(a), vget_high_u8(b)), vaddl_u8(vget_high_u8(c), vget_high_u8(d)));
+				// rounding shift: (sum + 2) >> 2
+				vst1q_u32(dst + i, vreinterpretq_u32_u8(vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2))));
+			}
+			downsample_scalar(dst + i, src0 + 2 * i, src1 + 2 * i, n - i);
+		}
+
+#endif // RICO_RASTER_NEON
+
+		inline Kernels select(void) {
+#if defined(RICO_RASTER_X86)
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2")) {
+				return Kernels { "avx2", fill_avx2, saturating_sub_avx2, blend_avx2, expand_avx2, downsample_avx2 };
+			}
+			if (__builtin_cpu_supports("sse2")) {
+				return Kernels { "sse2", fill_sse2, saturating_sub_sse2, blend_sse2, expand_scalar, downsample_sse2 };
+			}
+#elif defined(RICO_RASTER_NEON)
+			return Kernels { "neon", fill_neon, saturating_sub_neon, blend_neon, expand_scalar, downsample_neon };
+#endif
+			return Kernels { "scalar", fill_scalar, saturating_sub_scalar, blend_scalar, expand_scalar, downsample_scalar };
+		}
+
+	} // namespace detail
+
+	/**
+	 * @return the kernels selected for this CPU
+	 */
+	inline Kernels const& kernels(void) {
+		static Kernels const selected = detail::select();
+		return selected;
+	}
+
+	/**
+	 * @return name of the selected kernels ("avx2", "sse2", "neon", "scalar")
+	 */
+	inline char const* backend(void) {
+		return kernels().name;
+	}
+
+	/**
+	 * set every pixel of the rectangle to value
+	 */
+	inline void fill(uint32_t *dst, size_t pitch, uint32_t width, uint32_t height, uint32_t value) {
+		auto kernel = kernels().fill;
+		if (pitch == width) {
+			kernel(dst, static_cast<size_t>(width) * height, value);
+			return;
+		}
+		for (uint32_t row = 0; row < height; ++row) {
+			kernel(dst + row * pitch, width, value);
+		}
+	}
+
+	/**
+	 * copy the src rectangle into the dst rectangle (they may overlap)
+	 */
+	inline void copy(
+		uint32_t *dst, size_t dst_pitch,
+		uint32_t const *src, size_t src_pitch,
+		uint32_t width, uint32_t height)
+	{
+		size_t row_bytes = width * sizeof(uint32_t);
+		if (dst_pitch == width && src_pitch == width) {
+			std::memmove(dst, src, row_bytes * height);
+			return;
+		}
+		if (dst > src) {
+			// copy bottom-up so that overlapping rows are read before written
+			for (uint32_t row = height; row > 0; --row) {
+				std::memmove(dst + (row - 1) * dst_pitch, src + (row - 1) * src_pitch, row_bytes);
+			}
+		} else {
+			for (uint32_t row = 0; row < height; ++row) {
+				std::memmove(dst + row * dst_pitch, src + row * src_pitch, row_bytes);
+			}
+		}
+	}
+
+	/**
+	 * subtract each byte of amount from the matching byte of every pixel,
+	 * clamping at 0 (use 0 for the bytes of channels to keep unchanged)
+	 */
+	inline void saturating_sub(uint32_t *dst, size_t pitch, uint32_t width, uint32_t height, uint32_t amount) {
+		auto kernel = kernels().saturating_sub;
+		if (pitch == width) {
+			kernel(dst, static_cast<size_t>(width) * height, amount);
+			return;
+		}
+		for (uint32_t row = 0; row < height; ++row) {
+			kernel(dst + row * pitch, width, amount);
+		}
+	}
+
+	/**
+	 * draw the src rectangle over the dst rectangle (they must not overlap)
+	 */
+	inline void blend(
+		uint32_t *dst, size_t dst_pitch,
+		uint32_t const *src, size_t src_pitch,
+		uint32_t width, uint32_t height)
+	{
+		auto kernel = kernels().blend;
+		if (dst_pitch == width && src_pitch == width) {
+			kernel(dst, src, static_cast<size_t>(width) * height);
+			return;
+		}
+		for (uint32_t row = 0; row < height; ++row) {
+			kernel(dst + row * dst_pitch, src + row * src_pitch, width);
+		}
+	}
+
+	/**
+	 * replace each index of the src rectangle by its entry in lut (256
+	 * entries), into the dst rectangle
+	 */
+	inline void expand(
+		uint32_t *dst, size_t dst_pitch,
+		uint8_t const *src, size_t src_pitch,
+		uint32_t width, uint32_t height,
+		uint32_t const *lut)
+	{
+		auto kernel = kernels().expand;
+		if (dst_pitch == width && src_pitch == width) {
+			kernel(dst, src, static_cast<size_t>(width) * height, lut);
+			return;
+		}
+		for (uint32_t row = 0; row < height; ++row) {
+			kernel(dst + row * dst_pitch, src + row * src_pitch, width, lut);
+		}
+	}
+
+	/**
+	 * box filter the src rectangle of 2 * width x 2 * height pixels into the
+	 * dst rectangle of width x height pixels
+	 */
+	inline void downsample(
+		uint32_t *dst, size_t dst_pitch,
+		uint32_t const *src, size_t src_pitch,
+		uint32_t width, uint32_t height)
+	{
+		auto kernel = kernels().downsample;
+		for (uint32_t row = 0; row < height; ++row) {
+			uint32_t const *top = src + 2 * row * src_pitch;
+			kernel(dst + row * dst_pitch, top, top + src_pitch, width);
+		}
+	}
+
+	/**
+	 * half-open area [x0, x1) x [y0, y1) shapes are clipped to
+	 */
+	struct Clip {
+		int32_t x0, y0, x1, y1;
+	}; // struct Clip
+
+	/**
+	 * pixels [xa, xb] of row y
+	 */
+	inline void span(uint32_t *dst, size_t pitch, Clip const& clip, int64_t y, int64_t _xa, int64_t _xb, uint32_t value) {
+		if (y < clip.y0 || y >= clip.y1) return;
+		if (_xa > _xb || _xb < clip.x0 || _xa >= clip.x1) return;
+		int32_t const xa = static_cast<int32_t>(std::max<int64_t>(_xa, clip.x0));
+		int32_t const xb = static_cast<int32_t>(std::min<int64_t>(_xb, clip.x1 - 1));
+		uint32_t *row = dst + static_cast<size_t>(y) * pitch;
+		if (xb - xa < 16) {
+			// not worth a call to the kernel
+			for (int32_t x = xa; x <= xb; ++x) row[x] = value;
+		} else {
+			kernels().fill(row + xa, static_cast<size_t>(xb - xa + 1), value);
+		}
+	}
+
+	/**
+	 * pixels [ya, yb] of column x
+	 */
+	inline void column(uint32_t *dst, size_t pitch, Clip const& clip, int64_t x, int64_t _ya, int64_t _yb, uint32_t value) {
+		if (x < clip.x0 || x >= clip.x1) return;
+		if (_ya > _yb || _yb < clip.y0 || _ya >= clip.y1) return;
+		int32_t const ya = static_cast<int32_t>(std::max<int64_t>(_ya, clip.y0));
+		int32_t const yb = static_cast<int32_t>(std::min<int64_t>(_yb, clip.y1 - 1));
+		for (int32_t y = ya; y <= yb; ++y) dst[static_cast<size_t>(y) * pitch + static_cast<size_t>(x)] = value;
+	}
+
+	namespace detail {
+
+		// Cohen-Sutherland outcode of (x, y)
+		inline uint32_t outcode(Clip const& clip, int64_t x, int64_t y) {
+			return ((x < clip.x0) ? 1 : 0) | ((x >= clip.x1) ? 2 : 0)
+				| ((y < clip.y0) ? 4 : 0) | ((y >= clip.y1) ? 8 : 0);
+		}
+
+		// end points out of [-FAR, FAR]^2 are moved along the line, so that
+		// the products of draw_line fit in int64 (clips being inside [0, FAR)^2)
+		constexpr int64_t FAR = int64_t(1) << 29;
+
+		// move (x0, y0) along the line toward (x1, y1), into [-FAR, FAR]^2,
+		// (x1, y1) not being beyond the same edge of the clip
+		// the same for every clip (the tiles of a DrawList keep joining), the
+		// line moving by less than a pixel
+		inline void pull(int64_t& x0, int64_t& y0, int64_t x1, int64_t y1) {
+			// fraction of the way to (x1, y1) reaching the limits
+			double t = 0.0;
+			if (x0 < -FAR) t = std::max(t, double(-FAR - x0) / double(x1 - x0));
+			if (x0 > FAR) t = std::max(t, double(x0 - FAR) / double(x0 - x1));
+			if (y0 < -FAR) t = std::max(t, double(-FAR - y0) / double(y1 - y0));
+			if (y0 > FAR) t = std::max(t, double(y0 - FAR) / double(y0 - y1));
+			if (t == 0.0) return;
+			int64_t const x = static_cast<int64_t>(std::llround(double(x0) + t * double(x1 - x0)));
+			int64_t const y = static_cast<int64_t>(std::llround(double(y0) + t * double(y1 - y0)));
+			x0 = std::max(-FAR, std::min(x, FAR));
+			y0 = std::max(-FAR, std::min(y, FAR));
+		}
+
+		// smallest integer >= a / b, for b > 0
+		inline int64_t ceil_div(int64_t a, int64_t b) {
+			return (a >= 0) ? (a + b - 1) / b : -((-a) / b);
+		}
+
+		// largest w such that w^2 + d^2 <= r^2 + r (half width of the row d of a circle), -1 if none
+		inline int64_t circle_half_width(int64_t r, int64_t d) {
+			int64_t target = r * r + r - d * d;
+			if (target < 0) return -1;
+			int64_t w = static_cast<int64_t>(std::sqrt(static_cast<double>(target)));
+			while (w * w > target) --w;
+			while ((w + 1) * (w + 1) <= target) ++w;
+			return w;
+		}
+
+	} // namespace detail
+
+	/**
+	 * line from (x0, y0) to (x1, y1), a single pixel if they are equal
+	 */
+	inline void draw_line(uint32_t *dst, size_t pitch, Clip const& clip,
+		int32_t _x0, int32_t _y0, int32_t _x1, int32_t _y1, uint32_t value)
+	{
+		int64_t x0 = _x0, y0 = _y0, x1 = _x1, y1 = _y1;
+		uint32_t code0 = detail::outcode(clip, x0, y0), code1 = detail::outcode(clip, x1, y1);
+		if ((code0 & code1) != 0) return; // both end points on the outer side of an edge
+		if ((code0 | code1) != 0) {
+			int64_t const x = x0, y = y0;
+			detail::pull(x0, y0, x1, y1);
+			detail::pull(x1, y1, x, y);
+			code0 = detail::outcode(clip, x0, y0);
+			code1 = detail::outcode(clip, x1, y1);
+			if ((code0 & code1) != 0) return;
+		}
+		bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+		// iterate along the major axis (u), increasing, the minor one being v
+		if (steep) {
+			std::swap(x0, y0);
+			std::swap(x1, y1);
+		}
+		if (x0 > x1) {
+			std::swap(x0, x1);
+			std::swap(y0, y1);
+		}
+		int64_t length = x1 - x0, rise = std::abs(y1 - y0), step = (y1 > y0) ? 1 : -1;
+		// pixel i is at u = u0 + i, v = v0 + step * floor((2 * i * rise + length) / (2 * length))
+		int64_t first = 0, last = length;
+		if ((code0 | code1) != 0) {
+			// partly outside, restrict i to the clip along u...
+			int64_t u_min = steep ? clip.y0 : clip.x0, u_max = (steep ? clip.y1 : clip.x1) - 1;
+			int64_t v_min = steep ? clip.x0 : clip.y0, v_max = (steep ? clip.x1 : clip.y1) - 1;
+			first = std::max<int64_t>(first, u_min - x0);
+			last = std::min<int64_t>(last, u_max - x0);
+			// ...and along v: v - v0 = step * k is inside for i in
+			// [(2 * k_min - 1) * length / (2 * rise), (2 * k_max + 1) * length / (2 * rise))
+			int64_t k_min = (step > 0) ? v_min - y0 : y0 - v_max, k_max = (step > 0) ? v_max - y0 : y0 - v_min;
+			k_min = std::max<int64_t>(k_min, 0);
+			if (k_min > k_max) return;
+			if (rise == 0) {
+				if (k_min > 0) return;
+			} else {
+				first = std::max(first, detail::ceil_div((2 * k_min - 1) * length, 2 * rise));
+				last = std::min(last, detail::ceil_div((2 * k_max + 1) * length, 2 * rise) - 1);
+			}
+			if (first > last) return;
+		}
+		int64_t denominator = 2 * std::max<int64_t>(length, 1);
+		int64_t numerator = 2 * first * rise + length;
+		int64_t v = y0 + step * (numerator / denominator), error = numerator % denominator;
+		// a step along u moves by one pixel, along v by pitch pixels (or the opposite)
+		ptrdiff_t u_stride = steep ? static_cast<ptrdiff_t>(pitch) : 1;
+		ptrdiff_t v_stride = (steep ? 1 : static_cast<ptrdiff_t>(pitch)) * step;
+		int64_t u = x0 + first;
+		uint32_t *pixel = steep
+			? dst + static_cast<ptrdiff_t>(u) * static_cast<ptrdiff_t>(pitch) + static_cast<ptrdiff_t>(v)
+			: dst + static_cast<ptrdiff_t>(v) * static_cast<ptrdiff_t>(pitch) + static_cast<ptrdiff_t>(u);
+		for (int64_t i = first; i <= last; ++i) {
+			*pixel = value;
+			pixel += u_stride;
+			error += 2 * rise;
+			if (error >= denominator) {
+				error -= denominator;
+				pixel += v_stride;
+			}
+		}
+	}
+
+	/**
+	 * outline of the rectangle of corners (x0, y0) and (x1, y1)
+	 */
+	inline void draw_rect(uint32_t *dst, size_t pitch, Clip const& clip,
+		int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t value)
+	{
+		if (x0 > x1) std::swap(x0, x1);
+		if (y0 > y1) std::swap(y0, y1);
+		span(dst, pitch, clip, y0, x0, x1, value);
+		if (y1 != y0) span(dst, pitch, clip, y1, x0, x1, value);
+		column(dst, pitch, clip, x0, int64_t(y0) + 1, int64_t(y1) - 1, value);
+		if (x1 != x0) column(dst, pitch, clip, x1, int64_t(y0) + 1, int64_t(y1) - 1, value);
+	}
+
+	/**
+	 * area of the rectangle of corners (x0, y0) and (x1, y1)
+	 */
+	inline void fill_rect(uint32_t *dst, size_t pitch, Clip const& clip,
+		int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t value)
+	{
+		int32_t xa = std::max(std::min(x0, x1), clip.x0), xb = std::min(std::max(x0, x1), clip.x1 - 1);
+		int32_t ya = std::max(std::min(y0, y1), clip.y0), yb = std::min(std::max(y0, y1), clip.y1 - 1);
+		if (xa > xb) return;
+		for (int32_t y = ya; y <= yb; ++y) span(dst, pitch, clip, y, xa, xb, value);
+	}
+
+	/**
+	 * outline of the circle of center (x, y) and radius r (nothing if r < 0)
+	 */
+	inline void draw_circle(uint32_t *dst, size_t pitch, Clip const& clip,
+		int32_t x, int32_t y, int32_t r, uint32_t value)
+	{
+		int64_t ya = std::max<int64_t>(int64_t(y) - r, clip.y0), yb = std::min<int64_t>(int64_t(y) + r, clip.y1 - 1);
+		for (int64_t row = ya; row <= yb; ++row) {
+			int64_t d = std::abs(row - y);
+			int64_t w = detail::circle_half_width(r, d);
+			// from the end of the next row toward the center, at least one pixel
+			int64_t inner = std::min(detail::circle_half_width(r, d + 1) + 1, w);
+			if (inner <= 0) {
+				span(dst, pitch, clip, row, x - w, x + w, value);
+			} else {
+				span(dst, pitch, clip, row, x - w, x - inner, value);
+				span(dst, pitch, clip, row, x + inner, x + w, value);
+			}
+		}
+	}
+
+	/**
+	 * disk of center (x, y) and radius r (nothing if r < 0)
+	 * @param interior leave out the pixels of draw_circle
+	 */
+	inline void fill_circle(uint32_t *dst, size_t pitch, Clip const& clip,
+		int32_t x, int32_t y, int32_t r, uint32_t value, bool interior = false)
+	{
+		int64_t ya = std::max<int64_t>(int64_t(y) - r, clip.y0), yb = std::min<int64_t>(int64_t(y) + r, clip.y1 - 1);
+		for (int64_t row = ya; row <= yb; ++row) {
+			int64_t d = std::abs(row - y);
+			int64_t w = detail::circle_half_width(r, d);
+			if (interior) w = std::min(detail::circle_half_width(r, d + 1), w - 1);
+			span(dst, pitch, clip, row, x - w, x + w, value);
+		}
+	}
+
+} // namespace raster
+} // namespace rico
@@ -16,23 +16,69 @@
  * OnUserCreate: called once, for initialization
  * OnUserUpdate: called each frame
  * OnUserDestroy: called once, for cleanup
+ * and, optionally, OnUserRender: called each frame after OnUserUpdate
+ * and OnUserResize: called when the size of the frame changed
  *
  * Game contains several protected functions (Width, Height, SetPixel,
- * GetPixel, GetMousePos, GetButton, WaitMs, Clear), along with basic types
- * (Color, Button, HardwareButton) to work with (see documentation below).
+ * GetPixel, GetMousePos, GetButton, GetInputEvents, WaitMs, Clear), along
+ * with basic types (Color, Button, HardwareButton, InputEvent) to work with
+ * (see documentation below).
+ * For hot loops, Frame returns a FrameBuffer giving unchecked access to the
+ * raw pixels (bounds are checked anyway if RICO_BOUNDS_CHECK is non-zero,
+ * which is the default unless NDEBUG is defined).
+ * In indexed mode, Indexed returns an IndexedBuffer of 8 bits indices into a
+ * palette of 256 colors (SetPaletteColor), expanded at the end of the frame.
  * Feel free to use them to unleash your creativity!
- * To further help the user, the containers Tvec2D and Tmat2D are defined.
+ * To further help the user, the containers Tvec2D and Tmat2D are defined,
+ * along with Tvec2DArray, many vectors as a structure of arrays with
+ * batched SIMD operations (see vec2d.hpp).
+ * Bulk pixel operations (fill, blit, darken, blend) use the SIMD kernels of
+ * raster.hpp, available through FrameBuffer.
+ * Pixels are 32 bits values in PixelFormat, selected at compile time to
+ * match the texture format of the renderer (see pixel.hpp).
+ * Many shapes are best queued in a DrawList and rasterized at once, in
+ * parallel (see draw.hpp).
+ * Sprites are drawn by runs of opaque (or translucent) pixels, computed
+ * once, and a TileMap draws a grid of them row by row (see sprite.hpp).
+ * Worlds larger than the window are drawn into a WorldBuffer, and a Camera
+ * pans and zooms over it (see camera.hpp).
+ * ParallelFor2D split per-pixel work in tiles run by the thread pool of the
+ * engine (see scheduler.hpp), SetPixelUnchecked and FrameBuffer can be used
+ * from several threads as long as they write to different pixels.
  * An external random number generator is also available (see random.hpp).
+ * Neighbor queries over many points (radius, k nearest) are answered by a
+ * spatial hash rebuilt each frame (see spatial.hpp).
+ * The state of a simulation can be saved to snapshot files, mapped back in
+ * memory to resume it, whole or as deltas every N frames (see snapshot.hpp).
+ * Per-frame scratch data belongs in the frame arena, reset at each frame,
+ * so that frames do not allocate from the heap (see arena.hpp).
  *
  * GameEngine is a singleton and a wrapper around SDL elements
  * protected functions of Game are shortcuts for GameEngine static functions
  * GameEngine::Construct allow the user to create a window
+ * GameEngine::Resize / SetResizable change its size in place (OnUserResize)
+ * GameEngine::ConstructHeadless (or RICO_HEADLESS=<frames>) run without one
+ *   (with OpenGL, in a hidden window: the dumps of both backends compare)
+ * GameEngine::SetSubmit select how frames are handed to the texture
+ * GameEngine::SetBackend present with the SDL renderer or with OpenGL,
+ *   keeping the frame on the GPU (see gpu.hpp)
+ * GameEngine::SetCanvas / FadeCanvas accumulate frames on a canvas, faded
+ *   and blended by a shader with OpenGL (trails without whole frame passes)
+ * GameEngine::SetIndexed draw palette indices instead of colors
+ * GameEngine::SetInputQueue record timestamped input events (GetInputEvents)
+ * GameEngine::SetPipelined overlap OnUserUpdate with the upload and
+ *   presentation of the previous frame
+ * GameEngine::SetTargetFps / SetFixedTimestep pace the game loop
+ * The phases of the game loop are timed by the profiler (see profiler.hpp)
+ * GameEngine::StartRecording capture frames to disk (see capture.hpp)
  * GameEngine::Run<app> run the application (inheriting from Game)
  *
  * see examples:
  * rico/examples/demo.cpp = repeatedly change pixels color at random
  * rico/examples/life.cpp = Conway's Game Of Life
- * rico/examples/gravity.cpp = n-bodies simulation
+ * rico/examples/gravity.cpp = n-bodies simulation (its traces on the canvas
+ *   with -DGRAVITY_CANVAS)
+ * rico/examples/sprites.cpp = sprites bouncing over a scrolling tile map
  *
  * Compiling on Linux
  * ~~~~~~~~~~~~~~~~~~
@@ -51,63 +97,71 @@
 #pragma once
 
 #include <SDL2/SDL.h> // link with -lSDL2
+#include "arena.hpp"
+#include "raster.hpp"
+#include "capture.hpp"
+#include "gpu.hpp"
+#include "profiler.hpp"
+#include "scheduler.hpp"
+#include "vec2d.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <exception>
+#include <fstream>
+#include <memory>
+#include <type_traits>
 #include <stdexcept>
 #include <utility>
 #include <iostream>
+#include <string>
 #include <chrono>
 #include <ratio>
 #include <thread>
 #include <cmath>
+#include <vector>
+
+// bounds checking of the unchecked accessors, disabled by NDEBUG by default
+#ifndef RICO_BOUNDS_CHECK
+#ifdef NDEBUG
+#define RICO_BOUNDS_CHECK 0
+#else
+#define RICO_BOUNDS_CHECK 1
+#endif
+#endif
+
+#if RICO_BOUNDS_CHECK
+#define RICO_ASSERT_BOUNDS(condition) \
+	do { if (!(condition)) throw std::out_of_range("index out of range"); } while (0)
+#else
+#define RICO_ASSERT_BOUNDS(condition) ((void) 0)
+#endif
 
 namespace rico {
 
-	/**
-	 * template for 2-component vector
-	 */
-	template<typename T>
-	struct Tvec2D {
-		T x, y;
-		constexpr Tvec2D(T _x, T _y) : x(_x), y(_y) {}
-		constexpr Tvec2D(void) : Tvec2D(static_cast<T>(0), static_cast<T>(0)) {}
-		constexpr Tvec2D(Tvec2D const&) = default;
-		Tvec2D& operator=(Tvec2D const&) = default;
-		Tvec2D& operator+=(Tvec2D const& rhs) { this->x += rhs.x; this->y += rhs.y; return *this; }
-		Tvec2D& operator-=(Tvec2D const& rhs) { this->x -= rhs.x; this->y -= rhs.y; return *this; }
-		Tvec2D& operator*=(T      const& rhs) { this->x *= rhs  ; this->y *= rhs  ; return *this; }
-		Tvec2D& operator/=(T      const& rhs) { this->x /= rhs  ; this->y /= rhs  ; return *this; }
-		Tvec2D  operator+ (Tvec2D const& rhs) const { Tvec2D copy(*this); copy += rhs; return copy; }
-		Tvec2D  operator- (Tvec2D const& rhs) const { Tvec2D copy(*this); copy -= rhs; return copy; }
-		Tvec2D  operator* (T      const& rhs) const { Tvec2D copy(*this); copy *= rhs; return copy; }
-		Tvec2D  operator/ (T      const& rhs) const { Tvec2D copy(*this); copy /= rhs; return copy; }
-		bool operator==(Tvec2D const& rhs) const { return this->x == rhs.x && this->y == rhs.y; }
-		bool operator!=(Tvec2D const& rhs) const { return !(*this == rhs); }
-		template<typename U>
-		operator Tvec2D<U>(void) const { return Tvec2D<U>(U(x), U(y)); }
-	}; // struct Tvec2D
-
-	// to allow syntax 'T * Tvec2D<T>'
-	template<typename T>
-	Tvec2D<T> operator*(T const& rhs, Tvec2D<T> const& lhs) { return lhs * rhs; }
-
 	/**
 	 * define useful types
 	 */
 	using Position = Tvec2D<uint32_t>;
-	using Clock = std::chrono::system_clock;
+	using Clock = std::chrono::steady_clock;
 	using TimePoint = std::chrono::time_point<Clock>;
 	using Duration = std::chrono::duration<double, std::milli>;
 
 	/**
-	 * template for 2D matrix
+	 * non-owning view of a 2D matrix (or of a sub-rectangle of one)
+	 * pitch is the distance between two rows, in elements (pitch >= cols)
 	 */
 	template<typename T>
-	class Tmat2D {
+	class Tmat2DView {
 	private:
 
+		T* data; // top-left element
 		uint32_t rows, cols; // dimensions
-		T* data; // underlying data array
+		size_t pitch; // elements per row in memory
+
+	public:
 
 		// to allow the syntax 'matrix[i][j]'
 		struct Row {
@@ -126,62 +180,206 @@ namespace rico {
 				return data[index];
 			}
 
-		}; // struct Tmat2D::Row
+		}; // struct Tmat2DView::Row
+
+		Tmat2DView(void) noexcept
+			: data(NULL), rows(0), cols(0), pitch(0)
+		{}
+
+		Tmat2DView(T* _data, uint32_t _rows, uint32_t _cols, size_t _pitch) noexcept
+			: data(_data), rows(_rows), cols(_cols), pitch(_pitch)
+		{}
+
+		T* get_pointer(void) const { return data; }
+		uint32_t get_rows(void) const { return rows; }
+		uint32_t get_cols(void) const { return cols; }
+		size_t get_pitch(void) const { return pitch; }
+
+		Row operator[](uint32_t index) const {
+			if (index >= rows) throw std::out_of_range("index out of range");
+			return Row(data + pitch * index, cols);
+		}
+
+		// to allow the syntax 'matrix[Position(i, j)]'
+		T& operator[](Position pos) const {
+			return (*this)[pos.y][pos.x]; // in a (x, y) position, x refer to the column and y to the row
+		}
+
+		/**
+		 * @return view of the _rows x _cols sub-rectangle starting at (row, col)
+		 */
+		Tmat2DView view(uint32_t row, uint32_t col, uint32_t _rows, uint32_t _cols) const {
+			if (row > rows || _rows > rows - row) throw std::out_of_range("index out of range");
+			if (col > cols || _cols > cols - col) throw std::out_of_range("index out of range");
+			return Tmat2DView(data + pitch * row + col, _rows, _cols, pitch);
+		}
+
+	}; // class Tmat2DView
+
+	/**
+	 * template for 2D matrix
+	 * storage is aligned on Alignment bytes (a power of 2, 64 by default to
+	 * match cache lines and SIMD registers), rows can be padded so that each
+	 * of them also start on such a boundary
+	 * trivially copyable types are copied with memcpy and left uninitialized
+	 * by the constructor, other types are constructed and destroyed
+	 */
+	template<typename T, size_t Alignment = 64>
+	class Tmat2D {
+	private:
+
+		static_assert((Alignment & (Alignment - 1)) == 0, "Alignment must be a power of 2");
+		static_assert(Alignment >= alignof(T), "Alignment too small for T");
+
+		static constexpr bool trivial = std::is_trivially_copyable<T>::value
+			&& std::is_trivially_default_constructible<T>::value;
+
+		uint32_t rows, cols; // dimensions
+		size_t pitch; // elements per row in memory
+		size_t capacity; // elements allocated
+		T* data; // underlying data array
+
+		// number of elements in a row, so that rows start on Alignment bytes
+		static size_t padded_pitch(uint32_t cols) {
+			if (Alignment % sizeof(T) != 0) return cols;
+			size_t const per_line = Alignment / sizeof(T);
+			return (cols + per_line - 1) / per_line * per_line;
+		}
+
+		// allocate storage for count elements, do not construct them
+		static T* allocate(size_t count) {
+			if (count == 0) return NULL;
+			size_t bytes = (count * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+			T* retval = static_cast<T*>(std::aligned_alloc(Alignment, bytes));
+			if (retval == NULL) throw std::runtime_error("aligned_alloc returned NULL");
+			CountHeapAllocation();
+			return retval;
+		}
+
+		// destroy the elements and release storage
+		void release(void) noexcept {
+			if constexpr (!trivial) {
+				for (size_t i = 0; i < pitch * rows; ++i) data[i].~T();
+			}
+			std::free(data);
+		}
 
 	public:
 
+		using Row = typename Tmat2DView<T>::Row;
+
 		Tmat2D(void) noexcept
-			: rows(0), cols(0), data(NULL)
+			: rows(0), cols(0), pitch(0), capacity(0), data(NULL)
 		{}
 
-		Tmat2D(uint32_t _rows, uint32_t _cols)
-			: rows(_rows), cols(_cols)
+		/**
+		 * @param padded if true, each row start on an Alignment bytes boundary
+		 */
+		Tmat2D(uint32_t _rows, uint32_t _cols, bool padded = false)
+			: rows(_rows), cols(_cols),
+			pitch(padded ? padded_pitch(_cols) : _cols),
+			capacity(pitch * rows),
+			data(allocate(capacity))
 		{
-			data = static_cast<T*>(std::malloc(rows * cols * sizeof(T)));
-			if (data == NULL) throw std::runtime_error("malloc returned NULL");
+			if constexpr (!trivial) {
+				for (size_t i = 0; i < capacity; ++i) new (&data[i]) T();
+			}
 		}
 
 		~Tmat2D(void) noexcept {
-			std::free(data);
+			release();
 		}
 
 		Tmat2D(Tmat2D const& other)
-			: Tmat2D(other.rows, other.cols)
+			: rows(other.rows), cols(other.cols), pitch(other.pitch),
+			capacity(pitch * rows),
+			data(allocate(capacity))
 		{
-			for (uint32_t i = 0; i < rows * cols; ++i) {
-				new (&data[i]) T(other.data[i]);
+			if constexpr (trivial) {
+				if (capacity != 0) std::memcpy(data, other.data, capacity * sizeof(T));
+			} else {
+				std::uninitialized_copy(other.data, other.data + capacity, data);
 			}
 		}
 
 		Tmat2D& operator=(Tmat2D const& other) {
-			if (this != &other) {
-				Tmat2D tmp(other);
-				this->~Tmat2D();
-				*this = std::move(tmp);
+			if (this == &other) return *this;
+			if constexpr (trivial) {
+				if (capacity >= other.pitch * other.rows) {
+					// reuse the current storage
+					rows = other.rows;
+					cols = other.cols;
+					pitch = other.pitch;
+					if (pitch * rows != 0) std::memcpy(data, other.data, pitch * rows * sizeof(T));
+					return *this;
+				}
 			}
+			Tmat2D tmp(other);
+			swap(tmp);
 			return *this;
 		}
 
 		Tmat2D(Tmat2D&& other) noexcept
-			: rows(other.rows), cols(other.cols), data(other.data)
+			: Tmat2D()
 		{
-			new (&other) Tmat2D();
+			swap(other);
 		}
 
 		Tmat2D& operator=(Tmat2D&& other) noexcept {
-			if (this != &other) {
-				new (this) Tmat2D(std::move(other));
-			}
+			swap(other);
 			return *this;
 		}
 
-		T* get_pointer(void) {
-			return data;
+		void swap(Tmat2D& other) noexcept {
+			std::swap(rows, other.rows);
+			std::swap(cols, other.cols);
+			std::swap(pitch, other.pitch);
+			std::swap(capacity, other.capacity);
+			std::swap(data, other.data);
+		}
+
+		/**
+		 * change the dimensions, reusing the storage if it is large enough
+		 * (trivially copyable types only), the elements are left
+		 * uninitialized as by the constructor
+		 * @param padded if true, each row start on an Alignment bytes boundary
+		 */
+		void reshape(uint32_t _rows, uint32_t _cols, bool padded = false) {
+			size_t _pitch = padded ? padded_pitch(_cols) : _cols;
+			if (!trivial || _pitch * _rows > capacity) {
+				Tmat2D tmp(_rows, _cols, padded);
+				swap(tmp);
+				return;
+			}
+			rows = _rows;
+			cols = _cols;
+			pitch = _pitch;
+		}
+
+		T* get_pointer(void) { return data; }
+		T const* get_pointer(void) const { return data; }
+		uint32_t get_rows(void) const { return rows; }
+		uint32_t get_cols(void) const { return cols; }
+		size_t get_pitch(void) const { return pitch; }
+
+		Tmat2DView<T> view(void) {
+			return Tmat2DView<T>(data, rows, cols, pitch);
+		}
+
+		Tmat2DView<T const> view(void) const {
+			return Tmat2DView<T const>(data, rows, cols, pitch);
+		}
+
+		/**
+		 * @return view of the _rows x _cols sub-rectangle starting at (row, col)
+		 */
+		Tmat2DView<T> view(uint32_t row, uint32_t col, uint32_t _rows, uint32_t _cols) {
+			return view().view(row, col, _rows, _cols);
 		}
 
 		Row operator[](uint32_t index) {
 			if (index >= rows) throw std::out_of_range("index out of range");
-			return Row(data + cols * index, cols);
+			return Row(data + pitch * index, cols);
 		}
 
 		// to allow the syntax 'matrix[Position(i, j)]'
@@ -191,8 +389,15 @@ namespace rico {
 
 	}; // class Tmat2D
 
+	template<typename T, size_t Alignment>
+	void swap(Tmat2D<T, Alignment>& lhs, Tmat2D<T, Alignment>& rhs) noexcept {
+		lhs.swap(rhs);
+	}
+
 	/**
 	 * classic RGB color
+	 * converts to and from the 32 bits pixels of the frame (opaque), in
+	 * PixelFormat (see pixel.hpp)
 	 */
 	struct Color {
 
@@ -202,23 +407,32 @@ namespace rico {
 			: r(_r), g(_g), b(_b)
 		{}
 
-		Color(void)
+		constexpr Color(void)
 			: Color(0, 0, 0)
 		{}
 
-		Color(uint32_t rgba) {
-			rgba >>= 8; b = rgba % 256;
-			rgba >>= 8; g = rgba % 256;
-			rgba >>= 8; r = rgba % 256;
+		constexpr Color(uint32_t pixel)
+			: r(PixelFormat::red(pixel)), g(PixelFormat::green(pixel)), b(PixelFormat::blue(pixel))
+		{}
+
+		constexpr operator uint32_t(void) const {
+			return PixelFormat::pack(r, g, b);
 		}
 
-		operator uint32_t(void) const {
-			// use the RGBA8888 format
-			uint32_t retval = 255;
-			retval += (1 << 24) * r;
-			retval += (1 << 16) * g;
-			retval += (1 <<  8) * b;
-			return retval;
+		/**
+		 * @return this color in the pixel format F (see pixel.hpp)
+		 */
+		template<typename F>
+		constexpr typename F::type Pack(void) const {
+			return F::pack(r, g, b);
+		}
+
+		/**
+		 * @return color of the pixel value in the pixel format F
+		 */
+		template<typename F>
+		static constexpr Color Unpack(typename F::type value) {
+			return Color(F::red(value), F::green(value), F::blue(value));
 		}
 
 	}; // struct Color
@@ -257,6 +471,13 @@ namespace rico {
 			previous(false)
 		{}
 
+		HardwareButton(bool _pressed, bool _down, bool _released) :
+			pressed(_pressed),
+			down(_down),
+			released(_released),
+			previous(_down)
+		{}
+
 		void update(void) {
 			pressed = released = false;
 			if (down != previous) {
@@ -273,32 +494,44 @@ namespace rico {
 
 	/**
 	 * tagged enum to ease call syntax for querying button state
+	 * a key is either the character it types without modifiers (its SDL
+	 * keycode: layout dependent, letters are not case sensitive, shifted
+	 * characters such as '!' on a US layout are never reported) or its
+	 * SDL_Scancode (physical position, covering the keys that do not type a
+	 * character: arrows, function keys, ...)
 	 */
 	struct Button {
 
-		enum Tag { MOUSE, KEYBOARD };
+		enum Tag { MOUSE, KEYBOARD, SCANCODE };
 		Tag tag;
 		union {
 			uint8_t index;
 			char key;
+			uint16_t scancode;
 		};
 
 		static constexpr uint8_t LEFT = 1;
 		static constexpr uint8_t RIGHT = 2;
+		static constexpr uint8_t MIDDLE = 3;
+		static constexpr uint8_t X1 = 4;
+		static constexpr uint8_t X2 = 5;
 		Button(uint8_t _index) : tag(MOUSE), index(_index) {}
 		Button(char _key) : tag(KEYBOARD), key(_key) {}
+		Button(SDL_Scancode _scancode) : tag(SCANCODE), scancode(static_cast<uint16_t>(_scancode)) {}
 		Button(void) = delete; // always use ctor that set the tag
 
 		static constexpr uint8_t first_index = 1;
-		static constexpr uint8_t last_index = 2;
-		static constexpr char first_key = 'a';
-		static constexpr char last_key = 'z';
+		static constexpr uint8_t last_index = 5;
+		static constexpr char first_key = ' ';
+		static constexpr char last_key = '~';
 
 		static constexpr size_t index_count = last_index - first_index + 1;
 		static constexpr size_t key_count = last_key - first_key + 1;
+		static constexpr size_t scancode_count = SDL_NUM_SCANCODES;
 
 		/**
-		 * @param[out] output filled with the index of the button, if valid
+		 * @param[out] output filled with the index of the button among those
+		 *   of its tag (lowercase character for KEYBOARD), if valid
 		 * @return true if and only if the button is valid
 		 */
 		bool valid(size_t *output) const {
@@ -311,7 +544,14 @@ namespace rico {
 					break;
 				case KEYBOARD:
 					if (first_key <= key && key <= last_key) {
-						if (output != NULL) *output = key - first_key;
+						char lower = ('A' <= key && key <= 'Z') ? static_cast<char>(key - 'A' + 'a') : key;
+						if (output != NULL) *output = static_cast<size_t>(lower);
+						return true;
+					}
+					break;
+				case SCANCODE:
+					if (scancode != SDL_SCANCODE_UNKNOWN && scancode < scancode_count) {
+						if (output != NULL) *output = scancode;
 						return true;
 					}
 					break;
@@ -322,142 +562,1798 @@ namespace rico {
 	}; // struct Button
 
 	/**
-	 * singleton, wrapper around SDL elements
+	 * a change of the state of a button, or a mouse motion, as recorded by
+	 * the input queue (see GameEngine::SetInputQueue)
 	 */
-	class GameEngine {
+	struct InputEvent {
+
+		enum Type : uint8_t { PRESS, RELEASE, MOTION };
+		Type type;
+		bool repeat; // PRESS generated by a key held down
+		uint8_t mouse; // button index (see Button), 0 for keys and MOTION
+		char key; // character typed by the key without modifiers, '\0' if none
+		SDL_Scancode scancode; // SDL_SCANCODE_UNKNOWN for the mouse
+		uint32_t timestamp; // in milliseconds since SDL initialization
+		int32_t x, y; // mouse position in macro pixels (may be outside of the window)
+
+		/**
+		 * @return true if the event is a PRESS or RELEASE of button
+		 */
+		bool Is(Button button) const {
+			if (type == MOTION) return false;
+			size_t index;
+			if (!button.valid(&index)) return false;
+			switch (button.tag) {
+				case Button::MOUSE: return static_cast<size_t>(mouse) == index + Button::first_index;
+				case Button::KEYBOARD: return key != '\0' && static_cast<size_t>(key) == index;
+				case Button::SCANCODE: return scancode == static_cast<SDL_Scancode>(index);
+			}
+			return false;
+		}
+
+	}; // struct InputEvent
+
+	/**
+	 * state of the keyboard and mouse buttons, as bitsets indexed by slot:
+	 * keys by SDL_Scancode, then mouse buttons (see Button)
+	 * events update the buttons they concern, and only those that got an
+	 * edge (pressed / released) are visited to clear it after the next update
+	 * a press and a release within the same frame are both reported
+	 */
+	class InputState {
+	public:
+
+		static constexpr size_t SLOTS = Button::scancode_count + Button::index_count;
+
 	private:
 
-		// true if and only if Construct was called successfully
-		bool init;
-		// window size
-		uint32_t window_width, window_height;
-		// texture size (before stretching)
-		uint32_t texture_width, texture_height;
-		// stretching factor
-		uint32_t pixel_size;
-		// SDL elements
-		SDL_Window *window;
-		SDL_Renderer *renderer;
-		SDL_Texture *texture;
-		// raw pixel data for the texture
-		Tmat2D<uint32_t> data;
-		// devices state
-		HardwareButton mouse_state[Button::index_count];
-		HardwareButton keyboard_state[Button::key_count];
+		static constexpr size_t WORDS = (SLOTS + 63) / 64;
 
-		GameEngine(void) :
-			init(false)
+		uint64_t down[WORDS], pressed[WORDS], released[WORDS];
+		uint16_t edges[SLOTS]; // slots with pressed or released set
+		uint32_t edge_count;
+		// scancode of the printable characters, learned from key events
+		uint16_t keymap[128];
+
+		static bool Test(uint64_t const *bits, size_t slot) {
+			return (bits[slot / 64] >> (slot % 64)) & 1;
+		}
+
+		static void Set(uint64_t *bits, size_t slot, bool value) {
+			uint64_t mask = uint64_t(1) << (slot % 64);
+			bits[slot / 64] = value ? (bits[slot / 64] | mask) : (bits[slot / 64] & ~mask);
+		}
+
+		void Edge(size_t slot, uint64_t *bits) {
+			if (!Test(pressed, slot) && !Test(released, slot)) edges[edge_count++] = static_cast<uint16_t>(slot);
+			Set(bits, slot, true);
+		}
+
+	public:
+
+		InputState(void) {
+			Reset();
+		}
+
+		void Reset(void) {
+			std::memset(down, 0, sizeof(down));
+			std::memset(pressed, 0, sizeof(pressed));
+			std::memset(released, 0, sizeof(released));
+			std::memset(keymap, 0, sizeof(keymap));
+			edge_count = 0;
+		}
+
+		static size_t MouseSlot(uint8_t index) {
+			return Button::scancode_count + index - Button::first_index;
+		}
+
+		/**
+		 * @param[out] output slot of button, if valid and known
+		 * @return false for invalid buttons, and characters never typed yet
+		 */
+		bool Slot(Button button, size_t *output) const {
+			size_t index;
+			if (!button.valid(&index)) return false;
+			switch (button.tag) {
+				case Button::MOUSE: index += Button::scancode_count; break;
+				case Button::KEYBOARD: index = keymap[index]; break;
+				case Button::SCANCODE: break;
+			}
+			if (index == static_cast<size_t>(SDL_SCANCODE_UNKNOWN)) return false;
+			*output = index;
+			return true;
+		}
+
+		/**
+		 * record that a key types character key (SDL keycode)
+		 */
+		void Learn(SDL_Keycode key, SDL_Scancode scancode) {
+			if (key >= 0 && key < 128) keymap[key] = static_cast<uint16_t>(scancode);
+		}
+
+		void Press(size_t slot) {
+			if (Test(down, slot)) return;
+			Set(down, slot, true);
+			Edge(slot, pressed);
+		}
+
+		void Release(size_t slot) {
+			if (!Test(down, slot)) return;
+			Set(down, slot, false);
+			Edge(slot, released);
+		}
+
+		/**
+		 * clear the edges, once an update saw them
+		 */
+		void ClearEdges(void) {
+			for (uint32_t i = 0; i < edge_count; ++i) {
+				Set(pressed, edges[i], false);
+				Set(released, edges[i], false);
+			}
+			edge_count = 0;
+		}
+
+		HardwareButton Get(size_t slot) const {
+			return HardwareButton(Test(pressed, slot), Test(down, slot), Test(released, slot));
+		}
+
+	}; // class InputState
+
+	/**
+	 * record which tiles of the texture were modified since the last upload
+	 * tiles are squares of TILE x TILE pixels, one byte of state each
+	 * tiles can be marked from several threads at once
+	 */
+	class DirtyTiles {
+	public:
+
+		static constexpr uint32_t SHIFT = 4;
+		static constexpr uint32_t TILE = 1 << SHIFT;
+
+	private:
+
+		uint32_t width, height; // dimensions in pixels
+		uint32_t cols, rows; // dimensions in tiles
+		// non-zero if and only if dirty, relaxed atomics so that threads can
+		// mark tiles concurrently (only written if not already set)
+		std::unique_ptr<std::atomic<uint8_t>[]> tiles;
+		std::atomic<bool> any; // true if at least one tile is dirty
+
+		static void Set(std::atomic<uint8_t>& flag) {
+			if (flag.load(std::memory_order_relaxed) == 0) flag.store(1, std::memory_order_relaxed);
+		}
+
+		void SetAny(void) {
+			if (!any.load(std::memory_order_relaxed)) any.store(true, std::memory_order_relaxed);
+		}
+
+	public:
+
+		DirtyTiles(void) :
+			width(0), height(0),
+			cols(0), rows(0),
+			any(false)
 		{}
 
 		/**
-		 * access the single instance
-		 * @return reference to the instance
+		 * resize to cover a width x height texture, every tile is dirty
 		 */
-		static GameEngine& Get(void) {
-			static GameEngine instance;
-			return instance;
+		void Reset(uint32_t _width, uint32_t _height) {
+			width = _width;
+			height = _height;
+			cols = (width + TILE - 1) >> SHIFT;
+			rows = (height + TILE - 1) >> SHIFT;
+			tiles.reset(new std::atomic<uint8_t>[cols * rows]);
+			MarkAll();
+		}
+
+		void MarkAll(void) {
+			for (uint32_t i = 0; i < cols * rows; ++i) tiles[i].store(1, std::memory_order_relaxed);
+			any.store(true, std::memory_order_relaxed);
 		}
 
 		/**
-		 * print exception on standard error
-		 * @param e exception to print
+		 * mark the tile containing pixel (x, y), which must be inside the texture
 		 */
-		static void PrintException(std::exception const& e) noexcept {
-			std::cerr << "[ERROR] " << e.what();
-			char const * sdl_error = SDL_GetError();
-			if (*sdl_error != '\0') {
-				std::cerr << " : " << sdl_error;
+		void Mark(uint32_t x, uint32_t y) {
+			Set(tiles[(y >> SHIFT) * cols + (x >> SHIFT)]);
+			SetAny();
+		}
+
+		/**
+		 * mark every tile intersecting the rectangle (clipped to the texture)
+		 */
+		void MarkRect(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+			if (x >= width || y >= height || w == 0 || h == 0) return;
+			uint32_t x_end = (std::min(w, width - x) + x - 1) >> SHIFT;
+			uint32_t y_end = (std::min(h, height - y) + y - 1) >> SHIFT;
+			for (uint32_t row = y >> SHIFT; row <= y_end; ++row) {
+				for (uint32_t col = x >> SHIFT; col <= x_end; ++col) {
+					Set(tiles[row * cols + col]);
+				}
 			}
-			std::cerr << std::endl;
+			SetAny();
+		}
+
+		bool Empty(void) const {
+			return !any.load(std::memory_order_relaxed);
+		}
+
+		/**
+		 * call fn(SDL_Rect const&) on each horizontal run of dirty tiles
+		 * (a single rect if most of the texture is dirty)
+		 * must not run concurrently with Mark / MarkRect / Clear
+		 */
+		template<typename F>
+		void ForEachRun(F&& fn) const {
+			if (Empty()) return;
+			uint32_t count = 0;
+			for (uint32_t i = 0; i < cols * rows; ++i) count += tiles[i].load(std::memory_order_relaxed);
+			if (4 * count >= 3 * cols * rows) {
+				SDL_Rect rect = { 0, 0, static_cast<int>(width), static_cast<int>(height) };
+				fn(rect);
+			} else {
+				for (uint32_t row = 0; row < rows; ++row) {
+					std::atomic<uint8_t> const *line = tiles.get() + row * cols;
+					uint32_t col = 0;
+					while (col < cols) {
+						if (line[col].load(std::memory_order_relaxed) == 0) { ++col; continue; }
+						uint32_t first = col;
+						while (col < cols && line[col].load(std::memory_order_relaxed) != 0) ++col;
+						uint32_t x = first << SHIFT, y = row << SHIFT;
+						SDL_Rect rect = {
+							static_cast<int>(x),
+							static_cast<int>(y),
+							static_cast<int>(std::min(col << SHIFT, width) - x),
+							static_cast<int>(std::min((row + 1) << SHIFT, height) - y) };
+						fn(rect);
+					}
+				}
+			}
+		}
+
+		void Clear(void) {
+			for (uint32_t i = 0; i < cols * rows; ++i) tiles[i].store(0, std::memory_order_relaxed);
+			any.store(false, std::memory_order_relaxed);
+		}
+
+		void swap(DirtyTiles& other) noexcept {
+			std::swap(width, other.width);
+			std::swap(height, other.height);
+			std::swap(cols, other.cols);
+			std::swap(rows, other.rows);
+			tiles.swap(other.tiles);
+			bool tmp = any.load(std::memory_order_relaxed);
+			any.store(other.any.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			other.any.store(tmp, std::memory_order_relaxed);
+		}
+
+	}; // class DirtyTiles
+
+	/**
+	 * non-owning contiguous range of elements, such as a row of pixels
+	 */
+	template<typename T>
+	struct Span {
+
+		T *ptr;
+		uint32_t length;
+
+		constexpr Span(T *_ptr, uint32_t _length) : ptr(_ptr), length(_length) {}
+
+		T* data(void) const { return ptr; }
+		uint32_t size(void) const { return length; }
+		T* begin(void) const { return ptr; }
+		T* end(void) const { return ptr + length; }
+
+		T& operator[](uint32_t index) const {
+			RICO_ASSERT_BOUNDS(index < length);
+			return ptr[index];
+		}
+
+	}; // struct Span
+
+	/**
+	 * non-owning view of the frame being drawn, valid until the end of the frame
+	 * (in Submit::DIRECT mode, the pixels belong to the locked texture)
+	 * pitch is the distance between two rows, in pixels (pitch >= width)
+	 * accessors are not bounds checked unless RICO_BOUNDS_CHECK is non-zero
+	 * SetPixelUnchecked mark the pixel dirty, but writes through data() or
+	 * row() do not: call MarkDirty on the modified area (or MarkAll)
+	 */
+	class FrameBuffer {
+	private:
+
+		uint32_t *pixels;
+		size_t stride;
+		uint32_t cols, rows;
+		DirtyTiles *dirty;
+
+		// clip the area of size w x h starting at pos, return false if empty
+		bool Clip(Position pos, uint32_t& w, uint32_t& h) const {
+			if (pos.x >= cols || pos.y >= rows) return false;
+			w = std::min(w, cols - pos.x);
+			h = std::min(h, rows - pos.y);
+			return w != 0 && h != 0;
+		}
+
+		raster::Clip Bounds(void) const {
+			return raster::Clip { 0, 0, static_cast<int32_t>(cols), static_cast<int32_t>(rows) };
+		}
+
+		// mark the inclusive box [x0, x1] x [y0, y1], clipped to the frame
+		void MarkBox(int64_t x0, int64_t y0, int64_t x1, int64_t y1) const {
+			x0 = std::max<int64_t>(x0, 0);
+			y0 = std::max<int64_t>(y0, 0);
+			x1 = std::min<int64_t>(x1, int64_t(cols) - 1);
+			y1 = std::min<int64_t>(y1, int64_t(rows) - 1);
+			if (x0 > x1 || y0 > y1) return;
+			dirty->MarkRect(static_cast<uint32_t>(x0), static_cast<uint32_t>(y0),
+				static_cast<uint32_t>(x1 - x0) + 1, static_cast<uint32_t>(y1 - y0) + 1);
 		}
 
 	public:
 
+		FrameBuffer(uint32_t *_pixels, size_t _stride, uint32_t _cols, uint32_t _rows, DirtyTiles *_dirty)
+			: pixels(_pixels), stride(_stride), cols(_cols), rows(_rows), dirty(_dirty)
+		{}
+
+		uint32_t* data(void) const { return pixels; }
+		size_t pitch(void) const { return stride; }
+		uint32_t width(void) const { return cols; }
+		uint32_t height(void) const { return rows; }
+
+		Span<uint32_t> row(uint32_t y) const {
+			RICO_ASSERT_BOUNDS(y < rows);
+			return Span<uint32_t>(pixels + y * stride, cols);
+		}
+
+		void SetPixelUnchecked(Position pos, Color color) const {
+			RICO_ASSERT_BOUNDS(pos.x < cols && pos.y < rows);
+			pixels[pos.y * stride + pos.x] = uint32_t(color);
+			dirty->Mark(pos.x, pos.y);
+		}
+
+		Color GetPixelUnchecked(Position pos) const {
+			RICO_ASSERT_BOUNDS(pos.x < cols && pos.y < rows);
+			return Color(pixels[pos.y * stride + pos.x]);
+		}
+
 		/**
-		 * create window of size window_width x window_height (in pixels)
-		 * composed of macro pixels of size pixel_size x pixel_size
-		 * destroy any previously constructed window
-		 * @param window_[width/height] dimensions of the window
-		 * @param pixel_size dimension of macro pixels
+		 * record raw writes to the area of size w x h starting at pos
+		 */
+		void MarkDirty(Position pos, uint32_t w, uint32_t h) const {
+			dirty->MarkRect(pos.x, pos.y, w, h);
+		}
+
+		void MarkAll(void) const {
+			dirty->MarkAll();
+		}
+
+		/**
+		 * bulk operations on the area of size w x h starting at pos
+		 * the area is clipped to the frame and marked dirty
+		 * src is a rectangle of w x h pixels, src_pitch pixels per row
+		 */
+
+		void Fill(Position pos, uint32_t w, uint32_t h, Color color) const {
+			if (!Clip(pos, w, h)) return;
+			raster::fill(pixels + pos.y * stride + pos.x, stride, w, h, uint32_t(color));
+			dirty->MarkRect(pos.x, pos.y, w, h);
+		}
+
+		void Blit(Position pos, uint32_t w, uint32_t h, uint32_t const *src, size_t src_pitch) const {
+			if (!Clip(pos, w, h)) return;
+			raster::copy(pixels + pos.y * stride + pos.x, stride, src, src_pitch, w, h);
+			dirty->MarkRect(pos.x, pos.y, w, h);
+		}
+
+		void Blend(Position pos, uint32_t w, uint32_t h, uint32_t const *src, size_t src_pitch) const {
+			if (!Clip(pos, w, h)) return;
+			raster::blend(pixels + pos.y * stride + pos.x, stride, src, src_pitch, w, h);
+			dirty->MarkRect(pos.x, pos.y, w, h);
+		}
+
+		// subtract the components of amount from each pixel, clamping at 0
+		void SaturatingSub(Position pos, uint32_t w, uint32_t h, Color amount) const {
+			if (!Clip(pos, w, h)) return;
+			uint32_t value = uint32_t(amount) & ~PixelFormat::alpha_mask; // alpha is left unchanged
+			raster::saturating_sub(pixels + pos.y * stride + pos.x, stride, w, h, value);
+			dirty->MarkRect(pos.x, pos.y, w, h);
+		}
+
+		// whole frame versions of the above
+		void Fill(Color color) const { Fill(Position(0, 0), cols, rows, color); }
+		void SaturatingSub(Color amount) const { SaturatingSub(Position(0, 0), cols, rows, amount); }
+
+		/**
+		 * shapes (see raster.hpp), with signed coordinates, corners included
+		 * they are clipped to the frame and their bounding box is marked dirty
+		 */
+
+		void DrawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, Color color) const {
+			raster::draw_line(pixels, stride, Bounds(), x0, y0, x1, y1, uint32_t(color));
+			MarkBox(std::min(x0, x1), std::min(y0, y1), std::max(x0, x1), std::max(y0, y1));
+		}
+
+		void DrawRect(int32_t x0, int32_t y0, int32_t x1, int32_t y1, Color color) const {
+			raster::draw_rect(pixels, stride, Bounds(), x0, y0, x1, y1, uint32_t(color));
+			MarkBox(std::min(x0, x1), std::min(y0, y1), std::max(x0, x1), std::max(y0, y1));
+		}
+
+		void FillRect(int32_t x0, int32_t y0, int32_t x1, int32_t y1, Color color) const {
+			raster::fill_rect(pixels, stride, Bounds(), x0, y0, x1, y1, uint32_t(color));
+			MarkBox(std::min(x0, x1), std::min(y0, y1), std::max(x0, x1), std::max(y0, y1));
+		}
+
+		void DrawCircle(int32_t x, int32_t y, int32_t radius, Color color) const {
+			raster::draw_circle(pixels, stride, Bounds(), x, y, radius, uint32_t(color));
+			MarkBox(int64_t(x) - radius, int64_t(y) - radius, int64_t(x) + radius, int64_t(y) + radius);
+		}
+
+		// interior: leave out the pixels of DrawCircle
+		void FillCircle(int32_t x, int32_t y, int32_t radius, Color color, bool interior = false) const {
+			raster::fill_circle(pixels, stride, Bounds(), x, y, radius, uint32_t(color), interior);
+			MarkBox(int64_t(x) - radius, int64_t(y) - radius, int64_t(x) + radius, int64_t(y) + radius);
+		}
+
+	}; // class FrameBuffer
+
+	/**
+	 * non-owning view of the 8 bits indices of the frame, in indexed mode
+	 * (see GameEngine::SetIndexed), with the same rules as FrameBuffer
+	 * each index selects one of the 256 colors of the palette, the pixels
+	 * of the dirty regions are looked up at the end of the frame
+	 */
+	class IndexedBuffer {
+	private:
+
+		uint8_t *indices;
+		size_t stride;
+		uint32_t cols, rows;
+		DirtyTiles *dirty;
+
+	public:
+
+		IndexedBuffer(uint8_t *_indices, size_t _stride, uint32_t _cols, uint32_t _rows, DirtyTiles *_dirty)
+			: indices(_indices), stride(_stride), cols(_cols), rows(_rows), dirty(_dirty)
+		{}
+
+		uint8_t* data(void) const { return indices; }
+		size_t pitch(void) const { return stride; }
+		uint32_t width(void) const { return cols; }
+		uint32_t height(void) const { return rows; }
+
+		Span<uint8_t> row(uint32_t y) const {
+			RICO_ASSERT_BOUNDS(y < rows);
+			return Span<uint8_t>(indices + y * stride, cols);
+		}
+
+		void SetUnchecked(Position pos, uint8_t index) const {
+			RICO_ASSERT_BOUNDS(pos.x < cols && pos.y < rows);
+			indices[pos.y * stride + pos.x] = index;
+			dirty->Mark(pos.x, pos.y);
+		}
+
+		uint8_t GetUnchecked(Position pos) const {
+			RICO_ASSERT_BOUNDS(pos.x < cols && pos.y < rows);
+			return indices[pos.y * stride + pos.x];
+		}
+
+		/**
+		 * record raw writes to the area of size w x h starting at pos
+		 */
+		void MarkDirty(Position pos, uint32_t w, uint32_t h) const {
+			dirty->MarkRect(pos.x, pos.y, w, h);
+		}
+
+		void MarkAll(void) const {
+			dirty->MarkAll();
+		}
+
+		/**
+		 * set the area of size w x h starting at pos (clipped to the frame)
+		 * to index, and mark it dirty
+		 */
+		void Fill(Position pos, uint32_t w, uint32_t h, uint8_t index) const {
+			if (pos.x >= cols || pos.y >= rows) return;
+			w = std::min(w, cols - pos.x);
+			h = std::min(h, rows - pos.y);
+			for (uint32_t y = 0; y < h; ++y) std::memset(indices + (pos.y + y) * stride + pos.x, index, w);
+			dirty->MarkRect(pos.x, pos.y, w, h);
+		}
+
+		void Fill(uint8_t index) const { Fill(Position(0, 0), cols, rows, index); }
+
+	}; // class IndexedBuffer
+
+	/**
+	 * how a frame is handed over to the streaming texture
+	 * COPY: draw into a buffer owned by the engine, kept across frames and
+	 *   copied with SDL_UpdateTexture where dirty
+	 * DIRECT: draw straight into the pointer given by SDL_LockTexture, no copy
+	 *   but the content is lost every frame (the app must redraw every pixel)
+	 */
+	enum class Submit { COPY, DIRECT };
+
+	/**
+	 * how frames are presented in the window
+	 * RENDERER: a streaming texture of the SDL renderer (SDL_RenderCopy)
+	 * OPENGL: textures of an OpenGL 3.3 context, that stay on the GPU (see
+	 *   gpu.hpp): the palette of indexed mode is looked up by a shader, and
+	 *   so are the fade and blend of canvas mode (see GameEngine::SetCanvas)
+	 *   Submit::DIRECT is the same as Submit::COPY
+	 */
+	enum class Backend { RENDERER, OPENGL };
+
+	/**
+	 * hold the frame rate to a target, with sub-millisecond accuracy
+	 * frames are scheduled at regular deadlines: a late frame shortens the
+	 * wait of the next one, and deadlines are dropped when too far behind
+	 * the thread sleeps until shortly before a deadline (sleeping is only
+	 * accurate to the scheduler granularity) then yields until it is reached
+	 */
+	class FramePacer {
+	private:
+
+		Duration period; // 0 if the frame rate is not limited
+		TimePoint deadline;
+
+	public:
+
+		// remaining time below which the pacer stops sleeping and spins
+		static constexpr double SPIN_MS = 2.0;
+
+		FramePacer(void) :
+			period(0.0),
+			deadline(Clock::now())
+		{}
+
+		/**
+		 * @param fps frames per second, 0 to not limit the frame rate
+		 */
+		void SetTargetFps(double fps) {
+			period = Duration(fps > 0.0 ? 1000.0 / fps : 0.0);
+			deadline = Clock::now();
+		}
+
+		bool Enabled(void) const {
+			return period.count() > 0.0;
+		}
+
+		Duration Period(void) const {
+			return period;
+		}
+
+		/**
+		 * wait for the end of the current frame
+		 */
+		void Wait(void) {
+			if (!Enabled()) return;
+			deadline += std::chrono::duration_cast<Clock::duration>(period);
+			TimePoint now = Clock::now();
+			// more than a frame behind: do not try to catch up
+			if (now - deadline > period) {
+				deadline = now;
+				return;
+			}
+			Duration spin(SPIN_MS);
+			while (deadline - now > spin) {
+				std::this_thread::sleep_for(deadline - now - spin);
+				now = Clock::now();
+			}
+			while (Clock::now() < deadline) {
+				std::this_thread::yield();
+			}
+		}
+
+	}; // class FramePacer
+
+	class Game;
+
+	/**
+	 * singleton, wrapper around SDL elements
+	 */
+	class GameEngine {
+	private:
+
+		// true if and only if Construct was called successfully
+		bool init;
+		// no window: frames are run as fast as possible, and optionally dumped
+		bool headless;
+		uint64_t frame_limit; // 0 for no limit
+		uint64_t frame_count; // frames run by the current Run
+		bool running; // from OnUserCreate to OnUserDestroy
+		std::string dump_prefix; // empty for no dump
+		std::vector<uint8_t> dump_line;
+		// frame capture, see StartRecording
+		std::unique_ptr<Recorder> recorder;
+		// window size
+		uint32_t window_width, window_height;
+		// texture size (before stretching)
+		uint32_t texture_width, texture_height;
+		// stretching factor
+		uint32_t pixel_size;
+		// the user can resize the window
+		bool resizable;
+		// size requested by Resize or by the window, applied between frames
+		bool resize_pending;
+		uint32_t resize_width, resize_height, resize_pixel_size;
+		// SDL elements
+		SDL_Window *window;
+		SDL_Renderer *renderer;
+		SDL_Texture *texture;
+		// OpenGL backend, instead of renderer and texture
+		Backend backend;
+		std::unique_ptr<GpuPresenter> gpu;
+		// the texture is locked (DIRECT mode, between BeginFrame and EndFrame)
+		bool locked;
+		// raw pixel data for the texture
+		Tmat2D<uint32_t> data;
+		// current draw target (data or locked texture) and its pixels per row
+		uint32_t *pixels;
+		size_t pitch;
+		// how frames are handed over to the texture
+		Submit submit;
+		// indexed mode: the app draws indices, looked up in the palette at
+		// the end of the frame (pixels in PixelFormat)
+		bool indexed;
+		Tmat2D<uint8_t> indices;
+		uint32_t palette[256];
+		// regions of the texture to upload at the end of the frame
+		DirtyTiles dirty;
+		// pipelined mode: the previous frame and its dirty regions, uploaded
+		// while the next one is drawn in data
+		bool pipelined;
+		Tmat2D<uint32_t> shown;
+		DirtyTiles shown_dirty;
+		// canvas mode (see SetCanvas): the fades of the frame drawn and of the
+		// frame shown, the canvas (allocated while running, only the copy read
+		// back for the capture with the OpenGL backend) and tiles that are all
+		// dirty, to upload the whole canvas
+		bool canvas;
+		Color fade, shown_fade;
+		Tmat2D<uint32_t> canvas_pixels;
+		DirtyTiles canvas_tiles;
+		// frame rate limit
+		FramePacer pacer;
+		// fixed timestep (0 if variable), its accumulator and step limit
+		double timestep;
+		double accumulator;
+		uint32_t max_steps;
+		// worker threads, created on first use
+		std::unique_ptr<ThreadPool> pool;
+		uint32_t thread_count;
+		// scratch memory of the current frame, and of each worker of the pool
+		Arena frame_arena;
+		std::unique_ptr<Arena[]> thread_arenas;
+		// heap allocations before the current frame, and during the previous one
+		uint64_t allocations;
+		uint64_t frame_allocations;
+		// devices state, mouse position (in window pixels) from the events
+		InputState input;
+		int32_t mouse_x, mouse_y;
+		bool mouse_inside;
+		// input queue, events since the last update (if enabled)
+		bool queue_input;
+		std::vector<InputEvent> events;
+		// true once an update saw the current edges and queued events
+		bool input_seen;
+
+		GameEngine(void) :
+			init(false),
+			headless(false),
+			frame_limit(0),
+			frame_count(0),
+			running(false),
+			resizable(false),
+			resize_pending(false),
+			backend(Backend::RENDERER),
+			locked(false),
+			pixels(NULL),
+			pitch(0),
+			submit(Submit::COPY),
+			indexed(false),
+			pipelined(false),
+			canvas(false),
+			timestep(0.0),
+			accumulator(0.0),
+			max_steps(0),
+			thread_count(0),
+			allocations(0),
+			frame_allocations(0),
+			mouse_x(0),
+			mouse_y(0),
+			mouse_inside(false),
+			queue_input(false),
+			input_seen(false)
+		{
+			// grayscale, from black to white
+			for (uint32_t i = 0; i < 256; ++i) {
+				uint8_t level = static_cast<uint8_t>(i);
+				palette[i] = uint32_t(Color(level, level, level));
+			}
+		}
+
+		// the single instance (not function-local to avoid a guard on each access)
+		static GameEngine instance;
+
+		/**
+		 * access the single instance
+		 * @return reference to the instance
+		 */
+		static GameEngine& Get(void) {
+			return instance;
+		}
+
+		/**
+		 * print exception on standard error
+		 * @param e exception to print
+		 */
+		static void PrintException(std::exception const& e) noexcept {
+			std::cerr << "[ERROR] " << e.what();
+			char const * sdl_error = SDL_GetError();
+			if (*sdl_error != '\0') {
+				std::cerr << " : " << sdl_error;
+			}
+			std::cerr << std::endl;
+		}
+
+		/**
+		 * @return true if the frame is drawn straight into the locked texture
+		 *   (Submit::DIRECT with the renderer)
+		 */
+		bool Direct(void) const {
+			return submit == Submit::DIRECT && texture != NULL;
+		}
+
+		/**
+		 * @return true if the palette of indexed mode is looked up by the GPU
+		 *   (the CPU only expands the indices for the capture)
+		 */
+		bool Lookup(void) const {
+			return indexed && gpu && !recorder && !Dumping();
+		}
+
+		/**
+		 * @return true if the frames are written to files (see DumpFrame)
+		 */
+		bool Dumping(void) const {
+			return headless && !dump_prefix.empty();
+		}
+
+		/**
+		 * @return true if running in canvas mode (see SetCanvas)
+		 */
+		bool Composing(void) const {
+			return canvas_pixels.get_pointer() != NULL;
+		}
+
+		/**
+		 * make the draw target ready for the next frame
+		 * in DIRECT mode, this lock the whole texture
+		 */
+		void BeginFrame(void) {
+			if (Direct()) {
+				void *raw_pixels;
+				int raw_pitch;
+				int retval = SDL_LockTexture(texture, NULL, &raw_pixels, &raw_pitch);
+				if (retval != 0) throw std::runtime_error("SDL_LockTexture");
+				locked = true;
+				pixels = static_cast<uint32_t*>(raw_pixels);
+				pitch = static_cast<size_t>(raw_pitch) / sizeof(uint32_t);
+			} else {
+				pixels = data.get_pointer();
+				pitch = data.get_pitch();
+			}
+		}
+
+		/**
+		 * unlock the texture locked by BeginFrame, if any
+		 */
+		void Unlock(void) noexcept {
+			if (!locked) return;
+			SDL_UnlockTexture(texture);
+			locked = false;
+		}
+
+		/**
+		 * upload the dirty regions of a frame to the texture
+		 * @param source pixels of the frame
+		 * @param source_pitch pixels per row of source
+		 * @param tiles regions to upload (not cleared)
+		 */
+		void Upload(uint32_t const *source, size_t source_pitch, DirtyTiles const& tiles) {
+			RICO_PROFILE("upload");
+			if (headless && !gpu) return;
+			if (gpu) {
+				if (Lookup()) {
+					// a quarter of the pixels, and the palette
+					gpu->UploadPalette(palette);
+					tiles.ForEachRun([this](SDL_Rect const& rect) {
+						gpu->UploadIndices(rect, indices.get_pointer(), indices.get_pitch());
+					});
+				} else {
+					tiles.ForEachRun([this, source, source_pitch](SDL_Rect const& rect) {
+						gpu->UploadPixels(rect, source, source_pitch);
+					});
+				}
+			} else {
+				tiles.ForEachRun([this, source, source_pitch](SDL_Rect const& rect) {
+					int retval = SDL_UpdateTexture(
+						texture, // texture to update
+						&rect, // area to update
+						source + rect.y * source_pitch + rect.x, // raw pixel data
+						source_pitch * sizeof(uint32_t)); // bytes per line
+					if (retval != 0) throw std::runtime_error("SDL_UpdateTexture");
+				});
+			}
+		}
+
+		/**
+		 * in indexed mode, look the indices of the dirty regions up in the
+		 * palette, into the draw target (all of them in DIRECT mode, as the
+		 * locked texture does not keep its content), unless the GPU does it
+		 */
+		void Expand(void) {
+			if (!indexed || Lookup()) return;
+			RICO_PROFILE("expand");
+			auto expand = [this](SDL_Rect const& rect) {
+				raster::expand(
+					pixels + rect.y * pitch + rect.x, pitch,
+					indices.get_pointer() + rect.y * indices.get_pitch() + rect.x, indices.get_pitch(),
+					rect.w, rect.h, palette);
+			};
+			if (Direct()) {
+				expand(SDL_Rect { 0, 0, static_cast<int>(texture_width), static_cast<int>(texture_height) });
+			} else {
+				dirty.ForEachRun(expand);
+			}
+		}
+
+		/**
+		 * allocate the indices of indexed mode (set to 0), and mark the whole
+		 * frame dirty
+		 */
+		void CreateIndices(void) {
+			indices.reshape(texture_height, texture_width, true);
+			std::memset(indices.get_pointer(), 0, indices.get_pitch() * texture_height);
+			dirty.MarkAll();
+		}
+
+		/**
+		 * @throw if the window is not made of whole macro pixels
+		 */
+		static void CheckSize(uint32_t window_width, uint32_t window_height, uint32_t pixel_size) {
+			if (pixel_size == 0) throw std::runtime_error("invalid pixel_size");
+			if (window_width  % pixel_size != 0) throw std::runtime_error("invalid window_width");
+			if (window_height % pixel_size != 0) throw std::runtime_error("invalid window_height");
+		}
+
+		/**
+		 * @return SDL format of the pixels of the frame
+		 */
+		static constexpr uint32_t SdlFormat(void) {
+			if constexpr (std::is_same<PixelFormat, pixel::RGBA8888>::value) return SDL_PIXELFORMAT_RGBA8888;
+			else if constexpr (std::is_same<PixelFormat, pixel::ARGB8888>::value) return SDL_PIXELFORMAT_ARGB8888;
+			else return SDL_PIXELFORMAT_RGB888; // XRGB8888
+		}
+
+		/**
+		 * warn if the renderer does not list the format of the frame among
+		 * its texture formats, the driver converts every upload then
+		 */
+		void CheckFormat(void) const {
+			SDL_RendererInfo info;
+			if (SDL_GetRendererInfo(renderer, &info) != 0) return;
+			for (uint32_t i = 0; i < info.num_texture_formats; ++i) {
+				if (info.texture_formats[i] == SdlFormat()) return;
+			}
+			std::cerr << "[WARNING] the renderer " << info.name << " converts the pixels of each upload"
+				<< " (see RICO_PIXEL_FORMAT)" << std::endl;
+		}
+
+		/**
+		 * (re)create the streaming texture (the textures of the OpenGL
+		 * backend), of size texture_width x texture_height
+		 */
+		void CreateTexture(void) {
+			if (gpu) {
+				gpu->Resize(texture_width, texture_height);
+				return;
+			}
+			if (texture != NULL) SDL_DestroyTexture(texture);
+			texture = SDL_CreateTexture(
+				renderer, // associated renderer
+				SdlFormat(), // pixel format, see pixel.hpp
+				SDL_TEXTUREACCESS_STREAMING, // texture access
+				texture_width, texture_height); // texture size
+			if (texture == NULL) throw std::runtime_error("SDL_CreateTexture");
+		}
+
+		/**
+		 * (re)allocate the frame (set to black) and its dirty tiles, and the
+		 * indices in indexed mode, reusing their storage if possible
+		 */
+		void CreateFrame(void) {
+			// height is the number of rows and width is the number of cols
+			// rows are padded to start on a cache line
+			data.reshape(texture_height, texture_width, true);
+			raster::fill(data.get_pointer(), data.get_pitch(), texture_width, texture_height, uint32_t(BLACK));
+			pixels = data.get_pointer();
+			pitch = data.get_pitch();
+			dirty.Reset(texture_width, texture_height);
+			if (indexed) CreateIndices();
+		}
+
+		/**
+		 * canvas mode: (re)allocate the canvas (set to black), clear the frame
+		 * (transparent) and mark it dirty, so that the whole canvas is presented
+		 */
+		void CreateCanvas(void) {
+			canvas_pixels.reshape(texture_height, texture_width, true);
+			raster::fill(canvas_pixels.get_pointer(), canvas_pixels.get_pitch(), texture_width, texture_height, uint32_t(BLACK));
+			canvas_tiles.Reset(texture_width, texture_height);
+			raster::fill(data.get_pointer(), data.get_pitch(), texture_width, texture_height, 0);
+			dirty.MarkAll();
+			fade = shown_fade = BLACK;
+		}
+
+		/**
+		 * start or stop canvas mode (see SetCanvas), at the beginning of Run
+		 */
+		void PrepareCanvas(void) {
+			if (canvas) {
+				if (submit == Submit::DIRECT) throw std::logic_error("canvas mode requires Submit::COPY");
+				if (indexed) throw std::logic_error("canvas mode is incompatible with indexed mode");
+				CreateCanvas();
+			} else {
+				canvas_pixels = Tmat2D<uint32_t>();
+			}
+			if (gpu) gpu->SetCanvas(canvas);
+		}
+
+		/**
+		 * apply the size requested since the previous frame, if any: only the
+		 * texture (if its size changed) and the frame are reallocated
+		 * in pipelined mode, the worker must be idle
+		 * @return true if the size of the texture changed (see OnUserResize)
+		 */
+		bool ApplyResize(void) {
+			if (!resize_pending) return false;
+			RICO_PROFILE("resize");
+			resize_pending = false;
+			uint32_t const width = std::max(resize_width / resize_pixel_size, 1u);
+			uint32_t const height = std::max(resize_height / resize_pixel_size, 1u);
+			bool const changed = (width != texture_width || height != texture_height);
+			if (!headless && (resize_width != window_width || resize_height != window_height)) {
+				// no-op if the window already has this size (resized by the user)
+				SDL_SetWindowSize(window, resize_width, resize_height);
+			}
+			window_width = resize_width;
+			window_height = resize_height;
+			pixel_size = resize_pixel_size;
+			// the window content is lost in any case
+			dirty.MarkAll();
+			if (!changed) return false;
+			bool const relock = locked;
+			Unlock();
+			texture_width = width;
+			texture_height = height;
+			if (!headless || gpu) CreateTexture();
+			CreateFrame();
+			// on the GPU, the canvas was cleared with its textures
+			if (Composing()) CreateCanvas();
+			if (pipelined && shown.get_pointer() != NULL) {
+				shown.reshape(texture_height, texture_width, true);
+				shown_dirty.Reset(texture_width, texture_height);
+				shown_dirty.Clear();
+				// drawn into after the swap, without being brought up to date
+				if (Composing()) raster::fill(shown.get_pointer(), shown.get_pitch(), texture_width, texture_height, 0);
+			}
+			// frames of the recording all have the same size
+			recorder.reset();
+			if (relock) BeginFrame();
+			return true;
+		}
+
+		/**
+		 * canvas mode: fade the canvas, blend the dirty regions of a frame over
+		 * it and clear them (transparent), then upload what changed (on the
+		 * GPU, the dirty regions of the frame)
+		 * @param source pixels of the frame
+		 * @param source_pitch pixels per row of source
+		 * @param tiles regions drawn to (not cleared)
+		 * @param amount fade of the frame, reset to 0
+		 * @return true if the canvas changed and must be presented
+		 */
+		bool Compose(uint32_t *source, size_t source_pitch, DirtyTiles const& tiles, Color& amount) {
+			bool const faded = (amount.r | amount.g | amount.b) != 0;
+			if (tiles.Empty() && !faded) return false;
+			if (gpu) {
+				Upload(source, source_pitch, tiles);
+				RICO_PROFILE("compose");
+				gpu->Compose(amount.r, amount.g, amount.b);
+			} else {
+				{
+					RICO_PROFILE("compose");
+					uint32_t *target = canvas_pixels.get_pointer();
+					size_t const target_pitch = canvas_pixels.get_pitch();
+					if (faded) {
+						uint32_t value = uint32_t(amount) & ~PixelFormat::alpha_mask;
+						raster::saturating_sub(target, target_pitch, texture_width, texture_height, value);
+					}
+					tiles.ForEachRun([target, target_pitch, source, source_pitch](SDL_Rect const& rect) {
+						raster::blend(
+							target + rect.y * target_pitch + rect.x, target_pitch,
+							source + rect.y * source_pitch + rect.x, source_pitch,
+							rect.w, rect.h);
+					});
+				}
+				Upload(canvas_pixels.get_pointer(), canvas_pixels.get_pitch(), faded ? canvas_tiles : tiles);
+			}
+			// the next frame drawn into source starts transparent
+			tiles.ForEachRun([source, source_pitch](SDL_Rect const& rect) {
+				raster::fill(source + rect.y * source_pitch + rect.x, source_pitch, rect.w, rect.h, 0);
+			});
+			amount = BLACK;
+			return true;
+		}
+
+		/**
+		 * canvas mode: hand the canvas to the frame dump and the recorder, if
+		 * any (read back from the GPU while recording or dumping)
+		 */
+		void CaptureCanvas(void) {
+			if (gpu) {
+				if (!recorder && !Dumping()) return;
+				RICO_PROFILE("read back");
+				gpu->ReadCanvas(canvas_pixels.get_pointer(), canvas_pixels.get_pitch());
+			}
+			CaptureFrame(canvas_pixels.get_pointer(), canvas_pixels.get_pitch());
+		}
+
+		/**
+		 * hand the frame drawn since BeginFrame over to the texture (to the
+		 * canvas in canvas mode), and to the capture
+		 * only the dirty tiles are uploaded, except in DIRECT mode
+		 * @return true if the texture changed and must be presented
+		 */
+		bool EndFrame(void) {
+			if (Composing()) {
+				bool changed = Compose(pixels, pitch, dirty, fade);
+				dirty.Clear();
+				CaptureCanvas();
+				return changed;
+			}
+			// before the texture is unlocked, in DIRECT mode
+			CaptureFrame(pixels, pitch);
+			if (Direct()) {
+				RICO_PROFILE("upload");
+				Unlock();
+				return true;
+			}
+			if (dirty.Empty()) return false;
+			Upload(pixels, pitch, dirty);
+			dirty.Clear();
+			return true;
+		}
+
+		/**
+		 * copy the texture to the window
+		 */
+		void Present(void) {
+			if (headless) return;
+			if (gpu) {
+				RICO_PROFILE("present");
+				gpu->Present(window_width, pixel_size, Lookup());
+				return;
+			}
+			{
+				RICO_PROFILE("render copy");
+				// the window may not be made of whole macro pixels after the
+				// user resized it: keep them square, the remainder is black
+				SDL_Rect target = {
+					0, 0,
+					static_cast<int>(texture_width * pixel_size),
+					static_cast<int>(texture_height * pixel_size) };
+				bool const exact = (texture_width * pixel_size == window_width && texture_height * pixel_size == window_height);
+				if (!exact) SDL_RenderClear(renderer);
+				int retval = SDL_RenderCopy(
+					renderer, // rendering context
+					texture, // source texture
+					NULL, // take the entire texture
+					exact ? NULL : &target); // display it to the entire context, or to the macro pixels
+				if (retval != 0) throw std::runtime_error("SDL_RenderCopy");
+			}
+
+			RICO_PROFILE("present");
+			SDL_RenderPresent(renderer);
+		}
+
+		/**
+		 * end the frame: wait for its deadline (see SetTargetFps) then push
+		 * its timings to the profiler
+		 * @return true if the frame limit of headless mode is reached
+		 */
+		bool FinishFrame(void) {
+			if (!headless) {
+				RICO_PROFILE("wait");
+				pacer.Wait();
+			}
+			++frame_count;
+			CountAllocations();
+			Profiler::Get().NextFrame();
+			return headless && frame_limit != 0 && frame_count >= frame_limit;
+		}
+
+		/**
+		 * report the heap allocations since the previous call
+		 */
+		void CountAllocations(void) {
+			static uint32_t const counter = Profiler::Get().RegisterCounter("heap allocations");
+			uint64_t now = HeapAllocations();
+			frame_allocations = now - allocations;
+			allocations = now;
+			Profiler::Get().Add(counter, static_cast<int64_t>(frame_allocations));
+		}
+
+		/**
+		 * start a new frame of scratch memory, see GetFrameArena
+		 */
+		void ResetArenas(void) {
+			frame_arena.Reset();
+			if (!pool) return;
+			for (uint32_t i = 0; i + 1 < pool->Size(); ++i) thread_arenas[i].Reset();
+		}
+
+		/**
+		 * duration of a frame as seen by OnUserUpdate
+		 * in headless mode, this is the period of the target frame rate
+		 * (1/60 s if not set) instead of the measured duration, so that runs
+		 * are reproducible
+		 * @param measured measured duration of the frame
+		 */
+		double FrameTime(Duration measured) const {
+			if (!headless) return measured.count();
+			return pacer.Enabled() ? pacer.Period().count() : 1000.0 / 60.0;
+		}
+
+		/**
+		 * in headless mode, write the frame as a binary PPM image named
+		 * dump_prefix followed by the frame number, if dump_prefix is set
+		 * @param source pixels of the frame
+		 * @param source_pitch pixels per row of source
+		 */
+		void DumpFrame(uint32_t const *source, size_t source_pitch) {
+			if (!Dumping()) return;
+			RICO_PROFILE("dump");
+			char number[24];
+			std::snprintf(number, sizeof(number), "%06llu.ppm", static_cast<unsigned long long>(frame_count));
+			std::ofstream file(dump_prefix + number, std::ios::binary);
+			file << "P6\n" << texture_width << ' ' << texture_height << "\n255\n";
+			dump_line.resize(3 * texture_width);
+			for (uint32_t y = 0; y < texture_height; ++y) {
+				uint32_t const *line = source + y * source_pitch;
+				for (uint32_t x = 0; x < texture_width; ++x) {
+					dump_line[3 * x + 0] = PixelFormat::red(line[x]);
+					dump_line[3 * x + 1] = PixelFormat::green(line[x]);
+					dump_line[3 * x + 2] = PixelFormat::blue(line[x]);
+				}
+				file.write(reinterpret_cast<char const*>(dump_line.data()), dump_line.size());
+			}
+			if (!file) throw std::runtime_error("cannot write frame dump");
+		}
+
+		/**
+		 * hand a finished frame to the frame dump and the recorder, if any
+		 * @param source pixels of the frame
+		 * @param source_pitch pixels per row of source
+		 */
+		void CaptureFrame(uint32_t const *source, size_t source_pitch) {
+			DumpFrame(source, source_pitch);
+			if (recorder) recorder->Submit(source, source_pitch);
+		}
+
+		/**
+		 * stop recording and release SDL elements, see Construct and ~GameEngine
+		 */
+		void Destroy(void) noexcept {
+			if (init) {
+				recorder.reset();
+				if (window != NULL) {
+					Unlock();
+					// before its window
+					gpu.reset();
+					if (texture != NULL) SDL_DestroyTexture(texture);
+					if (renderer != NULL) SDL_DestroyRenderer(renderer);
+					SDL_DestroyWindow(window);
+					SDL_QuitSubSystem(SDL_INIT_EVENTS);
+					SDL_Quit();
+				}
+				locked = false;
+				resize_pending = false;
+				init = false;
+			}
+		}
+
+		/**
+		 * append an event to the input queue, if enabled
+		 */
+		void Queue(InputEvent::Type type, uint32_t timestamp, uint8_t mouse, SDL_Keysym const *keysym, bool repeat) {
+			if (!queue_input) return;
+			InputEvent event;
+			event.type = type;
+			event.repeat = repeat;
+			event.mouse = mouse;
+			event.key = '\0';
+			event.scancode = SDL_SCANCODE_UNKNOWN;
+			if (keysym != NULL) {
+				if (Button::first_key <= keysym->sym && keysym->sym <= Button::last_key) event.key = static_cast<char>(keysym->sym);
+				event.scancode = keysym->scancode;
+			}
+			event.timestamp = timestamp;
+			event.x = mouse_x / static_cast<int32_t>(pixel_size);
+			event.y = mouse_y / static_cast<int32_t>(pixel_size);
+			events.push_back(event);
+		}
+
+		/**
+		 * forget the edges and queued events, once an update saw them
+		 */
+		void ClearInput(void) {
+			input.ClearEdges();
+			events.clear();
+			input_seen = false;
+		}
+
+		/**
+		 * handle pending events and update the state of the buttons
+		 * @return true if the user asked to quit
+		 */
+		bool PollEvents(void) {
+			RICO_PROFILE("events");
+			// a frame without an update step (fixed timestep) keeps its input
+			if (input_seen) ClearInput();
+			if (headless) return false;
+			bool quit = false;
+			SDL_Event event;
+			while (SDL_PollEvent(&event) != 0) {
+				uint8_t mouse = 0;
+				switch (event.type) {
+					break; case SDL_QUIT:
+						quit = true;
+					break; case SDL_WINDOWEVENT:
+						// the window content was lost, upload and present it again
+						if (event.window.event == SDL_WINDOWEVENT_EXPOSED) dirty.MarkAll();
+						if (event.window.event == SDL_WINDOWEVENT_ENTER) mouse_inside = true;
+						if (event.window.event == SDL_WINDOWEVENT_LEAVE) mouse_inside = false;
+						if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+							// keep the size of the macro pixels, see ApplyResize
+							uint32_t width = static_cast<uint32_t>(std::max(event.window.data1, 1));
+							uint32_t height = static_cast<uint32_t>(std::max(event.window.data2, 1));
+							if (width != window_width || height != window_height || resize_pending) {
+								resize_width = width;
+								resize_height = height;
+								resize_pixel_size = resize_pending ? resize_pixel_size : pixel_size;
+								resize_pending = true;
+							}
+						}
+					break; case SDL_KEYDOWN:
+						input.Learn(event.key.keysym.sym, event.key.keysym.scancode);
+						if (event.key.keysym.scancode < SDL_NUM_SCANCODES) input.Press(event.key.keysym.scancode);
+						Queue(InputEvent::PRESS, event.key.timestamp, 0, &event.key.keysym, event.key.repeat != 0);
+					break; case SDL_KEYUP:
+						if (event.key.keysym.scancode < SDL_NUM_SCANCODES) input.Release(event.key.keysym.scancode);
+						Queue(InputEvent::RELEASE, event.key.timestamp, 0, &event.key.keysym, false);
+					break; case SDL_MOUSEMOTION:
+						mouse_x = event.motion.x;
+						mouse_y = event.motion.y;
+						mouse_inside = true;
+						Queue(InputEvent::MOTION, event.motion.timestamp, 0, NULL, false);
+					break; case SDL_MOUSEBUTTONDOWN:
+						mouse_x = event.button.x;
+						mouse_y = event.button.y;
+						mouse = MouseIndex(event.button.button);
+						if (mouse == 0) break;
+						input.Press(InputState::MouseSlot(mouse));
+						Queue(InputEvent::PRESS, event.button.timestamp, mouse, NULL, false);
+					break; case SDL_MOUSEBUTTONUP:
+						mouse_x = event.button.x;
+						mouse_y = event.button.y;
+						mouse = MouseIndex(event.button.button);
+						if (mouse == 0) break;
+						input.Release(InputState::MouseSlot(mouse));
+						Queue(InputEvent::RELEASE, event.button.timestamp, mouse, NULL, false);
+				}
+			}
+			return quit;
+		}
+
+		/**
+		 * @return index of an SDL mouse button (see Button), 0 if unknown
+		 */
+		static uint8_t MouseIndex(uint8_t sdl_button) {
+			switch (sdl_button) {
+				case SDL_BUTTON_LEFT: return Button::LEFT;
+				case SDL_BUTTON_RIGHT: return Button::RIGHT;
+				case SDL_BUTTON_MIDDLE: return Button::MIDDLE;
+				case SDL_BUTTON_X1: return Button::X1;
+				case SDL_BUTTON_X2: return Button::X2;
+			}
+			return 0;
+		}
+
+		// call OnUserUpdate once, or once per elapsed timestep
+		bool Update(Game& app, double elapsed_ms);
+
+		// game loops, see Run
+		int RunSerial(Game& app) noexcept;
+		int RunPipelined(Game& app) noexcept;
+
+		/**
+		 * see Construct and ConstructHeadless
+		 */
+		static int Create(
+			uint32_t window_width,
+			uint32_t window_height,
+			uint32_t pixel_size,
+			bool headless,
+			uint64_t frames)
+			noexcept
+		{
+			GameEngine& engine = Get();
+			engine.Destroy();
+
+			engine.window = NULL;
+			engine.renderer = NULL;
+			engine.texture = NULL;
+			engine.input.Reset();
+			engine.mouse_x = engine.mouse_y = 0;
+			engine.mouse_inside = false;
+			engine.events.clear();
+			engine.input_seen = false;
+
+			try {
+
+				CheckSize(window_width, window_height, pixel_size);
+
+				engine.window_width = window_width;
+				engine.window_height = window_height;
+				engine.pixel_size = pixel_size;
+				engine.texture_width = window_width / pixel_size;
+				engine.texture_height = window_height / pixel_size;
+				engine.headless = headless;
+				engine.frame_limit = frames;
+				engine.dump_prefix.clear();
+				if (headless) {
+					char const *dump = std::getenv("RICO_DUMP");
+					if (dump != NULL) engine.dump_prefix = dump;
+				}
+				bool const opengl = (engine.backend == Backend::OPENGL);
+				// headless with OpenGL: a hidden window holds the context, so
+				// that the GPU passes can be dumped and compared with the CPU
+				if (!headless || opengl) {
+					// the attributes of OpenGL need the video subsystem, before the window
+					int retval = SDL_Init(opengl ? SDL_INIT_EVENTS | SDL_INIT_VIDEO : SDL_INIT_EVENTS);
+					if (retval != 0) throw std::runtime_error("SDL_Init");
+					if (opengl) GpuPresenter::SetAttributes();
+
+					Uint32 flags = engine.resizable ? SDL_WINDOW_RESIZABLE : 0;
+					if (opengl) flags |= SDL_WINDOW_OPENGL;
+					if (headless) flags |= SDL_WINDOW_HIDDEN;
+					engine.window = SDL_CreateWindow(
+						"App", // window name
+						SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, // position on window
+						engine.window_width, engine.window_height, // window size
+						flags); // creation flags
+					if (engine.window == NULL) throw std::runtime_error("SDL_CreateWindow");
+
+					if (opengl) {
+						engine.gpu.reset(new GpuPresenter(engine.window, engine.texture_width, engine.texture_height));
+					} else {
+						engine.renderer = SDL_CreateRenderer(
+							engine.window, // associated window
+							-1, // index of the rendering driver
+							SDL_RENDERER_ACCELERATED); // creation flags
+						if (engine.renderer == NULL) throw std::runtime_error("SDL_CreateRenderer");
+
+						engine.CheckFormat();
+						engine.CreateTexture();
+					}
+				}
+
+				engine.CreateFrame();
+
+			} catch (std::exception const& e) {
+				PrintException(e);
+				return -1;
+			}
+
+			engine.init = true;
+			return 0;
+		}
+
+
+	public:
+
+		/**
+		 * create window of size window_width x window_height (in pixels)
+		 * composed of macro pixels of size pixel_size x pixel_size
+		 * destroy any previously constructed window
+		 * if the environment variable RICO_HEADLESS is set, this is the same
+		 * as ConstructHeadless with frames = RICO_HEADLESS (0 meaning no limit)
+		 * the environment variable RICO_BACKEND (renderer or opengl) overrides
+		 * SetBackend, in headless mode too
+		 * @param window_[width/height] dimensions of the window
+		 * @param pixel_size dimension of macro pixels
+		 * @return 0 on success, -1 on failure
+		 */
+		static int Construct(
+			uint32_t window_width,
+			uint32_t window_height,
+			uint32_t pixel_size)
+			noexcept
+		{
+			char const *backend = std::getenv("RICO_BACKEND");
+			if (backend != NULL) {
+				if (std::strcmp(backend, "opengl") == 0) SetBackend(Backend::OPENGL);
+				else if (std::strcmp(backend, "renderer") == 0) SetBackend(Backend::RENDERER);
+			}
+			char const *frames = std::getenv("RICO_HEADLESS");
+			if (frames != NULL) {
+				return ConstructHeadless(window_width, window_height, pixel_size, std::strtoull(frames, NULL, 10));
+			}
+			return Create(window_width, window_height, pixel_size, false, 0);
+		}
+
+		/**
+		 * same as Construct, but without any window: Run executes frames as
+		 * fast as possible, with a fixed frame time, until OnUserUpdate returns
+		 * false or frames were run, then prints the achieved frame rate
+		 * if the environment variable RICO_DUMP is set, each frame is written
+		 * to the file RICO_DUMP<frame number>.ppm
+		 * with Backend::OPENGL, a hidden window holds the context and frames
+		 * go through the GPU passes (read back to be dumped), so that the
+		 * dumps of both backends can be compared
+		 * @param window_[width/height] dimensions of the (virtual) window
+		 * @param pixel_size dimension of macro pixels
+		 * @param frames number of frames to run, 0 for no limit
+		 * @return 0 on success, -1 on failure
+		 */
+		static int ConstructHeadless(
+			uint32_t window_width,
+			uint32_t window_height,
+			uint32_t pixel_size,
+			uint64_t frames = 0)
+			noexcept
+		{
+			return Create(window_width, window_height, pixel_size, true, frames);
+		}
+
+		~GameEngine(void) noexcept {
+			Destroy();
+		}
+
+		/**
+		 * change the size of the window and of its macro pixels in place,
+		 * unlike Construct: the window, the renderer and the game keep their
+		 * state, only the texture and the frame are reallocated (if the size
+		 * of the texture changed), and the app is told by OnUserResize
+		 * during Run, this takes effect at the beginning of the next frame,
+		 * immediately otherwise
+		 * the frame is cleared to black if the size of the texture changed,
+		 * and the recording (if any) is stopped
+		 * @param window_[width/height] new dimensions of the window
+		 * @param pixel_size new dimension of macro pixels
 		 * @return 0 on success, -1 on failure
 		 */
-		static int Construct(
+		static int Resize(
 			uint32_t window_width,
 			uint32_t window_height,
 			uint32_t pixel_size)
 			noexcept
 		{
 			GameEngine& engine = Get();
-			if (engine.init) {
-				engine.~GameEngine();
+			if (!engine.init) return -1;
+			try {
+				CheckSize(window_width, window_height, pixel_size);
+				engine.resize_width = window_width;
+				engine.resize_height = window_height;
+				engine.resize_pixel_size = pixel_size;
+				engine.resize_pending = true;
+				if (!engine.running) engine.ApplyResize();
+			} catch (std::exception const& e) {
+				PrintException(e);
+				return -1;
 			}
+			return 0;
+		}
 
-			engine.window = NULL;
-			engine.renderer = NULL;
-			engine.texture = NULL;
-			for (uint32_t i = 0; i < Button::index_count; ++i) {
-				engine.mouse_state[i] = HardwareButton();
-			}
-			for (uint32_t i = 0; i < Button::key_count; ++i) {
-				engine.keyboard_state[i] = HardwareButton();
-			}
+		/**
+		 * allow the user to resize the window, the macro pixels keep their
+		 * size and the texture follows the window (see Resize)
+		 * @param enable true to allow resizing, false by default
+		 */
+		static void SetResizable(bool enable) {
+			GameEngine& engine = Get();
+			engine.resizable = enable;
+			if (engine.init && !engine.headless) SDL_SetWindowResizable(engine.window, enable ? SDL_TRUE : SDL_FALSE);
+		}
 
-			try {
+		/**
+		 * select how frames are presented (see Backend), take effect at the
+		 * next call to Construct (headless mode has neither)
+		 * @param mode presentation backend, Backend::RENDERER by default
+		 */
+		static void SetBackend(Backend mode) {
+			Get().backend = mode;
+		}
 
-				if (pixel_size == 0) throw std::runtime_error("invalid pixel_size");
-				if (window_width  % pixel_size != 0) throw std::runtime_error("invalid window_width");
-				if (window_height % pixel_size != 0) throw std::runtime_error("invalid window_height");
+		/**
+		 * select how frames are handed over to the texture (see Submit)
+		 * take effect at the next call to Run
+		 * @param mode submission mode, Submit::COPY by default
+		 */
+		static void SetSubmit(Submit mode) {
+			Get().submit = mode;
+		}
 
-				engine.window_width = window_width;
-				engine.window_height = window_height;
-				engine.pixel_size = pixel_size;
-				engine.texture_width = window_width / pixel_size;
-				engine.texture_height = window_height / pixel_size;
+		/**
+		 * in indexed mode, the app draws 8 bits palette indices (see
+		 * IndexedBuffer) instead of colors, a quarter of the memory traffic
+		 * of RGBA pixels, and the dirty regions are looked up in the palette
+		 * before being uploaded or captured
+		 * the RGBA pixels (SetPixel, FrameBuffer) should not be drawn, they
+		 * are overwritten in the dirty regions
+		 * incompatible with pipelined mode, take effect immediately, indices
+		 * start at 0
+		 * @param enable true to enable indexed mode, false by default
+		 * @return 0 on success, -1 on failure
+		 */
+		static int SetIndexed(bool enable) noexcept {
+			GameEngine& engine = Get();
+			engine.indexed = enable;
+			if (!enable) {
+				engine.indices = Tmat2D<uint8_t>();
+				return 0;
+			}
+			if (!engine.init) return 0;
+			try {
+				engine.CreateIndices();
+			} catch (std::exception const& e) {
+				PrintException(e);
+				engine.indexed = false;
+				return -1;
+			}
+			return 0;
+		}
 
-				int retval = SDL_Init(SDL_INIT_EVENTS);
-				if (retval != 0) throw std::runtime_error("SDL_Init");
+		/**
+		 * set a color of the palette of indexed mode, the whole frame is
+		 * redrawn if it changed
+		 * @param index index of the color
+		 * @param color new color
+		 */
+		static void SetPaletteColor(uint8_t index, Color color) {
+			GameEngine& engine = Get();
+			if (engine.palette[index] == uint32_t(color)) return;
+			engine.palette[index] = uint32_t(color);
+			engine.dirty.MarkAll();
+		}
 
-				engine.window = SDL_CreateWindow(
-					"App", // window name
-					SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, // position on window
-					engine.window_width, engine.window_height, // window size
-					0); // creation flags
-				if (engine.window == NULL) throw std::runtime_error("SDL_CreateWindow");
+		/**
+		 * @param index index of the color
+		 * @return color of the palette of indexed mode
+		 */
+		static Color GetPaletteColor(uint8_t index) {
+			return Color(Get().palette[index]);
+		}
 
-				engine.renderer = SDL_CreateRenderer(
-					engine.window, // associated window
-					-1, // index of the rendering driver
-					SDL_RENDERER_ACCELERATED); // creation flags
-				if (engine.renderer == NULL) throw std::runtime_error("SDL_CreateRenderer");
+		/**
+		 * in pipelined mode, OnUserUpdate runs on a dedicated thread and draws
+		 * frame N+1 in a second framebuffer while frame N is uploaded and
+		 * presented by the main thread (adding one frame of latency)
+		 * OnUserRender and the event loop stay on the main thread
+		 * incompatible with Submit::DIRECT, take effect at the next call to Run
+		 * @param enable true to enable pipelining, false by default
+		 */
+		static void SetPipelined(bool enable) {
+			Get().pipelined = enable;
+		}
 
-				engine.texture = SDL_CreateTexture(
-					engine.renderer, // associated renderer
-					SDL_PIXELFORMAT_RGBA8888, // pixel format
-					SDL_TEXTUREACCESS_STREAMING, // texture access
-					engine.texture_width, engine.texture_height); // texture size
-				if (engine.texture == NULL) throw std::runtime_error("SDL_CreateTexture");
+		/**
+		 * in canvas mode, frames accumulate on a canvas instead of replacing
+		 * each other: the frame starts transparent (pixels of value 0), and at
+		 * its end the canvas is faded (see FadeCanvas), what was drawn is
+		 * blended over it (see raster::blend, opaque colors replace the canvas)
+		 * and cleared, so that the app only draws what is new
+		 * with Backend::OPENGL, the canvas stays on the GPU: only the dirty
+		 * tiles of the frame are uploaded, the fade and the blend are a shader
+		 * pass, and the CPU never touches the whole frame; otherwise the CPU
+		 * does both, and uploads the whole canvas when it is faded
+		 * GetPixel and FrameBuffer read the frame, not the canvas, frames are
+		 * captured from the canvas (read back from the GPU), the headless dumps
+		 * of both backends are the same (see make check_canvas)
+		 * incompatible with Submit::DIRECT and indexed mode, take effect at
+		 * the next call to Run, the canvas starts black (and is cleared to
+		 * black when the size of the texture changes)
+		 * @param enable true to enable canvas mode, false by default
+		 */
+		static void SetCanvas(bool enable) {
+			Get().canvas = enable;
+		}
 
-				// height is the number of rows and width is the number of cols
-				engine.data = Tmat2D<uint32_t>(engine.texture_height, engine.texture_width);
+		/**
+		 * in canvas mode, darken the canvas before the frame being drawn is
+		 * blended over it: each component of amount is subtracted from the
+		 * pixels, clamping at 0 (as FrameBuffer::SaturatingSub), the fades of
+		 * a frame add up
+		 * @param amount fade of each component
+		 */
+		static void FadeCanvas(Color amount) {
+			Color& fade = Get().fade;
+			fade = Color(
+				static_cast<uint8_t>(std::min(255, fade.r + amount.r)),
+				static_cast<uint8_t>(std::min(255, fade.g + amount.g)),
+				static_cast<uint8_t>(std::min(255, fade.b + amount.b)));
+		}
 
+		/**
+		 * record every Nth frame to disk, until StopRecording or the next call
+		 * to Construct (see Recorder), encoding and writing are done by a
+		 * background thread and frames are dropped rather than waited for
+		 * must be called from the main thread (from OnUserRender, not from
+		 * OnUserUpdate, in pipelined mode), as StopRecording
+		 * @param path output file (RAW, Y4M) or prefix of the files (PNG)
+		 * @param format output format
+		 * @param every keep one frame out of every
+		 * @return 0 on success, -1 on failure
+		 */
+		static int StartRecording(char const *path, CaptureFormat format, uint32_t every = 1) noexcept {
+			GameEngine& engine = Get();
+			if (!engine.init) return -1;
+			try {
+				double fps = engine.pacer.Enabled() ? 1000.0 / engine.pacer.Period().count() : 60.0;
+				engine.recorder.reset();
+				engine.recorder.reset(new Recorder(path, format,
+					engine.texture_width, engine.texture_height, every, fps / std::max(every, 1u)));
+				// the GPU stops looking the palette up: expand every index
+				if (engine.gpu && engine.indexed) engine.dirty.MarkAll();
 			} catch (std::exception const& e) {
 				PrintException(e);
 				return -1;
 			}
-
-			engine.init = true;
 			return 0;
 		}
 
-		~GameEngine(void) noexcept {
-			if (init) {
-				SDL_DestroyTexture(texture);
-				SDL_DestroyRenderer(renderer);
-				SDL_DestroyWindow(window);
-				SDL_QuitSubSystem(SDL_INIT_EVENTS);
-				SDL_Quit();
-				init = false;
+		/**
+		 * write the remaining frames and stop recording
+		 * @return number of frames dropped since StartRecording
+		 */
+		static uint64_t StopRecording(void) noexcept {
+			GameEngine& engine = Get();
+			if (!engine.recorder) return 0;
+			bool failed = engine.recorder->Failed();
+			engine.recorder->Close();
+			uint64_t dropped = engine.recorder->Dropped();
+			engine.recorder.reset();
+			// the GPU looks the palette up again: upload every index
+			if (engine.gpu && engine.indexed) engine.dirty.MarkAll();
+			if (failed) PrintException(std::runtime_error("frame capture failed"));
+			return dropped;
+		}
+
+		/**
+		 * limit the frame rate, the end of each frame is waited for precisely
+		 * instead of sleeping a fixed duration (see FramePacer)
+		 * @param fps frames per second, 0 to not limit (default)
+		 */
+		static void SetTargetFps(double fps) {
+			Get().pacer.SetTargetFps(fps);
+		}
+
+		/**
+		 * update the simulation with a fixed timestep: OnUserUpdate is called
+		 * with elapsed_ms = step_ms as many times as needed to keep up with
+		 * real time (possibly 0 times in a frame), OnUserRender once per frame
+		 * button edges (pressed / released) are only seen by the first update
+		 * of a frame, and kept until an update sees them
+		 * @param step_ms duration of a step, 0 for a variable timestep (default)
+		 * @param steps maximum number of steps per frame, the simulation slows
+		 *   down instead of spiraling when updates are too slow
+		 */
+		static void SetFixedTimestep(double step_ms, uint32_t steps = 5) {
+			GameEngine& engine = Get();
+			engine.timestep = std::max(step_ms, 0.0);
+			engine.max_steps = std::max(steps, 1u);
+			engine.accumulator = 0.0;
+		}
+
+		/**
+		 * @return fraction of a timestep elapsed since the last update, in
+		 *   [0, 1), to interpolate the state drawn by OnUserRender (0 with a
+		 *   variable timestep)
+		 */
+		static double GetInterpolation(void) {
+			GameEngine& engine = Get();
+			if (engine.timestep <= 0.0) return 0.0;
+			return std::min(engine.accumulator / engine.timestep, 1.0);
+		}
+
+		/**
+		 * set the number of threads used by ParallelFor2D (calling thread
+		 * included), must not be called from inside a parallel loop
+		 * @param threads number of threads, 0 for one per hardware thread (default)
+		 */
+		static void SetThreadCount(uint32_t threads) {
+			GameEngine& engine = Get();
+			engine.thread_count = threads;
+			engine.pool.reset();
+			engine.thread_arenas.reset();
+		}
+
+		/**
+		 * access the thread pool of the engine, created on first use
+		 * @return reference to the thread pool
+		 */
+		static ThreadPool& GetThreadPool(void) {
+			GameEngine& engine = Get();
+			if (!engine.pool) {
+				engine.pool.reset(new ThreadPool(engine.thread_count));
+				engine.thread_arenas.reset(new Arena[engine.pool->Size() - 1]);
 			}
+			return *engine.pool;
+		}
+
+		/**
+		 * scratch memory of the current frame (see arena.hpp), reset before
+		 * OnUserUpdate: what is allocated by OnUserUpdate and OnUserRender is
+		 * valid until the end of the frame (in pipelined mode, until the end
+		 * of the following OnUserRender)
+		 * OnUserUpdate and OnUserRender never run at the same time, but other
+		 * threads must use GetThreadArena
+		 * @return the arena of the frame
+		 */
+		static Arena& GetFrameArena(void) {
+			return Get().frame_arena;
+		}
+
+		/**
+		 * scratch memory of the current thread of the pool, for the loops run
+		 * by ParallelFor, reset with the frame arena
+		 * @return the arena of the current thread (the frame arena for the
+		 *   thread starting the loop, and outside of loops)
+		 */
+		static Arena& GetThreadArena(void) {
+			GameEngine& engine = Get();
+			uint32_t index = ThreadPool::ThreadIndex();
+			if (index == 0 || !engine.pool) return engine.frame_arena;
+			return engine.thread_arenas[index - 1];
+		}
+
+		/**
+		 * @return number of heap allocations during the previous frame (see
+		 *   arena.hpp, only the storage of Tmat2D and the arenas unless
+		 *   RICO_COUNT_ALLOCATIONS is defined)
+		 */
+		static uint64_t GetFrameAllocations(void) {
+			return Get().frame_allocations;
+		}
+
+		/**
+		 * call fn(row, col, tile_rows, tile_cols) on each tile of a rows x cols
+		 * area, in parallel, tiles being tile x tile pixels (their width is
+		 * rounded up so that two threads never write the same cache line)
+		 * @param rows height of the area (usually GetHeight())
+		 * @param cols width of the area (usually GetWidth())
+		 * @param tile size of the tiles
+		 * @param fn function to call on each tile
+		 */
+		template<typename F>
+		static void ParallelFor2D(uint32_t rows, uint32_t cols, uint32_t tile, F&& fn) {
+			GetThreadPool().ParallelFor2D(rows, cols, tile, std::forward<F>(fn));
 		}
 
 		/**
@@ -490,10 +2386,60 @@ namespace rico {
 		static void SetPixel(Position pos, Color color) {
 			GameEngine& engine = Get();
 			if (engine.init) {
-				engine.data[pos] = uint32_t(color);
+				if (pos.x >= engine.texture_width || pos.y >= engine.texture_height) {
+					throw std::out_of_range("index out of range");
+				}
+				engine.pixels[pos.y * engine.pitch + pos.x] = uint32_t(color);
+				engine.dirty.Mark(pos.x, pos.y);
 			}
 		}
 
+		/**
+		 * access the raw pixels of the frame being drawn
+		 * @return view of the frame if constructed, an empty view otherwise
+		 */
+		static FrameBuffer GetFrameBuffer(void) {
+			GameEngine& engine = Get();
+			if (!engine.init) return FrameBuffer(NULL, 0, 0, 0, &engine.dirty);
+			return FrameBuffer(engine.pixels, engine.pitch, engine.texture_width, engine.texture_height, &engine.dirty);
+		}
+
+		/**
+		 * access the palette indices of the frame being drawn
+		 * @return view of the indices in indexed mode, an empty view otherwise
+		 */
+		static IndexedBuffer GetIndexedBuffer(void) {
+			GameEngine& engine = Get();
+			if (!engine.init || !engine.indexed) return IndexedBuffer(NULL, 0, 0, 0, &engine.dirty);
+			return IndexedBuffer(engine.indices.get_pointer(), engine.indices.get_pitch(),
+				engine.texture_width, engine.texture_height, &engine.dirty);
+		}
+
+		/**
+		 * set the color of a specific pixel, must be constructed
+		 * bounds are only checked if RICO_BOUNDS_CHECK is non-zero
+		 * @param pos position of the pixel
+		 * @param color color of the pixel
+		 */
+		static void SetPixelUnchecked(Position pos, Color color) {
+			GameEngine& engine = instance;
+			RICO_ASSERT_BOUNDS(pos.x < engine.texture_width && pos.y < engine.texture_height);
+			engine.pixels[pos.y * engine.pitch + pos.x] = uint32_t(color);
+			engine.dirty.Mark(pos.x, pos.y);
+		}
+
+		/**
+		 * get the color of a specific pixel, must be constructed
+		 * bounds are only checked if RICO_BOUNDS_CHECK is non-zero
+		 * @param pos position of the pixel
+		 * @return color of the pixel
+		 */
+		static Color GetPixelUnchecked(Position pos) {
+			GameEngine& engine = instance;
+			RICO_ASSERT_BOUNDS(pos.x < engine.texture_width && pos.y < engine.texture_height);
+			return Color(engine.pixels[pos.y * engine.pitch + pos.x]);
+		}
+
 		/**
 		 * get the color of a specific pixel if constructed
 		 * @param pos position of the pixel
@@ -503,29 +2449,29 @@ namespace rico {
 		static bool GetPixel(Position pos, Color *output) {
 			GameEngine& engine = Get();
 			if (!engine.init || output == NULL) return false;
-			*output = engine.data[pos];
+			if (pos.x >= engine.texture_width || pos.y >= engine.texture_height) {
+				throw std::out_of_range("index out of range");
+			}
+			*output = engine.pixels[pos.y * engine.pitch + pos.x];
 			return true;
 		}
 
 		/**
-		 * query mouse position
+		 * query mouse position, as of the last mouse event (no SDL call)
 		 * @param[out] output if not NULL, position of the pixel under mouse
 		 * @return true if the mouse is above the window, false otherwise
 		 */
 		static bool GetMousePos(Position *output) {
 			GameEngine& engine = Get();
-			if (!engine.init) return false;
-			int32_t window_x, window_y;
-			SDL_GetWindowPosition(engine.window, &window_x, &window_y);
-			int32_t global_x, global_y;
-			(void) SDL_GetGlobalMouseState(&global_x, &global_y);
-			int32_t x = global_x - window_x, y = global_y - window_y;
+			if (!engine.init || engine.headless) return false;
+			int32_t x = engine.mouse_x, y = engine.mouse_y;
 			if (output != NULL) {
 				output->x = x / engine.pixel_size;
 				output->y = y / engine.pixel_size;
 			}
-			return x >= 0 && static_cast<uint32_t>(x) < engine.window_width
-				&& y >= 0 && static_cast<uint32_t>(y) < engine.window_height;
+			return engine.mouse_inside
+				&& x >= 0 && static_cast<uint32_t>(x) / engine.pixel_size < engine.texture_width
+				&& y >= 0 && static_cast<uint32_t>(y) / engine.pixel_size < engine.texture_height;
 		}
 
 		/**
@@ -535,16 +2481,32 @@ namespace rico {
 		 */
 		static HardwareButton GetButton(Button button) {
 			GameEngine& engine = Get();
-			size_t index;
-			if (engine.init && button.valid(&index)) {
-				switch (button.tag) {
-					case Button::MOUSE: return engine.mouse_state[index];
-					case Button::KEYBOARD: return engine.keyboard_state[index];
-				}
-			}
+			size_t slot;
+			if (engine.init && engine.input.Slot(button, &slot)) return engine.input.Get(slot);
 			return HardwareButton();
 		}
 
+		/**
+		 * record every input event (with its timestamp) in a queue, so that
+		 * fast sequences of inputs are not lost between two frames
+		 * @param enable true to enable the queue, false by default
+		 */
+		static void SetInputQueue(bool enable) {
+			GameEngine& engine = Get();
+			engine.queue_input = enable;
+			engine.events.clear();
+		}
+
+		/**
+		 * access the input events received since the previous update, in order
+		 * with a fixed timestep, only the first step of a frame sees them, and
+		 * a frame without a step keeps them for the next one
+		 * @return events not yet reported, empty if the queue is disabled
+		 */
+		static std::vector<InputEvent> const& GetInputEvents(void) {
+			return Get().events;
+		}
+
 		/**
 		 * @param ms minimal idle duration (in milliseconds) if constructed
 		 */
@@ -567,6 +2529,8 @@ namespace rico {
 
 	}; // class GameEngine
 
+	inline GameEngine GameEngine::instance;
+
 	/**
 	 * abstract class for user to inherit from
 	 */
@@ -588,6 +2552,27 @@ namespace rico {
 		 */
 		virtual bool OnUserUpdate(double elapsed_ms) = 0;
 
+		/**
+		 * called once every frame after OnUserUpdate, always on the main thread
+		 * in pipelined mode, OnUserUpdate is not running meanwhile, so this is
+		 * where to draw from the state of the simulation
+		 */
+		virtual void OnUserRender(void) {}
+
+		/**
+		 * called at the beginning of a frame, before OnUserUpdate, when the
+		 * size of the texture changed (see GameEngine::Resize), always on the
+		 * main thread (OnUserUpdate is not running meanwhile)
+		 * the frame was cleared to black, and FrameBuffer and IndexedBuffer
+		 * views of the previous size are invalid
+		 * @param width new width of the texture (see Width)
+		 * @param height new height of the texture (see Height)
+		 */
+		virtual void OnUserResize(uint32_t width, uint32_t height) {
+			(void) width;
+			(void) height;
+		}
+
 		/**
 		 * called once after game loop
 		 * will not be called if OnUserCreate returned false
@@ -603,20 +2588,30 @@ namespace rico {
 		uint32_t Height(void) const { return GameEngine::GetHeight(); }
 		void SetPixel(Position pos, Color value) const { GameEngine::SetPixel(pos, value); }
 		bool GetPixel(Position pos, Color *output) const { return GameEngine::GetPixel(pos, output); }
+		FrameBuffer Frame(void) const { return GameEngine::GetFrameBuffer(); }
+		IndexedBuffer Indexed(void) const { return GameEngine::GetIndexedBuffer(); }
+		void SetPaletteColor(uint8_t index, Color color) const { GameEngine::SetPaletteColor(index, color); }
+		void SetPixelUnchecked(Position pos, Color value) const { GameEngine::SetPixelUnchecked(pos, value); }
+		Color GetPixelUnchecked(Position pos) const { return GameEngine::GetPixelUnchecked(pos); }
 		bool GetMousePos(Position *output) const { return GameEngine::GetMousePos(output); }
 		HardwareButton GetButton(Button button) const { return GameEngine::GetButton(button); }
+		std::vector<InputEvent> const& GetInputEvents(void) const { return GameEngine::GetInputEvents(); }
 		void WaitMs(double ms) const { GameEngine::WaitMs(ms); }
+		template<typename F>
+		void ParallelFor2D(uint32_t rows, uint32_t cols, uint32_t tile, F&& fn) const {
+			GameEngine::ParallelFor2D(rows, cols, tile, std::forward<F>(fn));
+		}
 
 		/**
 		 * clear window with the given color
 		 * @param color color used to fill
 		 */
 		void Clear(Color color) const {
-			for (uint32_t row = 0; row < Height(); ++row) {
-				for (uint32_t col = 0; col < Width(); ++col) {
-					SetPixel(Position(col, row), color);
-				}
-			}
+			FrameBuffer frame = Frame();
+			ParallelFor2D(frame.height(), frame.width(), 128,
+				[&](uint32_t row, uint32_t col, uint32_t rows, uint32_t cols) {
+					frame.Fill(Position(col, row), cols, rows, color);
+				});
 		}
 
 	}; // class Game
@@ -633,19 +2628,17 @@ namespace rico {
 
 		// purge old events
 		SDL_Event event;
-		while (SDL_PollEvent(&event) != 0) {
+		while (!engine.headless && SDL_PollEvent(&event) != 0) {
 			if (event.type == SDL_QUIT) return EXIT_SUCCESS;
 		}
 
-		// to test return values
-		bool ok;
-		int retval;
-
 		// initialization
-		TimePoint start_of_last_frame = Clock::now(), now;
-		Duration diff;
-		Game *app;
+		bool ok;
+		Game *app = NULL;
+		engine.running = true;
 		try {
+			engine.PrepareCanvas();
+			engine.BeginFrame();
 			app = new C();
 			ok = app->OnUserCreate(argc, argv);
 		} catch (std::exception const& e) {
@@ -653,12 +2646,62 @@ namespace rico {
 			ok = false;
 		}
 		if (!ok) {
+			// OnUserDestroy is only called after a successful OnUserCreate
+			delete app;
+			engine.Unlock();
+			engine.running = false;
 			return EXIT_FAILURE;
 		}
 
-		// game loop
+		// game loop, traced if RICO_TRACE is set
+		char const *trace = std::getenv("RICO_TRACE");
+		if (trace != NULL) Profiler::Get().StartTrace();
+		engine.frame_count = 0;
+		TimePoint start = Clock::now();
+		int status = engine.pipelined ? engine.RunPipelined(*app) : engine.RunSerial(*app);
+		if (trace != NULL && !Profiler::Get().StopTrace(trace)) {
+			PrintException(std::runtime_error("cannot write trace file"));
+		}
+		if (engine.headless) {
+			Duration total = Clock::now() - start;
+			std::cerr << "[HEADLESS] " << engine.frame_count << " frames in " << total.count() << " ms ("
+				<< (total.count() > 0.0 ? 1000.0 * engine.frame_count / total.count() : 0.0) << " fps)" << std::endl;
+#ifdef RICO_COUNT_ALLOCATIONS
+			std::cerr << "[HEADLESS] " << engine.frame_allocations << " heap allocations in the last frame" << std::endl;
+#endif
+		}
+
+		// finalization
+		app->OnUserDestroy();
+		delete app;
+		engine.running = false;
+
+		return status;
+	}
+
+	inline bool GameEngine::Update(Game& app, double elapsed_ms) {
+		RICO_PROFILE("update");
+		if (timestep <= 0.0) {
+			input_seen = true;
+			return app.OnUserUpdate(elapsed_ms);
+		}
+		accumulator = std::min(accumulator + elapsed_ms, timestep * max_steps);
+		while (accumulator >= timestep) {
+			// edges and queued events are reported to a single step
+			if (input_seen) ClearInput();
+			input_seen = true;
+			accumulator -= timestep;
+			if (!app.OnUserUpdate(timestep)) return false;
+		}
+		return true;
+	}
+
+	// events -> update -> render -> upload -> present -> wait
+	inline int GameEngine::RunSerial(Game& app) noexcept {
 		int status = EXIT_SUCCESS;
 		bool end = false;
+		TimePoint start_of_last_frame = Clock::now(), now;
+		Duration diff;
 		while (!end) {
 
 			// timing
@@ -667,61 +2710,34 @@ namespace rico {
 			start_of_last_frame = now;
 
 			// user inputs
-			while (SDL_PollEvent(&event) != 0) {
-				Button button = '\0';
-				size_t index;
-				switch (event.type) {
-					break; case SDL_QUIT:
-						end = true;
-					break; case SDL_KEYDOWN:
-						button = static_cast<char>(event.key.keysym.sym);
-						if (button.valid(&index)) engine.keyboard_state[index].down = true;
-					break; case SDL_KEYUP:
-						button = static_cast<char>(event.key.keysym.sym);
-						if (button.valid(&index)) engine.keyboard_state[index].down = false;
-					break; case SDL_MOUSEBUTTONDOWN:
-						if (event.button.button == SDL_BUTTON_LEFT)  button = Button::LEFT;
-						if (event.button.button == SDL_BUTTON_RIGHT) button = Button::RIGHT;
-						if (button.valid(&index)) engine.mouse_state[index].down = true;
-					break; case SDL_MOUSEBUTTONUP:
-						if (event.button.button == SDL_BUTTON_LEFT)  button = Button::LEFT;
-						if (event.button.button == SDL_BUTTON_RIGHT) button = Button::RIGHT;
-						if (button.valid(&index)) engine.mouse_state[index].down = false;
-				}
-			}
-			for (size_t i = 0; i < Button::index_count; ++i) {
-				engine.mouse_state[i].update();
-			}
-			for (size_t i = 0; i < Button::key_count; ++i) {
-				engine.keyboard_state[i].update();
-			}
+			end |= PollEvents();
 
-			// update
+			// update and draw
 			try {
-				end |= !app->OnUserUpdate(diff.count());
+				ResetArenas();
+				if (ApplyResize()) app.OnUserResize(texture_width, texture_height);
+				end |= !Update(app, FrameTime(diff));
+				RICO_PROFILE("render");
+				app.OnUserRender();
 			} catch (std::exception const& e) {
 				PrintException(e);
 				status = EXIT_FAILURE;
 				end = true;
 			}
 
-			// display
+			// display (skipped if nothing changed since the last frame)
 			try {
-				retval = SDL_UpdateTexture(
-					engine.texture, // texture to update
-					NULL, // update the entire texture
-					engine.data.get_pointer(), // raw pixel data
-					engine.texture_width * sizeof(uint32_t)); // bytes per line
-				if (retval != 0) throw std::runtime_error("SDL_UpdateTexture");
-
-				retval = SDL_RenderCopy(
-					engine.renderer, // rendering context
-					engine.texture, // source texture
-					NULL, // take the entire texture
-					NULL); // display it to the entire context
-				if (retval != 0) throw std::runtime_error("SDL_RenderCopy");
+				// before EndFrame, which unlocks the texture in DIRECT mode
+				Expand();
+				if (EndFrame()) {
+					Present();
+				} else if (!pacer.Enabled() && !headless) {
+					// nothing blocks on vsync, do not spin
+					std::this_thread::sleep_for(Duration(1.0));
+				}
+				end |= FinishFrame();
 
-				SDL_RenderPresent(engine.renderer);
+				if (!end) BeginFrame();
 
 			} catch (std::exception const& e) {
 				PrintException(e);
@@ -729,11 +2745,142 @@ namespace rico {
 				end = true;
 			}
 		}
+		return status;
+	}
 
-		// finalization
-		app->OnUserDestroy();
-		delete app;
+	// main thread: events -> render N -> swap -> upload N -> present N -> wait
+	// worker:                                 \-> copy forward -> update N+1
+	inline int GameEngine::RunPipelined(Game& app) noexcept {
+		if (submit == Submit::DIRECT) {
+			PrintException(std::logic_error("pipelined mode requires Submit::COPY"));
+			return EXIT_FAILURE;
+		}
+		if (indexed) {
+			PrintException(std::logic_error("pipelined mode is incompatible with indexed mode"));
+			return EXIT_FAILURE;
+		}
+
+		// second framebuffer, the first copy forward must copy everything
+		try {
+			shown = Tmat2D<uint32_t>(texture_height, texture_width, true);
+			shown_dirty.Reset(texture_width, texture_height);
+			shown_dirty.Clear();
+			dirty.MarkAll();
+			if (Composing()) raster::fill(shown.get_pointer(), shown.get_pitch(), texture_width, texture_height, 0);
+		} catch (std::exception const& e) {
+			PrintException(e);
+			return EXIT_FAILURE;
+		}
+
+		// shared with the worker, only accessed while it is idle
+		double elapsed_ms = 0.0;
+		bool keep_going = true;
+
+		int status = EXIT_SUCCESS;
+		bool end = false;
+		bool pending = false; // true while the worker runs
+		TimePoint start_of_last_frame = Clock::now(), now;
+		Duration diff;
+		try {
+			BackgroundTask worker([&]() {
+				// data holds the frame before shown: bring it up to date (in
+				// canvas mode, it was cleared when shown instead)
+				if (!Composing()) {
+					RICO_PROFILE("copy forward");
+					shown_dirty.ForEachRun([this](SDL_Rect const& rect) {
+						raster::copy(
+							data.get_pointer() + rect.y * data.get_pitch() + rect.x, data.get_pitch(),
+							shown.get_pointer() + rect.y * shown.get_pitch() + rect.x, shown.get_pitch(),
+							rect.w, rect.h);
+					});
+				}
+				keep_going = Update(app, elapsed_ms);
+			});
+
+			while (!end) {
+
+				// timing
+				now = Clock::now();
+				diff = now - start_of_last_frame;
+				start_of_last_frame = now;
+
+				// wait for the update of the frame in data
+				if (pending) {
+					pending = false;
+					try {
+						worker.Wait();
+						end |= !keep_going;
+					} catch (std::exception const& e) {
+						PrintException(e);
+						status = EXIT_FAILURE;
+						end = true;
+					}
+					shown_dirty.Clear();
+					if (end) break;
+				}
+
+				// user inputs, for the next update
+				end |= PollEvents();
+
+				// draw
+				try {
+					if (ApplyResize()) app.OnUserResize(texture_width, texture_height);
+					RICO_PROFILE("render");
+					app.OnUserRender();
+				} catch (std::exception const& e) {
+					PrintException(e);
+					status = EXIT_FAILURE;
+					end = true;
+				}
+				if (end) break;
+
+				// show the frame in data, draw the next one in the other buffer
+				try {
+					ResetArenas();
+				} catch (std::exception const& e) {
+					PrintException(e);
+					status = EXIT_FAILURE;
+					break;
+				}
+				data.swap(shown);
+				dirty.swap(shown_dirty);
+				std::swap(fade, shown_fade);
+				pixels = data.get_pointer();
+				pitch = data.get_pitch();
+				elapsed_ms = FrameTime(diff);
+				worker.Start();
+				pending = true;
+
+				// display (skipped if nothing changed since the last frame)
+				try {
+					bool changed;
+					if (Composing()) {
+						changed = Compose(shown.get_pointer(), shown.get_pitch(), shown_dirty, shown_fade);
+						CaptureCanvas();
+					} else {
+						changed = !shown_dirty.Empty();
+						if (changed) Upload(shown.get_pointer(), shown.get_pitch(), shown_dirty);
+						CaptureFrame(shown.get_pointer(), shown.get_pitch());
+					}
+					if (changed) {
+						Present();
+					} else if (!pacer.Enabled() && !headless) {
+						std::this_thread::sleep_for(Duration(1.0));
+					}
+					end |= FinishFrame();
+				} catch (std::exception const& e) {
+					PrintException(e);
+					status = EXIT_FAILURE;
+					end = true;
+				}
+			}
+
+			if (pending) worker.Wait();
 
+		} catch (std::exception const& e) {
+			PrintException(e);
+			status = EXIT_FAILURE;
+		}
 		return status;
 	}
 
@@ -763,6 +2910,13 @@ namespace rico {
 		return start + (stop - start) * t;
 	}
 
+	// Position to the signed coordinates of the FrameBuffer shapes, far
+	// enough from any frame and small enough that the sum or difference of
+	// two of them (a center and a radius) does not overflow
+	inline int32_t signed_coordinate(uint32_t value) {
+		return static_cast<int32_t>(std::min<uint32_t>(value, 1u << 29));
+	}
+
 	struct Line : public Shape {
 
 		Position start, stop;
@@ -774,17 +2928,9 @@ namespace rico {
 		{}
 
 		void Draw(void) const override {
-			using floatPos = rico::Tvec2D<float>;
-			uint32_t dx = (start.x > stop.x) ? (start.x - stop.x) : (stop.x - start.x);
-			uint32_t dy = (start.y > stop.y) ? (start.y - stop.y) : (stop.y - start.y);
-			uint32_t n = std::max(dx, dy);
-			floatPos fstart = floatPos(start);
-			floatPos fstop = floatPos(stop);
-			for (uint32_t i = 0; i <= n; ++i) {
-				double t = ((double) i) / ((double) n);
-				floatPos pos = lerp<floatPos>(fstart, fstop, t);
-				GameEngine::SetPixel(Position(pos), outline);
-			}
+			GameEngine::GetFrameBuffer().DrawLine(
+				signed_coordinate(start.x), signed_coordinate(start.y),
+				signed_coordinate(stop.x), signed_coordinate(stop.y), outline);
 		}
 
 		void Fill(void) const override {
@@ -793,6 +2939,10 @@ namespace rico {
 
 	}; // struct Line
 
+	/**
+	 * the outline includes both corners (as DrawRect and DrawList, see
+	 * draw.hpp), Fill covers the pixels strictly inside of it
+	 */
 	struct Rectangle : public Shape {
 
 		Position top_left, bottom_right;
@@ -811,24 +2961,42 @@ namespace rico {
 		Rectangle(void) = default;
 
 		void Draw(void) const override {
-			for (uint32_t x = top_left.x; x < bottom_right.x; ++x) {
-				GameEngine::SetPixel(Position(x, top_left.y), outline);
-				GameEngine::SetPixel(Position(x, bottom_right.y), outline);
-			}
-			for (uint32_t y = top_left.y; y < bottom_right.y; ++y) {
-				GameEngine::SetPixel(Position(top_left.x, y), outline);
-				GameEngine::SetPixel(Position(bottom_right.x, y), outline);
-			}
+			GameEngine::GetFrameBuffer().DrawRect(
+				signed_coordinate(top_left.x), signed_coordinate(top_left.y),
+				signed_coordinate(bottom_right.x), signed_coordinate(bottom_right.y), outline);
 		}
 
 		void Fill(void) const override {
-			for (uint32_t x = top_left.x+1; x < bottom_right.x-1; ++x) {
-				for (uint32_t y = top_left.y+1; y < bottom_right.y-1; ++y) {
-					GameEngine::SetPixel(Position(x, y), fill);
-				}
-			}
+			// interior of the outline, clipped to the window
+			uint32_t w = bottom_right.x - top_left.x, h = bottom_right.y - top_left.y;
+			if (w < 2 || h < 2) return;
+			GameEngine::GetFrameBuffer().Fill(top_left + Position(1, 1), w - 1, h - 1, fill);
 		}
 
 	}; // struct Rectangle
 
+	struct Circle : public Shape {
+
+		Position center;
+		uint32_t radius;
+
+		Circle(Position _center, uint32_t _radius, Color outline, Color fill)
+			: Shape(outline, fill), center(_center), radius(_radius)
+		{}
+
+		Circle(void) = default;
+
+		void Draw(void) const override {
+			GameEngine::GetFrameBuffer().DrawCircle(
+				signed_coordinate(center.x), signed_coordinate(center.y), signed_coordinate(radius), outline);
+		}
+
+		void Fill(void) const override {
+			// interior of the outline, clipped to the window
+			GameEngine::GetFrameBuffer().FillCircle(
+				signed_coordinate(center.x), signed_coordinate(center.y), signed_coordinate(radius), fill, true);
+		}
+
+	}; // struct Circle
+
 } // namespace rico
\ No newline at end of file
@@ -0,0 +1,330 @@
+/** rico/scheduler.hpp
+ *
+ * ThreadPool runs loops over independent items on a fixed set of worker
+ * threads, the calling thread taking part in the work.
+ *
+ * ParallelFor(count, fn) call fn(index) for every index in [0, count).
+ * The range is first split in one contiguous chunk per thread. A thread
+ * processes its own chunk from the front and, once it is empty, steals the
+ * back half of a chunk of another thread (work stealing), so that uneven
+ * items keep every thread busy. Chunks are lock-free (begin and end are
+ * packed in a single atomic word), and a loop does not allocate memory.
+ *
+ * ParallelFor2D(rows, cols, tile, fn) split a rows x cols area in tiles
+ * and call fn(row, col, tile_rows, tile_cols) for each of them. The width
+ * of a tile is rounded up to a multiple of 16 elements: with 32 bits pixels
+ * and rows starting on a cache line (see Tmat2D padding), two threads never
+ * write to the same cache line.
+ *
+ * A loop started from inside another loop (or from a second thread while
+ * a loop runs) is run serially by the calling thread. The first exception
+ * thrown by fn is rethrown once every item was processed.
+ *
+ * BackgroundTask runs the same task on a dedicated thread each time it is
+ * started, to overlap it with the work of the calling thread.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace rico {
+
+	class ThreadPool {
+	private:
+
+		// the chunk of items owned by a thread, alone on its cache line
+		struct alignas(64) Chunk {
+			std::atomic<uint64_t> bounds; // (begin << 32) | end
+		}; // struct ThreadPool::Chunk
+
+		static uint64_t pack(uint32_t begin, uint32_t end) {
+			return (static_cast<uint64_t>(begin) << 32) | end;
+		}
+
+		uint32_t participants; // workers + calling thread
+		std::vector<std::thread> workers;
+		std::unique_ptr<Chunk[]> chunks;
+
+		// current loop
+		void (*job)(void *context, uint32_t index);
+		void *context;
+		std::atomic<bool> running;
+		std::atomic<uint32_t> done; // number of workers done with the loop
+		std::mutex error_mutex;
+		std::exception_ptr error;
+
+		// wake up workers
+		std::mutex mutex;
+		std::condition_variable wake;
+		uint64_t generation;
+		bool stop;
+
+		// index of the current thread in the loop it takes part in
+		static inline thread_local uint32_t thread_index = 0;
+
+		// take the first item of the chunk of thread self
+		bool Pop(uint32_t self, uint32_t& item) {
+			std::atomic<uint64_t>& bounds = chunks[self].bounds;
+			uint64_t current = bounds.load(std::memory_order_relaxed);
+			while (true) {
+				uint32_t begin = static_cast<uint32_t>(current >> 32);
+				uint32_t end = static_cast<uint32_t>(current);
+				if (begin >= end) return false;
+				if (bounds.compare_exchange_weak(current, pack(begin + 1, end), std::memory_order_acq_rel)) {
+					item = begin;
+					return true;
+				}
+			}
+		}
+
+		// move the back half of the chunk of another thread into the chunk of self
+		bool Steal(uint32_t self) {
+			for (uint32_t offset = 1; offset < participants; ++offset) {
+				std::atomic<uint64_t>& bounds = chunks[(self + offset) % participants].bounds;
+				uint64_t current = bounds.load(std::memory_order_relaxed);
+				while (true) {
+					uint32_t begin = static_cast<uint32_t>(current >> 32);
+					uint32_t end = static_cast<uint32_t>(current);
+					if (begin >= end) break;
+					uint32_t middle = begin + (end - begin) / 2;
+					if (bounds.compare_exchange_weak(current, pack(begin, middle), std::memory_order_acq_rel)) {
+						chunks[self].bounds.store(pack(middle, end), std::memory_order_release);
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+
+		// process items until every chunk is empty
+		void Drain(uint32_t self) {
+			thread_index = self;
+			uint32_t item;
+			while (Pop(self, item) || (Steal(self) && Pop(self, item))) {
+				try {
+					job(context, item);
+				} catch (...) {
+					std::lock_guard<std::mutex> lock(error_mutex);
+					if (!error) error = std::current_exception();
+				}
+			}
+			thread_index = 0;
+		}
+
+		void WorkerLoop(uint32_t self) {
+			uint64_t seen = 0;
+			while (true) {
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					wake.wait(lock, [&]() { return stop || generation != seen; });
+					if (stop) return;
+					seen = generation;
+				}
+				Drain(self);
+				done.fetch_add(1, std::memory_order_release);
+			}
+		}
+
+		// run job on [0, count), return false if another loop is running
+		bool Run(uint32_t count, void (*_job)(void*, uint32_t), void *_context) {
+			if (running.exchange(true, std::memory_order_acquire)) return false;
+			job = _job;
+			context = _context;
+			error = nullptr;
+			done.store(0, std::memory_order_relaxed);
+			for (uint32_t i = 0; i < participants; ++i) {
+				uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(count) * i / participants);
+				uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(count) * (i + 1) / participants);
+				chunks[i].bounds.store(pack(begin, end), std::memory_order_relaxed);
+			}
+			if (!workers.empty()) {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					++generation;
+				}
+				wake.notify_all();
+			}
+			Drain(0);
+			// workers read the job until they are done, wait for all of them
+			while (done.load(std::memory_order_acquire) != workers.size()) {
+				std::this_thread::yield();
+			}
+			std::exception_ptr retval = error;
+			running.store(false, std::memory_order_release);
+			if (retval) std::rethrow_exception(retval);
+			return true;
+		}
+
+	public:
+
+		/**
+		 * @param threads total number of threads (calling thread included),
+		 *   0 to use one per hardware thread
+		 */
+		explicit ThreadPool(uint32_t threads = 0)
+			: participants(threads),
+			job(nullptr), context(nullptr),
+			running(false), done(0),
+			generation(0), stop(false)
+		{
+			if (participants == 0) participants = std::max(1u, std::thread::hardware_concurrency());
+			chunks.reset(new Chunk[participants]);
+			for (uint32_t i = 0; i < participants; ++i) chunks[i].bounds.store(0);
+			for (uint32_t i = 1; i < participants; ++i) {
+				workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+			}
+		}
+
+		~ThreadPool(void) noexcept {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stop = true;
+			}
+			wake.notify_all();
+			for (std::thread& worker : workers) worker.join();
+		}
+
+		ThreadPool(ThreadPool const&) = delete;
+		ThreadPool& operator=(ThreadPool const&) = delete;
+
+		/**
+		 * @return number of threads taking part in a loop (calling thread included)
+		 */
+		uint32_t Size(void) const {
+			return participants;
+		}
+
+		/**
+		 * @return index in [0, Size()) of the current thread within the running
+		 *   loop, 0 for the calling thread and outside of loops
+		 */
+		static uint32_t ThreadIndex(void) {
+			return thread_index;
+		}
+
+		/**
+		 * call fn(index) for each index in [0, count), in parallel
+		 */
+		template<typename F>
+		void ParallelFor(uint32_t count, F&& fn) {
+			if (count == 0) return;
+			using Fn = typename std::remove_reference<F>::type;
+			auto trampoline = [](void *ctx, uint32_t index) { (*static_cast<Fn*>(ctx))(index); };
+			void *ctx = const_cast<void*>(static_cast<void const*>(std::addressof(fn)));
+			if (participants == 1 || count == 1 || !Run(count, trampoline, ctx)) {
+				for (uint32_t i = 0; i < count; ++i) fn(i);
+			}
+		}
+
+		/**
+		 * call fn(row, col, tile_rows, tile_cols) on each tile of a rows x cols
+		 * area, in parallel (tiles of tile x tile elements, width rounded up
+		 * to a multiple of 16, smaller on the bottom and right edges)
+		 */
+		template<typename F>
+		void ParallelFor2D(uint32_t rows, uint32_t cols, uint32_t tile, F&& fn) {
+			if (rows == 0 || cols == 0) return;
+			uint32_t tile_rows = std::max(tile, 1u);
+			uint32_t tile_cols = (std::max(tile, 1u) + 15) / 16 * 16;
+			uint32_t count_x = (cols + tile_cols - 1) / tile_cols;
+			uint32_t count_y = (rows + tile_rows - 1) / tile_rows;
+			ParallelFor(count_x * count_y, [&](uint32_t index) {
+				uint32_t row = (index / count_x) * tile_rows;
+				uint32_t col = (index % count_x) * tile_cols;
+				fn(row, col, std::min(tile_rows, rows - row), std::min(tile_cols, cols - col));
+			});
+		}
+
+	}; // class ThreadPool
+
+	/**
+	 * run a task on a dedicated thread, once per call to Start
+	 * Wait block until the task is done, and rethrow its exception if any
+	 */
+	class BackgroundTask {
+	private:
+
+		std::function<void(void)> task;
+		std::mutex mutex;
+		std::condition_variable signal;
+		bool requested, running, stop;
+		std::exception_ptr error;
+		std::thread thread; // last, started once everything else is ready
+
+		void Loop(void) {
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true) {
+				signal.wait(lock, [this]() { return stop || requested; });
+				if (stop) return;
+				requested = false;
+				lock.unlock();
+				std::exception_ptr retval;
+				try {
+					task();
+				} catch (...) {
+					retval = std::current_exception();
+				}
+				lock.lock();
+				error = retval;
+				running = false;
+				signal.notify_all();
+			}
+		}
+
+	public:
+
+		explicit BackgroundTask(std::function<void(void)> _task)
+			: task(std::move(_task)),
+			requested(false), running(false), stop(false),
+			thread(&BackgroundTask::Loop, this)
+		{}
+
+		~BackgroundTask(void) noexcept {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				signal.wait(lock, [this]() { return !running; });
+				stop = true;
+			}
+			signal.notify_all();
+			thread.join();
+		}
+
+		BackgroundTask(BackgroundTask const&) = delete;
+		BackgroundTask& operator=(BackgroundTask const&) = delete;
+
+		/**
+		 * run the task once, the previous run must have been waited for
+		 */
+		void Start(void) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				requested = running = true;
+			}
+			signal.notify_all();
+		}
+
+		/**
+		 * wait for the end of the current run (if any)
+		 */
+		void Wait(void) {
+			std::unique_lock<std::mutex> lock(mutex);
+			signal.wait(lock, [this]() { return !running; });
+			std::exception_ptr retval = error;
+			error = nullptr;
+			if (retval) std::rethrow_exception(retval);
+		}
+
+	}; // class BackgroundTask
+
+} // namespace rico
@@ -0,0 +1,722 @@
+/** rico/snapshot.hpp
+ *
+ * Snapshots save the state of a simulation to a file and restore it, to
+ * resume long runs or to reproduce a run from a given frame.
+ *
+ * A snapshot file is a header followed by named sections, each one being
+ * a 64 bytes section header (name, size, element size and shape) and the
+ * raw bytes of an array, padded to 64 bytes. Bytes are in the native order:
+ * files are meant to be read back by the same kind of machine.
+ *
+ * Snapshot maps the file in memory (mmap, read-only) and only reads the
+ * section headers: opening a snapshot neither reads nor parses the data,
+ * the pages are loaded by the system when they are first touched. View
+ * gives a Tmat2DView over a section without any copy, Read copies sections
+ * into containers (vectors, Tmat2D, BitGrid, Bodies, SparseLife, values).
+ * Sections written by SnapshotWriter::Write(name, container) are read back
+ * with Snapshot::Read(name, container), composite ones (Bodies, SparseLife)
+ * are stored as several sections named after name.
+ *
+ * A delta snapshot is written against a base snapshot: a section that is
+ * also in the base only stores its blocks of 4 KiB that differ (those past
+ * the end of the section of the base, if it grew, always do), sections new
+ * or changed everywhere are stored whole. Blocks are compared in place, so
+ * the tiles of a SparseLife keep the slots of the base in a delta, rather
+ * than their sorted order that any new tile would shift. The file name of the base is
+ * stored too, the base must stay in the same directory. Reading a section of a delta
+ * copies it from the base (opened recursively) and applies the blocks:
+ * only the whole sections are read without a copy.
+ *
+ * SnapshotSeries writes a snapshot every N frames, named PREFIX<8 digits
+ * frame number>.snap: every Kth one whole (a keyframe), the others as
+ * deltas against the previous one.
+ *
+ * SnapshotWriter writes to PATH.tmp and renames it to PATH when closed, so
+ * that an interrupted run never leaves a truncated snapshot behind.
+ */
+
+#pragma once
+
+#include "rico.hpp"
+#include "bitgrid.hpp"
+#include "nbody.hpp"
+#include "sparselife.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RICO_SNAPSHOT_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace rico {
+
+	namespace snapshot {
+
+		static constexpr char MAGIC[8] = { 'R', 'I', 'C', 'O', 'S', 'N', 'A', 'P' };
+		static constexpr uint32_t VERSION = 1;
+		static constexpr size_t ALIGNMENT = 64; // of the headers and of the data of each section
+		static constexpr size_t BLOCK = 4096; // granularity of the deltas, in bytes
+		static constexpr size_t NAME = 24; // bytes of a section name, NUL included
+
+		struct FileHeader {
+			char magic[8];
+			uint32_t version;
+			uint32_t delta; // 1 if written against a base
+			uint64_t frame;
+			char reserved[40];
+		}; // struct FileHeader
+
+		enum class Kind : uint32_t {
+			FULL, // the bytes of the section
+			DELTA // number of blocks, their indices, then their bytes
+		}; // enum class Kind
+
+		struct SectionHeader {
+			char name[NAME];
+			uint64_t size; // bytes of the section
+			uint64_t stored; // bytes stored in the file, before padding
+			Kind kind;
+			uint32_t element; // bytes of an element
+			uint32_t rows, cols; // of a matrix, 0 otherwise
+			uint64_t pitch; // elements per row of a matrix
+		}; // struct SectionHeader
+
+		static_assert(sizeof(FileHeader) == ALIGNMENT, "the data must stay aligned");
+		static_assert(sizeof(SectionHeader) == ALIGNMENT, "the data must stay aligned");
+
+		inline size_t padded(size_t bytes) {
+			return (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+		}
+
+		inline std::string basename(std::string const& path) {
+			size_t slash = path.find_last_of('/');
+			return (slash == std::string::npos) ? path : path.substr(slash + 1);
+		}
+
+		inline std::string directory(std::string const& path) {
+			size_t slash = path.find_last_of('/');
+			return (slash == std::string::npos) ? std::string() : path.substr(0, slash + 1);
+		}
+
+		/**
+		 * read-only mapping of a whole file (a copy in memory where mmap is
+		 * not available)
+		 */
+		class Mapping {
+		private:
+
+			unsigned char const *data;
+			size_t length;
+#ifndef RICO_SNAPSHOT_MMAP
+			std::vector<unsigned char> buffer;
+#endif
+
+		public:
+
+			explicit Mapping(std::string const& path)
+				: data(NULL), length(0)
+			{
+#ifdef RICO_SNAPSHOT_MMAP
+				int fd = open(path.c_str(), O_RDONLY);
+				if (fd < 0) throw std::runtime_error("cannot open " + path);
+				struct stat info;
+				if (fstat(fd, &info) != 0) {
+					close(fd);
+					throw std::runtime_error("cannot open " + path);
+				}
+				length = static_cast<size_t>(info.st_size);
+				if (length > 0) {
+					void *address = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+					if (address == MAP_FAILED) {
+						close(fd);
+						throw std::runtime_error("cannot map " + path);
+					}
+					data = static_cast<unsigned char const*>(address);
+				}
+				// the mapping stays valid without the descriptor
+				close(fd);
+#else
+				std::ifstream file(path, std::ios::binary | std::ios::ate);
+				if (!file) throw std::runtime_error("cannot open " + path);
+				buffer.resize(static_cast<size_t>(file.tellg()));
+				file.seekg(0);
+				file.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+				if (!file) throw std::runtime_error("cannot read " + path);
+				data = buffer.data();
+				length = buffer.size();
+#endif
+			}
+
+			~Mapping(void) noexcept {
+#ifdef RICO_SNAPSHOT_MMAP
+				if (data != NULL) munmap(const_cast<unsigned char*>(data), length);
+#endif
+			}
+
+			Mapping(Mapping const&) = delete;
+			Mapping& operator=(Mapping const&) = delete;
+
+			unsigned char const* get_data(void) const { return data; }
+			size_t get_length(void) const { return length; }
+
+		}; // class Mapping
+
+	} // namespace snapshot
+
+	/**
+	 * snapshot file, mapped in memory, see the top of this file
+	 */
+	class Snapshot {
+	private:
+
+		struct Section {
+			snapshot::SectionHeader const *header;
+			unsigned char const *payload; // stored bytes
+		}; // struct Snapshot::Section
+
+		std::string path;
+		snapshot::Mapping mapping;
+		uint64_t frame;
+		bool delta;
+		std::map<std::string, Section> sections;
+		std::unique_ptr<Snapshot> base; // of a delta
+		mutable std::map<std::string, std::vector<unsigned char>> patched; // sections of a delta, once read
+
+		[[noreturn]] void Corrupt(void) const {
+			throw std::runtime_error("corrupt snapshot " + path);
+		}
+
+		Section const& Get(std::string const& name) const {
+			auto found = sections.find(name);
+			if (found == sections.end()) throw std::runtime_error("no section " + name + " in " + path);
+			return found->second;
+		}
+
+		template<typename T>
+		T const* Array(std::string const& name, size_t *count) const {
+			static_assert(std::is_trivially_copyable<T>::value, "sections hold trivially copyable elements");
+			if (Get(name).header->element != sizeof(T)) throw std::runtime_error("section " + name + " holds elements of another size");
+			size_t bytes;
+			void const *data = Data(name, &bytes);
+			*count = bytes / sizeof(T);
+			return static_cast<T const*>(data);
+		}
+
+	public:
+
+		/**
+		 * map the file and read its section headers, and open its base if it
+		 * is a delta
+		 * @param _base the base of the delta, if already open (it is opened
+		 *   again if it is not the one named by the delta)
+		 */
+		explicit Snapshot(std::string const& _path, std::unique_ptr<Snapshot> _base = std::unique_ptr<Snapshot>())
+			: path(_path), mapping(_path), frame(0), delta(false)
+		{
+			unsigned char const *data = mapping.get_data();
+			size_t const length = mapping.get_length();
+			if (length < sizeof(snapshot::FileHeader)) Corrupt();
+			snapshot::FileHeader header;
+			std::memcpy(&header, data, sizeof(header));
+			if (std::memcmp(header.magic, snapshot::MAGIC, sizeof(header.magic)) != 0) Corrupt();
+			if (header.version != snapshot::VERSION) throw std::runtime_error("unsupported snapshot version in " + path);
+			frame = header.frame;
+			delta = (header.delta != 0);
+			size_t offset = sizeof(header);
+			while (offset < length) {
+				if (length - offset < sizeof(snapshot::SectionHeader)) Corrupt();
+				Section section;
+				section.header = reinterpret_cast<snapshot::SectionHeader const*>(data + offset);
+				offset += sizeof(snapshot::SectionHeader);
+				if (section.header->stored > length - offset) Corrupt();
+				section.payload = data + offset;
+				offset += std::min(snapshot::padded(section.header->stored), length - offset);
+				if (section.header->kind != snapshot::Kind::FULL && section.header->kind != snapshot::Kind::DELTA) Corrupt();
+				if (section.header->kind == snapshot::Kind::FULL && section.header->stored != section.header->size) Corrupt();
+				if (section.header->element == 0 || section.header->name[snapshot::NAME - 1] != '\0') Corrupt();
+				sections[section.header->name] = section;
+			}
+			if (delta) {
+				size_t bytes;
+				char const *data = Array<char>(".base", &bytes);
+				std::string name(data, bytes);
+				if (_base && snapshot::basename(_base->path) == name) {
+					base = std::move(_base);
+				} else {
+					base.reset(new Snapshot(snapshot::directory(path) + name));
+				}
+			}
+		}
+
+		Snapshot(Snapshot const&) = delete;
+		Snapshot& operator=(Snapshot const&) = delete;
+
+		std::string const& get_path(void) const { return path; }
+		uint64_t get_frame(void) const { return frame; }
+		bool is_delta(void) const { return delta; }
+
+		bool Has(std::string const& name) const {
+			return sections.count(name) != 0;
+		}
+
+		/**
+		 * read every section of a delta, then close its base: the snapshot
+		 * no longer depends on other files (nor holds their copies)
+		 */
+		void Resolve(void) {
+			if (!base) return;
+			for (auto const& entry : sections) {
+				size_t bytes;
+				Data(entry.first, &bytes);
+			}
+			base.reset();
+		}
+
+		/**
+		 * @param bytes output, size of the section
+		 * @return bytes of the section, valid as long as the snapshot
+		 */
+		void const* Data(std::string const& name, size_t *bytes) const {
+			Section const& section = Get(name);
+			snapshot::SectionHeader const& header = *section.header;
+			*bytes = header.size;
+			if (header.kind == snapshot::Kind::FULL) return section.payload;
+			auto found = patched.find(name);
+			if (found != patched.end()) return found->second.data();
+			// the section of the base, then the blocks that changed
+			if (!base) Corrupt();
+			size_t base_bytes;
+			unsigned char const *source = static_cast<unsigned char const*>(base->Data(name, &base_bytes));
+			uint64_t count;
+			if (header.stored < sizeof(count)) Corrupt();
+			std::memcpy(&count, section.payload, sizeof(count));
+			size_t const blocks = (header.size + snapshot::BLOCK - 1) / snapshot::BLOCK;
+			if (count > blocks) Corrupt();
+			// the indices fit in the stored bytes (count is small enough not to overflow)
+			if (count > (header.stored - sizeof(count)) / sizeof(uint64_t)) Corrupt();
+			// the section may have grown or shrunk since the base
+			std::vector<unsigned char> copy(header.size, 0);
+			if (!copy.empty()) std::memcpy(copy.data(), source, std::min<size_t>(base_bytes, header.size));
+			unsigned char const *indices = section.payload + sizeof(count);
+			unsigned char const *stored = indices + count * sizeof(uint64_t);
+			unsigned char const *end = section.payload + header.stored;
+			for (uint64_t i = 0; i < count; ++i) {
+				uint64_t index;
+				std::memcpy(&index, indices + i * sizeof(index), sizeof(index));
+				if (index >= blocks) Corrupt();
+				size_t offset = index * snapshot::BLOCK, size = std::min(snapshot::BLOCK, header.size - offset);
+				if (size > static_cast<size_t>(end - stored)) Corrupt();
+				std::memcpy(copy.data() + offset, stored, size);
+				stored += size;
+			}
+			return (patched[name] = std::move(copy)).data();
+		}
+
+		/**
+		 * @return view of a matrix section (written from a Tmat2D), without copy
+		 */
+		template<typename T>
+		Tmat2DView<T const> View(std::string const& name) const {
+			snapshot::SectionHeader const& header = *Get(name).header;
+			size_t count;
+			T const *data = Array<T>(name, &count);
+			if (header.rows != 0 && (header.pitch < header.cols || count < (header.rows - 1) * header.pitch + header.cols)) Corrupt();
+			return Tmat2DView<T const>(data, header.rows, header.cols, header.pitch);
+		}
+
+		template<typename T>
+		void ReadValue(std::string const& name, T& value) const {
+			size_t count;
+			T const *data = Array<T>(name, &count);
+			if (count != 1) throw std::runtime_error("section " + name + " is not a single value");
+			std::memcpy(&value, data, sizeof(T));
+		}
+
+		template<typename T>
+		void Read(std::string const& name, std::vector<T>& output) const {
+			size_t count;
+			T const *data = Array<T>(name, &count);
+			output.resize(count);
+			if (count != 0) std::memcpy(output.data(), data, count * sizeof(T));
+		}
+
+		/**
+		 * the padding of the rows of output is kept
+		 */
+		template<typename T, size_t Alignment>
+		void Read(std::string const& name, Tmat2D<T, Alignment>& output) const {
+			Tmat2DView<T const> view = View<T>(name);
+			bool padded = output.get_pitch() != output.get_cols();
+			output.reshape(view.get_rows(), view.get_cols(), padded);
+			for (uint32_t row = 0; row < view.get_rows(); ++row) {
+				std::memcpy(output.get_pointer() + row * output.get_pitch(), view.get_pointer() + row * view.get_pitch(), view.get_cols() * sizeof(T));
+			}
+		}
+
+		void Read(std::string const& name, BitGrid& output) const {
+			snapshot::SectionHeader const& header = *Get(name).header;
+			size_t count;
+			uint64_t const *data = Array<uint64_t>(name, &count);
+			BitGrid grid(header.rows, header.cols);
+			if (header.pitch != grid.get_words() || count != size_t(grid.get_rows()) * grid.get_words()) Corrupt();
+			if (count != 0) std::memcpy(grid.row(0), data, count * sizeof(uint64_t));
+			output.swap(grid);
+		}
+
+		template<typename T>
+		void Read(std::string const& name, Bodies<T>& output) const {
+			Read(name + ".x", output.position.x);
+			Read(name + ".y", output.position.y);
+			Read(name + ".vx", output.speed.x);
+			Read(name + ".vy", output.speed.y);
+			Read(name + ".mass", output.mass);
+			Read(name + ".fx", output.force.x);
+			Read(name + ".fy", output.force.y);
+			uint32_t const n = output.size();
+			for (Tvec2DArray<T> const *array : { &output.position, &output.speed, &output.force }) {
+				if (array->x.size() != n || array->y.size() != n) Corrupt();
+			}
+		}
+
+		/**
+		 * the HashLife nodes of output are lost, every tile is active
+		 */
+		void Read(std::string const& name, SparseLife& output) const {
+			LifeRule rule = CONWAY;
+			uint64_t generation;
+			ReadValue(name + ".rule", rule);
+			ReadValue(name + ".gen", generation);
+			size_t tiles, words;
+			int32_t const *positions = Array<int32_t>(name + ".tiles", &tiles);
+			uint64_t const *rows = Array<uint64_t>(name + ".rows", &words);
+			if (tiles % 2 != 0 || words != tiles / 2 * SparseLife::TILE) Corrupt();
+			output = SparseLife(rule);
+			for (size_t i = 0; i < tiles / 2; ++i) {
+				output.set_tile(positions[2 * i], positions[2 * i + 1], rows + i * SparseLife::TILE);
+			}
+			output.set_generation(generation);
+		}
+
+	}; // class Snapshot
+
+	/**
+	 * write a snapshot file, see the top of this file
+	 */
+	class SnapshotWriter {
+	private:
+
+		std::string path;
+		std::string temporary;
+		std::ofstream file;
+		Snapshot const *base; // NULL for a full snapshot
+		std::set<std::string> names;
+		std::vector<uint64_t> blocks; // of a delta section
+		std::vector<unsigned char> scratch; // contiguous copies of padded sections
+		size_t offset; // bytes written
+		bool closed;
+
+		void Put(void const *data, size_t bytes) {
+			file.write(static_cast<char const*>(data), static_cast<std::streamsize>(bytes));
+			offset += bytes;
+		}
+
+		void Pad(void) {
+			static constexpr char zeros[snapshot::ALIGNMENT] = {};
+			Put(zeros, snapshot::padded(offset) - offset);
+		}
+
+		// a delta against, if not NULL, whole otherwise
+		void WriteSection(std::string const& name, void const *data, size_t bytes,
+			uint32_t element, uint32_t rows, uint32_t cols, uint64_t pitch, Snapshot const *against)
+		{
+			if (closed) throw std::logic_error("snapshot already closed");
+			if (name.empty() || name.size() >= snapshot::NAME) throw std::invalid_argument("invalid section name " + name);
+			if (!names.insert(name).second) throw std::invalid_argument("duplicate section " + name);
+			if (element == 0 || bytes % element != 0) throw std::invalid_argument("invalid element size");
+			snapshot::SectionHeader header = {};
+			std::memcpy(header.name, name.data(), name.size());
+			header.size = bytes;
+			header.element = element;
+			header.rows = rows;
+			header.cols = cols;
+			header.pitch = pitch;
+			unsigned char const *source = static_cast<unsigned char const*>(data);
+			unsigned char const *previous = NULL;
+			size_t previous_bytes = 0;
+			if (against != NULL && against->Has(name)) previous = static_cast<unsigned char const*>(against->Data(name, &previous_bytes));
+			blocks.clear();
+			size_t stored = 0;
+			if (previous != NULL) {
+				// blocks past the end of the previous section always changed
+				for (size_t start = 0; start < bytes; start += snapshot::BLOCK) {
+					size_t size = std::min(snapshot::BLOCK, bytes - start);
+					if (start + size <= previous_bytes && std::memcmp(source + start, previous + start, size) == 0) continue;
+					blocks.push_back(start / snapshot::BLOCK);
+					stored += size;
+				}
+			}
+			if (previous != NULL && stored < bytes) {
+				uint64_t count = blocks.size();
+				header.kind = snapshot::Kind::DELTA;
+				header.stored = sizeof(count) + count * sizeof(uint64_t) + stored;
+				Put(&header, sizeof(header));
+				Put(&count, sizeof(count));
+				Put(blocks.data(), count * sizeof(uint64_t));
+				for (uint64_t block : blocks) {
+					size_t start = block * snapshot::BLOCK;
+					Put(source + start, std::min(snapshot::BLOCK, bytes - start));
+				}
+			} else {
+				header.kind = snapshot::Kind::FULL;
+				header.stored = bytes;
+				Put(&header, sizeof(header));
+				Put(source, bytes);
+			}
+			Pad();
+		}
+
+	public:
+
+		/**
+		 * @param frame number saved in the header (see Snapshot::get_frame)
+		 * @param _base snapshot to write a delta against, NULL for a full one
+		 *   (in the same directory, and kept open until Close)
+		 */
+		explicit SnapshotWriter(std::string const& _path, uint64_t frame = 0, Snapshot const *_base = NULL)
+			: path(_path), temporary(_path + ".tmp"), file(temporary, std::ios::binary | std::ios::trunc),
+			base(_base), offset(0), closed(false)
+		{
+			if (!file) throw std::runtime_error("cannot write " + temporary);
+			snapshot::FileHeader header = {};
+			std::memcpy(header.magic, snapshot::MAGIC, sizeof(header.magic));
+			header.version = snapshot::VERSION;
+			header.delta = (base != NULL) ? 1 : 0;
+			header.frame = frame;
+			Put(&header, sizeof(header));
+			if (base != NULL) {
+				// whole, the base of the base may have a name of the same size
+				std::string name = snapshot::basename(base->get_path());
+				WriteSection(".base", name.data(), name.size(), 1, 0, 0, 0, NULL);
+			}
+		}
+
+		// an unclosed snapshot is discarded
+		~SnapshotWriter(void) noexcept {
+			if (closed) return;
+			file.close();
+			std::remove(temporary.c_str());
+		}
+
+		SnapshotWriter(SnapshotWriter const&) = delete;
+		SnapshotWriter& operator=(SnapshotWriter const&) = delete;
+
+		/**
+		 * write a section (names starting with '.' are reserved)
+		 * @param data, bytes contents of the section
+		 * @param element bytes of an element
+		 * @param rows, cols, pitch shape of a matrix, 0 otherwise
+		 */
+		void Write(std::string const& name, void const *data, size_t bytes,
+			uint32_t element = 1, uint32_t rows = 0, uint32_t cols = 0, uint64_t pitch = 0)
+		{
+			WriteSection(name, data, bytes, element, rows, cols, pitch, base);
+		}
+
+		template<typename T>
+		void WriteValue(std::string const& name, T const& value) {
+			static_assert(std::is_trivially_copyable<T>::value, "sections hold trivially copyable elements");
+			Write(name, &value, sizeof(T), sizeof(T));
+		}
+
+		template<typename T>
+		void Write(std::string const& name, std::vector<T> const& input) {
+			static_assert(std::is_trivially_copyable<T>::value, "sections hold trivially copyable elements");
+			Write(name, input.data(), input.size() * sizeof(T), sizeof(T));
+		}
+
+		/**
+		 * the rows are written without their padding
+		 */
+		template<typename T, size_t Alignment>
+		void Write(std::string const& name, Tmat2D<T, Alignment> const& input) {
+			static_assert(std::is_trivially_copyable<T>::value, "sections hold trivially copyable elements");
+			uint32_t const rows = input.get_rows(), cols = input.get_cols();
+			size_t const bytes = size_t(rows) * cols * sizeof(T);
+			void const *data = input.get_pointer();
+			if (input.get_pitch() != cols) {
+				scratch.resize(bytes);
+				for (uint32_t row = 0; row < rows; ++row) {
+					std::memcpy(scratch.data() + row * cols * sizeof(T), input.get_pointer() + row * input.get_pitch(), cols * sizeof(T));
+				}
+				data = scratch.data();
+			}
+			Write(name, data, bytes, sizeof(T), rows, cols, cols);
+		}
+
+		void Write(std::string const& name, BitGrid const& input) {
+			uint32_t const rows = input.get_rows();
+			size_t const words = size_t(rows) * input.get_words();
+			Write(name, (rows != 0) ? input.row(0) : NULL, words * sizeof(uint64_t), sizeof(uint64_t),
+				rows, input.get_cols(), input.get_words());
+		}
+
+		template<typename T>
+		void Write(std::string const& name, Bodies<T> const& input) {
+			Write(name + ".x", input.position.x);
+			Write(name + ".y", input.position.y);
+			Write(name + ".vx", input.speed.x);
+			Write(name + ".vy", input.speed.y);
+			Write(name + ".mass", input.mass);
+			Write(name + ".fx", input.force.x);
+			Write(name + ".fy", input.force.y);
+		}
+
+		/**
+		 * tiles are sorted by position, but a delta keeps the order of its
+		 * base: the tiles of the base stay in their slot (empty if they died),
+		 * new ones are appended, so that only the blocks of the tiles that
+		 * changed are stored (the next whole snapshot drops the empty slots)
+		 */
+		void Write(std::string const& name, SparseLife const& input) {
+			struct Tile {
+				int32_t tx, ty;
+				uint64_t const *rows;
+				bool operator<(Tile const& other) const {
+					return (ty != other.ty) ? ty < other.ty : tx < other.tx;
+				}
+			}; // struct Tile
+			std::vector<Tile> tiles;
+			input.for_each_tile([&tiles](int32_t tx, int32_t ty, uint64_t const *rows) {
+				tiles.push_back(Tile { tx, ty, rows });
+			});
+			std::sort(tiles.begin(), tiles.end());
+			std::vector<int32_t> positions;
+			std::vector<uint64_t> rows;
+			positions.reserve(2 * tiles.size());
+			rows.reserve(tiles.size() * SparseLife::TILE);
+			auto put = [&positions, &rows](int32_t tx, int32_t ty, uint64_t const *cells) {
+				positions.push_back(tx);
+				positions.push_back(ty);
+				if (cells != NULL) {
+					rows.insert(rows.end(), cells, cells + SparseLife::TILE);
+				} else {
+					rows.resize(rows.size() + SparseLife::TILE, 0);
+				}
+			};
+			std::vector<bool> placed(tiles.size(), false);
+			if (base != NULL && base->Has(name + ".tiles")) {
+				std::vector<int32_t> slots;
+				base->Read(name + ".tiles", slots);
+				for (size_t i = 0; i + 1 < slots.size(); i += 2) {
+					Tile const key = { slots[i], slots[i + 1], NULL };
+					auto found = std::lower_bound(tiles.begin(), tiles.end(), key);
+					bool const alive = (found != tiles.end() && !(key < *found));
+					if (alive) placed[found - tiles.begin()] = true;
+					put(key.tx, key.ty, alive ? found->rows : NULL);
+				}
+			}
+			for (size_t i = 0; i < tiles.size(); ++i) {
+				if (!placed[i]) put(tiles[i].tx, tiles[i].ty, tiles[i].rows);
+			}
+			WriteValue(name + ".rule", input.get_rule());
+			WriteValue(name + ".gen", input.get_generation());
+			Write(name + ".tiles", positions);
+			Write(name + ".rows", rows);
+		}
+
+		/**
+		 * finish the file and move it to its path
+		 */
+		void Close(void) {
+			if (closed) return;
+			file.close();
+			if (!file || std::rename(temporary.c_str(), path.c_str()) != 0) {
+				std::remove(temporary.c_str());
+				closed = true;
+				throw std::runtime_error("cannot write " + path);
+			}
+			closed = true;
+		}
+
+	}; // class SnapshotWriter
+
+	/**
+	 * a snapshot every interval frames, see the top of this file
+	 */
+	class SnapshotSeries {
+	private:
+
+		std::string prefix;
+		uint32_t interval;
+		uint32_t keyframes;
+		uint32_t written; // snapshots since the creation
+		std::string current; // path of the snapshot started
+		std::unique_ptr<Snapshot> previous; // base of the next delta, resolved
+		std::unique_ptr<SnapshotWriter> writer;
+
+	public:
+
+		/**
+		 * @param _interval frames between two snapshots, 0 for none
+		 * @param _keyframes a whole snapshot every _keyframes ones, 1 for no delta
+		 */
+		SnapshotSeries(std::string const& _prefix, uint32_t _interval, uint32_t _keyframes = 16)
+			: prefix(_prefix), interval(_interval), keyframes(std::max(_keyframes, 1u)), written(0)
+		{}
+
+		/**
+		 * @return path of the snapshot of a frame
+		 */
+		static std::string Path(std::string const& prefix, uint64_t frame) {
+			char number[24];
+			std::snprintf(number, sizeof(number), "%08llu.snap", static_cast<unsigned long long>(frame));
+			return prefix + number;
+		}
+
+		/**
+		 * @return true if a snapshot of the frame is due
+		 */
+		bool Due(uint64_t frame) const {
+			return interval != 0 && frame % interval == 0;
+		}
+
+		/**
+		 * start the snapshot of a frame, to be written then given to End
+		 */
+		SnapshotWriter& Begin(uint64_t frame) {
+			if (written % keyframes == 0) previous.reset();
+			current = Path(prefix, frame);
+			writer.reset(new SnapshotWriter(current, frame, previous.get()));
+			return *writer;
+		}
+
+		/**
+		 * close the snapshot started by Begin, it becomes the base of the next delta
+		 */
+		void End(void) {
+			if (!writer) throw std::logic_error("no snapshot started");
+			writer->Close();
+			writer.reset();
+			// the contents just written, to compare the next snapshot with
+			previous.reset(new Snapshot(current, std::move(previous)));
+			previous->Resolve();
+			++written;
+		}
+
+	}; // class SnapshotSeries
+
+} // namespace rico
@@ -0,0 +1,687 @@
+/** rico/sparselife.hpp
+ *
+ * SparseLife is a Life-like cellular automaton on an unbounded board (cell
+ * coordinates are signed 32 bits integers), meant for boards far larger
+ * than the window.
+ *
+ * The board is stored as tiles of 64 x 64 cells, one 64 bits word per row,
+ * kept in a hash table: regions without any alive cell hold no tile. Only
+ * the active tiles are computed at each generation, a tile being active if
+ * it or one of its 8 neighbors changed at the previous generation (or was
+ * set by the user). Stable regions cost nothing, and tiles that become
+ * empty are dropped. Active tiles are computed in parallel, with the same
+ * bit-parallel adders as life_step (see bitgrid.hpp).
+ *
+ * Draw copies a viewport of the board into a FrameBuffer or IndexedBuffer,
+ * either entirely or only the tiles that changed since the previous Draw,
+ * so that only those are marked dirty and uploaded.
+ *
+ * Jump advances the board by 2^k generations at once with HashLife: the
+ * board is turned into a quadtree whose nodes are hash-consed (identical
+ * regions share a node) and memoize their future, so that repetitive
+ * patterns are computed once for all their occurrences. The nodes are kept
+ * from one Jump to the next (up to a limit), see HashLife.
+ */
+
+#pragma once
+
+#include "rico.hpp"
+#include "bitgrid.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace rico {
+
+	/**
+	 * hash-consed quadtree of a Life-like automaton (Gosper's HashLife)
+	 * a node of level L is a square of 2^L x 2^L cells, level 0 nodes are
+	 * single cells, the others are made of 4 children of level L - 1
+	 * nodes are never released individually, see Clear
+	 */
+	class HashLife {
+	public:
+
+		struct Node {
+			Node const *nw, *ne, *sw, *se; // NULL for cells
+			uint64_t population; // alive cells
+			uint32_t level;
+			// memoized Successor, valid if jump == step
+			mutable Node const *result;
+			mutable uint32_t step;
+		}; // struct HashLife::Node
+
+	private:
+
+		struct Key {
+			Node const *nw, *ne, *sw, *se;
+			bool operator==(Key const& rhs) const {
+				return nw == rhs.nw && ne == rhs.ne && sw == rhs.sw && se == rhs.se;
+			}
+		}; // struct HashLife::Key
+
+		struct KeyHash {
+			size_t operator()(Key const& key) const {
+				uint64_t h = reinterpret_cast<uintptr_t>(key.nw);
+				h = h * 0x9e3779b97f4a7c15ull + reinterpret_cast<uintptr_t>(key.ne);
+				h = h * 0x9e3779b97f4a7c15ull + reinterpret_cast<uintptr_t>(key.sw);
+				h = h * 0x9e3779b97f4a7c15ull + reinterpret_cast<uintptr_t>(key.se);
+				return static_cast<size_t>(h ^ (h >> 29));
+			}
+		}; // struct HashLife::KeyHash
+
+		static constexpr uint32_t NONE = UINT32_MAX; // step of a node without result
+
+		LifeRule rule;
+		std::deque<Node> nodes; // stable addresses
+		std::unordered_map<Key, Node const*, KeyHash> table;
+		Node const *cells[2]; // dead and alive cells
+		std::vector<Node const*> empty; // empty node of each level
+
+		Node const* Make(Node const *nw, Node const *ne, Node const *sw, Node const *se, uint64_t population, uint32_t level) {
+			nodes.push_back(Node { nw, ne, sw, se, population, level, NULL, NONE });
+			return &nodes.back();
+		}
+
+		// next generation of the 2 x 2 cells at the center of a level 2 node
+		Node const* Base(Node const *node) {
+			// bit 4 * y + x is the cell (x, y)
+			uint32_t bits = 0;
+			Node const *quadrants[4] = { node->nw, node->ne, node->sw, node->se };
+			for (uint32_t q = 0; q < 4; ++q) {
+				Node const *c = quadrants[q];
+				uint32_t x = 2 * (q % 2), y = 2 * (q / 2);
+				if (c->nw->population) bits |= 1u << (4 * y + x);
+				if (c->ne->population) bits |= 1u << (4 * y + x + 1);
+				if (c->sw->population) bits |= 1u << (4 * (y + 1) + x);
+				if (c->se->population) bits |= 1u << (4 * (y + 1) + x + 1);
+			}
+			Node const *next[4];
+			for (uint32_t q = 0; q < 4; ++q) {
+				uint32_t x = 1 + q % 2, y = 1 + q / 2, count = 0;
+				for (uint32_t dy = y - 1; dy <= y + 1; ++dy) {
+					for (uint32_t dx = x - 1; dx <= x + 1; ++dx) {
+						if (dx != x || dy != y) count += (bits >> (4 * dy + dx)) & 1;
+					}
+				}
+				bool alive = (bits >> (4 * y + x)) & 1;
+				next[q] = Cell(((alive ? rule.survive : rule.birth) >> count) & 1);
+			}
+			return Join(next[0], next[1], next[2], next[3]);
+		}
+
+	public:
+
+		explicit HashLife(LifeRule _rule = CONWAY) : rule(_rule) {
+			Clear();
+		}
+
+		HashLife(HashLife const&) = delete;
+		HashLife& operator=(HashLife const&) = delete;
+
+		/**
+		 * release every node (the nodes returned so far become invalid)
+		 */
+		void Clear(void) {
+			table.clear();
+			nodes.clear();
+			empty.clear();
+			cells[0] = Make(NULL, NULL, NULL, NULL, 0, 0);
+			cells[1] = Make(NULL, NULL, NULL, NULL, 1, 0);
+			empty.push_back(cells[0]);
+		}
+
+		/**
+		 * @return number of nodes alive
+		 */
+		size_t Size(void) const {
+			return nodes.size();
+		}
+
+		Node const* Cell(bool alive) const {
+			return cells[alive ? 1 : 0];
+		}
+
+		/**
+		 * @return the node of children nw, ne, sw, se (of the same level)
+		 */
+		Node const* Join(Node const *nw, Node const *ne, Node const *sw, Node const *se) {
+			Key key = { nw, ne, sw, se };
+			auto found = table.find(key);
+			if (found != table.end()) return found->second;
+			Node const *node = Make(nw, ne, sw, se,
+				nw->population + ne->population + sw->population + se->population, nw->level + 1);
+			table.emplace(key, node);
+			return node;
+		}
+
+		/**
+		 * @return the node of level without any alive cell
+		 */
+		Node const* Empty(uint32_t level) {
+			while (empty.size() <= level) {
+				Node const *e = empty.back();
+				empty.push_back(Join(e, e, e, e));
+			}
+			return empty[level];
+		}
+
+		/**
+		 * @return the 2^(L-1) x 2^(L-1) cells at the center of node (of level
+		 *   L >= 2), 2^jump generations later, jump <= L - 2
+		 */
+		Node const* Successor(Node const *node, uint32_t jump) {
+			if (node->population == 0) return node->nw;
+			jump = std::min(jump, node->level - 2);
+			if (node->step == jump) return node->result;
+			if (node->level == 2) {
+				node->result = Base(node);
+				node->step = 0;
+				return node->result;
+			}
+
+			Node const *a = node->nw, *b = node->ne, *c = node->sw, *d = node->se;
+			// the 9 overlapping nodes of level L - 1, moved 2^jump generations
+			// (or 2^(L-3) generations if jump = L - 2)
+			uint32_t inner = std::min(jump, node->level - 3);
+			Node const *n00 = Successor(a, inner);
+			Node const *n01 = Successor(Join(a->ne, b->nw, a->se, b->sw), inner);
+			Node const *n02 = Successor(b, inner);
+			Node const *n10 = Successor(Join(a->sw, a->se, c->nw, c->ne), inner);
+			Node const *n11 = Successor(Join(a->se, b->sw, c->ne, d->nw), inner);
+			Node const *n12 = Successor(Join(b->sw, b->se, d->nw, d->ne), inner);
+			Node const *n20 = Successor(c, inner);
+			Node const *n21 = Successor(Join(c->ne, d->nw, c->se, d->sw), inner);
+			Node const *n22 = Successor(d, inner);
+
+			Node const *result;
+			if (jump < node->level - 2) {
+				// already there: keep the centers
+				result = Join(
+					Join(n00->se, n01->sw, n10->ne, n11->nw),
+					Join(n01->se, n02->sw, n11->ne, n12->nw),
+					Join(n10->se, n11->sw, n20->ne, n21->nw),
+					Join(n11->se, n12->sw, n21->ne, n22->nw));
+			} else {
+				// the other half of the generations
+				result = Join(
+					Successor(Join(n00, n01, n10, n11), inner),
+					Successor(Join(n01, n02, n11, n12), inner),
+					Successor(Join(n10, n11, n20, n21), inner),
+					Successor(Join(n11, n12, n21, n22), inner));
+			}
+			node->result = result;
+			node->step = jump;
+			return result;
+		}
+
+	}; // class HashLife
+
+	class SparseLife {
+	public:
+
+		static constexpr int32_t TILE = 64; // side of a tile, in cells
+		static constexpr uint32_t MAX_JUMP = 24; // see Jump
+		static constexpr size_t MAX_NODES = size_t(1) << 22; // HashLife nodes kept between jumps
+
+	private:
+
+		struct Tile {
+			int32_t tx, ty; // position, in tiles
+			bool active; // computed at the next generation
+			bool changed; // by the last generation
+			uint64_t now[TILE]; // bit x of row y is the cell (64 * tx + x, 64 * ty + y)
+			uint64_t next[TILE];
+		}; // struct SparseLife::Tile
+
+		struct TileHash {
+			size_t operator()(uint64_t key) const {
+				key *= 0x9e3779b97f4a7c15ull;
+				return static_cast<size_t>(key ^ (key >> 32));
+			}
+		}; // struct SparseLife::TileHash
+
+		LifeRule rule;
+		uint64_t generation;
+		std::vector<Tile> tiles; // slots, free ones are listed in unused
+		std::vector<uint32_t> unused;
+		std::unordered_map<uint64_t, uint32_t, TileHash> index; // key -> slot
+		std::vector<uint32_t> active; // slots to compute at the next generation
+		std::vector<uint32_t> current; // slots computed by the last generation
+		std::vector<uint64_t> touched; // keys of the tiles changed since the last Draw
+		bool redraw; // everything changed since the last Draw
+		std::unique_ptr<HashLife> hashlife; // created by the first Jump
+
+		static uint64_t Key(int32_t tx, int32_t ty) {
+			return (uint64_t(static_cast<uint32_t>(tx)) << 32) | static_cast<uint32_t>(ty);
+		}
+
+		// floor division by TILE, and remainder
+		static int32_t TileOf(int32_t coordinate) {
+			return coordinate >> 6;
+		}
+
+		static uint32_t CellOf(int32_t coordinate) {
+			return static_cast<uint32_t>(coordinate) & (TILE - 1);
+		}
+
+		static bool Empty(uint64_t const *rows) {
+			uint64_t any = 0;
+			for (int32_t y = 0; y < TILE; ++y) any |= rows[y];
+			return any == 0;
+		}
+
+		Tile const* Find(int32_t tx, int32_t ty) const {
+			auto found = index.find(Key(tx, ty));
+			return (found == index.end()) ? NULL : &tiles[found->second];
+		}
+
+		// @return slot of the tile, created empty if needed
+		uint32_t Create(int32_t tx, int32_t ty) {
+			uint64_t key = Key(tx, ty);
+			auto found = index.find(key);
+			if (found != index.end()) return found->second;
+			uint32_t slot;
+			if (unused.empty()) {
+				slot = static_cast<uint32_t>(tiles.size());
+				tiles.emplace_back();
+			} else {
+				slot = unused.back();
+				unused.pop_back();
+			}
+			Tile& tile = tiles[slot];
+			tile.tx = tx;
+			tile.ty = ty;
+			tile.active = tile.changed = false;
+			std::memset(tile.now, 0, sizeof(tile.now));
+			index.emplace(key, slot);
+			return slot;
+		}
+
+		void Remove(uint32_t slot) {
+			index.erase(Key(tiles[slot].tx, tiles[slot].ty));
+			unused.push_back(slot);
+		}
+
+		void Activate(uint32_t slot) {
+			if (tiles[slot].active) return;
+			tiles[slot].active = true;
+			active.push_back(slot);
+		}
+
+		// activate the tile and its 8 neighbors, creating them if needed
+		void ActivateAround(int32_t tx, int32_t ty) {
+			for (int32_t dy = -1; dy <= 1; ++dy) {
+				for (int32_t dx = -1; dx <= 1; ++dx) Activate(Create(tx + dx, ty + dy));
+			}
+		}
+
+		// activate the existing neighbors of a changed tile, and create those
+		// its border cells may give birth in
+		void Spread(uint32_t slot) {
+			int32_t const tx = tiles[slot].tx, ty = tiles[slot].ty;
+			uint64_t const *rows = tiles[slot].now;
+			uint64_t left = 0, right = 0;
+			for (int32_t y = 0; y < TILE; ++y) {
+				left |= rows[y] & 1;
+				right |= rows[y] >> 63;
+			}
+			uint64_t const top = rows[0], bottom = rows[TILE - 1];
+			bool const edge[3][3] = {
+				{ (top & 1) != 0, top != 0, (top >> 63) != 0 },
+				{ left != 0, true, right != 0 },
+				{ (bottom & 1) != 0, bottom != 0, (bottom >> 63) != 0 } };
+			for (int32_t dy = -1; dy <= 1; ++dy) {
+				for (int32_t dx = -1; dx <= 1; ++dx) {
+					auto found = index.find(Key(tx + dx, ty + dy));
+					if (found != index.end()) {
+						Activate(found->second);
+					} else if (edge[dy + 1][dx + 1]) {
+						Activate(Create(tx + dx, ty + dy));
+					}
+				}
+			}
+		}
+
+		// compute tile.next, @return true if it differs from tile.now
+		bool Compute(Tile& tile) const {
+			Tile const *around[3][3];
+			for (int32_t dy = -1; dy <= 1; ++dy) {
+				for (int32_t dx = -1; dx <= 1; ++dx) around[dy + 1][dx + 1] = Find(tile.tx + dx, tile.ty + dy);
+			}
+			// rows -1 to 64, and the cells on their left and right
+			uint64_t mid[TILE + 2], west[TILE + 2], east[TILE + 2];
+			for (int32_t y = -1; y <= TILE; ++y) {
+				int32_t band = (y < 0) ? 0 : (y < TILE) ? 1 : 2;
+				int32_t row = (y + TILE) % TILE;
+				Tile const *w = around[band][0], *m = around[band][1], *e = around[band][2];
+				uint64_t line = (m != NULL) ? m->now[row] : 0;
+				mid[y + 1] = line;
+				west[y + 1] = (line << 1) | ((w != NULL) ? w->now[row] >> 63 : 0);
+				east[y + 1] = (line >> 1) | ((e != NULL) ? (e->now[row] & 1) << 63 : 0);
+			}
+			bool const conway = (rule == CONWAY);
+			uint64_t changed = 0;
+			for (int32_t y = 0; y < TILE; ++y) {
+				uint64_t next = detail::life_word(
+					west[y], mid[y], east[y],
+					west[y + 1], mid[y + 1], east[y + 1],
+					west[y + 2], mid[y + 2], east[y + 2],
+					rule, conway);
+				tile.next[y] = next;
+				changed |= next ^ mid[y + 1];
+			}
+			return changed != 0;
+		}
+
+		void Touch(uint64_t key) {
+			if (redraw) return;
+			if (touched.size() >= index.size() + 64) {
+				// cheaper to draw everything
+				redraw = true;
+				touched.clear();
+				return;
+			}
+			touched.push_back(key);
+		}
+
+		// copy the rows of a tile (NULL if empty) inside the viewport
+		template<typename T>
+		static void DrawTile(T *pixels, size_t pitch, int32_t left, int32_t top, uint32_t width, uint32_t height,
+			int32_t tx, int32_t ty, uint64_t const *rows, T alive, T dead)
+		{
+			int64_t const x0 = int64_t(tx) * TILE - left, y0 = int64_t(ty) * TILE - top;
+			int64_t const xa = std::max<int64_t>(x0, 0), xb = std::min<int64_t>(x0 + TILE, width);
+			int64_t const ya = std::max<int64_t>(y0, 0), yb = std::min<int64_t>(y0 + TILE, height);
+			for (int64_t y = ya; y < yb; ++y) {
+				T *line = pixels + y * pitch;
+				uint64_t bits = (rows != NULL) ? rows[y - y0] : 0;
+				for (int64_t x = xa; x < xb; ++x) line[x] = ((bits >> (x - x0)) & 1) ? alive : dead;
+			}
+		}
+
+	public:
+
+		/**
+		 * @param _rule rule of the automaton, without birth on 0 neighbors
+		 *   (the empty regions of the board must stay empty)
+		 */
+		explicit SparseLife(LifeRule _rule = CONWAY)
+			: rule(_rule), generation(0), redraw(true)
+		{
+			if (rule.birth & 1) throw std::invalid_argument("rule with birth on 0 neighbors");
+		}
+
+		LifeRule get_rule(void) const { return rule; }
+		uint64_t get_generation(void) const { return generation; }
+		uint32_t get_tiles(void) const { return static_cast<uint32_t>(index.size()); }
+		uint32_t get_active(void) const { return static_cast<uint32_t>(active.size()); }
+
+		uint64_t population(void) const {
+			uint64_t count = 0;
+			for (auto const& entry : index) {
+				for (int32_t y = 0; y < TILE; ++y) count += __builtin_popcountll(tiles[entry.second].now[y]);
+			}
+			return count;
+		}
+
+		bool get(int32_t x, int32_t y) const {
+			Tile const *tile = Find(TileOf(x), TileOf(y));
+			return tile != NULL && ((tile->now[CellOf(y)] >> CellOf(x)) & 1);
+		}
+
+		void set(int32_t x, int32_t y, bool value) {
+			if (!value && Find(TileOf(x), TileOf(y)) == NULL) return;
+			uint32_t slot = Create(TileOf(x), TileOf(y));
+			uint64_t& word = tiles[slot].now[CellOf(y)];
+			uint64_t mask = uint64_t(1) << CellOf(x);
+			if (((word & mask) != 0) == value) return;
+			word ^= mask;
+			ActivateAround(TileOf(x), TileOf(y));
+			Touch(Key(TileOf(x), TileOf(y)));
+		}
+
+		// @return the new value of the cell
+		bool toggle(int32_t x, int32_t y) {
+			bool value = !get(x, y);
+			set(x, y, value);
+			return value;
+		}
+
+		/**
+		 * call fn(tx, ty, rows) for each tile holding alive cells, in no
+		 * particular order: bit x of rows[y] is the cell (TILE * tx + x, TILE * ty + y)
+		 */
+		template<typename F>
+		void for_each_tile(F&& fn) const {
+			for (auto const& entry : index) {
+				Tile const& tile = tiles[entry.second];
+				if (!Empty(tile.now)) fn(tile.tx, tile.ty, static_cast<uint64_t const*>(tile.now));
+			}
+		}
+
+		/**
+		 * set the TILE x TILE cells of tile (tx, ty), rows as in for_each_tile
+		 */
+		void set_tile(int32_t tx, int32_t ty, uint64_t const *rows) {
+			if (Empty(rows) && Find(tx, ty) == NULL) return;
+			uint32_t slot = Create(tx, ty);
+			std::memcpy(tiles[slot].now, rows, sizeof(tiles[slot].now));
+			ActivateAround(tx, ty);
+			Touch(Key(tx, ty));
+		}
+
+		void set_generation(uint64_t value) {
+			generation = value;
+		}
+
+		void clear(void) {
+			tiles.clear();
+			unused.clear();
+			index.clear();
+			active.clear();
+			current.clear();
+			touched.clear();
+			redraw = true;
+		}
+
+		/**
+		 * compute the next generation of the active tiles
+		 * @param pool thread pool computing the tiles, NULL to stay on this thread
+		 */
+		void Step(ThreadPool *pool = NULL) {
+			current.swap(active);
+			active.clear();
+			for (uint32_t slot : current) tiles[slot].active = false;
+			auto compute = [this](uint32_t i) {
+				Tile& tile = tiles[current[i]];
+				tile.changed = Compute(tile);
+			};
+			uint32_t const count = static_cast<uint32_t>(current.size());
+			if (pool != NULL && count > 1) {
+				pool->ParallelFor(count, compute);
+			} else {
+				for (uint32_t i = 0; i < count; ++i) compute(i);
+			}
+			for (uint32_t slot : current) {
+				Tile& tile = tiles[slot];
+				if (!tile.changed) continue;
+				std::memcpy(tile.now, tile.next, sizeof(tile.now));
+				Touch(Key(tile.tx, tile.ty));
+			}
+			// Spread may create tiles, which can move the others in memory
+			for (uint32_t slot : current) {
+				if (tiles[slot].changed) Spread(slot);
+			}
+			// nothing happens around an inactive empty tile
+			for (uint32_t slot : current) {
+				if (!tiles[slot].active && Empty(tiles[slot].now)) Remove(slot);
+			}
+			++generation;
+		}
+
+		/**
+		 * advance the board by 2^k generations with HashLife, k <= MAX_JUMP
+		 * so that cells stay far from the limits of 32 bits coordinates
+		 */
+		void Jump(uint32_t k) {
+			if (k > MAX_JUMP) throw std::invalid_argument("jump too large");
+			if (!hashlife) hashlife.reset(new HashLife(rule));
+			HashLife& h = *hashlife;
+			using Node = HashLife::Node;
+
+			// bounding box of the tiles
+			int64_t tx0 = INT64_MAX, ty0 = INT64_MAX, tx1 = INT64_MIN, ty1 = INT64_MIN;
+			for (auto const& entry : index) {
+				Tile const& tile = tiles[entry.second];
+				if (Empty(tile.now)) continue;
+				tx0 = std::min<int64_t>(tx0, tile.tx);
+				ty0 = std::min<int64_t>(ty0, tile.ty);
+				tx1 = std::max<int64_t>(tx1, tile.tx);
+				ty1 = std::max<int64_t>(ty1, tile.ty);
+			}
+			generation += uint64_t(1) << k;
+			if (tx0 > tx1) {
+				clear();
+				return;
+			}
+
+			// root of level L centered on a tile corner, with every cell in the
+			// middle 2^(L-2) cells and 2^k <= 2^(L-3): nothing can leave the
+			// 2^(L-1) cells of the result
+			int64_t const cx = (tx0 + tx1 + 1) / 2 * TILE, cy = (ty0 + ty1 + 1) / 2 * TILE;
+			int64_t const extent = std::max(
+				std::max(cx - tx0 * TILE, (tx1 + 1) * TILE - cx),
+				std::max(cy - ty0 * TILE, (ty1 + 1) * TILE - cy));
+			uint32_t level = std::max<uint32_t>(8, k + 3); // the result is made of whole tiles
+			while ((int64_t(1) << (level - 3)) < extent) ++level;
+
+			// a level 6 node per tile, inserted under the root
+			Node const *root = h.Empty(level);
+			int64_t const half = int64_t(1) << (level - 1);
+			for (auto const& entry : index) {
+				Tile const& tile = tiles[entry.second];
+				if (Empty(tile.now)) continue;
+				Node const *leaf = FromRows(h, tile.now, 0, 0, 6);
+				int64_t x = int64_t(tile.tx) * TILE - cx + half, y = int64_t(tile.ty) * TILE - cy + half;
+				root = Insert(h, root, level, x, y, leaf);
+			}
+			Node const *result = h.Successor(root, k);
+
+			// back to tiles, the result covers [c - 2^(L-2), c + 2^(L-2))
+			clear();
+			int64_t const quarter = int64_t(1) << (level - 2);
+			Extract(result, cx - quarter, cy - quarter);
+			std::vector<uint64_t> keys;
+			for (auto const& entry : index) keys.push_back(entry.first);
+			for (uint64_t key : keys) ActivateAround(static_cast<int32_t>(key >> 32), static_cast<int32_t>(static_cast<uint32_t>(key)));
+			if (h.Size() > MAX_NODES) h.Clear();
+		}
+
+		/**
+		 * draw the viewport of the frame size whose top-left cell is (left,
+		 * top) into frame, and mark the drawn tiles dirty
+		 * @param frame FrameBuffer or IndexedBuffer
+		 * @param alive value of the alive cells (Color or palette index)
+		 * @param dead value of the dead cells
+		 * @param all draw every tile, instead of those changed since the
+		 *   previous Draw (needed when the viewport moved)
+		 */
+		template<typename Buffer, typename V>
+		void Draw(Buffer const& frame, int32_t left, int32_t top, V alive, V dead, bool all = false) {
+			using T = typename std::remove_pointer<decltype(frame.data())>::type;
+			T const on = static_cast<T>(alive), off = static_cast<T>(dead);
+			uint32_t const width = frame.width(), height = frame.height();
+			T *pixels = frame.data();
+			size_t const pitch = frame.pitch();
+			if (all || redraw) {
+				int32_t const tx0 = TileOf(left), ty0 = TileOf(top);
+				int32_t const tx1 = TileOf(static_cast<int32_t>(left + width - 1)), ty1 = TileOf(static_cast<int32_t>(top + height - 1));
+				for (int32_t ty = ty0; ty <= ty1; ++ty) {
+					for (int32_t tx = tx0; tx <= tx1; ++tx) {
+						Tile const *tile = Find(tx, ty);
+						DrawTile(pixels, pitch, left, top, width, height, tx, ty, (tile != NULL) ? tile->now : NULL, on, off);
+					}
+				}
+				frame.MarkAll();
+			} else {
+				for (uint64_t key : touched) {
+					int32_t tx = static_cast<int32_t>(key >> 32), ty = static_cast<int32_t>(static_cast<uint32_t>(key));
+					int64_t x = int64_t(tx) * TILE - left, y = int64_t(ty) * TILE - top;
+					if (x + TILE <= 0 || y + TILE <= 0 || x >= width || y >= height) continue;
+					Tile const *tile = Find(tx, ty);
+					DrawTile(pixels, pitch, left, top, width, height, tx, ty, (tile != NULL) ? tile->now : NULL, on, off);
+					int64_t xa = std::max<int64_t>(x, 0), ya = std::max<int64_t>(y, 0);
+					frame.MarkDirty(Position(static_cast<uint32_t>(xa), static_cast<uint32_t>(ya)),
+						static_cast<uint32_t>(std::min<int64_t>(x + TILE, width) - xa),
+						static_cast<uint32_t>(std::min<int64_t>(y + TILE, height) - ya));
+				}
+			}
+			touched.clear();
+			redraw = false;
+		}
+
+	private:
+
+		// node of the size x size cells starting at (x, y) of a tile
+		static HashLife::Node const* FromRows(HashLife& h, uint64_t const *rows, uint32_t x, uint32_t y, uint32_t level) {
+			uint32_t const size = 1u << level;
+			uint64_t const mask = (size == 64) ? ~uint64_t(0) : ((uint64_t(1) << size) - 1) << x;
+			uint64_t any = 0;
+			for (uint32_t row = y; row < y + size; ++row) any |= rows[row] & mask;
+			if (any == 0) return h.Empty(level);
+			if (level == 0) return h.Cell(true);
+			uint32_t const half = size / 2;
+			return h.Join(
+				FromRows(h, rows, x, y, level - 1), FromRows(h, rows, x + half, y, level - 1),
+				FromRows(h, rows, x, y + half, level - 1), FromRows(h, rows, x + half, y + half, level - 1));
+		}
+
+		// node with the level 6 node leaf at (x, y) of node (x, y multiple of 64)
+		static HashLife::Node const* Insert(HashLife& h, HashLife::Node const *node, uint32_t level, int64_t x, int64_t y, HashLife::Node const *leaf) {
+			if (level == 6) return leaf;
+			int64_t const half = int64_t(1) << (level - 1);
+			bool const east = x >= half, south = y >= half;
+			int64_t const cx = east ? x - half : x, cy = south ? y - half : y;
+			HashLife::Node const *nw = node->nw, *ne = node->ne, *sw = node->sw, *se = node->se;
+			HashLife::Node const *& child = south ? (east ? se : sw) : (east ? ne : nw);
+			child = Insert(h, child, level - 1, cx, cy, leaf);
+			return h.Join(nw, ne, sw, se);
+		}
+
+		// write the alive cells of node, whose top-left cell is (x, y), to the tiles
+		void Extract(HashLife::Node const *node, int64_t x, int64_t y) {
+			if (node->population == 0) return;
+			if (node->level == 6) {
+				uint32_t slot = Create(static_cast<int32_t>(x >> 6), static_cast<int32_t>(y >> 6));
+				ExtractRows(node, 0, 0, tiles[slot].now);
+				return;
+			}
+			int64_t const half = int64_t(1) << (node->level - 1);
+			Extract(node->nw, x, y);
+			Extract(node->ne, x + half, y);
+			Extract(node->sw, x, y + half);
+			Extract(node->se, x + half, y + half);
+		}
+
+		static void ExtractRows(HashLife::Node const *node, uint32_t x, uint32_t y, uint64_t *rows) {
+			if (node->population == 0) return;
+			if (node->level == 0) {
+				rows[y] |= uint64_t(1) << x;
+				return;
+			}
+			uint32_t const half = 1u << (node->level - 1);
+			ExtractRows(node->nw, x, y, rows);
+			ExtractRows(node->ne, x + half, y, rows);
+			ExtractRows(node->sw, x, y + half, rows);
+			ExtractRows(node->se, x + half, y + half, rows);
+		}
+
+	}; // class SparseLife
+
+} // namespace rico
@@ -0,0 +1,381 @@
+/** rico/spatial.hpp
+ *
+ * SpatialHash sorts points into the cells of an unbounded uniform grid:
+ * the cell of a position is floor(position / cell_size), and cells are
+ * hashed into a power of 2 number of buckets (at least twice the number of
+ * points, so that few cells share a bucket). build sorts the points by
+ * bucket with a counting sort (count the points of each bucket, prefix sum
+ * of the counts, scatter), the points of a bucket end up contiguous and
+ * their positions (and cells) are copied in that order, so that queries
+ * read memory sequentially. The cells sharing a bucket have their points
+ * interleaved: queries check the cell of each point of the bucket. The arrays are reused from one build to the next: the
+ * grid is meant to be rebuilt each frame.
+ *
+ * build runs on the thread pool given (if any): the buckets are counted
+ * and filled with atomics, then each bucket is sorted by index, so that
+ * the result (and the order in which queries visit the points) does not
+ * depend on the scheduling.
+ *
+ * for_each_in_radius visits the points within a distance of a position,
+ * in the cells covered by the disk (or all of them, when there are fewer
+ * points than cells to scan), within collects their indices, and nearest
+ * finds the k nearest by scanning rings of cells around the position until
+ * no unvisited cell can hold a nearer point.
+ *
+ * Queries are const and can run in parallel once the grid is built, one
+ * per point for short-range forces (collisions, contact, ...) or for the
+ * near field of a Barnes-Hut leaf pass (see nbody.hpp). With a cell_size
+ * of the radius of the queries, a query scans at most 3 x 3 cells, and
+ * visiting the points in sorted order makes consecutive queries read the
+ * same cells.
+ */
+
+#pragma once
+
+#include "rico.hpp"
+#include "scheduler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace rico {
+
+	template<typename T>
+	class SpatialHash {
+	public:
+
+		static_assert(std::is_floating_point<T>::value, "positions are floating point");
+
+		static constexpr uint32_t CHUNK = 4096; // points or buckets per task of build
+		static constexpr int32_t LIMIT = 1 << 30; // cell coordinates are clamped to [-LIMIT, +LIMIT]
+
+		T cell_size; // side of the cells, taken into account by the next build
+
+		explicit SpatialHash(T _cell_size = 1)
+			: cell_size(_cell_size), inverse(1 / _cell_size), count(0), bits(0), capacity(0),
+			min_cx(0), min_cy(0), max_cx(-1), max_cy(-1)
+		{}
+
+		SpatialHash(SpatialHash const&) = delete;
+		SpatialHash& operator=(SpatialHash const&) = delete;
+
+		/**
+		 * @return number of points of the last build
+		 */
+		uint32_t size(void) const {
+			return count;
+		}
+
+		/**
+		 * @return indices of the points, by bucket
+		 */
+		std::vector<uint32_t> const& sorted(void) const {
+			return order;
+		}
+
+		/**
+		 * sort the points (x[i], y[i]) for i in [0, n) by bucket
+		 * @param pool thread pool to use, NULL to stay on this thread
+		 */
+		void build(T const *x, T const *y, uint32_t n, ThreadPool *pool = NULL) {
+			inverse = 1 / cell_size;
+			count = n;
+			bits = 4;
+			while ((uint64_t(1) << bits) < 2 * uint64_t(n) && bits < 31) ++bits;
+			uint32_t const buckets = 1u << bits;
+			if (buckets > capacity) {
+				fill.reset(new std::atomic<uint32_t>[buckets]);
+				capacity = buckets;
+			}
+			keys.resize(n);
+			codes.resize(n);
+			order.resize(n);
+			sx.resize(n);
+			sy.resize(n);
+			sc.resize(n);
+			start.resize(buckets + 1);
+			uint32_t const chunks = (n + CHUNK - 1) / CHUNK;
+			uint32_t const blocks = (buckets + CHUNK - 1) / CHUNK;
+			boxes.resize(chunks);
+			totals.resize(blocks);
+			// count the points of each bucket, and the cells they cover
+			run(pool, blocks, [this, buckets](uint32_t index) {
+				uint32_t end = std::min(buckets, (index + 1) * CHUNK);
+				for (uint32_t b = index * CHUNK; b < end; ++b) fill[b].store(0, std::memory_order_relaxed);
+			});
+			run(pool, chunks, [this, x, y, n](uint32_t index) {
+				Box box = { LIMIT, LIMIT, -LIMIT, -LIMIT };
+				uint32_t end = std::min(n, (index + 1) * CHUNK);
+				for (uint32_t i = index * CHUNK; i < end; ++i) {
+					int32_t cx = cell(x[i]), cy = cell(y[i]);
+					box.min_x = std::min(box.min_x, cx);
+					box.min_y = std::min(box.min_y, cy);
+					box.max_x = std::max(box.max_x, cx);
+					box.max_y = std::max(box.max_y, cy);
+					keys[i] = bucket(cx, cy);
+					codes[i] = code(cx, cy);
+					fill[keys[i]].fetch_add(1, std::memory_order_relaxed);
+				}
+				boxes[index] = box;
+			});
+			min_cx = min_cy = LIMIT;
+			max_cx = max_cy = -LIMIT;
+			for (Box const& box : boxes) {
+				min_cx = std::min(min_cx, box.min_x);
+				min_cy = std::min(min_cy, box.min_y);
+				max_cx = std::max(max_cx, box.max_x);
+				max_cy = std::max(max_cy, box.max_y);
+			}
+			// prefix sum of the counts: per block, then of the blocks
+			run(pool, blocks, [this, buckets](uint32_t index) {
+				uint32_t end = std::min(buckets, (index + 1) * CHUNK), total = 0;
+				for (uint32_t b = index * CHUNK; b < end; ++b) total += fill[b].load(std::memory_order_relaxed);
+				totals[index] = total;
+			});
+			uint32_t offset = 0;
+			for (uint32_t& total : totals) {
+				uint32_t block = total;
+				total = offset;
+				offset += block;
+			}
+			run(pool, blocks, [this, buckets](uint32_t index) {
+				uint32_t end = std::min(buckets, (index + 1) * CHUNK), offset = totals[index];
+				for (uint32_t b = index * CHUNK; b < end; ++b) {
+					start[b] = offset;
+					offset += fill[b].load(std::memory_order_relaxed);
+					// from now on, the next free slot of the bucket
+					fill[b].store(start[b], std::memory_order_relaxed);
+				}
+			});
+			start[buckets] = n;
+			// scatter the indices
+			run(pool, chunks, [this, n](uint32_t index) {
+				uint32_t end = std::min(n, (index + 1) * CHUNK);
+				for (uint32_t i = index * CHUNK; i < end; ++i) {
+					order[fill[keys[i]].fetch_add(1, std::memory_order_relaxed)] = i;
+				}
+			});
+			// the order within a bucket depends on the scheduling, sort it
+			// then copy the positions
+			run(pool, blocks, [this, x, y, buckets](uint32_t index) {
+				uint32_t end = std::min(buckets, (index + 1) * CHUNK);
+				for (uint32_t b = index * CHUNK; b < end; ++b) {
+					uint32_t *first = order.data() + start[b], *last = order.data() + start[b + 1];
+					if (last - first > 16) {
+						std::sort(first, last);
+					} else {
+						for (uint32_t *p = first + 1; p < last; ++p) {
+							uint32_t value = *p, *q = p;
+							for (; q > first && *(q - 1) > value; --q) *q = *(q - 1);
+							*q = value;
+						}
+					}
+				}
+				uint32_t last = start[end];
+				for (uint32_t k = start[index * CHUNK]; k < last; ++k) {
+					sx[k] = x[order[k]];
+					sy[k] = y[order[k]];
+					sc[k] = codes[order[k]];
+				}
+			});
+		}
+
+		/**
+		 * sort the given points by bucket
+		 * @param pool thread pool to use, NULL to stay on this thread
+		 */
+		void build(std::vector<Tvec2D<T>> const& positions, ThreadPool *pool = NULL) {
+			// copied to a structure of arrays
+			uint32_t const n = static_cast<uint32_t>(positions.size());
+			xy.resize(2 * size_t(n));
+			for (uint32_t i = 0; i < n; ++i) {
+				xy[i] = positions[i].x;
+				xy[n + i] = positions[i].y;
+			}
+			build(xy.data(), xy.data() + n, n, pool);
+		}
+
+		/**
+		 * call fn(index, square distance) for each point closer than radius
+		 * to (px, py) (or at radius), in no particular order
+		 */
+		template<typename F>
+		void for_each_in_radius(T px, T py, T radius, F&& fn) const {
+			if (count == 0 || !(radius >= 0)) return;
+			T const r2 = radius * radius;
+			auto visit = [&](uint32_t k) {
+				T dx = sx[k] - px, dy = sy[k] - py;
+				T d2 = dx * dx + dy * dy;
+				if (d2 <= r2) fn(order[k], d2);
+			};
+			int64_t x0 = std::max(cell(px - radius), min_cx), x1 = std::min(cell(px + radius), max_cx);
+			int64_t y0 = std::max(cell(py - radius), min_cy), y1 = std::min(cell(py + radius), max_cy);
+			if (x0 > x1 || y0 > y1) return;
+			if ((x1 - x0 + 1) * (y1 - y0 + 1) >= count) {
+				// more cells than points
+				for (uint32_t k = 0; k < count; ++k) visit(k);
+				return;
+			}
+			for (int64_t cy = y0; cy <= y1; ++cy) {
+				for (int64_t cx = x0; cx <= x1; ++cx) {
+					scan(static_cast<int32_t>(cx), static_cast<int32_t>(cy), visit);
+				}
+			}
+		}
+
+		template<typename F>
+		void for_each_in_radius(Tvec2D<T> position, T radius, F&& fn) const {
+			for_each_in_radius(position.x, position.y, radius, std::forward<F>(fn));
+		}
+
+		/**
+		 * collect the indices of the points closer than radius to position
+		 * (or at radius), in no particular order
+		 * @return number of points found
+		 */
+		uint32_t within(Tvec2D<T> position, T radius, std::vector<uint32_t>& output) const {
+			output.clear();
+			for_each_in_radius(position.x, position.y, radius, [&output](uint32_t index, T d2) {
+				(void) d2;
+				output.push_back(index);
+			});
+			return static_cast<uint32_t>(output.size());
+		}
+
+		/**
+		 * find the k points nearest to position (of lowest index on ties)
+		 * @param indices output, k elements, by increasing distance
+		 * @param squares output, k elements, square distance of each point found
+		 * @return number of points found, min(k, size())
+		 */
+		uint32_t nearest(Tvec2D<T> position, uint32_t k, uint32_t *indices, T *squares) const {
+			T const px = position.x, py = position.y;
+			uint32_t found = 0;
+			auto visit = [&](uint32_t slot) {
+				T dx = sx[slot] - px, dy = sy[slot] - py;
+				T d2 = dx * dx + dy * dy;
+				uint32_t index = order[slot];
+				if (found == k && !closer(d2, index, squares[k - 1], indices[k - 1])) return;
+				// insertion in the sorted output
+				uint32_t p = (found < k) ? found++ : k - 1;
+				for (; p > 0 && closer(d2, index, squares[p - 1], indices[p - 1]); --p) {
+					squares[p] = squares[p - 1];
+					indices[p] = indices[p - 1];
+				}
+				squares[p] = d2;
+				indices[p] = index;
+			};
+			if (k == 0 || count == 0) return 0;
+			int64_t const cx = cell(px), cy = cell(py);
+			// no point further than this ring
+			int64_t const rings = std::max(std::max(cx - min_cx, max_cx - cx), std::max(cy - min_cy, max_cy - cy));
+			// no cell of the points closer than this ring
+			int64_t const first = std::max(std::max(int64_t(0), std::max(min_cx - cx, cx - max_cx)), std::max(min_cy - cy, cy - max_cy));
+			uint64_t scanned = 0;
+			for (int64_t ring = first; ring <= rings; ++ring) {
+				auto row = [&](int64_t y) {
+					if (y < min_cy || y > max_cy) return;
+					for (int64_t x = std::max<int64_t>(cx - ring, min_cx); x <= std::min<int64_t>(cx + ring, max_cx); ++x) {
+						scan(static_cast<int32_t>(x), static_cast<int32_t>(y), visit);
+						++scanned;
+					}
+				};
+				auto column = [&](int64_t x) {
+					if (x < min_cx || x > max_cx) return;
+					for (int64_t y = std::max<int64_t>(cy - ring + 1, min_cy); y <= std::min<int64_t>(cy + ring - 1, max_cy); ++y) {
+						scan(static_cast<int32_t>(x), static_cast<int32_t>(y), visit);
+						++scanned;
+					}
+				};
+				row(cy - ring);
+				if (ring > 0) {
+					row(cy + ring);
+					column(cx - ring);
+					column(cx + ring);
+				}
+				// the points of the next rings are at least ring cells away
+				T reach = T(ring) / inverse;
+				if (found == k && squares[k - 1] <= reach * reach) return found;
+				if (scanned > count) {
+					// sparse points, scanning all of them is cheaper
+					found = 0;
+					for (uint32_t slot = 0; slot < count; ++slot) visit(slot);
+					return found;
+				}
+			}
+			return found;
+		}
+
+	private:
+
+		struct Box {
+			int32_t min_x, min_y, max_x, max_y;
+		}; // struct SpatialHash::Box
+
+		T inverse; // 1 / cell_size, of the last build
+		uint32_t count; // number of points
+		uint32_t bits; // log2 of the number of buckets
+		uint32_t capacity; // size of fill
+		int32_t min_cx, min_cy, max_cx, max_cy; // cells covered by the points
+		// reused from one build to the next
+		std::vector<uint32_t> keys; // bucket of each point
+		std::vector<uint64_t> codes; // cell of each point
+		std::vector<uint32_t> start; // first slot of each bucket, and the number of points
+		std::unique_ptr<std::atomic<uint32_t>[]> fill; // counts, then next free slots
+		std::vector<Box> boxes; // cells covered, per chunk of points
+		std::vector<uint32_t> totals; // points per block of buckets, then their prefix sum
+		std::vector<uint32_t> order; // index of the point, by bucket
+		std::vector<T> sx, sy; // positions, by bucket
+		std::vector<uint64_t> sc; // cells, by bucket
+		std::vector<T> xy; // positions of a Tvec2D build, x then y
+
+		template<typename F>
+		static void run(ThreadPool *pool, uint32_t count, F&& fn) {
+			if (pool != NULL) {
+				pool->ParallelFor(count, fn);
+			} else {
+				for (uint32_t index = 0; index < count; ++index) fn(index);
+			}
+		}
+
+		// d2 (index) is nearer than other_d2 (other_index)
+		static bool closer(T d2, uint32_t index, T other_d2, uint32_t other_index) {
+			return d2 < other_d2 || (d2 == other_d2 && index < other_index);
+		}
+
+		int32_t cell(T value) const {
+			// NaN goes to +LIMIT
+			T f = std::max(T(-LIMIT), std::min(T(LIMIT), value * inverse));
+			// floor, without the call of std::floor when SSE4.1 is not enabled
+			int32_t c = static_cast<int32_t>(f);
+			return c - (T(c) > f ? 1 : 0);
+		}
+
+		static uint64_t code(int32_t cx, int32_t cy) {
+			return (uint64_t(uint32_t(cx)) << 32) | uint32_t(cy);
+		}
+
+		uint32_t bucket(int32_t cx, int32_t cy) const {
+			uint64_t h = uint64_t(uint32_t(cx)) * 0x9e3779b97f4a7c15ull ^ uint64_t(uint32_t(cy)) * 0xc2b2ae3d27d4eb4full;
+			return static_cast<uint32_t>(h >> (64 - bits));
+		}
+
+		// call visit(slot) for each point of cell (cx, cy)
+		template<typename F>
+		void scan(int32_t cx, int32_t cy, F& visit) const {
+			uint32_t b = bucket(cx, cy);
+			uint64_t c = code(cx, cy);
+			for (uint32_t k = start[b], end = start[b + 1]; k < end; ++k) {
+				// other cells may share the bucket
+				if (sc[k] != c) continue;
+				visit(k);
+			}
+		}
+
+	}; // class SpatialHash
+
+} // namespace rico
@@ -0,0 +1,341 @@
+/** rico/sprite.hpp
+ *
+ * Sprite is an image (a Tmat2D of pixels) along with a run-length mask of
+ * its transparency, computed once at creation: each row is a list of runs,
+ * spans of consecutive pixels that are all opaque or all translucent, the
+ * transparent pixels between them being left out. Drawing a sprite copies
+ * the opaque runs (memcpy, short ones inline) and blends the translucent
+ * ones (raster::blend), transparent pixels cost nothing.
+ *
+ * The transparency of a pixel is its alpha (see pixel.hpp): 0 is
+ * transparent, 255 opaque, anything else translucent. Sprites can also be
+ * made from an image and a color key (pixels of that color are
+ * transparent, the others opaque), or from text (one character per pixel,
+ * looked up in a palette).
+ *
+ * Sprites are drawn at signed coordinates, clipped to the frame (or to a
+ * raster::Clip) and marked dirty. Many of them are best queued in a
+ * DrawList (see draw.hpp), which draws the tiles of the frame in parallel.
+ *
+ * TileMap is a grid of cells, each one showing a tile (a Sprite, all of
+ * the same size) or nothing. Only the cells inside of the clip are drawn,
+ * row by row of pixels: a row of the frame is written from left to right,
+ * by the runs of the tiles it crosses. The rows of cells are split on the
+ * thread pool given (if any).
+ */
+
+#pragma once
+
+#include "rico.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace rico {
+
+	class Sprite {
+	public:
+
+		static constexpr uint32_t SHORT = 8; // runs shorter than that are copied inline
+
+		/**
+		 * consecutive pixels of a row, [begin, begin + length)
+		 */
+		struct Run {
+			uint32_t begin, length;
+			bool blend; // translucent pixels, opaque if false
+		}; // struct Sprite::Run
+
+	private:
+
+		Tmat2D<uint32_t> image;
+		std::vector<Run> runs;
+		std::vector<uint32_t> first; // runs of row r are [first[r], first[r + 1])
+		uint32_t opaque; // number of pixels in the runs
+
+		void Encode(void) {
+			uint32_t const rows = image.get_rows(), cols = image.get_cols();
+			runs.clear();
+			first.assign(1, 0);
+			opaque = 0;
+			for (uint32_t r = 0; r < rows; ++r) {
+				uint32_t const *row = image.get_pointer() + r * image.get_pitch();
+				uint32_t c = 0;
+				while (c < cols) {
+					uint8_t alpha = PixelFormat::alpha(row[c]);
+					if (alpha == 0) {
+						++c;
+						continue;
+					}
+					bool blend = alpha != 255;
+					uint32_t begin = c;
+					while (c < cols && PixelFormat::alpha(row[c]) != 0 && (PixelFormat::alpha(row[c]) != 255) == blend) ++c;
+					runs.push_back(Run { begin, c - begin, blend });
+					opaque += c - begin;
+				}
+				first.push_back(static_cast<uint32_t>(runs.size()));
+			}
+		}
+
+	public:
+
+		Sprite(void)
+			: first(1, 0), opaque(0)
+		{}
+
+		/**
+		 * @param pixels image, transparent where alpha is 0
+		 */
+		explicit Sprite(Tmat2D<uint32_t> pixels)
+			: image(std::move(pixels))
+		{
+			Encode();
+		}
+
+		/**
+		 * @param pixels image, transparent where the color is key, opaque
+		 *   elsewhere (alpha is ignored, and set to 255)
+		 */
+		Sprite(Tmat2D<uint32_t> pixels, Color key)
+			: image(std::move(pixels))
+		{
+			uint32_t const mask = PixelFormat::alpha_mask;
+			uint32_t const transparent = uint32_t(key) & ~mask;
+			for (uint32_t r = 0; r < image.get_rows(); ++r) {
+				uint32_t *row = image.get_pointer() + r * image.get_pitch();
+				for (uint32_t c = 0; c < image.get_cols(); ++c) {
+					row[c] = ((row[c] & ~mask) == transparent) ? transparent : (row[c] | mask);
+				}
+			}
+			Encode();
+		}
+
+		/**
+		 * @param lines rows of the sprite, one character per pixel (shorter
+		 *   lines are transparent on the right)
+		 * @param palette color of each character, the others are transparent
+		 */
+		static Sprite FromText(std::initializer_list<char const*> lines, std::initializer_list<std::pair<char, Color>> palette) {
+			uint32_t cols = 0;
+			for (char const *line : lines) cols = std::max(cols, static_cast<uint32_t>(std::strlen(line)));
+			Tmat2D<uint32_t> pixels(static_cast<uint32_t>(lines.size()), cols);
+			uint32_t r = 0;
+			for (char const *line : lines) {
+				uint32_t *row = pixels.get_pointer() + r * pixels.get_pitch();
+				for (uint32_t c = 0; c < cols; ++c) {
+					row[c] = 0;
+					if (c >= std::strlen(line)) continue;
+					for (std::pair<char, Color> const& entry : palette) {
+						if (entry.first == line[c]) row[c] = uint32_t(entry.second);
+					}
+				}
+				++r;
+			}
+			return Sprite(std::move(pixels));
+		}
+
+		uint32_t get_width(void) const { return image.get_cols(); }
+		uint32_t get_height(void) const { return image.get_rows(); }
+		Tmat2D<uint32_t> const& get_pixels(void) const { return image; }
+
+		/**
+		 * @return number of pixels that are not transparent
+		 */
+		uint32_t get_opaque(void) const { return opaque; }
+
+		/**
+		 * @return the runs of a row, from left to right
+		 */
+		Span<Run const> row(uint32_t r) const {
+			RICO_ASSERT_BOUNDS(r < get_height());
+			return Span<Run const>(runs.data() + first[r], first[r + 1] - first[r]);
+		}
+
+		/**
+		 * call fn(row, col, length) for every run, row by row
+		 */
+		template<typename F>
+		void for_each_run(F&& fn) const {
+			for (uint32_t r = 0; r < get_height(); ++r) {
+				for (Run const& run : row(r)) fn(r, run.begin, run.length);
+			}
+		}
+
+		/**
+		 * draw the columns [begin, end) of row r, column begin going to dst[0]
+		 */
+		void DrawRow(uint32_t *dst, uint32_t r, uint32_t begin, uint32_t end) const {
+			uint32_t const *src = image.get_pointer() + r * image.get_pitch() + begin;
+			for (uint32_t k = first[r]; k < first[r + 1]; ++k) {
+				Run const& run = runs[k];
+				if (run.begin >= end) break;
+				uint32_t b = std::max(run.begin, begin), e = std::min(run.begin + run.length, end);
+				if (b >= e) continue;
+				// offsets from column begin
+				uint32_t const offset = b - begin, length = e - b;
+				if (run.blend) {
+					raster::kernels().blend(dst + offset, src + offset, length);
+				} else if (length < SHORT) {
+					for (uint32_t c = offset; c < offset + length; ++c) dst[c] = src[c];
+				} else {
+					std::memcpy(dst + offset, src + offset, length * sizeof(uint32_t));
+				}
+			}
+		}
+
+		/**
+		 * draw the sprite with its top-left pixel at (x, y), clipped to clip,
+		 * into the image of pixel (0, 0) pixels and of pitch pitch
+		 */
+		void Draw(uint32_t *pixels, size_t pitch, raster::Clip const& clip, int32_t x, int32_t y) const {
+			// clip, in coordinates of the sprite
+			int64_t c0 = std::max<int64_t>(int64_t(clip.x0) - x, 0), c1 = std::min<int64_t>(int64_t(clip.x1) - x, get_width());
+			int64_t r0 = std::max<int64_t>(int64_t(clip.y0) - y, 0), r1 = std::min<int64_t>(int64_t(clip.y1) - y, get_height());
+			if (c0 >= c1 || r0 >= r1) return;
+			for (int64_t r = r0; r < r1; ++r) {
+				// column c0 of the sprite, inside of the clip
+				uint32_t *row = pixels + static_cast<size_t>(y + r) * pitch + (x + c0);
+				DrawRow(row, static_cast<uint32_t>(r), static_cast<uint32_t>(c0), static_cast<uint32_t>(c1));
+			}
+		}
+
+		/**
+		 * draw the sprite with its top-left pixel at (x, y), clipped to the
+		 * frame, and mark its area dirty
+		 */
+		void Draw(FrameBuffer const& frame, int32_t x, int32_t y) const {
+			raster::Clip clip = { 0, 0, static_cast<int32_t>(frame.width()), static_cast<int32_t>(frame.height()) };
+			int64_t x0 = std::max<int64_t>(x, 0), x1 = std::min<int64_t>(int64_t(x) + get_width(), clip.x1);
+			int64_t y0 = std::max<int64_t>(y, 0), y1 = std::min<int64_t>(int64_t(y) + get_height(), clip.y1);
+			if (x0 >= x1 || y0 >= y1) return;
+			frame.MarkDirty(Position(uint32_t(x0), uint32_t(y0)), uint32_t(x1 - x0), uint32_t(y1 - y0));
+			Draw(frame.data(), frame.pitch(), clip, x, y);
+		}
+
+	}; // class Sprite
+
+	class TileMap {
+	public:
+
+		static constexpr uint16_t EMPTY = 0xffff; // cell without a tile
+
+	private:
+
+		uint32_t tile_width, tile_height; // in pixels
+		Tmat2D<uint16_t> cells; // tile index of each cell
+		std::vector<Sprite> tiles;
+
+	public:
+
+		/**
+		 * @param _tile_width, _tile_height size of the tiles, in pixels
+		 * @param cols, rows number of cells, all of them empty
+		 */
+		TileMap(uint32_t _tile_width, uint32_t _tile_height, uint32_t cols, uint32_t rows)
+			: tile_width(_tile_width), tile_height(_tile_height), cells(rows, cols)
+		{
+			if (tile_width == 0 || tile_height == 0) throw std::invalid_argument("empty tiles");
+			fill(EMPTY);
+		}
+
+		uint32_t get_cols(void) const { return cells.get_cols(); }
+		uint32_t get_rows(void) const { return cells.get_rows(); }
+		uint32_t get_tile_width(void) const { return tile_width; }
+		uint32_t get_tile_height(void) const { return tile_height; }
+		// in pixels, that may not fit in 32 bits
+		uint64_t get_width(void) const { return uint64_t(get_cols()) * tile_width; }
+		uint64_t get_height(void) const { return uint64_t(get_rows()) * tile_height; }
+
+		/**
+		 * @param tile sprite of the size of the tiles
+		 * @return index of the tile, for set
+		 */
+		uint16_t add_tile(Sprite tile) {
+			if (tile.get_width() != tile_width || tile.get_height() != tile_height) throw std::invalid_argument("tile of the wrong size");
+			if (tiles.size() >= EMPTY) throw std::length_error("too many tiles");
+			tiles.push_back(std::move(tile));
+			return static_cast<uint16_t>(tiles.size() - 1);
+		}
+
+		Sprite const& get_tile(uint16_t index) const {
+			if (index >= tiles.size()) throw std::out_of_range("index out of range");
+			return tiles[index];
+		}
+
+		uint16_t get(uint32_t col, uint32_t row) const {
+			if (col >= get_cols() || row >= get_rows()) throw std::out_of_range("index out of range");
+			return cells.get_pointer()[row * cells.get_pitch() + col];
+		}
+
+		/**
+		 * @param tile index returned by add_tile, or EMPTY
+		 */
+		void set(uint32_t col, uint32_t row, uint16_t tile) {
+			if (col >= get_cols() || row >= get_rows()) throw std::out_of_range("index out of range");
+			if (tile != EMPTY && tile >= tiles.size()) throw std::out_of_range("no such tile");
+			cells.get_pointer()[row * cells.get_pitch() + col] = tile;
+		}
+
+		void fill(uint16_t tile) {
+			if (tile != EMPTY && tile >= tiles.size()) throw std::out_of_range("no such tile");
+			for (uint32_t r = 0; r < get_rows(); ++r) {
+				uint16_t *row = cells.get_pointer() + r * cells.get_pitch();
+				std::fill(row, row + get_cols(), tile);
+			}
+		}
+
+		/**
+		 * draw the map with its top-left pixel at (x, y), clipped to clip,
+		 * into the image of pixel (0, 0) pixels and of pitch pitch
+		 * @param pool thread pool drawing the rows of cells, NULL to stay on this thread
+		 */
+		void Draw(uint32_t *pixels, size_t pitch, raster::Clip const& clip, int32_t x, int32_t y, ThreadPool *pool = NULL) const {
+			// clip, in pixels of the map
+			int64_t const px0 = std::max<int64_t>(int64_t(clip.x0) - x, 0), px1 = std::min<int64_t>(int64_t(clip.x1) - x, get_width());
+			int64_t const py0 = std::max<int64_t>(int64_t(clip.y0) - y, 0), py1 = std::min<int64_t>(int64_t(clip.y1) - y, get_height());
+			if (px0 >= px1 || py0 >= py1) return;
+			uint32_t const c0 = uint32_t(px0 / tile_width), c1 = uint32_t((px1 - 1) / tile_width) + 1;
+			uint32_t const r0 = uint32_t(py0 / tile_height), r1 = uint32_t((py1 - 1) / tile_height) + 1;
+			auto band = [&](uint32_t index) {
+				uint32_t const r = r0 + index;
+				int64_t const top = int64_t(r) * tile_height;
+				uint32_t const ty0 = uint32_t(std::max(py0, top) - top), ty1 = uint32_t(std::min(py1, top + tile_height) - top);
+				uint16_t const *cell = cells.get_pointer() + r * cells.get_pitch();
+				for (uint32_t ty = ty0; ty < ty1; ++ty) {
+					// the row of the frame, from the first column of the clip
+					uint32_t *row = pixels + static_cast<size_t>(y + top + ty) * pitch + (x + px0);
+					for (uint32_t c = c0; c < c1; ++c) {
+						if (cell[c] == EMPTY) continue;
+						int64_t const left = int64_t(c) * tile_width;
+						uint32_t const tx0 = uint32_t(std::max(px0, left) - left), tx1 = uint32_t(std::min(px1, left + tile_width) - left);
+						tiles[cell[c]].DrawRow(row + (left + tx0 - px0), ty, tx0, tx1);
+					}
+				}
+			};
+			if (pool != NULL) {
+				pool->ParallelFor(r1 - r0, band);
+			} else {
+				for (uint32_t index = 0; index < r1 - r0; ++index) band(index);
+			}
+		}
+
+		/**
+		 * draw the map with its top-left pixel at (x, y), clipped to the
+		 * frame, and mark its area dirty
+		 */
+		void Draw(FrameBuffer const& frame, int32_t x, int32_t y, ThreadPool *pool = NULL) const {
+			raster::Clip clip = { 0, 0, static_cast<int32_t>(frame.width()), static_cast<int32_t>(frame.height()) };
+			int64_t x0 = std::max<int64_t>(x, 0), x1 = std::min<int64_t>(int64_t(x) + get_width(), clip.x1);
+			int64_t y0 = std::max<int64_t>(y, 0), y1 = std::min<int64_t>(int64_t(y) + get_height(), clip.y1);
+			if (x0 >= x1 || y0 >= y1) return;
+			frame.MarkDirty(Position(uint32_t(x0), uint32_t(y0)), uint32_t(x1 - x0), uint32_t(y1 - y0));
+			Draw(frame.data(), frame.pitch(), clip, x, y, pool);
+		}
+
+	}; // class TileMap
+
+} // namespace rico
@@ -0,0 +1,477 @@
+/** rico/vec2d.hpp
+ *
+ * Tvec2D is a 2-component vector, its operations are constexpr and build
+ * results directly (no copy then compound assignment), so that they fold
+ * at compile time and inline into loops.
+ *
+ * Tvec2DArray stores many vectors as a structure of arrays (the x of all
+ * vectors, then the y of all vectors), the layout of SIMD registers: its
+ * batched operations (sum, scaling, dot product, length, normalization)
+ * process 8 (float) or 4 (double) vectors at a time with AVX on x86, 4 or
+ * 2 with NEON on ARM, selected at runtime like the raster kernels, and
+ * fall back to scalar loops for other types. The kernels use no fused
+ * multiply-add: they round exactly like the scalar loops, so results do
+ * not depend on the CPU. Arrays are reused: assigning an array of the same
+ * size (or smaller) does not allocate.
+ *
+ * Bodies of nbody.hpp store their positions, speeds and forces in
+ * Tvec2DArray, and Gravity integrates them with the batched operations.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RICO_VEC2D_X86 1
+#define RICO_VEC2D_TARGET __attribute__((target("avx")))
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define RICO_VEC2D_NEON 1
+#define RICO_VEC2D_TARGET
+#include <arm_neon.h>
+#endif
+
+namespace rico {
+
+	/**
+	 * template for 2-component vector
+	 */
+	template<typename T>
+	struct Tvec2D {
+		T x, y;
+		constexpr Tvec2D(T _x, T _y) noexcept : x(_x), y(_y) {}
+		constexpr Tvec2D(void) noexcept : Tvec2D(static_cast<T>(0), static_cast<T>(0)) {}
+		constexpr Tvec2D(Tvec2D const&) noexcept = default;
+		constexpr Tvec2D& operator=(Tvec2D const&) noexcept = default;
+		constexpr Tvec2D& operator+=(Tvec2D const& rhs) noexcept { this->x += rhs.x; this->y += rhs.y; return *this; }
+		constexpr Tvec2D& operator-=(Tvec2D const& rhs) noexcept { this->x -= rhs.x; this->y -= rhs.y; return *this; }
+		constexpr Tvec2D& operator*=(T      const& rhs) noexcept { this->x *= rhs  ; this->y *= rhs  ; return *this; }
+		constexpr Tvec2D& operator/=(T      const& rhs) noexcept { this->x /= rhs  ; this->y /= rhs  ; return *this; }
+		constexpr Tvec2D  operator+ (Tvec2D const& rhs) const noexcept { return Tvec2D(x + rhs.x, y + rhs.y); }
+		constexpr Tvec2D  operator- (Tvec2D const& rhs) const noexcept { return Tvec2D(x - rhs.x, y - rhs.y); }
+		constexpr Tvec2D  operator* (T      const& rhs) const noexcept { return Tvec2D(x * rhs  , y * rhs  ); }
+		constexpr Tvec2D  operator/ (T      const& rhs) const noexcept { return Tvec2D(x / rhs  , y / rhs  ); }
+		constexpr Tvec2D  operator- (void) const noexcept { return Tvec2D(-x, -y); }
+		constexpr bool operator==(Tvec2D const& rhs) const noexcept { return this->x == rhs.x && this->y == rhs.y; }
+		constexpr bool operator!=(Tvec2D const& rhs) const noexcept { return !(*this == rhs); }
+		template<typename U>
+		constexpr operator Tvec2D<U>(void) const noexcept { return Tvec2D<U>(U(x), U(y)); }
+
+		constexpr T dot(Tvec2D const& rhs) const noexcept { return x * rhs.x + y * rhs.y; }
+		// z component of the 3D cross product
+		constexpr T cross(Tvec2D const& rhs) const noexcept { return x * rhs.y - y * rhs.x; }
+		constexpr T length_squared(void) const noexcept { return dot(*this); }
+		T length(void) const noexcept { return static_cast<T>(std::sqrt(length_squared())); }
+		/**
+		 * @return vector of length 1 in the same direction, null if the vector is null
+		 */
+		Tvec2D normalized(void) const noexcept {
+			T l = length();
+			return l > 0 ? *this * (1 / l) : *this;
+		}
+	}; // struct Tvec2D
+
+	// to allow syntax 'T * Tvec2D<T>'
+	template<typename T>
+	constexpr Tvec2D<T> operator*(T const& rhs, Tvec2D<T> const& lhs) noexcept { return lhs * rhs; }
+
+	namespace vec2d {
+
+		/**
+		 * batched kernels of a given type, over n elements
+		 * one component at a time: axpy (y += a * x), scale (x *= a),
+		 * multiply (x *= f), divide (x /= d)
+		 * on vectors: dot (out = ax * bx + ay * by), length (out = |v|),
+		 * normalize (v *= 1 / |v|, null vectors stay null)
+		 */
+		template<typename T>
+		struct Kernels {
+			char const *name;
+			void (*axpy)(T a, T const *x, T *y, uint32_t n);
+			void (*scale)(T a, T *x, uint32_t n);
+			void (*multiply)(T const *f, T *x, uint32_t n);
+			void (*divide)(T const *d, T *x, uint32_t n);
+			void (*dot)(T const *ax, T const *ay, T const *bx, T const *by, T *out, uint32_t n);
+			void (*length)(T const *x, T const *y, T *out, uint32_t n);
+			void (*normalize)(T *x, T *y, uint32_t n);
+		}; // struct Kernels
+
+		namespace detail {
+
+			template<typename T>
+			inline void axpy_scalar(T a, T const *x, T *y, uint32_t n) {
+				for (uint32_t i = 0; i < n; ++i) y[i] += a * x[i];
+			}
+
+			template<typename T>
+			inline void scale_scalar(T a, T *x, uint32_t n) {
+				for (uint32_t i = 0; i < n; ++i) x[i] *= a;
+			}
+
+			template<typename T>
+			inline void multiply_scalar(T const *f, T *x, uint32_t n) {
+				for (uint32_t i = 0; i < n; ++i) x[i] *= f[i];
+			}
+
+			template<typename T>
+			inline void divide_scalar(T const *d, T *x, uint32_t n) {
+				for (uint32_t i = 0; i < n; ++i) x[i] /= d[i];
+			}
+
+			template<typename T>
+			inline void dot_scalar(T const *ax, T const *ay, T const *bx, T const *by, T *out, uint32_t n) {
+				for (uint32_t i = 0; i < n; ++i) out[i] = ax[i] * bx[i] + ay[i] * by[i];
+			}
+
+			template<typename T>
+			inline void length_scalar(T const *x, T const *y, T *out, uint32_t n) {
+				for (uint32_t i = 0; i < n; ++i) out[i] = static_cast<T>(std::sqrt(x[i] * x[i] + y[i] * y[i]));
+			}
+
+			template<typename T>
+			inline void normalize_scalar(T *x, T *y, uint32_t n) {
+				for (uint32_t i = 0; i < n; ++i) {
+					T l = static_cast<T>(std::sqrt(x[i] * x[i] + y[i] * y[i]));
+					if (l > 0) {
+						T r = 1 / l;
+						x[i] *= r;
+						y[i] *= r;
+					}
+				}
+			}
+
+#if defined(RICO_VEC2D_X86) || defined(RICO_VEC2D_NEON)
+
+			// registers and operations of the SIMD extension, for float and double
+			template<typename T>
+			struct simd;
+
+#ifdef RICO_VEC2D_X86
+
+			template<>
+			struct simd<float> {
+				using V = __m256;
+				static constexpr uint32_t LANES = 8;
+				RICO_VEC2D_TARGET static V load(float const *p) { return _mm256_loadu_ps(p); }
+				RICO_VEC2D_TARGET static void store(float *p, V v) { _mm256_storeu_ps(p, v); }
+				RICO_VEC2D_TARGET static V set1(float a) { return _mm256_set1_ps(a); }
+				RICO_VEC2D_TARGET static V add(V a, V b) { return _mm256_add_ps(a, b); }
+				RICO_VEC2D_TARGET static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+				RICO_VEC2D_TARGET static V div(V a, V b) { return _mm256_div_ps(a, b); }
+				RICO_VEC2D_TARGET static V sqrt(V a) { return _mm256_sqrt_ps(a); }
+				// a where l > 0, b elsewhere
+				RICO_VEC2D_TARGET static V positive(V l, V a, V b) {
+					return _mm256_blendv_ps(b, a, _mm256_cmp_ps(l, _mm256_setzero_ps(), _CMP_GT_OQ));
+				}
+			}; // struct simd<float>
+
+			template<>
+			struct simd<double> {
+				using V = __m256d;
+				static constexpr uint32_t LANES = 4;
+				RICO_VEC2D_TARGET static V load(double const *p) { return _mm256_loadu_pd(p); }
+				RICO_VEC2D_TARGET static void store(double *p, V v) { _mm256_storeu_pd(p, v); }
+				RICO_VEC2D_TARGET static V set1(double a) { return _mm256_set1_pd(a); }
+				RICO_VEC2D_TARGET static V add(V a, V b) { return _mm256_add_pd(a, b); }
+				RICO_VEC2D_TARGET static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+				RICO_VEC2D_TARGET static V div(V a, V b) { return _mm256_div_pd(a, b); }
+				RICO_VEC2D_TARGET static V sqrt(V a) { return _mm256_sqrt_pd(a); }
+				RICO_VEC2D_TARGET static V positive(V l, V a, V b) {
+					return _mm256_blendv_pd(b, a, _mm256_cmp_pd(l, _mm256_setzero_pd(), _CMP_GT_OQ));
+				}
+			}; // struct simd<double>
+
+#else // RICO_VEC2D_NEON
+
+			template<>
+			struct simd<float> {
+				using V = float32x4_t;
+				static constexpr uint32_t LANES = 4;
+				static V load(float const *p) { return vld1q_f32(p); }
+				static void store(float *p, V v) { vst1q_f32(p, v); }
+				static V set1(float a) { return vdupq_n_f32(a); }
+				static V add(V a, V b) { return vaddq_f32(a, b); }
+				static V mul(V a, V b) { return vmulq_f32(a, b); }
+				static V div(V a, V b) { return vdivq_f32(a, b); }
+				static V sqrt(V a) { return vsqrtq_f32(a); }
+				static V positive(V l, V a, V b) { return vbslq_f32(vcgtq_f32(l, vdupq_n_f32(0)), a, b); }
+			}; // struct simd<float>
+
+			template<>
+			struct simd<double> {
+				using V = float64x2_t;
+				static constexpr uint32_t LANES = 2;
+				static V load(double const *p) { return vld1q_f64(p); }
+				static void store(double *p, V v) { vst1q_f64(p, v); }
+				static V set1(double a) { return vdupq_n_f64(a); }
+				static V add(V a, V b) { return vaddq_f64(a, b); }
+				static V mul(V a, V b) { return vmulq_f64(a, b); }
+				static V div(V a, V b) { return vdivq_f64(a, b); }
+				static V sqrt(V a) { return vsqrtq_f64(a); }
+				static V positive(V l, V a, V b) { return vbslq_f64(vcgtq_f64(l, vdupq_n_f64(0)), a, b); }
+			}; // struct simd<double>
+
+#endif
+
+			// each kernel processes whole registers, then the rest with the scalar loop
+
+			template<typename T>
+			RICO_VEC2D_TARGET inline void axpy_simd(T a, T const *x, T *y, uint32_t n) {
+				using S = simd<T>;
+				typename S::V va = S::set1(a);
+				uint32_t const wide = n - n % S::LANES;
+				for (uint32_t i = 0; i < wide; i += S::LANES) S::store(y + i, S::add(S::load(y + i), S::mul(va, S::load(x + i))));
+				axpy_scalar(a, x + wide, y + wide, n - wide);
+			}
+
+			template<typename T>
+			RICO_VEC2D_TARGET inline void scale_simd(T a, T *x, uint32_t n) {
+				using S = simd<T>;
+				typename S::V va = S::set1(a);
+				uint32_t const wide = n - n % S::LANES;
+				for (uint32_t i = 0; i < wide; i += S::LANES) S::store(x + i, S::mul(S::load(x + i), va));
+				scale_scalar(a, x + wide, n - wide);
+			}
+
+			template<typename T>
+			RICO_VEC2D_TARGET inline void multiply_simd(T const *f, T *x, uint32_t n) {
+				using S = simd<T>;
+				uint32_t const wide = n - n % S::LANES;
+				for (uint32_t i = 0; i < wide; i += S::LANES) S::store(x + i, S::mul(S::load(x + i), S::load(f + i)));
+				multiply_scalar(f + wide, x + wide, n - wide);
+			}
+
+			template<typename T>
+			RICO_VEC2D_TARGET inline void divide_simd(T const *d, T *x, uint32_t n) {
+				using S = simd<T>;
+				uint32_t const wide = n - n % S::LANES;
+				for (uint32_t i = 0; i < wide; i += S::LANES) S::store(x + i, S::div(S::load(x + i), S::load(d + i)));
+				divide_scalar(d + wide, x + wide, n - wide);
+			}
+
+			template<typename T>
+			RICO_VEC2D_TARGET inline void dot_simd(T const *ax, T const *ay, T const *bx, T const *by, T *out, uint32_t n) {
+				using S = simd<T>;
+				uint32_t const wide = n - n % S::LANES;
+				for (uint32_t i = 0; i < wide; i += S::LANES) {
+					S::store(out + i, S::add(S::mul(S::load(ax + i), S::load(bx + i)), S::mul(S::load(ay + i), S::load(by + i))));
+				}
+				dot_scalar(ax + wide, ay + wide, bx + wide, by + wide, out + wide, n - wide);
+			}
+
+			template<typename T>
+			RICO_VEC2D_TARGET inline void length_simd(T const *x, T const *y, T *out, uint32_t n) {
+				using S = simd<T>;
+				uint32_t const wide = n - n % S::LANES;
+				for (uint32_t i = 0; i < wide; i += S::LANES) {
+					typename S::V vx = S::load(x + i), vy = S::load(y + i);
+					S::store(out + i, S::sqrt(S::add(S::mul(vx, vx), S::mul(vy, vy))));
+				}
+				length_scalar(x + wide, y + wide, out + wide, n - wide);
+			}
+
+			template<typename T>
+			RICO_VEC2D_TARGET inline void normalize_simd(T *x, T *y, uint32_t n) {
+				using S = simd<T>;
+				uint32_t const wide = n - n % S::LANES;
+				for (uint32_t i = 0; i < wide; i += S::LANES) {
+					typename S::V vx = S::load(x + i), vy = S::load(y + i);
+					typename S::V l = S::sqrt(S::add(S::mul(vx, vx), S::mul(vy, vy)));
+					// one division for both components, 1 / 0 in the null lanes is discarded
+					typename S::V r = S::div(S::set1(T(1)), l);
+					S::store(x + i, S::positive(l, S::mul(vx, r), vx));
+					S::store(y + i, S::positive(l, S::mul(vy, r), vy));
+				}
+				normalize_scalar(x + wide, y + wide, n - wide);
+			}
+
+#endif // RICO_VEC2D_X86 || RICO_VEC2D_NEON
+
+			template<typename T>
+			inline Kernels<T> select(void) {
+				// SIMD kernels exist for float and double only
+				if constexpr (std::is_same<T, float>::value || std::is_same<T, double>::value) {
+#if defined(RICO_VEC2D_X86)
+					__builtin_cpu_init();
+					if (__builtin_cpu_supports("avx")) {
+						return Kernels<T> { "avx", axpy_simd<T>, scale_simd<T>, multiply_simd<T>, divide_simd<T>,
+							dot_simd<T>, length_simd<T>, normalize_simd<T> };
+					}
+#elif defined(RICO_VEC2D_NEON)
+					return Kernels<T> { "neon", axpy_simd<T>, scale_simd<T>, multiply_simd<T>, divide_simd<T>,
+						dot_simd<T>, length_simd<T>, normalize_simd<T> };
+#endif
+				}
+				return Kernels<T> { "scalar", axpy_scalar<T>, scale_scalar<T>, multiply_scalar<T>, divide_scalar<T>,
+					dot_scalar<T>, length_scalar<T>, normalize_scalar<T> };
+			}
+
+		} // namespace detail
+
+		/**
+		 * @return the kernels of type T selected for this CPU
+		 */
+		template<typename T>
+		inline Kernels<T> const& kernels(void) {
+			static Kernels<T> const selected = detail::select<T>();
+			return selected;
+		}
+
+		/**
+		 * @return name of the selected kernels ("avx", "neon", "scalar")
+		 */
+		template<typename T>
+		inline char const* backend(void) {
+			return kernels<T>().name;
+		}
+
+	} // namespace vec2d
+
+	/**
+	 * array of 2-component vectors, as a structure of arrays
+	 * batched operations require arrays of the same size (std::invalid_argument)
+	 */
+	template<typename T>
+	struct Tvec2DArray {
+
+		std::vector<T> x, y;
+
+		Tvec2DArray(void) = default;
+
+		explicit Tvec2DArray(uint32_t size, Tvec2D<T> value = Tvec2D<T>())
+			: x(size, value.x), y(size, value.y)
+		{}
+
+		uint32_t size(void) const {
+			return static_cast<uint32_t>(x.size());
+		}
+
+		bool empty(void) const {
+			return x.empty();
+		}
+
+		void resize(uint32_t size, Tvec2D<T> value = Tvec2D<T>()) {
+			x.resize(size, value.x);
+			y.resize(size, value.y);
+		}
+
+		void reserve(uint32_t size) {
+			x.reserve(size);
+			y.reserve(size);
+		}
+
+		void clear(void) {
+			x.clear();
+			y.clear();
+		}
+
+		void swap(Tvec2DArray& other) noexcept {
+			x.swap(other.x);
+			y.swap(other.y);
+		}
+
+		void push_back(Tvec2D<T> value) {
+			x.push_back(value.x);
+			y.push_back(value.y);
+		}
+
+		Tvec2D<T> get(uint32_t index) const {
+			return Tvec2D<T>(x[index], y[index]);
+		}
+
+		void set(uint32_t index, Tvec2D<T> value) {
+			x[index] = value.x;
+			y[index] = value.y;
+		}
+
+		void fill(Tvec2D<T> value) {
+			std::fill(x.begin(), x.end(), value.x);
+			std::fill(y.begin(), y.end(), value.y);
+		}
+
+		Tvec2DArray& operator+=(Tvec2DArray const& rhs) {
+			return add_scaled(rhs, static_cast<T>(1));
+		}
+
+		Tvec2DArray& operator-=(Tvec2DArray const& rhs) {
+			return add_scaled(rhs, static_cast<T>(-1));
+		}
+
+		Tvec2DArray& operator*=(T const& rhs) {
+			vec2d::kernels<T>().scale(rhs, x.data(), size());
+			vec2d::kernels<T>().scale(rhs, y.data(), size());
+			return *this;
+		}
+
+		/**
+		 * this += factor * other
+		 */
+		Tvec2DArray& add_scaled(Tvec2DArray const& other, T factor) {
+			check(other.size());
+			vec2d::kernels<T>().axpy(factor, other.x.data(), x.data(), size());
+			vec2d::kernels<T>().axpy(factor, other.y.data(), y.data(), size());
+			return *this;
+		}
+
+		/**
+		 * multiply each vector by its own factor
+		 */
+		Tvec2DArray& multiply(std::vector<T> const& factors) {
+			check(static_cast<uint32_t>(factors.size()));
+			vec2d::kernels<T>().multiply(factors.data(), x.data(), size());
+			vec2d::kernels<T>().multiply(factors.data(), y.data(), size());
+			return *this;
+		}
+
+		/**
+		 * divide each vector by its own divisor
+		 */
+		Tvec2DArray& divide(std::vector<T> const& divisors) {
+			check(static_cast<uint32_t>(divisors.size()));
+			vec2d::kernels<T>().divide(divisors.data(), x.data(), size());
+			vec2d::kernels<T>().divide(divisors.data(), y.data(), size());
+			return *this;
+		}
+
+		/**
+		 * @param output resized, dot product of each pair of vectors
+		 */
+		void dot(Tvec2DArray const& other, std::vector<T>& output) const {
+			check(other.size());
+			output.resize(size());
+			vec2d::kernels<T>().dot(x.data(), y.data(), other.x.data(), other.y.data(), output.data(), size());
+		}
+
+		/**
+		 * @param output resized, length of each vector
+		 */
+		void length(std::vector<T>& output) const {
+			output.resize(size());
+			vec2d::kernels<T>().length(x.data(), y.data(), output.data(), size());
+		}
+
+		/**
+		 * scale each vector to a length of 1, null vectors stay null
+		 */
+		Tvec2DArray& normalize(void) {
+			vec2d::kernels<T>().normalize(x.data(), y.data(), size());
+			return *this;
+		}
+
+	private:
+
+		void check(uint32_t other) const {
+			if (other != size()) throw std::invalid_argument("arrays of different sizes");
+		}
+
+	}; // struct Tvec2DArray
+
+} // namespace rico